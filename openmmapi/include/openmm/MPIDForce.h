@@ -67,7 +67,33 @@ public:
          * Periodic boundary conditions are used, and Particle-Mesh Ewald (PME) summation is used to compute the interaction of each particle
          * with all periodic copies of every other particle.
          */
-        PME = 1
+        PME = 1,
+
+        /**
+         * Periodic boundary conditions are used, and the reciprocal space part of the Ewald sum is evaluated
+         * explicitly as a sum over reciprocal lattice vectors instead of on a grid.  The cost grows as N times
+         * the number of k-vectors, so this is intended for small unit cells and as a reference for checking PME.
+         */
+        Ewald = 2,
+
+        /**
+         * Periodic boundary conditions are used, and the PME grid is convolved by multilevel summation (MSM) instead
+         * of with FFTs: charges are restricted to a hierarchy of coarser grids, each level applies a local stencil,
+         * and the potentials are interpolated back.  The work is linear in the number of grid points and needs no
+         * global transforms.  Grid dimensions are rounded up to the form t*2^k with t between 4 and 7, so that each
+         * can be halved down to a top level of a few points, and the B-spline order must be even; an automatic
+         * order of 5 is raised to 6.
+         */
+        MSM = 3,
+
+        /**
+         * No cutoff is applied and periodic boundary conditions are not used, but instead of computing all N^2
+         * interactions, those between distant groups of particles are computed with the fast multipole method (FMM)
+         * on an octree.  Pairs of particles in neighboring leaves of the tree are computed exactly; the leaves are
+         * made wide enough that every covalently scaled pair is among them, and so is every pair whose Thole damping
+         * matters at the accuracy of the expansions.  The accuracy is set by the expansion order; see setFMMParameters().
+         */
+        FMM = 4
     };
 
     enum PolarizationType {
@@ -90,8 +116,49 @@ public:
          * to set the coefficients used for the extrapolation.  The default coefficients used in this release are
          * [-0.154, 0.017, 0.658, 0.474], but be aware that those may change in a future release.
          */
-        Extrapolated = 2
+        Extrapolated = 2,
+
+        /**
+         * Truncated conjugate gradient with one iteration.  Starting from the direct dipoles, a single
+         * conjugate gradient step preconditioned by the polarizabilities is taken.  The cost is a fixed
+         * number of field evaluations, and the forces are the exact derivatives of the resulting energy.
+         */
+        TCG1 = 3,
+
+        /**
+         * Truncated conjugate gradient with two iterations.  This is more accurate than TCG1 for strongly
+         * coupled systems, at the cost of two more field evaluations.
+         */
+        TCG2 = 4
+
+    };
+
+    enum MutualInducedSolver {
+
+        /**
+         * Direct inversion in the iterative subspace.  This is the default, and the only solver supported
+         * by every platform.
+         */
+        DIIS = 0,
 
+        /**
+         * Preconditioned conjugate gradient, using the polarizability of each site as preconditioner.  It needs
+         * memory for only a few vectors of dipoles instead of a history of previous iterations.
+         */
+        ConjugateGradient = 1
+    };
+
+    enum VolumeFileFormat {
+
+        /**
+         * Gaussian cube file, in atomic units.
+         */
+        Cube = 0,
+
+        /**
+         * The values as doubles in native byte order with no header, in the units of OpenMM.
+         */
+        RawBinary = 1
     };
 
     enum MultipoleAxisTypes { ZThenX = 0, Bisector = 1, ZBisect = 2, ThreeFold = 3, ZOnly = 4, NoAxisType = 5, LastAxisTypeIndex = 6 };
@@ -132,6 +199,18 @@ public:
      */
     void setPolarizationType(PolarizationType type);
 
+    /**
+     * Get the solver used to converge the mutual induced dipoles.  It only matters when the
+     * polarization type is Mutual.
+     */
+    MutualInducedSolver getMutualInducedSolver() const;
+
+    /**
+     * Set the solver used to converge the mutual induced dipoles.  It only matters when the
+     * polarization type is Mutual.
+     */
+    void setMutualInducedSolver(MutualInducedSolver solver);
+
     /**
      * Get the cutoff distance (in nm) being used for nonbonded interactions.  If the NonbondedMethod in use
      * is NoCutoff, this value will have no effect.
@@ -161,7 +240,8 @@ public:
 
     /**
      * Set the parameters to use for PME calculations.  If alpha is 0 (the default), these parameters are
-     * ignored and instead their values are chosen based on the Ewald error tolerance.
+     * ignored and instead their values are chosen based on the Ewald error tolerance.  When the nonbonded
+     * method is Ewald, nx, ny and nz are the largest reciprocal lattice indices summed along each axis.
      *
      * @param alpha   the separation parameter
      * @param nx      the number of grid points along the X axis
@@ -189,12 +269,79 @@ public:
     void setAEwald(double aewald);
 
     /**
-     * Get the B-spline order to use for PME charge spreading
+     * Get the B-spline order to use for PME multipole spreading.  If this is 0 (the default), the order is
+     * chosen from the highest multipole rank present in the System; getPMEParametersInContext() reports
+     * the order chosen.
      *
      * @return the B-spline order
      */
     int getPmeBSplineOrder() const;
 
+    /**
+     * Set the B-spline order to use for PME multipole spreading.  Allowed values are 4, 5 and 6, or 0 (the
+     * default) to choose automatically: 4 for point charges, 5 if there are dipoles or polarizabilities,
+     * and 6 if there are quadrupoles or octopoles.  Forces on a multipole of rank l are only continuous
+     * for orders of at least l+3, so creating a Context with an explicit order below that throws an
+     * exception: quadrupoles need 5 or more and octopoles 6.  Versions before the automatic choice always
+     * used 6; set 6 explicitly to reproduce their energies for systems of charges and dipoles.
+     *
+     * @param order   the B-spline order, or 0 to choose automatically
+     */
+    void setPmeBSplineOrder(int order);
+
+    /**
+     * Get whether PME uses the influence function that minimizes the interpolation error in place of the
+     * smooth PME one.
+     *
+     * @return true if the optimal influence function is used
+     */
+    bool getPmeOptimalInfluenceFunction() const;
+
+    /**
+     * Set whether PME uses the influence function that minimizes the interpolation error (Hockney and
+     * Eastwood) in place of the smooth PME one.  It mostly pays off together with interlaced grids, where
+     * it allows a coarser grid for the same Ewald error tolerance.  The default is false.
+     *
+     * @param use   whether to use the optimal influence function
+     */
+    void setPmeOptimalInfluenceFunction(bool use);
+
+    /**
+     * Get whether PME averages the reciprocal space potential over two interlaced grids.
+     *
+     * @return true if interlaced grids are used
+     */
+    bool getPmeInterlacedGrids() const;
+
+    /**
+     * Set whether PME averages the reciprocal space potential over two grids, the second shifted by half
+     * a grid spacing along every axis.  This cancels most of the aliasing error, so the grid chosen from
+     * the Ewald error tolerance gets coarser along each axis.  Every grid is spread and transformed twice,
+     * but has far fewer points.  The default is false.  This only affects the PME nonbonded method.
+     *
+     * @param use   whether to use interlaced grids
+     */
+    void setPmeInterlacedGrids(bool use);
+
+    /**
+     * Get whether PME treats the system as a slab that is only periodic along x and y.
+     *
+     * @return true if the slab correction is used
+     */
+    bool getPmeSlabCorrection() const;
+
+    /**
+     * Set whether PME treats the system as a slab that is only periodic along x and y, as for an interface
+     * with a vacuum gap along z.  The Yeh-Berkowitz correction then removes the interaction of the total
+     * dipole moment along z, including the induced dipoles, with its periodic images.  Along z the Ewald
+     * sum only covers about three times the height of the occupied region rather than the whole box, so
+     * the grid is correspondingly shorter.  The system must be neutral.  The default is false.  This only
+     * affects the PME nonbonded method.
+     *
+     * @param use   whether to use the slab correction
+     */
+    void setPmeSlabCorrection(bool use);
+
     /**
      * Get the PME grid dimensions.  If Ewald alpha is 0 (the default), this is ignored and grid dimensions
      * are chosen automatically based on the Ewald error tolerance.
@@ -227,6 +374,58 @@ public:
      */
     void getPMEParametersInContext(const Context& context, double& alpha, int& nx, int& ny, int& nz) const;
 
+    /**
+     * Get the parameters being used for PME in a particular Context, including the direct space cutoff
+     * and B-spline order.  When alpha is 0, the reference and CUDA platforms use the alpha and grid that
+     * meet the Ewald error tolerance at the requested cutoff.  The CPU platform times several cutoffs, each
+     * with the alpha and grid that meet the tolerance, during the first force evaluation and keeps the
+     * fastest; the values reported before that are the ones for the requested cutoff.  When
+     * the nonbonded method is Ewald, nx, ny and nz are the largest reciprocal lattice indices and order is 0.
+     *
+     * @param context        the Context for which to get the parameters
+     * @param[out] alpha     the separation parameter
+     * @param[out] nx        the number of grid points along the X axis
+     * @param[out] ny        the number of grid points along the Y axis
+     * @param[out] nz        the number of grid points along the Z axis
+     * @param[out] cutoff    the direct space cutoff
+     * @param[out] order     the B-spline order
+     */
+    void getPMEParametersInContext(const Context& context, double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const;
+
+    /**
+     * Get the parameters of the fast multipole method, used when the nonbonded method is FMM.
+     *
+     * @param[out] expansionOrder   the order of the Cartesian Taylor expansions
+     * @param[out] treeDepth        the number of times the bounding cube is halved along each axis, or 0 if
+     *                              it is chosen from the number of particles
+     */
+    void getFMMParameters(int& expansionOrder, int& treeDepth) const;
+
+    /**
+     * Set the parameters of the fast multipole method, used when the nonbonded method is FMM.  Higher orders
+     * are more accurate and cost more per pair of interacting boxes; the error in the far field falls by
+     * roughly a factor of two for every two orders.  The tree depth is reduced if needed to keep the leaves
+     * wider than the range of covalent scaling, and than the distance at which Thole damping changes an
+     * interaction by less than that error, 2^(-expansionOrder/2); with fewer than two levels everything is
+     * computed exactly.  Use getFMMParametersInContext() to see the depth that was used.
+     *
+     * @param expansionOrder   the order of the Cartesian Taylor expansions, between 4 and 20 (default 12)
+     * @param treeDepth        the number of times the bounding cube is halved along each axis, between 1 and
+     *                         10, or 0 (the default) to choose it from the number of particles
+     */
+    void setFMMParameters(int expansionOrder, int treeDepth);
+
+    /**
+     * Get the parameters being used for the fast multipole method in a particular Context.
+     *
+     * @param context               the Context for which to get the parameters
+     * @param[out] expansionOrder   the order of the Cartesian Taylor expansions
+     * @param[out] treeDepth        the level of the leaves in the tree built by the last force evaluation,
+     *                              after any reduction for Thole damping and covalent scaling, or 0 before
+     *                              the first evaluation
+     */
+    void getFMMParametersInContext(const Context& context, int& expansionOrder, int& treeDepth) const;
+
 
     /**
      * Add multipole-related info for a particle
@@ -366,6 +565,9 @@ public:
      * which is acceptable.  This value is used to select the grid dimensions and separation (alpha)
      * parameter so that the average error level will be less than the tolerance.  There is not a
      * rigorous guarantee that all forces on all atoms will be less than the tolerance, however.
+     * The error estimates account for the highest multipole rank present and the B-spline order.
+     * On the CPU platform the cutoff may also be varied around the requested value, keeping whichever
+     * setting is fastest; use getPMEParametersInContext() to see what was chosen.
      *
      * This can be overridden by explicitly setting an alpha parameter and grid dimensions to use.
      */
@@ -377,6 +579,19 @@ public:
      * @param[out] dipoles    the fixed dipole moment of particle i is stored into the i'th element
      */
     void getLabFramePermanentDipoles(Context& context, std::vector<Vec3>& dipoles);
+    /**
+     * Get the fixed multipole moments of all particles in the global reference frame.  These only depend on
+     * the positions of each particle's axis atoms, so the induced dipoles are not computed, and the cost is
+     * linear in the number of particles.
+     *
+     * @param context             the Context for which to get the fixed multipoles
+     * @param[out] dipoles        the fixed dipole moment of particle i is stored into the i'th element
+     * @param[out] quadrupoles    the fixed quadrupole moment of particle i is stored into elements 6*i to 6*i+5,
+     *                            in the same order as for setMultipoleParameters() (XX XY YY XZ YZ ZZ)
+     * @param[out] octopoles      the fixed octopole moment of particle i is stored into elements 10*i to 10*i+9,
+     *                            in the same order as for setMultipoleParameters() (XXX XXY XYY YYY XXZ XYZ YYZ XZZ YZZ ZZZ)
+     */
+    void getLabFramePermanentMultipoles(Context& context, std::vector<Vec3>& dipoles, std::vector<double>& quadrupoles, std::vector<double>& octopoles);
     /**
      * Get the induced dipole moments of all particles.
      *
@@ -394,7 +609,9 @@ public:
     void getTotalDipoles(Context& context, std::vector<Vec3>& dipoles);
 
     /**
-     * Get the electrostatic potential.
+     * Get the electrostatic potential.  This includes the fixed multipoles up to octopoles and the
+     * induced dipoles.  With PME or Ewald it is the periodic Ewald potential, whose direct space part
+     * is cut off like the energy; the PME slab correction is not supported.
      *
      * @param inputGrid    input grid points over which the potential is to be evaluated
      * @param context      context
@@ -404,6 +621,83 @@ public:
     void getElectrostaticPotential(const std::vector< Vec3 >& inputGrid,
                                     Context& context, std::vector< double >& outputElectrostaticPotential);
 
+    /**
+     * Get the electrostatic potential, and optionally the electric field, on a regular lattice.  Point (i, j, k)
+     * is origin + i*axes[0] + j*axes[1] + k*axes[2], stored at index (i*numPoints[1]+j)*numPoints[2]+k.  The
+     * potential is the one from getElectrostaticPotential(), but the work that only depends on the particles,
+     * such as the reciprocal space grid of PME, is shared by all points.
+     *
+     * @param context         context
+     * @param origin          the first point of the lattice
+     * @param axes            the three step vectors of the lattice
+     * @param numPoints       the number of points along each step vector
+     * @param[out] potential  the potential at each point, in kJ/mol/e
+     * @param[out] field      the electric field at each point, in kJ/mol/nm/e, if includeField is true; otherwise empty
+     * @param includeField    whether to compute the electric field
+     */
+    void getElectrostaticPotentialVolume(Context& context, const Vec3& origin, const std::vector<Vec3>& axes, const std::vector<int>& numPoints,
+                                         std::vector<double>& potential, std::vector<Vec3>& field, bool includeField=false);
+
+    /**
+     * Write the electrostatic potential, and optionally the electric field, on a regular lattice to a file.  The
+     * lattice is as for getElectrostaticPotentialVolume(), but it is computed and written one plane of constant i
+     * at a time, so the whole volume is never held in memory.
+     *
+     * A Cube file is in atomic units (bohr, hartree/e and hartree/e/bohr).  It lists the particles with atomic
+     * number 0, since the System has no elements, and their charge.  With the field each point has four values,
+     * the potential followed by the field.  A RawBinary file holds the same values in the same order.
+     *
+     * @param context         context
+     * @param filename        the file to write
+     * @param format          the format of the file
+     * @param origin          the first point of the lattice
+     * @param axes            the three step vectors of the lattice
+     * @param numPoints       the number of points along each step vector
+     * @param includeField    whether to write the electric field
+     */
+    void writeElectrostaticPotentialVolume(Context& context, const std::string& filename, VolumeFileFormat format, const Vec3& origin,
+                                           const std::vector<Vec3>& axes, const std::vector<int>& numPoints, bool includeField=false);
+
+    /**
+     * Get the electric field at each particle due to the fixed multipoles and induced dipoles of the other
+     * particles, with the same covalent scaling and Thole damping as the field that polarizes it.  The fixed
+     * multipole part is kept from the last evaluation of the induced dipoles, so this only adds one pass for
+     * the field of the converged induced dipoles.
+     *
+     * @param context         the Context for which to get the fields
+     * @param[out] fields     the field at particle i, in kJ/mol/nm/e, is stored into the i'th element
+     */
+    void getElectricFields(Context& context, std::vector<Vec3>& fields);
+
+    /**
+     * Get the gradient of the electric field from getElectricFields() at each particle.
+     *
+     * @param context             the Context for which to get the field gradients
+     * @param[out] gradients      the field gradient at particle i, in kJ/mol/nm^2/e, is stored into elements 6*i
+     *                            to 6*i+5, in the same order as the quadrupoles (XX XY YY XZ YZ ZZ)
+     */
+    void getElectricFieldGradients(Context& context, std::vector<double>& gradients);
+
+    /**
+     * Get the electric field at a set of points: minus the gradient of the potential from
+     * getElectrostaticPotential().
+     *
+     * @param context         the Context for which to get the fields
+     * @param points          the points at which to compute the field
+     * @param[out] fields     the field at point i, in kJ/mol/nm/e, is stored into the i'th element
+     */
+    void getElectricFieldsAtPoints(Context& context, const std::vector<Vec3>& points, std::vector<Vec3>& fields);
+
+    /**
+     * Get the gradient of the electric field from getElectricFieldsAtPoints() at a set of points.
+     *
+     * @param context             the Context for which to get the field gradients
+     * @param points              the points at which to compute the field gradient
+     * @param[out] gradients      the field gradient at point i, in kJ/mol/nm^2/e, is stored into elements 6*i
+     *                            to 6*i+5, in the same order as the quadrupoles (XX XY YY XZ YZ ZZ)
+     */
+    void getElectricFieldGradientsAtPoints(Context& context, const std::vector<Vec3>& points, std::vector<double>& gradients);
+
     /**
      * Get the system multipole moments.
      *
@@ -440,7 +734,7 @@ public:
      * @returns true if nonbondedMethod uses PBC and false otherwise
      */
     bool usesPeriodicBoundaryConditions() const {
-        return nonbondedMethod == MPIDForce::PME;
+        return nonbondedMethod == MPIDForce::PME || nonbondedMethod == MPIDForce::Ewald || nonbondedMethod == MPIDForce::MSM;
     }
 
     /**
@@ -474,9 +768,12 @@ protected:
 private:
     NonbondedMethod nonbondedMethod;
     PolarizationType polarizationType;
+    MutualInducedSolver mutualInducedSolver;
     double cutoffDistance;
     double alpha, defaultThole, scaleFactor14;
     int pmeBSplineOrder, nx, ny, nz;
+    bool pmeOptimalInfluenceFunction, pmeInterlacedGrids, pmeSlabCorrection;
+    int fmmExpansionOrder, fmmTreeDepth;
     int mutualInducedMaxIterations;
     std::vector<double> extrapolationCoefficients;
 
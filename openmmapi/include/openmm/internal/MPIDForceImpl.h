@@ -35,6 +35,7 @@
 #include "openmm/internal/ForceImpl.h"
 #include "openmm/MPIDForce.h"
 #include "openmm/Kernel.h"
+#include "openmm/System.h"
 #include "openmm/Vec3.h"
 #include <utility>
 #include <string>
@@ -81,16 +82,106 @@ public:
      * @param covalentDegree      covalent degrees for the CovalentEnd lists
      */
     static void getCovalentDegree(const MPIDForce& force, std::vector<int>& covalentDegree);
+
+    /**
+     * Get the highest multipole rank present: 0 for charges, 1 for dipoles or polarizabilities,
+     * 2 for quadrupoles and 3 for octopoles.
+     *
+     * @param force                MPIDForce force reference
+     */
+    static int getMaxMultipoleRank(const MPIDForce& force);
+
+    /**
+     * Get the B-spline order to use for PME.  This is the order set on the force or, if that is 0,
+     * the order chosen from the highest multipole rank present (see MPIDForce::setPmeBSplineOrder()).
+     * An explicit order that is too low for the multipoles present is rejected with an exception,
+     * unless the force uses Ewald, which has no B-splines.
+     *
+     * @param force                MPIDForce force reference
+     */
+    static int getPmeBSplineOrder(const MPIDForce& force);
+
+    /**
+     * Throw an exception if a PME B-spline order is too low for multipoles of the given rank, i.e.
+     * below maxRank+3, for which the forces would be discontinuous or missing terms.
+     *
+     * @param order                the B-spline order
+     * @param maxRank              highest multipole rank present
+     */
+    static void checkPmeBSplineOrder(int order, int maxRank);
+
+    /**
+     * Estimate the relative error in the direct space forces of PME from truncating the screened
+     * interactions at the cutoff.
+     *
+     * @param maxRank              highest multipole rank present
+     * @param alpha                the Ewald separation parameter
+     * @param cutoff               the direct space cutoff
+     */
+    static double estimateDirectSpaceError(int maxRank, double alpha, double cutoff);
+
+    /**
+     * Estimate the relative error in the reciprocal space forces of PME from interpolating on the grid.
+     *
+     * @param maxRank              highest multipole rank present
+     * @param alpha                the Ewald separation parameter
+     * @param gridSpacing          the largest grid spacing along any axis
+     * @param order                the B-spline order
+     */
+    static double estimateReciprocalSpaceError(int maxRank, double alpha, double gridSpacing, int order);
+
+    /**
+     * Choose the PME parameters for a cutoff from the Ewald error tolerance of the force, taking the
+     * multipole ranks and B-spline order into account.  Alpha is the smallest value meeting the
+     * tolerance in direct space, and the grid the coarsest meeting it in reciprocal space.  Platforms
+     * may still round the grid dimensions up to sizes their FFT handles efficiently.
+     *
+     * @param system               the System the force belongs to
+     * @param force                MPIDForce force reference
+     * @param cutoff               the direct space cutoff
+     * @param[out] alpha           the Ewald separation parameter
+     * @param[out] nx              the number of grid points along the X axis
+     * @param[out] ny              the number of grid points along the Y axis
+     * @param[out] nz              the number of grid points along the Z axis
+     */
+    static void calcPMEParameters(const System& system, const MPIDForce& force, double cutoff, double& alpha, int& nx, int& ny, int& nz);
+
+    /**
+     * Choose the parameters for explicit Ewald summation from the Ewald error tolerance of the force.
+     * Alpha is chosen as for PME, and the largest reciprocal lattice index along each axis is the
+     * smallest one for which the neglected k-vectors meet the tolerance.
+     *
+     * @param system               the System the force belongs to
+     * @param force                MPIDForce force reference
+     * @param cutoff               the direct space cutoff
+     * @param[out] alpha           the Ewald separation parameter
+     * @param[out] kmaxx           the largest reciprocal lattice index along the X axis
+     * @param[out] kmaxy           the largest reciprocal lattice index along the Y axis
+     * @param[out] kmaxz           the largest reciprocal lattice index along the Z axis
+     */
+    static void calcEwaldParameters(const System& system, const MPIDForce& force, double cutoff, double& alpha, int& kmaxx, int& kmaxy, int& kmaxz);
     void getLabFramePermanentDipoles(ContextImpl& context, std::vector<Vec3>& dipoles);
+    void getLabFramePermanentMultipoles(ContextImpl& context, std::vector<Vec3>& dipoles,
+                                        std::vector<double>& quadrupoles, std::vector<double>& octopoles);
     void getInducedDipoles(ContextImpl& context, std::vector<Vec3>& dipoles);
     void getTotalDipoles(ContextImpl& context, std::vector<Vec3>& dipoles);
 
     void getElectrostaticPotential(ContextImpl& context, const std::vector< Vec3 >& inputGrid,
                                    std::vector< double >& outputElectrostaticPotential);
+    void getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const std::vector<Vec3>& axes, const std::vector<int>& numPoints,
+                                         std::vector<double>& potential, std::vector<Vec3>& field, bool includeField);
+    void writeElectrostaticPotentialVolume(ContextImpl& context, const std::string& filename, MPIDForce::VolumeFileFormat format, const Vec3& origin,
+                                           const std::vector<Vec3>& axes, const std::vector<int>& numPoints, bool includeField);
+    void getElectricFields(ContextImpl& context, std::vector<Vec3>& fields);
+    void getElectricFieldGradients(ContextImpl& context, std::vector<double>& gradients);
+    void getElectricFieldsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<Vec3>& fields);
+    void getElectricFieldGradientsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<double>& gradients);
 
     void getSystemMultipoleMoments(ContextImpl& context, std::vector< double >& outputMultipoleMoments);
     void updateParametersInContext(ContextImpl& context);
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    void getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const;
+    void getFMMParameters(int& expansionOrder, int& treeDepth) const;
 
 
 private:
@@ -37,6 +37,7 @@
 #include "openmm/System.h"
 #include "openmm/Platform.h"
 
+#include <functional>
 #include <set>
 #include <string>
 #include <vector>
@@ -77,12 +78,63 @@ public:
     virtual double execute(ContextImpl& context, bool includeForces, bool includeEnergy) = 0;
 
     virtual void getLabFramePermanentDipoles(ContextImpl& context, std::vector<Vec3>& dipoles) = 0;
+    virtual void getLabFramePermanentMultipoles(ContextImpl& context, std::vector<Vec3>& dipoles,
+                                                std::vector<double>& quadrupoles, std::vector<double>& octopoles) = 0;
     virtual void getInducedDipoles(ContextImpl& context, std::vector<Vec3>& dipoles) = 0;
     virtual void getTotalDipoles(ContextImpl& context, std::vector<Vec3>& dipoles) = 0;
 
     virtual void getElectrostaticPotential(ContextImpl& context, const std::vector< Vec3 >& inputGrid,
                                            std::vector< double >& outputElectrostaticPotential) = 0;
 
+    /**
+     * Compute the electrostatic potential, and optionally the field, on a regular lattice one plane of constant
+     * first index at a time; see MPIDForce::getElectrostaticPotentialVolume().
+     *
+     * @param context        the context in which to execute this kernel
+     * @param origin         the first point of the lattice
+     * @param axes           the three step vectors of the lattice
+     * @param numPoints      the number of points along each step vector
+     * @param includeField   whether to compute the field
+     * @param processPlane   called for each plane in order with its index, the potential at its points and, if
+     *                       includeField is set, the field at its points
+     */
+    virtual void getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                                 const std::function<void (int, const std::vector<double>&, const std::vector<Vec3>&)>& processPlane) = 0;
+
+    /**
+     * Get the electric field at each particle; see MPIDForce::getElectricFields().
+     *
+     * @param context    the context in which to execute this kernel
+     * @param fields     the field at particle i is stored into the i'th element
+     */
+    virtual void getElectricFields(ContextImpl& context, std::vector<Vec3>& fields) = 0;
+
+    /**
+     * Get the electric field gradient at each particle; see MPIDForce::getElectricFieldGradients().
+     *
+     * @param context    the context in which to execute this kernel
+     * @param gradients  the field gradient at particle i is stored into elements 6*i to 6*i+5 (XX XY YY XZ YZ ZZ)
+     */
+    virtual void getElectricFieldGradients(ContextImpl& context, std::vector<double>& gradients) = 0;
+
+    /**
+     * Get the electric field at a set of points; see MPIDForce::getElectricFieldsAtPoints().
+     *
+     * @param context    the context in which to execute this kernel
+     * @param points     the points at which to compute the field
+     * @param fields     the field at point i is stored into the i'th element
+     */
+    virtual void getElectricFieldsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<Vec3>& fields) = 0;
+
+    /**
+     * Get the electric field gradient at a set of points; see MPIDForce::getElectricFieldGradientsAtPoints().
+     *
+     * @param context    the context in which to execute this kernel
+     * @param points     the points at which to compute the field gradient
+     * @param gradients  the field gradient at point i is stored into elements 6*i to 6*i+5 (XX XY YY XZ YZ ZZ)
+     */
+    virtual void getElectricFieldGradientsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<double>& gradients) = 0;
+
     virtual void getSystemMultipoleMoments(ContextImpl& context, std::vector< double >& outputMultipoleMoments) = 0;
     /**
      * Copy changed parameters over to a context.
@@ -99,8 +151,18 @@ public:
      * @param nx      the number of grid points along the X axis
      * @param ny      the number of grid points along the Y axis
      * @param nz      the number of grid points along the Z axis
+     * @param cutoff  the direct space cutoff
+     * @param order   the B-spline order
+     */
+    virtual void getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const = 0;
+
+    /**
+     * Get the parameters being used for the fast multipole method.
+     *
+     * @param expansionOrder   the order of the Taylor expansions
+     * @param treeDepth        the level of the leaves in the tree built by the last force evaluation
      */
-    virtual void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const = 0;
+    virtual void getFMMParameters(int& expansionOrder, int& treeDepth) const = 0;
 };
 
 
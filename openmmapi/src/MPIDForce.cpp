@@ -40,9 +40,9 @@ using namespace OpenMM;
 using std::string;
 using std::vector;
 
-MPIDForce::MPIDForce() : nonbondedMethod(NoCutoff), polarizationType(Extrapolated), pmeBSplineOrder(6), cutoffDistance(1.0), ewaldErrorTol(5e-4), mutualInducedMaxIterations(60),
+MPIDForce::MPIDForce() : nonbondedMethod(NoCutoff), polarizationType(Extrapolated), mutualInducedSolver(DIIS), pmeBSplineOrder(0), cutoffDistance(1.0), ewaldErrorTol(5e-4), mutualInducedMaxIterations(60),
                                                mutualInducedTargetEpsilon(1.0e-5), scalingDistanceCutoff(100.0), electricConstant(138.9354558456), defaultThole(5.0),
-                                               alpha(0.0), nx(0), ny(0), nz(0), scaleFactor14(1.0) {
+                                               alpha(0.0), nx(0), ny(0), nz(0), pmeOptimalInfluenceFunction(false), pmeInterlacedGrids(false), pmeSlabCorrection(false), fmmExpansionOrder(12), fmmTreeDepth(0), scaleFactor14(1.0) {
     extrapolationCoefficients.push_back(-0.154);
     extrapolationCoefficients.push_back(0.017);
     extrapolationCoefficients.push_back(0.658);
@@ -54,7 +54,7 @@ MPIDForce::NonbondedMethod MPIDForce::getNonbondedMethod() const {
 }
 
 void MPIDForce::setNonbondedMethod(MPIDForce::NonbondedMethod method) {
-    if (method < 0 || method > 1)
+    if (method < 0 || method > 4)
         throw OpenMMException("MPIDForce: Illegal value for nonbonded method");
     nonbondedMethod = method;
 }
@@ -67,6 +67,16 @@ void MPIDForce::setPolarizationType(MPIDForce::PolarizationType type) {
     polarizationType = type;
 }
 
+MPIDForce::MutualInducedSolver MPIDForce::getMutualInducedSolver() const {
+    return mutualInducedSolver;
+}
+
+void MPIDForce::setMutualInducedSolver(MPIDForce::MutualInducedSolver solver) {
+    if (solver < 0 || solver > 1)
+        throw OpenMMException("MPIDForce: Illegal value for mutual induced solver");
+    mutualInducedSolver = solver;
+}
+
 void MPIDForce::setExtrapolationCoefficients(const std::vector<double> &coefficients) {
     extrapolationCoefficients = coefficients;
 }
@@ -109,6 +119,36 @@ int MPIDForce::getPmeBSplineOrder() const {
     return pmeBSplineOrder; 
 } 
  
+void MPIDForce::setPmeBSplineOrder(int order) {
+    if (order != 0 && (order < 4 || order > 6))
+        throw OpenMMException("MPIDForce: The PME B-spline order must be 4, 5, 6, or 0 to choose it automatically");
+    pmeBSplineOrder = order;
+}
+
+bool MPIDForce::getPmeOptimalInfluenceFunction() const {
+    return pmeOptimalInfluenceFunction;
+}
+
+void MPIDForce::setPmeOptimalInfluenceFunction(bool use) {
+    pmeOptimalInfluenceFunction = use;
+}
+
+bool MPIDForce::getPmeInterlacedGrids() const {
+    return pmeInterlacedGrids;
+}
+
+void MPIDForce::setPmeInterlacedGrids(bool use) {
+    pmeInterlacedGrids = use;
+}
+
+bool MPIDForce::getPmeSlabCorrection() const {
+    return pmeSlabCorrection;
+}
+
+void MPIDForce::setPmeSlabCorrection(bool use) {
+    pmeSlabCorrection = use;
+}
+ 
 void MPIDForce::getPmeGridDimensions(std::vector<int>& gridDimension) const { 
     if (gridDimension.size() < 3)
         gridDimension.resize(3);
@@ -127,6 +167,28 @@ void MPIDForce::getPMEParametersInContext(const Context& context, double& alpha,
     dynamic_cast<const MPIDForceImpl&>(getImplInContext(context)).getPMEParameters(alpha, nx, ny, nz);
 }
 
+void MPIDForce::getPMEParametersInContext(const Context& context, double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const {
+    dynamic_cast<const MPIDForceImpl&>(getImplInContext(context)).getPMEParameters(alpha, nx, ny, nz, cutoff, order);
+}
+
+void MPIDForce::getFMMParametersInContext(const Context& context, int& expansionOrder, int& treeDepth) const {
+    dynamic_cast<const MPIDForceImpl&>(getImplInContext(context)).getFMMParameters(expansionOrder, treeDepth);
+}
+
+void MPIDForce::getFMMParameters(int& expansionOrder, int& treeDepth) const {
+    expansionOrder = fmmExpansionOrder;
+    treeDepth = fmmTreeDepth;
+}
+
+void MPIDForce::setFMMParameters(int expansionOrder, int treeDepth) {
+    if (expansionOrder < 4 || expansionOrder > 20)
+        throw OpenMMException("MPIDForce: The FMM expansion order must be between 4 and 20");
+    if (treeDepth < 0 || treeDepth > 10)
+        throw OpenMMException("MPIDForce: The FMM tree depth must be between 1 and 10, or 0 to choose it automatically");
+    fmmExpansionOrder = expansionOrder;
+    fmmTreeDepth = treeDepth;
+}
+
 int MPIDForce::getMutualInducedMaxIterations() const {
     return mutualInducedMaxIterations;
 }
@@ -258,6 +320,10 @@ void MPIDForce::getLabFramePermanentDipoles(Context& context, vector<Vec3>& dipo
     dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getLabFramePermanentDipoles(getContextImpl(context), dipoles);
 }
 
+void MPIDForce::getLabFramePermanentMultipoles(Context& context, vector<Vec3>& dipoles, vector<double>& quadrupoles, vector<double>& octopoles) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getLabFramePermanentMultipoles(getContextImpl(context), dipoles, quadrupoles, octopoles);
+}
+
 void MPIDForce::getTotalDipoles(Context& context, vector<Vec3>& dipoles) {
     dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getTotalDipoles(getContextImpl(context), dipoles);
 }
@@ -266,6 +332,32 @@ void MPIDForce::getElectrostaticPotential(const std::vector< Vec3 >& inputGrid,
     dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getElectrostaticPotential(getContextImpl(context), inputGrid, outputElectrostaticPotential);
 }
 
+void MPIDForce::getElectrostaticPotentialVolume(Context& context, const Vec3& origin, const vector<Vec3>& axes, const vector<int>& numPoints,
+                                                vector<double>& potential, vector<Vec3>& field, bool includeField) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getElectrostaticPotentialVolume(getContextImpl(context), origin, axes, numPoints, potential, field, includeField);
+}
+
+void MPIDForce::writeElectrostaticPotentialVolume(Context& context, const std::string& filename, VolumeFileFormat format, const Vec3& origin,
+                                                  const vector<Vec3>& axes, const vector<int>& numPoints, bool includeField) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).writeElectrostaticPotentialVolume(getContextImpl(context), filename, format, origin, axes, numPoints, includeField);
+}
+
+void MPIDForce::getElectricFields(Context& context, vector<Vec3>& fields) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getElectricFields(getContextImpl(context), fields);
+}
+
+void MPIDForce::getElectricFieldGradients(Context& context, vector<double>& gradients) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getElectricFieldGradients(getContextImpl(context), gradients);
+}
+
+void MPIDForce::getElectricFieldsAtPoints(Context& context, const vector<Vec3>& points, vector<Vec3>& fields) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getElectricFieldsAtPoints(getContextImpl(context), points, fields);
+}
+
+void MPIDForce::getElectricFieldGradientsAtPoints(Context& context, const vector<Vec3>& points, vector<double>& gradients) {
+    dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getElectricFieldGradientsAtPoints(getContextImpl(context), points, gradients);
+}
+
 void MPIDForce::getSystemMultipoleMoments(Context& context, std::vector< double >& outputMultipoleMoments) {
     dynamic_cast<MPIDForceImpl&>(getImplInContext(context)).getSystemMultipoleMoments(getContextImpl(context), outputMultipoleMoments);
 }
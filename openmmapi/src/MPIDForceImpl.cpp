@@ -34,6 +34,7 @@
 #include "openmm/mpidKernels.h"
 #include <stdio.h>
 #include <math.h>
+#include <algorithm>
 
 using namespace OpenMM;
 
@@ -58,7 +59,7 @@ void MPIDForceImpl::initialize(ContextImpl& context) {
 
     // check cutoff < 0.5*boxSize
 
-    if (owner.getNonbondedMethod() == MPIDForce::PME) {
+    if (owner.usesPeriodicBoundaryConditions()) {
         Vec3 boxVectors[3];
         system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
         double cutoff = owner.getCutoffDistance();
@@ -148,6 +149,12 @@ void MPIDForceImpl::initialize(ContextImpl& context) {
             throw OpenMMException(buffer.str());
         }
     }
+
+    // An explicit PME B-spline order must be high enough for the multipoles present.
+
+    if (owner.getNonbondedMethod() == MPIDForce::PME || owner.getNonbondedMethod() == MPIDForce::MSM)
+        getPmeBSplineOrder(owner);
+
     kernel = context.getPlatform().createKernel(CalcMPIDForceKernel::Name(), context);
     kernel.getAs<CalcMPIDForceKernel>().initialize(context.getSystem(), owner);
 }
@@ -209,10 +216,167 @@ void MPIDForceImpl::getCovalentDegree(const MPIDForce& force, std::vector<int>&
     return;
 }
 
+int MPIDForceImpl::getMaxMultipoleRank(const MPIDForce& force) {
+
+    // Induced dipoles count as dipoles, so any polarizability raises the rank to at least 1.
+
+    int maxRank = 0;
+    for (int ii = 0; ii < force.getNumMultipoles() && maxRank < 3; ii++) {
+        int axisType, multipoleAtomZ, multipoleAtomX, multipoleAtomY;
+        double charge, thole;
+        std::vector<double> molecularDipole;
+        std::vector<double> molecularQuadrupole;
+        std::vector<double> molecularOctopole;
+        std::vector<double> alphas;
+        force.getMultipoleParameters(ii, charge, molecularDipole, molecularQuadrupole, molecularOctopole, axisType,
+                                     multipoleAtomZ, multipoleAtomX, multipoleAtomY, thole, alphas);
+        for (unsigned int jj = 0; jj < molecularOctopole.size(); jj++)
+            if (molecularOctopole[jj] != 0.0)
+                maxRank = 3;
+        for (unsigned int jj = 0; jj < molecularQuadrupole.size(); jj++)
+            if (molecularQuadrupole[jj] != 0.0 && maxRank < 2)
+                maxRank = 2;
+        for (unsigned int jj = 0; jj < molecularDipole.size(); jj++)
+            if (molecularDipole[jj] != 0.0 && maxRank < 1)
+                maxRank = 1;
+        for (unsigned int jj = 0; jj < alphas.size(); jj++)
+            if (alphas[jj] != 0.0 && maxRank < 1)
+                maxRank = 1;
+    }
+    return maxRank;
+}
+
+int MPIDForceImpl::getPmeBSplineOrder(const MPIDForce& force) {
+    int maxRank = getMaxMultipoleRank(force);
+    int order = force.getPmeBSplineOrder();
+    if (order == 0)
+        return std::min(6, 4+maxRank);
+
+    // Ewald sums the reciprocal space directly and never uses the order.
+
+    if (force.getNonbondedMethod() != MPIDForce::Ewald)
+        checkPmeBSplineOrder(order, maxRank);
+    return order;
+}
+
+void MPIDForceImpl::checkPmeBSplineOrder(int order, int maxRank) {
+
+    // The force and torque on a rank l multipole take l+1 derivatives of the B-splines.  For order p
+    // the (p-1)th derivative is piecewise constant and the pth is zero, so below l+3 the forces are
+    // either discontinuous or missing terms.
+
+    if (order >= maxRank+3)
+        return;
+    const char* rankNames[] = {"charges", "dipoles or polarizabilities", "quadrupoles", "octopoles"};
+    std::stringstream buffer;
+    buffer << "MPIDForce: a PME B-spline order of " << order << " is too low for the " << rankNames[maxRank];
+    buffer << " in the System; it must be at least " << maxRank+3;
+    throw OpenMMException(buffer.str());
+}
+
+double MPIDForceImpl::estimateDirectSpaceError(int maxRank, double alpha, double cutoff) {
+
+    // The force between two sites of rank l involves the screened interaction tensor B_n(r) with
+    // n = 2l+1.  Relative to the bare (2n-1)!!/r^(2n+1), the part left out at the cutoff obeys
+    // R_0 = erfc(x), R_n = R_(n-1) + 2^n x^(2n-1) exp(-x^2)/(sqrt(pi) (2n-1)!!), with x = alpha*cutoff.
+
+    double x = alpha*cutoff;
+    double gaussian = exp(-x*x)/sqrt(M_PI);
+    double error = erfc(x);
+    double power = 1.0/x;
+    double doubleFactorial = 1.0;
+    for (int n = 1; n <= 2*maxRank+1; n++) {
+        power *= 2.0*x*x;
+        doubleFactorial *= 2*n-1;
+        error += power*gaussian/doubleFactorial;
+    }
+    return error;
+}
+
+double MPIDForceImpl::estimateReciprocalSpaceError(int maxRank, double alpha, double gridSpacing, int order) {
+
+    // For point charges (2*alpha*h/3)^order is the usual estimate for the force error of smooth PME.
+    // The force on a rank l site differentiates the interpolated potential l more times, and each
+    // derivative of the B-spline costs one order of accuracy.
+
+    int exponent = std::max(1, order-maxRank);
+    return pow(2.0*alpha*gridSpacing/3.0, exponent);
+}
+
+void MPIDForceImpl::calcPMEParameters(const System& system, const MPIDForce& force, double cutoff, double& alpha, int& nx, int& ny, int& nz) {
+    int maxRank = getMaxMultipoleRank(force);
+    int order = getPmeBSplineOrder(force);
+    double tol = force.getEwaldErrorTolerance();
+
+    // The direct space error decreases monotonically with alpha; bisect for the smallest alpha that
+    // meets the tolerance, which keeps the grid as coarse as possible.
+
+    double low = 0.0, high = 1.0;
+    while (estimateDirectSpaceError(maxRank, high, cutoff) > tol)
+        high *= 2.0;
+    for (int iteration = 0; iteration < 60; iteration++) {
+        double middle = 0.5*(low+high);
+        if (estimateDirectSpaceError(maxRank, middle, cutoff) > tol)
+            low = middle;
+        else
+            high = middle;
+    }
+    alpha = high;
+
+    // The grid spacing along each axis follows by inverting the reciprocal space estimate.
+
+    Vec3 boxVectors[3];
+    system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+    int exponent = std::max(1, order-maxRank);
+    double maxSpacing = 1.5*pow(tol, 1.0/exponent)/alpha;
+
+    // Interlaced grids cancel the odd aliases, and with the optimal influence function the remaining
+    // ones as well.  The factors were measured against an Ewald sum for water with octopoles: they
+    // reach the force error of smooth PME with about 1.4 and 1.6 times the spacing.
+
+    if (force.getNonbondedMethod() == MPIDForce::PME && force.getPmeInterlacedGrids())
+        maxSpacing *= (force.getPmeOptimalInfluenceFunction() ? 1.6 : 1.4);
+    nx = std::max((int) ceil(boxVectors[0][0]/maxSpacing), order);
+    ny = std::max((int) ceil(boxVectors[1][1]/maxSpacing), order);
+    nz = std::max((int) ceil(boxVectors[2][2]/maxSpacing), order);
+}
+
+void MPIDForceImpl::calcEwaldParameters(const System& system, const MPIDForce& force, double cutoff, double& alpha, int& kmaxx, int& kmaxy, int& kmaxz) {
+    int maxRank = getMaxMultipoleRank(force);
+    double tol = force.getEwaldErrorTolerance();
+    int nx, ny, nz;
+    calcPMEParameters(system, force, cutoff, alpha, nx, ny, nz);
+
+    // The reciprocal space Gaussian exp(-pi^2 k^2/alpha^2) has the same form in x = pi*k/alpha as the
+    // direct space one in x = alpha*r, so the truncation error at |k| = kmax/L follows the same
+    // estimate.  Bisect for the smallest x that meets the tolerance.
+
+    double low = 0.0, high = 1.0;
+    while (estimateDirectSpaceError(maxRank, 1.0, high) > tol)
+        high *= 2.0;
+    for (int iteration = 0; iteration < 60; iteration++) {
+        double middle = 0.5*(low+high);
+        if (estimateDirectSpaceError(maxRank, 1.0, middle) > tol)
+            low = middle;
+        else
+            high = middle;
+    }
+    Vec3 boxVectors[3];
+    system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+    kmaxx = std::max((int) ceil(high*alpha*boxVectors[0][0]/M_PI), 1);
+    kmaxy = std::max((int) ceil(high*alpha*boxVectors[1][1]/M_PI), 1);
+    kmaxz = std::max((int) ceil(high*alpha*boxVectors[2][2]/M_PI), 1);
+}
+
 void MPIDForceImpl::getLabFramePermanentDipoles(ContextImpl& context, vector<Vec3>& dipoles) {
     kernel.getAs<CalcMPIDForceKernel>().getLabFramePermanentDipoles(context, dipoles);
 }
 
+void MPIDForceImpl::getLabFramePermanentMultipoles(ContextImpl& context, vector<Vec3>& dipoles,
+                                                   vector<double>& quadrupoles, vector<double>& octopoles) {
+    kernel.getAs<CalcMPIDForceKernel>().getLabFramePermanentMultipoles(context, dipoles, quadrupoles, octopoles);
+}
+
 void MPIDForceImpl::getInducedDipoles(ContextImpl& context, vector<Vec3>& dipoles) {
     kernel.getAs<CalcMPIDForceKernel>().getInducedDipoles(context, dipoles);
 }
@@ -226,6 +390,112 @@ void MPIDForceImpl::getElectrostaticPotential(ContextImpl& context, const std::v
     kernel.getAs<CalcMPIDForceKernel>().getElectrostaticPotential(context, inputGrid, outputElectrostaticPotential);
 }
 
+static void checkVolume(const vector<Vec3>& axes, const vector<int>& numPoints) {
+    if (axes.size() != 3 || numPoints.size() != 3)
+        throw OpenMMException("MPIDForce: a volume needs three axes and three numbers of points");
+    for (int ii = 0; ii < 3; ii++)
+        if (numPoints[ii] < 1)
+            throw OpenMMException("MPIDForce: a volume needs at least one point along each axis");
+}
+
+void MPIDForceImpl::getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const vector<Vec3>& axes, const vector<int>& numPoints,
+                                                    vector<double>& potential, vector<Vec3>& field, bool includeField) {
+    checkVolume(axes, numPoints);
+    size_t planeSize = (size_t) numPoints[1]*numPoints[2];
+    potential.resize(numPoints[0]*planeSize);
+    field.resize(includeField ? potential.size() : 0);
+    kernel.getAs<CalcMPIDForceKernel>().getElectrostaticPotentialVolume(context, origin, &axes[0], &numPoints[0], includeField,
+            [&] (int plane, const vector<double>& planePotential, const vector<Vec3>& planeField) {
+        std::copy(planePotential.begin(), planePotential.end(), potential.begin()+plane*planeSize);
+        if (includeField)
+            std::copy(planeField.begin(), planeField.end(), field.begin()+plane*planeSize);
+    });
+}
+
+void MPIDForceImpl::writeElectrostaticPotentialVolume(ContextImpl& context, const std::string& filename, MPIDForce::VolumeFileFormat format,
+                                                      const Vec3& origin, const vector<Vec3>& axes, const vector<int>& numPoints, bool includeField) {
+    checkVolume(axes, numPoints);
+    if (format != MPIDForce::Cube && format != MPIDForce::RawBinary)
+        throw OpenMMException("MPIDForce: unknown volume file format");
+    FILE* file = fopen(filename.c_str(), format == MPIDForce::Cube ? "w" : "wb");
+    if (file == NULL)
+        throw OpenMMException("MPIDForce: cannot open "+filename+" for writing");
+
+    // cube files are in bohr and hartree
+
+    const double bohr = 0.052917721092;
+    const double hartree = 2625.499639;
+    double potentialScale = (format == MPIDForce::Cube ? 1.0/hartree : 1.0);
+    double fieldScale = (format == MPIDForce::Cube ? bohr/hartree : 1.0);
+    int numValues = (includeField ? 4 : 1);
+    if (format == MPIDForce::Cube) {
+        vector<Vec3> positions;
+        context.getPositions(positions);
+        fprintf(file, "MPIDForce electrostatic potential\n");
+        fprintf(file, "%s in atomic units\n", includeField ? "potential and field" : "potential");
+        fprintf(file, "%5d %12.6f %12.6f %12.6f", (int) positions.size(), origin[0]/bohr, origin[1]/bohr, origin[2]/bohr);
+        if (includeField)
+            fprintf(file, " %5d", numValues);
+        fprintf(file, "\n");
+        for (int ii = 0; ii < 3; ii++)
+            fprintf(file, "%5d %12.6f %12.6f %12.6f\n", numPoints[ii], axes[ii][0]/bohr, axes[ii][1]/bohr, axes[ii][2]/bohr);
+        for (int ii = 0; ii < (int) positions.size(); ii++) {
+            double charge, thole;
+            int axisType, atomZ, atomX, atomY;
+            vector<double> dipole, quadrupole, octopole, alphas;
+            owner.getMultipoleParameters(ii, charge, dipole, quadrupole, octopole, axisType, atomZ, atomX, atomY, thole, alphas);
+            fprintf(file, "%5d %12.6f %12.6f %12.6f %12.6f\n", 0, charge, positions[ii][0]/bohr, positions[ii][1]/bohr, positions[ii][2]/bohr);
+        }
+    }
+
+    // Each plane is written as soon as it is computed.  In a cube file every line of constant i and
+    // j starts on a new line, with six values per line.
+
+    vector<double> values(numValues*numPoints[2]);
+    try {
+        kernel.getAs<CalcMPIDForceKernel>().getElectrostaticPotentialVolume(context, origin, &axes[0], &numPoints[0], includeField,
+                [&] (int plane, const vector<double>& planePotential, const vector<Vec3>& planeField) {
+            for (int jj = 0; jj < numPoints[1]; jj++) {
+                for (int kk = 0; kk < numPoints[2]; kk++) {
+                    int point = jj*numPoints[2]+kk;
+                    values[numValues*kk] = planePotential[point]*potentialScale;
+                    if (includeField)
+                        for (int ii = 0; ii < 3; ii++)
+                            values[numValues*kk+1+ii] = planeField[point][ii]*fieldScale;
+                }
+                if (format == MPIDForce::RawBinary)
+                    fwrite(&values[0], sizeof(double), values.size(), file);
+                else {
+                    for (int ii = 0; ii < (int) values.size(); ii++)
+                        fprintf(file, (ii%6 == 5 || ii == (int) values.size()-1) ? " %12.5E\n" : " %12.5E", values[ii]);
+                }
+            }
+        });
+    }
+    catch (...) {
+        fclose(file);
+        throw;
+    }
+    if (fclose(file) != 0)
+        throw OpenMMException("MPIDForce: error writing "+filename);
+}
+
+void MPIDForceImpl::getElectricFields(ContextImpl& context, vector<Vec3>& fields) {
+    kernel.getAs<CalcMPIDForceKernel>().getElectricFields(context, fields);
+}
+
+void MPIDForceImpl::getElectricFieldGradients(ContextImpl& context, vector<double>& gradients) {
+    kernel.getAs<CalcMPIDForceKernel>().getElectricFieldGradients(context, gradients);
+}
+
+void MPIDForceImpl::getElectricFieldsAtPoints(ContextImpl& context, const vector<Vec3>& points, vector<Vec3>& fields) {
+    kernel.getAs<CalcMPIDForceKernel>().getElectricFieldsAtPoints(context, points, fields);
+}
+
+void MPIDForceImpl::getElectricFieldGradientsAtPoints(ContextImpl& context, const vector<Vec3>& points, vector<double>& gradients) {
+    kernel.getAs<CalcMPIDForceKernel>().getElectricFieldGradientsAtPoints(context, points, gradients);
+}
+
 void MPIDForceImpl::getSystemMultipoleMoments(ContextImpl& context, std::vector< double >& outputMultipoleMoments) {
     kernel.getAs<CalcMPIDForceKernel>().getSystemMultipoleMoments(context, outputMultipoleMoments);
 }
@@ -236,5 +506,15 @@ void MPIDForceImpl::updateParametersInContext(ContextImpl& context) {
 }
 
 void MPIDForceImpl::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
-    kernel.getAs<CalcMPIDForceKernel>().getPMEParameters(alpha, nx, ny, nz);
+    double cutoff;
+    int order;
+    kernel.getAs<CalcMPIDForceKernel>().getPMEParameters(alpha, nx, ny, nz, cutoff, order);
+}
+
+void MPIDForceImpl::getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const {
+    kernel.getAs<CalcMPIDForceKernel>().getPMEParameters(alpha, nx, ny, nz, cutoff, order);
+}
+
+void MPIDForceImpl::getFMMParameters(int& expansionOrder, int& treeDepth) const {
+    kernel.getAs<CalcMPIDForceKernel>().getFMMParameters(expansionOrder, treeDepth);
 }
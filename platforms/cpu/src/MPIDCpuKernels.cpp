@@ -0,0 +1,52 @@
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include "MPIDCpuKernels.h"
+#include "MPIDCpuPmeForce.h"
+#include "CpuPlatform.h"
+
+using namespace OpenMM;
+
+CpuCalcMPIDForceKernel::CpuCalcMPIDForceKernel(std::string name, const Platform& platform, const System& system) :
+         ReferenceCalcMPIDForceKernel(name, platform, system) {
+}
+
+MPIDReferenceForce* CpuCalcMPIDForceKernel::setupMPIDReferenceForce(ContextImpl& context)
+{
+    MPIDReferenceForce* mpidReferenceForce = ReferenceCalcMPIDForceKernel::setupMPIDReferenceForce(context);
+    mpidReferenceForce->setThreadPool(&CpuPlatform::getPlatformData(context).threads);
+    return mpidReferenceForce;
+}
+
+MPIDReferencePmeForce* CpuCalcMPIDForceKernel::createMPIDReferencePmeForce()
+{
+    return new MPIDCpuPmeForce();
+}
+
+bool CpuCalcMPIDForceKernel::tunesPmeCutoff() const
+{
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef MPID_OPENMM_CPU_KERNELS_H_
+#define MPID_OPENMM_CPU_KERNELS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include "MPIDReferenceKernels.h"
+
+namespace OpenMM {
+
+/**
+ * This kernel is invoked by MPIDForce on the CPU platform.  It runs the reference
+ * implementation with the direct space pair loops split across the platform's threads.
+ */
+class CpuCalcMPIDForceKernel : public ReferenceCalcMPIDForceKernel {
+public:
+    CpuCalcMPIDForceKernel(std::string name, const Platform& platform, const System& system);
+    /**
+     * Setup for MPIDReferenceForce instance, handing it the thread pool of the context.
+     *
+     * @param context        the current context
+     *
+     * @return pointer to initialized instance of MPIDReferenceForce
+     */
+    MPIDReferenceForce* setupMPIDReferenceForce(ContextImpl& context);
+    /**
+     * Create the MPIDReferencePmeForce instance used when 'usePme' is set.  On the CPU platform
+     * its direct space loop is vectorized.
+     *
+     * @return pointer to new instance of MPIDCpuPmeForce
+     */
+    MPIDReferencePmeForce* createMPIDReferencePmeForce();
+    /**
+     * Automatically chosen PME parameters are tuned on the CPU platform, by timing several cutoffs
+     * around the requested one during the first force evaluation.
+     *
+     * @return true
+     */
+    bool tunesPmeCutoff() const;
+};
+
+
+} // namespace OpenMM
+
+#endif /*MPID_OPENMM_CPU_KERNELS_H*/
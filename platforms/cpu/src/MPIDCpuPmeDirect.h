@@ -0,0 +1,141 @@
+#ifndef MPID_OPENMM_CPU_PME_DIRECT_H_
+#define MPID_OPENMM_CPU_PME_DIRECT_H_
+
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+// The definitions of the vectorized direct space loop.  This is included by each translation unit
+// that compiles the loop for one instruction set, and instantiates it with that unit's vector types.
+
+#include "MPIDCpuPmeForce.h"
+#include "MPIDCpuVectorize.h"
+#include "MPIDCpuQIPairKernel.h"
+#include <algorithm>
+
+namespace OpenMM {
+
+template <class VEC>
+void MPIDCpuPmeForce::gatherParticle(const unsigned int* index, MPIDQIPairKernel::Particle<VEC>& particle) const
+{
+    using MPID_CPU_SIMD_NAMESPACE::gather;
+    const ParticleArrays& arrays = _particleArrays;
+    particle.charge = gather<VEC>(arrays.charge, index);
+    for (int ii = 0; ii < 3; ii++)
+        particle.sphericalDipole[ii] = gather<VEC>(arrays.sphericalDipole[ii], index);
+    for (int ii = 0; ii < 5; ii++)
+        particle.sphericalQuadrupole[ii] = gather<VEC>(arrays.sphericalQuadrupole[ii], index);
+    for (int ii = 0; ii < 7; ii++)
+        particle.sphericalOctopole[ii] = gather<VEC>(arrays.sphericalOctopole[ii], index);
+    for (int ii = 0; ii < 3; ii++)
+        particle.inducedDipole[ii] = gather<VEC>(arrays.inducedDipole[ii], index);
+    particle.thole = gather<VEC>(arrays.thole, index);
+    particle.dampingFactor = gather<VEC>(arrays.dampingFactor, index);
+    particle.anisotropic = gather<VEC>(arrays.anisotropic, index);
+}
+
+template <class VEC, class MASK>
+double MPIDCpuPmeForce::calculatePmeDirectElectrostaticBlockSimd(unsigned int start, unsigned int end,
+                                                                 std::vector<Vec3>& forces, std::vector<Vec3>& torques) const
+{
+    using MPID_CPU_SIMD_NAMESPACE::gather;
+    const int numLanes = VEC::numLanes;
+    const ParticleArrays& arrays = _particleArrays;
+    MPIDQIPairKernel::Parameters parameters;
+    loadQIPairParameters(parameters);
+    double laneValues[numLanes];
+    for (int lane = 0; lane < numLanes; lane++)
+        laneValues[lane] = lane;
+    const VEC laneIndex = VEC::load(laneValues);
+    VEC energy(0.0);
+
+    for (unsigned int first = start; first < end; first += numLanes) {
+
+        // Gather up to numLanes pairs.  Unused lanes repeat the first pair and are masked out below.
+
+        int numPairs = std::min((unsigned int) numLanes, end-first);
+        unsigned int indexI[numLanes], indexJ[numLanes];
+        double mScale[numLanes], pScale[numLanes];
+        for (int lane = 0; lane < numLanes; lane++) {
+            const NeighborPair& pair = _neighborList[first + (lane < numPairs ? lane : 0)];
+            indexI[lane] = pair.particleI;
+            indexJ[lane] = pair.particleJ;
+            mScale[lane] = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + M_SCALE];
+            pScale[lane] = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + P_SCALE];
+        }
+        VEC yI = gather<VEC>(arrays.y, indexI), yJ = gather<VEC>(arrays.y, indexJ);
+        VEC zI = gather<VEC>(arrays.z, indexI), zJ = gather<VEC>(arrays.z, indexJ);
+        VEC deltaR[3] = {gather<VEC>(arrays.x, indexJ) - gather<VEC>(arrays.x, indexI), yJ - yI, zJ - zI};
+        MASK offAxis = (yI != yJ) | (zI != zJ);
+
+        // Apply periodic boundary conditions, as in getPeriodicDelta().
+
+        for (int k = 2; k >= 0; k--) {
+            VEC shift = floor(deltaR[k]*_recipBoxVectors[k][k] + 0.5);
+            for (int d = 0; d < 3; d++)
+                deltaR[d] -= _periodicBoxVectors[k][d]*shift;
+        }
+        VEC r2 = deltaR[0]*deltaR[0] + deltaR[1]*deltaR[1] + deltaR[2]*deltaR[2];
+        MASK include = (r2 <= _cutoffDistanceSquared) & (laneIndex < (double) numPairs);
+        if (!any(include))
+            continue;
+        VEC r = sqrt(r2);
+
+        MPIDQIPairKernel::Particle<VEC> particleI, particleJ;
+        gatherParticle(indexI, particleI);
+        gatherParticle(indexJ, particleJ);
+        VEC force[3], torqueI[3], torqueJ[3];
+        VEC pairEnergy = MPIDQIPairKernel::computePmeDirectInteraction(parameters, particleI, particleJ, deltaR, r, offAxis,
+                                                                       VEC::load(mScale), VEC::load(pScale), force, torqueI, torqueJ);
+        energy += blend(0.0, pairEnergy, include);
+
+        // Scatter the results; excluded lanes contribute zero.
+
+        double laneForce[3][numLanes], laneTorqueI[3][numLanes], laneTorqueJ[3][numLanes];
+        for (int d = 0; d < 3; d++) {
+            blend(0.0, force[d], include).store(laneForce[d]);
+            blend(0.0, torqueI[d], include).store(laneTorqueI[d]);
+            blend(0.0, torqueJ[d], include).store(laneTorqueJ[d]);
+        }
+        for (int lane = 0; lane < numPairs; lane++) {
+            for (int d = 0; d < 3; d++) {
+                torques[indexI[lane]][d] += laneTorqueI[d][lane];
+                torques[indexJ[lane]][d] += laneTorqueJ[d][lane];
+                forces[indexI[lane]][d]  -= laneForce[d][lane];
+                forces[indexJ[lane]][d]  += laneForce[d][lane];
+            }
+        }
+    }
+    double laneEnergy[numLanes];
+    energy.store(laneEnergy);
+    double totalEnergy = 0.0;
+    for (int lane = 0; lane < numLanes; lane++)
+        totalEnergy += laneEnergy[lane];
+    return totalEnergy;
+}
+
+} // namespace OpenMM
+
+#endif /*MPID_OPENMM_CPU_PME_DIRECT_H_*/
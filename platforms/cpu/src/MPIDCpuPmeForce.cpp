@@ -0,0 +1,112 @@
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include "MPIDCpuPmeDirect.h"
+
+using namespace OpenMM;
+using std::vector;
+
+MPIDCpuPmeForce::MPIDCpuPmeForce() : MPIDReferencePmeForce() {
+}
+
+void MPIDCpuPmeForce::loadParticleArrays(const vector<MultipoleParticleData>& particleData)
+{
+    ParticleArrays& arrays = _particleArrays;
+    arrays.x.resize(_numParticles);
+    arrays.y.resize(_numParticles);
+    arrays.z.resize(_numParticles);
+    arrays.charge.resize(_numParticles);
+    for (int ii = 0; ii < 3; ii++)
+        arrays.sphericalDipole[ii].resize(_numParticles);
+    for (int ii = 0; ii < 5; ii++)
+        arrays.sphericalQuadrupole[ii].resize(_numParticles);
+    for (int ii = 0; ii < 7; ii++)
+        arrays.sphericalOctopole[ii].resize(_numParticles);
+    for (int ii = 0; ii < 3; ii++)
+        arrays.inducedDipole[ii].resize(_numParticles);
+    arrays.thole.resize(_numParticles);
+    arrays.dampingFactor.resize(_numParticles);
+    arrays.anisotropic.resize(_numParticles);
+    for (unsigned int i = 0; i < _numParticles; i++) {
+        const MultipoleParticleData& particle = particleData[i];
+        arrays.x[i] = particle.position[0];
+        arrays.y[i] = particle.position[1];
+        arrays.z[i] = particle.position[2];
+        arrays.charge[i] = particle.charge;
+        for (int ii = 0; ii < 3; ii++)
+            arrays.sphericalDipole[ii][i] = particle.sphericalDipole[ii];
+        for (int ii = 0; ii < 5; ii++)
+            arrays.sphericalQuadrupole[ii][i] = particle.sphericalQuadrupole[ii];
+        for (int ii = 0; ii < 7; ii++)
+            arrays.sphericalOctopole[ii][i] = particle.sphericalOctopole[ii];
+        for (int ii = 0; ii < 3; ii++)
+            arrays.inducedDipole[ii][i] = _inducedDipole[i][ii];
+        arrays.thole[i] = particle.thole;
+        arrays.dampingFactor[i] = particle.dampingFactor;
+        arrays.anisotropic[i] = particle.isAnisotropic ? 1.0 : 0.0;
+    }
+}
+
+void MPIDCpuPmeForce::loadQIPairParameters(MPIDQIPairKernel::Parameters& parameters) const
+{
+    parameters.prefactor = _electric/_dielectric;
+    parameters.alphaEwald = _alphaEwald;
+    parameters.sqrtPi = SQRT_PI;
+    parameters.defaultTholeWidth = _defaultTholeWidth;
+    parameters.mutual = (getPolarizationType() == MPIDReferenceForce::Mutual);
+}
+
+double MPIDCpuPmeForce::calculateElectrostatic(const vector<MultipoleParticleData>& particleData,
+                                               vector<Vec3>& torques, vector<Vec3>& forces)
+{
+    loadParticleArrays(particleData);
+    return MPIDReferencePmeForce::calculateElectrostatic(particleData, torques, forces);
+}
+
+double MPIDCpuPmeForce::calculatePmeDirectElectrostaticBlock(const vector<MultipoleParticleData>& particleData,
+                                                             unsigned int start, unsigned int end,
+                                                             vector<Vec3>& forces, vector<Vec3>& torques)
+{
+    // Use the widest loop that was compiled and that this CPU can run.
+
+#ifdef MPID_CPU_AVX512
+    static const bool hasAvx512 = __builtin_cpu_supports("avx512f");
+    if (hasAvx512)
+        return calculatePmeDirectElectrostaticBlockAvx512(start, end, forces, torques);
+#endif
+#ifdef MPID_CPU_AVX2
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (hasAvx2)
+        return calculatePmeDirectElectrostaticBlockAvx2(start, end, forces, torques);
+#endif
+#ifdef __AVX__
+    return calculatePmeDirectElectrostaticBlockSimd<MPID_CPU_SIMD_NAMESPACE::dvec, MPID_CPU_SIMD_NAMESPACE::dmask>(start, end, forces, torques);
+#else
+    // The plain loops dvec4 falls back to without AVX are slower than the reference pair loop.
+
+    return MPIDReferencePmeForce::calculatePmeDirectElectrostaticBlock(particleData, start, end, forces, torques);
+#endif
+}
@@ -0,0 +1,148 @@
+#ifndef MPID_OPENMM_CPU_PME_FORCE_H_
+#define MPID_OPENMM_CPU_PME_FORCE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include "MPIDReferenceForce.h"
+#include <vector>
+
+namespace OpenMM {
+
+namespace MPIDQIPairKernel {
+template <class T> struct Particle;
+struct Parameters;
+}
+
+/**
+ * MPIDReferencePmeForce with a vectorized direct space loop.  The neighbor list is processed several
+ * pairs at a time by the same QI pair kernel the reference implementation uses, instantiated with
+ * a SIMD type.  Particle data are copied into a structure of arrays before the loop, so each lane
+ * can be gathered field by field.
+ *
+ * The loop is compiled for AVX2 (four lanes) and AVX-512 (eight lanes) where the compiler supports
+ * them, and the widest one the CPU supports is chosen at run time.  CPUs with neither use the
+ * reference pair loop.
+ */
+class MPIDCpuPmeForce : public MPIDReferencePmeForce {
+public:
+    MPIDCpuPmeForce();
+
+protected:
+
+    /**
+     * Calculate electrostatic forces.
+     *
+     * @param particleData            vector of parameters (charge, labFrame dipoles, quadrupoles, ...) for particles
+     * @param torques                 output torques
+     * @param forces                  output forces
+     *
+     * @return energy
+     */
+    double calculateElectrostatic(const std::vector<MultipoleParticleData>& particleData,
+                                  std::vector<OpenMM::Vec3>& torques,
+                                  std::vector<OpenMM::Vec3>& forces);
+
+    /**
+     * Calculate the direct space electrostatic interactions of a contiguous block of the neighbor list.
+     *
+     * @param particleData      vector of parameters (charge, labFrame dipoles, quadrupoles, ...) for particles
+     * @param start             index of the first neighbor list entry
+     * @param end               one past the index of the last neighbor list entry
+     * @param forces            vector of particle forces to be updated
+     * @param torques           vector of particle torques to be updated
+     *
+     * @return energy
+     */
+    double calculatePmeDirectElectrostaticBlock(const std::vector<MultipoleParticleData>& particleData,
+                                                unsigned int start, unsigned int end,
+                                                std::vector<Vec3>& forces, std::vector<Vec3>& torques);
+
+private:
+
+    /**
+     * Copy the particle data and induced dipoles into _particleArrays.
+     *
+     * @param particleData      vector of parameters (charge, labFrame dipoles, quadrupoles, ...) for particles
+     */
+    void loadParticleArrays(const std::vector<MultipoleParticleData>& particleData);
+
+    /**
+     * Set the parameters of the QI pair kernel that are shared by all pairs.
+     *
+     * @param parameters        the kernel parameters
+     */
+    void loadQIPairParameters(MPIDQIPairKernel::Parameters& parameters) const;
+
+    /**
+     * The direct space loop for one vector type, which is instantiated in MPIDCpuPmeDirect.h.  The
+     * arguments and return value are those of calculatePmeDirectElectrostaticBlock().
+     */
+    template <class VEC, class MASK>
+    double calculatePmeDirectElectrostaticBlockSimd(unsigned int start, unsigned int end,
+                                                    std::vector<Vec3>& forces, std::vector<Vec3>& torques) const;
+
+    /**
+     * The direct space loop compiled for AVX2, in MPIDCpuPmeForceAvx2.cpp.
+     */
+    double calculatePmeDirectElectrostaticBlockAvx2(unsigned int start, unsigned int end,
+                                                    std::vector<Vec3>& forces, std::vector<Vec3>& torques) const;
+
+    /**
+     * The direct space loop compiled for AVX-512, in MPIDCpuPmeForceAvx512.cpp.
+     */
+    double calculatePmeDirectElectrostaticBlockAvx512(unsigned int start, unsigned int end,
+                                                      std::vector<Vec3>& forces, std::vector<Vec3>& torques) const;
+
+    /**
+     * Gather the data of one particle per lane from _particleArrays into the kernel's particle.
+     *
+     * @param index             the particle index for each lane
+     * @param particle          the gathered particle
+     */
+    template <class VEC>
+    void gatherParticle(const unsigned int* index, MPIDQIPairKernel::Particle<VEC>& particle) const;
+
+    /*
+     * Particle data in structure of arrays layout.
+     */
+    struct ParticleArrays {
+        std::vector<double> x, y, z;
+        std::vector<double> charge;
+        std::vector<double> sphericalDipole[3];
+        std::vector<double> sphericalQuadrupole[5];
+        std::vector<double> sphericalOctopole[7];
+        std::vector<double> inducedDipole[3];
+        std::vector<double> thole;
+        std::vector<double> dampingFactor;
+        std::vector<double> anisotropic;
+    };
+    ParticleArrays _particleArrays;
+};
+
+} // namespace OpenMM
+
+#endif /*MPID_OPENMM_CPU_PME_FORCE_H_*/
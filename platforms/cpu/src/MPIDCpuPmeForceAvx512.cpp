@@ -0,0 +1,44 @@
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+// The direct space loop compiled for AVX-512.  The build defines MPID_CPU_AVX512, and compiles this file
+// with the matching compiler flag, only if the compiler supports it.  MPIDCpuPmeForce.cpp checks at
+// run time that the CPU supports it too before calling it.
+
+#ifdef MPID_CPU_AVX512
+
+#include "MPIDCpuPmeDirect.h"
+
+using namespace OpenMM;
+using std::vector;
+
+double MPIDCpuPmeForce::calculatePmeDirectElectrostaticBlockAvx512(unsigned int start, unsigned int end,
+                                                                   vector<Vec3>& forces, vector<Vec3>& torques) const
+{
+    return calculatePmeDirectElectrostaticBlockSimd<MPID_CPU_SIMD_NAMESPACE::dvec, MPID_CPU_SIMD_NAMESPACE::dmask>(start, end, forces, torques);
+}
+
+#endif
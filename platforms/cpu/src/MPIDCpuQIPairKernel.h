@@ -0,0 +1,784 @@
+
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MPID_OPENMM_CPU_QI_PAIR_KERNEL_H_
+#define MPID_OPENMM_CPU_QI_PAIR_KERNEL_H_
+
+#include "MPIDReferenceForce.h"
+#include "openmm/internal/MSVC_erfc.h"
+#include <cmath>
+
+/**
+ * The quasi-internal (QI) frame pair kernel for the PME direct space interaction, written as a
+ * template over the arithmetic type and instantiated with the SIMD types of MPIDCpuVectorize.h, so
+ * each call evaluates several pairs at once.  It follows
+ * MPIDReferencePmeForce::calculatePmeDirectElectrostaticPairIxn() operation for operation, and the
+ * CPU platform tests compare the two.
+ *
+ * The arithmetic type T must provide the usual arithmetic operators (also with double operands),
+ * comparisons returning a mask type, and sqrt(), fabs(), exp() and erf().  Data dependent branches
+ * are expressed with blend(a, b, mask), which returns b where mask is set and a elsewhere, so that
+ * every pair follows the same sequence of operations.
+ */
+namespace OpenMM {
+namespace MPIDQIPairKernel {
+
+/**
+ * The multipoles and polarization parameters of one particle, in the lab frame.
+ */
+template <class T>
+struct Particle {
+    T charge;
+    T sphericalDipole[3];
+    T sphericalQuadrupole[5];
+    T sphericalOctopole[7];
+    T inducedDipole[3];
+    T thole;
+    T dampingFactor;
+    // 1 if the particle's polarizability is anisotropic, 0 otherwise
+    T anisotropic;
+};
+
+/**
+ * Parameters shared by all pairs.
+ */
+struct Parameters {
+    double prefactor;
+    double alphaEwald;
+    double sqrtPi;
+    double defaultTholeWidth;
+    bool mutual;
+};
+
+/**
+ * Form the rotation matrix from the lab frame to the QI frame, whose z axis is along deltaR.
+ * The rows are in spherical harmonic ordering {z,x,y}.
+ *
+ * @param deltaR          the vector from particle I to particle J
+ * @param r               the length of deltaR
+ * @param offAxis         true if the two particles differ in their y or z coordinates
+ * @param rotationMatrix  the rotation matrix
+ */
+template <class T, class M>
+void formRotationMatrix(const T (&deltaR)[3], const T& r, const M& offAxis, T (&rotationMatrix)[3][3])
+{
+    T scale = 1.0/r;
+    T vectorZ[3] = {deltaR[0]*scale, deltaR[1]*scale, deltaR[2]*scale};
+    T vectorX[3] = {blend(vectorZ[0], vectorZ[0] + 1.0, offAxis), blend(vectorZ[1] + 1.0, vectorZ[1], offAxis), vectorZ[2]};
+
+    T dot = vectorZ[0]*vectorX[0] + vectorZ[1]*vectorX[1] + vectorZ[2]*vectorX[2];
+    for (int ii = 0; ii < 3; ii++)
+        vectorX[ii] -= vectorZ[ii]*dot;
+    T norm = sqrt(vectorX[0]*vectorX[0] + vectorX[1]*vectorX[1] + vectorX[2]*vectorX[2]);
+    T normScale = blend(T(1.0), 1.0/norm, norm > 0.0);
+    for (int ii = 0; ii < 3; ii++)
+        vectorX[ii] *= normScale;
+    T vectorY[3] = {vectorZ[1]*vectorX[2] - vectorZ[2]*vectorX[1],
+                    vectorZ[2]*vectorX[0] - vectorZ[0]*vectorX[2],
+                    vectorZ[0]*vectorX[1] - vectorZ[1]*vectorX[0]};
+
+    // Reorder the Cartesian {x,y,z} dipole rotation matrix, to account
+    // for spherical harmonic ordering {z,x,y}.
+    rotationMatrix[0][0] = vectorZ[2];
+    rotationMatrix[0][1] = vectorZ[0];
+    rotationMatrix[0][2] = vectorZ[1];
+    rotationMatrix[1][0] = vectorX[2];
+    rotationMatrix[1][1] = vectorX[0];
+    rotationMatrix[1][2] = vectorX[1];
+    rotationMatrix[2][0] = vectorY[2];
+    rotationMatrix[2][1] = vectorY[0];
+    rotationMatrix[2][2] = vectorY[1];
+}
+
+/**
+ * Build the rotation matrix for spherical quadrupoles from the dipole rotation matrix.
+ */
+template <class T>
+void buildQuadrupoleRotationMatrix(const T (&D1)[3][3], T (&D2)[5][5])
+{
+    D2[0][0] = 0.5*(3.0*D1[0][0]*D1[0][0] - 1.0);
+    D2[1][0] = sqrtThree*D1[0][0]*D1[1][0];
+    D2[2][0] = sqrtThree*D1[0][0]*D1[2][0];
+    D2[3][0] = 0.5*sqrtThree*(D1[1][0]*D1[1][0] - D1[2][0]*D1[2][0]);
+    D2[4][0] = sqrtThree*D1[1][0]*D1[2][0];
+    D2[0][1] = sqrtThree*D1[0][0]*D1[0][1];
+    D2[1][1] = D1[1][0]*D1[0][1] + D1[0][0]*D1[1][1];
+    D2[2][1] = D1[2][0]*D1[0][1] + D1[0][0]*D1[2][1];
+    D2[3][1] = D1[1][0]*D1[1][1] - D1[2][0]*D1[2][1];
+    D2[4][1] = D1[2][0]*D1[1][1] + D1[1][0]*D1[2][1];
+    D2[0][2] = sqrtThree*D1[0][0]*D1[0][2];
+    D2[1][2] = D1[1][0]*D1[0][2] + D1[0][0]*D1[1][2];
+    D2[2][2] = D1[2][0]*D1[0][2] + D1[0][0]*D1[2][2];
+    D2[3][2] = D1[1][0]*D1[1][2] - D1[2][0]*D1[2][2];
+    D2[4][2] = D1[2][0]*D1[1][2] + D1[1][0]*D1[2][2];
+    D2[0][3] = 0.5*sqrtThree*(D1[0][1]*D1[0][1] - D1[0][2]*D1[0][2]);
+    D2[1][3] = D1[0][1]*D1[1][1] - D1[0][2]*D1[1][2];
+    D2[2][3] = D1[0][1]*D1[2][1] - D1[0][2]*D1[2][2];
+    D2[3][3] = 0.5*(D1[1][1]*D1[1][1] - D1[2][1]*D1[2][1] - D1[1][2]*D1[1][2] + D1[2][2]*D1[2][2]);
+    D2[4][3] = D1[1][1]*D1[2][1] - D1[1][2]*D1[2][2];
+    D2[0][4] = sqrtThree*D1[0][1]*D1[0][2];
+    D2[1][4] = D1[1][1]*D1[0][2] + D1[0][1]*D1[1][2];
+    D2[2][4] = D1[2][1]*D1[0][2] + D1[0][1]*D1[2][2];
+    D2[3][4] = D1[1][1]*D1[1][2] - D1[2][1]*D1[2][2];
+    D2[4][4] = D1[2][1]*D1[1][2] + D1[1][1]*D1[2][2];
+}
+
+/**
+ * Build the rotation matrix for spherical octopoles from the dipole and quadrupole rotation matrices.
+ */
+template <class T>
+void buildOctopoleRotationMatrix(const T (&D1)[3][3], const T (&D2)[5][5], T (&D3)[7][7])
+{
+    D3[0][0] = D1[0][0]*D2[0][0] - 0.5773502691896258*(D1[1][0]*D2[1][0] + D1[2][0]*D2[2][0]);
+    D3[0][1] = 0.25*(4.242640687119285*D1[0][0]*D2[0][1] - 2.449489742783178*(D1[1][0]*D2[1][1] + D1[2][0]*D2[2][1]));
+    D3[0][2] = 0.25*(4.242640687119285*D1[0][0]*D2[0][2] - 2.449489742783178*(D1[1][0]*D2[1][2] + D1[2][0]*D2[2][2]));
+    D3[0][3] = 0.4472135954999579*(3.*D1[0][0]*D2[0][3] - 1.732050807568877*(D1[1][0]*D2[1][3] + D1[2][0]*D2[2][3]));
+    D3[0][4] = 0.4472135954999579*(3.*D1[0][0]*D2[0][4] - 1.732050807568877*(D1[1][0]*D2[1][4] + D1[2][0]*D2[2][4]));
+    D3[0][5] = 0.3162277660168379*(1.732050807568877*(D1[0][1]*D2[0][3] - D1[0][2]*D2[0][4]) - D1[1][1]*D2[1][3] + D1[1][2]*D2[1][4] - D1[2][1]*D2[2][3] + D1[2][2]*D2[2][4]);
+    D3[0][6] = 0.5477225575051661*(D1[0][2]*D2[0][3] + D1[0][1]*D2[0][4]) - 0.3162277660168379*(D1[1][2]*D2[1][3] + D1[1][1]*D2[1][4] + D1[2][2]*D2[2][3] + D1[2][1]*D2[2][4]);
+    D3[1][0] = 0.2357022603955158*(3.464101615137755*D1[1][0]*D2[0][0] + 4.*D1[0][0]*D2[1][0] - D1[1][0]*D2[3][0] - D1[2][0]*D2[4][0]);
+    D3[1][1] = 0.25*(3.464101615137755*D1[1][0]*D2[0][1] + 4.*D1[0][0]*D2[1][1] - D1[1][0]*D2[3][1] - D1[2][0]*D2[4][1]);
+    D3[1][2] = 0.25*(3.464101615137755*D1[1][0]*D2[0][2] + 4.*D1[0][0]*D2[1][2] - D1[1][0]*D2[3][2] - D1[2][0]*D2[4][2]);
+    D3[1][3] = 0.3162277660168379*(3.464101615137755*D1[1][0]*D2[0][3] + 4.*D1[0][0]*D2[1][3] - D1[1][0]*D2[3][3] - D1[2][0]*D2[4][3]);
+    D3[1][4] = 0.3162277660168379*(3.464101615137755*D1[1][0]*D2[0][4] + 4.*D1[0][0]*D2[1][4] - D1[1][0]*D2[3][4] - D1[2][0]*D2[4][4]);
+    D3[1][5] = 0.07453559924999299*(-6.*D1[1][2]*D2[0][4] + D1[1][1]*(6.*D2[0][3] - 1.732050807568877*D2[3][3]) + 1.732050807568877*(4.*D1[0][1]*D2[1][3] - 4.*D1[0][2]*D2[1][4] + D1[1][2]*D2[3][4] - D1[2][1]*D2[4][3] + D1[2][2]*D2[4][4]));
+    D3[1][6] = 0.07453559924999299*(6.*(D1[1][2]*D2[0][3] + D1[1][1]*D2[0][4]) + 6.928203230275509*(D1[0][2]*D2[1][3] + D1[0][1]*D2[1][4]) - 1.732050807568877*(D1[1][2]*D2[3][3] + D1[1][1]*D2[3][4] + D1[2][2]*D2[4][3] + D1[2][1]*D2[4][4]));
+    D3[2][0] = 0.2357022603955158*(4.*D1[0][0]*D2[2][0] + D1[2][0]*(3.464101615137755*D2[0][0] + D2[3][0]) - D1[1][0]*D2[4][0]);
+    D3[2][1] = 0.25*(4.*D1[0][0]*D2[2][1] + D1[2][0]*(3.464101615137755*D2[0][1] + D2[3][1]) - D1[1][0]*D2[4][1]);
+    D3[2][2] = 0.25*(4.*D1[0][0]*D2[2][2] + D1[2][0]*(3.464101615137755*D2[0][2] + D2[3][2]) - D1[1][0]*D2[4][2]);
+    D3[2][3] = 0.3162277660168379*(4.*D1[0][0]*D2[2][3] + D1[2][0]*(3.464101615137755*D2[0][3] + D2[3][3]) - D1[1][0]*D2[4][3]);
+    D3[2][4] = 0.3162277660168379*(4.*D1[0][0]*D2[2][4] + D1[2][0]*(3.464101615137755*D2[0][4] + D2[3][4]) - D1[1][0]*D2[4][4]);
+    D3[2][5] = 0.07453559924999299*(-6.*D1[2][2]*D2[0][4] + D1[2][1]*(6.*D2[0][3] + 1.732050807568877*D2[3][3]) + 1.732050807568877*(4.*D1[0][1]*D2[2][3] - 4.*D1[0][2]*D2[2][4] - D1[2][2]*D2[3][4] - D1[1][1]*D2[4][3] + D1[1][2]*D2[4][4]));
+    D3[2][6] = 0.07453559924999299*(6.*D1[2][1]*D2[0][4] + D1[2][2]*(6.*D2[0][3] + 1.732050807568877*D2[3][3]) + 1.732050807568877*(4.*D1[0][2]*D2[2][3] + 4.*D1[0][1]*D2[2][4] + D1[2][1]*D2[3][4] - D1[1][2]*D2[4][3] - D1[1][1]*D2[4][4]));
+    D3[3][0] = 0.7453559924999299*(D1[1][0]*D2[1][0] - D1[2][0]*D2[2][0] + D1[0][0]*D2[3][0]);
+    D3[3][1] = 0.7905694150420948*(D1[1][0]*D2[1][1] - D1[2][0]*D2[2][1] + D1[0][0]*D2[3][1]);
+    D3[3][2] = 0.7905694150420948*(D1[1][0]*D2[1][2] - D1[2][0]*D2[2][2] + D1[0][0]*D2[3][2]);
+    D3[3][3] = D1[1][0]*D2[1][3] - D1[2][0]*D2[2][3] + D1[0][0]*D2[3][3];
+    D3[3][4] = D1[1][0]*D2[1][4] - D1[2][0]*D2[2][4] + D1[0][0]*D2[3][4];
+    D3[3][5] = 0.408248290463863*(D1[1][1]*D2[1][3] - D1[1][2]*D2[1][4] - D1[2][1]*D2[2][3] + D1[2][2]*D2[2][4] + D1[0][1]*D2[3][3] - D1[0][2]*D2[3][4]);
+    D3[3][6] = 0.408248290463863*(D1[1][2]*D2[1][3] + D1[1][1]*D2[1][4] - D1[2][2]*D2[2][3] - D1[2][1]*D2[2][4] + D1[0][2]*D2[3][3] + D1[0][1]*D2[3][4]);
+    D3[4][0] = 0.7453559924999299*(D1[2][0]*D2[1][0] + D1[1][0]*D2[2][0] + D1[0][0]*D2[4][0]);
+    D3[4][1] = 0.7905694150420948*(D1[2][0]*D2[1][1] + D1[1][0]*D2[2][1] + D1[0][0]*D2[4][1]);
+    D3[4][2] = 0.7905694150420948*(D1[2][0]*D2[1][2] + D1[1][0]*D2[2][2] + D1[0][0]*D2[4][2]);
+    D3[4][3] = D1[2][0]*D2[1][3] + D1[1][0]*D2[2][3] + D1[0][0]*D2[4][3];
+    D3[4][4] = D1[2][0]*D2[1][4] + D1[1][0]*D2[2][4] + D1[0][0]*D2[4][4];
+    D3[4][5] = 0.408248290463863*(D1[2][1]*D2[1][3] - D1[2][2]*D2[1][4] + D1[1][1]*D2[2][3] - D1[1][2]*D2[2][4] + D1[0][1]*D2[4][3] - D1[0][2]*D2[4][4]);
+    D3[4][6] = 0.408248290463863*(D1[2][2]*D2[1][3] + D1[2][1]*D2[1][4] + D1[1][2]*D2[2][3] + D1[1][1]*D2[2][4] + D1[0][2]*D2[4][3] + D1[0][1]*D2[4][4]);
+    D3[5][0] = 0.9128709291752769*(D1[1][0]*D2[3][0] - D1[2][0]*D2[4][0]);
+    D3[5][1] = 0.9682458365518542*(D1[1][0]*D2[3][1] - D1[2][0]*D2[4][1]);
+    D3[5][2] = 0.9682458365518542*(D1[1][0]*D2[3][2] - D1[2][0]*D2[4][2]);
+    D3[5][3] = 1.224744871391589*(D1[1][0]*D2[3][3] - D1[2][0]*D2[4][3]);
+    D3[5][4] = 1.224744871391589*(D1[1][0]*D2[3][4] - D1[2][0]*D2[4][4]);
+    D3[5][5] = 0.5*(D1[1][1]*D2[3][3] - D1[1][2]*D2[3][4] - D1[2][1]*D2[4][3] + D1[2][2]*D2[4][4]);
+    D3[5][6] = 0.5*(D1[1][2]*D2[3][3] + D1[1][1]*D2[3][4] - D1[2][2]*D2[4][3] - D1[2][1]*D2[4][4]);
+    D3[6][0] = 0.9128709291752769*(D1[2][0]*D2[3][0] + D1[1][0]*D2[4][0]);
+    D3[6][1] = 0.9682458365518542*(D1[2][0]*D2[3][1] + D1[1][0]*D2[4][1]);
+    D3[6][2] = 0.9682458365518542*(D1[2][0]*D2[3][2] + D1[1][0]*D2[4][2]);
+    D3[6][3] = 1.224744871391589*(D1[2][0]*D2[3][3] + D1[1][0]*D2[4][3]);
+    D3[6][4] = 1.224744871391589*(D1[2][0]*D2[3][4] + D1[1][0]*D2[4][4]);
+    D3[6][5] = 0.5*(D1[2][1]*D2[3][3] - D1[2][2]*D2[3][4] + D1[1][1]*D2[4][3] - D1[1][2]*D2[4][4]);
+    D3[6][6] = 0.5*(D1[2][2]*D2[3][3] + D1[2][1]*D2[3][4] + D1[1][2]*D2[4][3] + D1[1][1]*D2[4][4]);
+}
+
+/**
+ * Compute the PME direct space interaction of a pair of particles in the QI frame.  The caller
+ * is responsible for the cutoff; forces and torques are returned rather than accumulated.
+ *
+ * @param parameters      parameters shared by all pairs
+ * @param particleI       the first particle
+ * @param particleJ       the second particle
+ * @param deltaR          the (periodic) vector from particle I to particle J
+ * @param r               the length of deltaR
+ * @param offAxis         true if the two particles differ in their y or z coordinates
+ * @param mScale          the scale factor for permanent multipole interactions
+ * @param pScale          the scale factor for polarization interactions
+ * @param force           the force on particle J (particle I gets the negative)
+ * @param torqueI         the torque on particle I
+ * @param torqueJ         the torque on particle J
+ * @return the energy of the interaction
+ */
+template <class T, class M>
+T computePmeDirectInteraction(const Parameters& parameters, const Particle<T>& particleI, const Particle<T>& particleJ,
+                              const T (&deltaR)[3], const T& r, const M& offAxis, const T& mScale, const T& pScale,
+                              T (&force)[3], T (&torqueI)[3], T (&torqueJ)[3])
+{
+    // Start by constructing rotation matrices to put dipoles and
+    // quadrupoles into the QI frame, from the lab frame.
+    T qiRotationMatrix1[3][3];
+    formRotationMatrix(deltaR, r, offAxis, qiRotationMatrix1);
+    T qiRotationMatrix2[5][5];
+    buildQuadrupoleRotationMatrix(qiRotationMatrix1, qiRotationMatrix2);
+    T qiRotationMatrix3[7][7];
+    buildOctopoleRotationMatrix(qiRotationMatrix1, qiRotationMatrix2, qiRotationMatrix3);
+    // The force rotation matrix rotates the QI forces into the lab
+    // frame, and makes sure the result is in {x,y,z} ordering. Its
+    // transpose is used to rotate the induced dipoles to the QI frame.
+    T forceRotationMatrix[3][3];
+    forceRotationMatrix[0][0] = qiRotationMatrix1[1][1];
+    forceRotationMatrix[0][1] = qiRotationMatrix1[2][1];
+    forceRotationMatrix[0][2] = qiRotationMatrix1[0][1];
+    forceRotationMatrix[1][0] = qiRotationMatrix1[1][2];
+    forceRotationMatrix[1][1] = qiRotationMatrix1[2][2];
+    forceRotationMatrix[1][2] = qiRotationMatrix1[0][2];
+    forceRotationMatrix[2][0] = qiRotationMatrix1[1][0];
+    forceRotationMatrix[2][1] = qiRotationMatrix1[2][0];
+    forceRotationMatrix[2][2] = qiRotationMatrix1[0][0];
+    // For efficiency, we go ahead and cache that transposed version
+    // now, because we need to do 4 rotations in total (I,J, and p,d).
+    // We also fold in the factor of 0.5 needed to average the p and d
+    // components.
+    T inducedDipoleRotationMatrix[3][3];
+    inducedDipoleRotationMatrix[0][0] = 0.5*qiRotationMatrix1[0][1];
+    inducedDipoleRotationMatrix[0][1] = 0.5*qiRotationMatrix1[0][2];
+    inducedDipoleRotationMatrix[0][2] = 0.5*qiRotationMatrix1[0][0];
+    inducedDipoleRotationMatrix[1][0] = 0.5*qiRotationMatrix1[1][1];
+    inducedDipoleRotationMatrix[1][1] = 0.5*qiRotationMatrix1[1][2];
+    inducedDipoleRotationMatrix[1][2] = 0.5*qiRotationMatrix1[1][0];
+    inducedDipoleRotationMatrix[2][0] = 0.5*qiRotationMatrix1[2][1];
+    inducedDipoleRotationMatrix[2][1] = 0.5*qiRotationMatrix1[2][2];
+    inducedDipoleRotationMatrix[2][2] = 0.5*qiRotationMatrix1[2][0];
+    // Rotate the induced dipoles to the QI frame.
+    T qiUindI[3], qiUindJ[3];
+    for (int ii = 0; ii < 3; ii++) {
+        T valID = 0.0;
+        T valJD = 0.0;
+        for (int jj = 0; jj < 3; jj++) {
+            valID += inducedDipoleRotationMatrix[ii][jj] * particleI.inducedDipole[jj];
+            valJD += inducedDipoleRotationMatrix[ii][jj] * particleJ.inducedDipole[jj];
+        }
+        qiUindI[ii] = valID;
+        qiUindJ[ii] = valJD;
+    }
+
+    // The Qtilde intermediates (QI frame multipoles) for atoms I and J
+    T qiQI[16], qiQJ[16];
+    // Rotate the permanent multipoles to the QI frame.
+    qiQI[0] = particleI.charge;
+    qiQJ[0] = particleJ.charge;
+    for (int ii = 0; ii < 3; ii++) {
+        T valI = 0.0;
+        T valJ = 0.0;
+        for (int jj = 0; jj < 3; jj++) {
+            valI += qiRotationMatrix1[ii][jj] * particleI.sphericalDipole[jj];
+            valJ += qiRotationMatrix1[ii][jj] * particleJ.sphericalDipole[jj];
+        }
+        qiQI[ii+1] = valI;
+        qiQJ[ii+1] = valJ;
+    }
+    for (int ii = 0; ii < 5; ii++) {
+        T valI = 0.0;
+        T valJ = 0.0;
+        for (int jj = 0; jj < 5; jj++) {
+            valI += qiRotationMatrix2[ii][jj] * particleI.sphericalQuadrupole[jj];
+            valJ += qiRotationMatrix2[ii][jj] * particleJ.sphericalQuadrupole[jj];
+        }
+        qiQI[ii+4] = valI;
+        qiQJ[ii+4] = valJ;
+    }
+    for (int ii = 0; ii < 7; ii++) {
+        T valI = 0.0;
+        T valJ = 0.0;
+        for (int jj = 0; jj < 7; jj++) {
+            valI += qiRotationMatrix3[ii][jj] * particleI.sphericalOctopole[jj];
+            valJ += qiRotationMatrix3[ii][jj] * particleJ.sphericalOctopole[jj];
+        }
+        qiQI[ii+9] = valI;
+        qiQJ[ii+9] = valJ;
+    }
+
+    // The Qtilde{x,y,z} torque intermediates for atoms I and J, which are used to obtain the torques on the permanent moments.
+    // 0    1    2    3    4    5    6    7    8    9   10   11   12   13   14   15
+    // q    10  11c  11s   20  21c  21s  22c  22s  30   31c  31s  32c  32s  33c  33s
+    T qiQIX[16] = {0.0, qiQI[3], 0.0, -qiQI[1], sqrtThree*qiQI[6], qiQI[8], -sqrtThree*qiQI[4] - qiQI[7], qiQI[6], -qiQI[5],
+                        sqrtSix*qiQI[11], sqrtFiveHalves*qiQI[13], -sqrtSix*qiQI[9]-sqrtFiveHalves*qiQI[12],sqrtFiveHalves*qiQI[11]+sqrtThreeHalves*qiQI[15],
+                        -sqrtFiveHalves*qiQI[10]-sqrtThreeHalves*qiQI[14], sqrtThreeHalves*qiQI[13], -sqrtThreeHalves*qiQI[12]};
+    T qiQIY[16] = {0.0, -qiQI[2], qiQI[1], 0.0, -sqrtThree*qiQI[5], sqrtThree*qiQI[4] - qiQI[7], -qiQI[8], qiQI[5], qiQI[6],
+                        -sqrtSix*qiQI[10], sqrtSix*qiQI[9]-sqrtFiveHalves*qiQI[12], -sqrtFiveHalves*qiQI[13], sqrtFiveHalves*qiQI[10]-sqrtThreeHalves*qiQI[14],
+                        sqrtFiveHalves*qiQI[11]-sqrtThreeHalves*qiQI[15], sqrtThreeHalves*qiQI[12], sqrtThreeHalves*qiQI[13]};
+    T qiQIZ[16] = {0.0, 0.0, -qiQI[3], qiQI[2], 0.0, -qiQI[6], qiQI[5], -2.0*qiQI[8], 2.0*qiQI[7],
+                        0.0, -qiQI[11], qiQI[10], -2.0*qiQI[13], 2.0*qiQI[12], -3.0*qiQI[15], 3.0*qiQI[14]};
+    T qiQJX[16] = {0.0, qiQJ[3], 0.0, -qiQJ[1], sqrtThree*qiQJ[6], qiQJ[8], -sqrtThree*qiQJ[4] - qiQJ[7], qiQJ[6], -qiQJ[5],
+                        sqrtSix*qiQJ[11], sqrtFiveHalves*qiQJ[13], -sqrtSix*qiQJ[9]-sqrtFiveHalves*qiQJ[12],sqrtFiveHalves*qiQJ[11]+sqrtThreeHalves*qiQJ[15],
+                        -sqrtFiveHalves*qiQJ[10]-sqrtThreeHalves*qiQJ[14], sqrtThreeHalves*qiQJ[13], -sqrtThreeHalves*qiQJ[12]};
+    T qiQJY[16] = {0.0, -qiQJ[2], qiQJ[1], 0.0, -sqrtThree*qiQJ[5], sqrtThree*qiQJ[4] - qiQJ[7], -qiQJ[8], qiQJ[5], qiQJ[6],
+                        -sqrtSix*qiQJ[10], sqrtSix*qiQJ[9]-sqrtFiveHalves*qiQJ[12], -sqrtFiveHalves*qiQJ[13], sqrtFiveHalves*qiQJ[10]-sqrtThreeHalves*qiQJ[14],
+                        sqrtFiveHalves*qiQJ[11]-sqrtThreeHalves*qiQJ[15], sqrtThreeHalves*qiQJ[12], sqrtThreeHalves*qiQJ[13]};
+    T qiQJZ[16] = {0.0, 0.0, -qiQJ[3], qiQJ[2], 0.0, -qiQJ[6], qiQJ[5], -2.0*qiQJ[8], 2.0*qiQJ[7],
+                        0.0, -qiQJ[11], qiQJ[10], -2.0*qiQJ[13], 2.0*qiQJ[12], -3.0*qiQJ[15], 3.0*qiQJ[14]};
+
+    // The field derivatives at I due to permanent and induced moments on J, and vice-versa.
+    // Also, their derivatives w.r.t. R, which are needed for force calculations
+    T Vij[16], Vji[16], VjiR[16], VijR[16];
+    // The field derivatives at I due to only permanent moments on J, and vice-versa.
+    T Vijd[3], Vjid[3];
+    T rInvVec[9], alphaRVec[10], bVec[6];
+
+    double prefac = parameters.prefactor;
+    T rInv = 1.0 / r;
+
+    // The rInvVec array is defined such that the ith element is R^-i, with the
+    // dieleectric constant folded in, to avoid conversions later.
+    rInvVec[1] = prefac * rInv;
+    for (int i = 2; i < 9; ++i)
+        rInvVec[i] = rInvVec[i-1] * rInv;
+
+    // The alpharVec array is defined such that the ith element is (alpha R)^i,
+    // where kappa (alpha in OpenMM parlance) is the Ewald attenuation parameter.
+    alphaRVec[1] = parameters.alphaEwald * r;
+    for (int i = 2; i < 10; ++i)
+        alphaRVec[i] = alphaRVec[i-1] * alphaRVec[1];
+
+    T erfAlphaR = erf(alphaRVec[1]);
+    T X = 2.0*exp(-alphaRVec[2])/parameters.sqrtPi;
+    T dScale = pScale;
+    T uScale = 1.0;
+
+    int doubleFactorial = 1, facCount = 1;
+    T tmp = alphaRVec[1];
+    bVec[1] = -erfAlphaR;
+    for (int i=2; i < 6; ++i) {
+        bVec[i] = bVec[i-1] + tmp * X / doubleFactorial;
+        facCount = facCount + 2;
+        doubleFactorial = doubleFactorial * facCount;
+        tmp *= 2.0 * alphaRVec[2];
+    }
+
+    T dmp = particleI.dampingFactor*particleJ.dampingFactor;
+    T a = blend(T(parameters.defaultTholeWidth), particleI.thole + particleJ.thole, pScale == 0.0);
+    T u = blend(T(1E10), r/dmp, fabs(dmp) > 1.0E-5);
+    T au = a*u;
+    T expau = blend(T(0.0), exp(-au), au < 50.0);
+    T au2 = au*au;
+    T au3 = au2*au;
+    T au4 = au3*au;
+    T au5 = au4*au;
+    T au6 = au5*au;
+    // Thole damping factors for energies
+    T thole_c   = 1.0 - expau*(1.0 + au + 0.5*au2);
+    T thole_d0  = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/4.0);
+    T thole_d1  = 1.0 - expau*(1.0 + au + 0.5*au2);
+    T thole_q0  = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/18.0);
+    T thole_q1  = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0);
+    T thole_o0  = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/24.0 + au5/120.0);
+    T thole_o1  = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/30.0);
+    // Thole damping factors for derivatives
+    T dthole_c  = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/4.0);
+    T dthole_d0 = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/12.0);
+    T dthole_d1 = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0);
+    T dthole_q0 = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/24.0 + au5/72.0);
+    T dthole_q1 = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/24.0);
+    T dthole_o0 = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/24.0 + au5/120.0 + au6/600.0);
+    T dthole_o1 = 1.0 - expau*(1.0 + au + 0.5*au2 + au3/6.0 + au4/25.0 + au5/150.0);
+
+    // Now we compute the (attenuated) Coulomb operator and its derivatives, contracted with
+    // permanent moments and induced dipoles.  Note that the coefficient of the permanent force
+    // terms is half of the expected value; this is because we compute the interaction of I with
+    // the sum of induced and permanent moments on J, as well as the interaction of J with I's
+    // permanent and induced moments; doing so double counts the permanent-permanent interaction.
+    T ePermCoef, dPermCoef, eUindCoef, dUindCoef;
+
+    // C-C terms (m=0)
+    ePermCoef = rInvVec[1]*(mScale + bVec[2] - alphaRVec[1]*X);
+    dPermCoef = -0.5*(mScale + bVec[2])*rInvVec[2];
+    Vij[0]  = ePermCoef*qiQJ[0];
+    Vji[0]  = ePermCoef*qiQI[0];
+    VijR[0] = dPermCoef*qiQJ[0];
+    VjiR[0] = dPermCoef*qiQI[0];
+
+    // C-D and C-Uind terms (m=0)
+    ePermCoef = rInvVec[2]*(mScale + bVec[2]);
+    eUindCoef = 2.0*rInvVec[2]*(pScale*thole_c + bVec[2]);
+    dPermCoef = -rInvVec[3]*(mScale + bVec[2] + alphaRVec[3]*X);
+    dUindCoef = -4.0*rInvVec[3]*(dScale*dthole_c + bVec[2] + alphaRVec[3]*X);
+    Vij[0]  += -(ePermCoef*qiQJ[1] + eUindCoef*qiUindJ[0]);
+    Vji[1]   = -(ePermCoef*qiQI[0]);
+    VijR[0] += -(dPermCoef*qiQJ[1] + dUindCoef*qiUindJ[0]);
+    VjiR[1]  = -(dPermCoef*qiQI[0]);
+    Vjid[0]  = -(eUindCoef*qiQI[0]);
+    // D-C and Uind-C terms (m=0)
+    Vij[1]   = ePermCoef*qiQJ[0];
+    Vji[0]  += ePermCoef*qiQI[1] + eUindCoef*qiUindI[0];
+    VijR[1]  = dPermCoef*qiQJ[0];
+    VjiR[0] += dPermCoef*qiQI[1] + dUindCoef*qiUindI[0];
+    Vijd[0]  = eUindCoef*qiQJ[0];
+
+    // D-D and D-Uind terms (m=0)
+    ePermCoef = -twoThirds*rInvVec[3]*(3.0*(mScale + bVec[3]) + alphaRVec[3]*X);
+    eUindCoef = -2.0*twoThirds*rInvVec[3]*(3.0*(dScale*thole_d0 + bVec[3]) + alphaRVec[3]*X);
+    dPermCoef = rInvVec[4]*(3.0*(mScale + bVec[3]) + 2.*alphaRVec[5]*X);
+    dUindCoef = 2.0*rInvVec[4]*(6.0*(dScale*dthole_d0 + bVec[3]) + 4.0*alphaRVec[5]*X);
+    Vij[1]  += ePermCoef*qiQJ[1] + eUindCoef*qiUindJ[0];
+    Vji[1]  += ePermCoef*qiQI[1] + eUindCoef*qiUindI[0];
+    VijR[1] += dPermCoef*qiQJ[1] + dUindCoef*qiUindJ[0];
+    VjiR[1] += dPermCoef*qiQI[1] + dUindCoef*qiUindI[0];
+    Vijd[0] += eUindCoef*qiQJ[1];
+    Vjid[0] += eUindCoef*qiQI[1];
+    // D-D and D-Uind terms (m=1)
+    ePermCoef = rInvVec[3]*(mScale + bVec[3] - twoThirds*alphaRVec[3]*X);
+    eUindCoef = 2.0*rInvVec[3]*(dScale*thole_d1 + bVec[3] - twoThirds*alphaRVec[3]*X);
+    dPermCoef = -1.5*rInvVec[4]*(mScale + bVec[3]);
+    dUindCoef = -6.0*rInvVec[4]*(dScale*dthole_d1 + bVec[3]);
+    Vij[2]  = ePermCoef*qiQJ[2] + eUindCoef*qiUindJ[1];
+    Vji[2]  = ePermCoef*qiQI[2] + eUindCoef*qiUindI[1];
+    VijR[2] = dPermCoef*qiQJ[2] + dUindCoef*qiUindJ[1];
+    VjiR[2] = dPermCoef*qiQI[2] + dUindCoef*qiUindI[1];
+    Vij[3]  = ePermCoef*qiQJ[3] + eUindCoef*qiUindJ[2];
+    Vji[3]  = ePermCoef*qiQI[3] + eUindCoef*qiUindI[2];
+    VijR[3] = dPermCoef*qiQJ[3] + dUindCoef*qiUindJ[2];
+    VjiR[3] = dPermCoef*qiQI[3] + dUindCoef*qiUindI[2];
+    Vijd[1] = eUindCoef*qiQJ[2];
+    Vjid[1] = eUindCoef*qiQI[2];
+    Vijd[2] = eUindCoef*qiQJ[3];
+    Vjid[2] = eUindCoef*qiQI[3];
+
+    // C-Q terms (m=0)
+    ePermCoef = (mScale + bVec[3])*rInvVec[3];
+    dPermCoef = -oneThird*rInvVec[4]*(4.5*(mScale + bVec[3]) + 2.0*alphaRVec[5]*X);
+    Vij[0]  += ePermCoef*qiQJ[4];
+    Vji[4]   = ePermCoef*qiQI[0];
+    VijR[0] += dPermCoef*qiQJ[4];
+    VjiR[4]  = dPermCoef*qiQI[0];
+    // Q-C terms (m=0)
+    Vij[4]   = ePermCoef*qiQJ[0];
+    Vji[0]  += ePermCoef*qiQI[4];
+    VijR[4]  = dPermCoef*qiQJ[0];
+    VjiR[0] += dPermCoef*qiQI[4];
+
+    // D-Q and Uind-Q terms (m=0)
+    ePermCoef = rInvVec[4]*(3.0*(mScale + bVec[3]) + fourThirds*alphaRVec[5]*X);
+    eUindCoef = 2.0*rInvVec[4]*(3.0*(dScale*thole_q0 + bVec[3]) + fourThirds*alphaRVec[5]*X);
+    dPermCoef = -fourThirds*rInvVec[5]*(4.5*(mScale + bVec[3]) + (1.0 + alphaRVec[2])*alphaRVec[5]*X);
+    dUindCoef = -2.0*fourThirds*rInvVec[5]*(9.0*(dScale*dthole_q0 + bVec[3]) + 2.0*(1.0 + alphaRVec[2])*alphaRVec[5]*X);
+    Vij[1]  += ePermCoef*qiQJ[4];
+    Vji[4]  += ePermCoef*qiQI[1] + eUindCoef*qiUindI[0];
+    VijR[1] += dPermCoef*qiQJ[4];
+    VjiR[4] += dPermCoef*qiQI[1] + dUindCoef*qiUindI[0];
+    Vijd[0] += eUindCoef*qiQJ[4];
+    // Q-D and Q-Uind terms (m=0)
+    Vij[4]  += -(ePermCoef*qiQJ[1] + eUindCoef*qiUindJ[0]);
+    Vji[1]  += -(ePermCoef*qiQI[4]);
+    VijR[4] += -(dPermCoef*qiQJ[1] + dUindCoef*qiUindJ[0]);
+    VjiR[1] += -(dPermCoef*qiQI[4]);
+    Vjid[0] += -(eUindCoef*qiQI[4]);
+
+    // D-Q and Uind-Q terms (m=1)
+    ePermCoef = -sqrtThree*rInvVec[4]*(mScale + bVec[3]);
+    eUindCoef = -2.0*sqrtThree*rInvVec[4]*(pScale*thole_q1 + bVec[3]);
+    dPermCoef = fourSqrtOneThird*rInvVec[5]*(1.5*(mScale + bVec[3]) + 0.5*alphaRVec[5]*X);
+    dUindCoef = 2.0*fourSqrtOneThird*rInvVec[5]*(3.0*(dScale*dthole_q1 + bVec[3]) + alphaRVec[5]*X);
+    Vij[2]  += ePermCoef*qiQJ[5];
+    Vji[5]   = ePermCoef*qiQI[2] + eUindCoef*qiUindI[1];
+    VijR[2] += dPermCoef*qiQJ[5];
+    VjiR[5]  = dPermCoef*qiQI[2] + dUindCoef*qiUindI[1];
+    Vij[3]  += ePermCoef*qiQJ[6];
+    Vji[6]   = ePermCoef*qiQI[3] + eUindCoef*qiUindI[2];
+    VijR[3] += dPermCoef*qiQJ[6];
+    VjiR[6]  = dPermCoef*qiQI[3] + dUindCoef*qiUindI[2];
+    Vijd[1] += eUindCoef*qiQJ[5];
+    Vijd[2] += eUindCoef*qiQJ[6];
+    // D-Q and Uind-Q terms (m=1)
+    Vij[5]   = -(ePermCoef*qiQJ[2] + eUindCoef*qiUindJ[1]);
+    Vji[2]  += -(ePermCoef*qiQI[5]);
+    VijR[5]  = -(dPermCoef*qiQJ[2] + dUindCoef*qiUindJ[1]);
+    VjiR[2] += -(dPermCoef*qiQI[5]);
+    Vij[6]   = -(ePermCoef*qiQJ[3] + eUindCoef*qiUindJ[2]);
+    Vji[3]  += -(ePermCoef*qiQI[6]);
+    VijR[6]  = -(dPermCoef*qiQJ[3] + dUindCoef*qiUindJ[2]);
+    VjiR[3] += -(dPermCoef*qiQI[6]);
+    Vjid[1] += -(eUindCoef*qiQI[5]);
+    Vjid[2] += -(eUindCoef*qiQI[6]);
+
+    // Q-Q terms (m=0)
+    ePermCoef = rInvVec[5]*(6.0*(mScale + bVec[4]) + fourOverFortyFive*(-3.0 + 10.0*alphaRVec[2])*alphaRVec[5]*X);
+    dPermCoef = -oneNinth*rInvVec[6]*(135.0*(mScale + bVec[4]) + 4.0*(1.0 + 2.0*alphaRVec[2])*alphaRVec[7]*X);
+    Vij[4]  += ePermCoef*qiQJ[4];
+    Vji[4]  += ePermCoef*qiQI[4];
+    VijR[4] += dPermCoef*qiQJ[4];
+    VjiR[4] += dPermCoef*qiQI[4];
+    // Q-Q terms (m=1)
+    ePermCoef = -fourOverFifteen*rInvVec[5]*(15.0*(mScale + bVec[4]) + alphaRVec[5]*X);
+    dPermCoef = rInvVec[6]*(10.0*(mScale + bVec[4]) + fourThirds*alphaRVec[7]*X);
+    Vij[5]  += ePermCoef*qiQJ[5];
+    Vji[5]  += ePermCoef*qiQI[5];
+    VijR[5] += dPermCoef*qiQJ[5];
+    VjiR[5] += dPermCoef*qiQI[5];
+    Vij[6]  += ePermCoef*qiQJ[6];
+    Vji[6]  += ePermCoef*qiQI[6];
+    VijR[6] += dPermCoef*qiQJ[6];
+    VjiR[6] += dPermCoef*qiQI[6];
+    // Q-Q terms (m=2)
+    ePermCoef = rInvVec[5]*(mScale + bVec[4] - fourOverFifteen*alphaRVec[5]*X);
+    dPermCoef = -2.5*(mScale + bVec[4])*rInvVec[6];
+    Vij[7]  = ePermCoef*qiQJ[7];
+    Vji[7]  = ePermCoef*qiQI[7];
+    VijR[7] = dPermCoef*qiQJ[7];
+    VjiR[7] = dPermCoef*qiQI[7];
+    Vij[8]  = ePermCoef*qiQJ[8];
+    Vji[8]  = ePermCoef*qiQI[8];
+    VijR[8] = dPermCoef*qiQJ[8];
+    VjiR[8] = dPermCoef*qiQI[8];
+
+    // C-O (m=0)
+    ePermCoef = rInvVec[4]*(-mScale - bVec[3] - fourOverFifteen*alphaRVec[5]*X);
+    dPermCoef = 0.5*fourOverFifteen*rInvVec[5]*(15.*(mScale+bVec[3])+2.*(2.*alphaRVec[5]+alphaRVec[7])*X);
+    Vij[0]  += ePermCoef*qiQJ[9];
+    Vji[9]   = ePermCoef*qiQI[0];
+    VijR[0] += dPermCoef*qiQJ[9];
+    VjiR[9]  = dPermCoef*qiQI[0];
+    // O-C (m=0)
+    Vij[9]   = -ePermCoef*qiQJ[0];
+    Vji[0]  -=  ePermCoef*qiQI[9];
+    VijR[9]  = -dPermCoef*qiQJ[0];
+    VjiR[0] -=  dPermCoef*qiQI[9];
+
+    // D-O and Uind-O (m=0)
+    ePermCoef = -4.*rInvVec[5]*(mScale+bVec[4]+twoOverFifteen*alphaRVec[7]*X);
+    eUindCoef = -8.*rInvVec[5]*(dScale*thole_o0+bVec[4]+twoOverFifteen*alphaRVec[7]*X);
+    dPermCoef = 0.5*fourOverFifteen*rInvVec[6]*(75.*(mScale+bVec[4])+4.*(1.+alphaRVec[2])*alphaRVec[7]*X);
+    dUindCoef = 2.0*fourOverFifteen*rInvVec[6]*(75.*(dScale*dthole_o0+bVec[4])+4.*(1.+alphaRVec[2])*alphaRVec[7]*X);
+    Vij[1]  += ePermCoef*qiQJ[9];
+    Vji[9]  += ePermCoef*qiQI[1] + eUindCoef*qiUindI[0];
+    VijR[1] += dPermCoef*qiQJ[9];
+    VjiR[9] += dPermCoef*qiQI[1] + dUindCoef*qiUindI[0];
+    // O-D and O-Uind (m=0)
+    Vij[9]  += ePermCoef*qiQJ[1] + eUindCoef*qiUindJ[0];
+    Vji[1]  += ePermCoef*qiQI[9];
+    VijR[9] += dPermCoef*qiQJ[1] + dUindCoef*qiUindJ[0];
+    VjiR[1] += dPermCoef*qiQI[9];
+    Vijd[0] += eUindCoef*qiQJ[9];
+    Vjid[0] += eUindCoef*qiQI[9];
+    // D-O and O-Uind (m=1)
+    ePermCoef = sqrtSix*(mScale+bVec[4])*rInvVec[5];
+    eUindCoef = 2.0*sqrtSix*(dScale*thole_o1+bVec[4])*rInvVec[5];
+    dPermCoef = -0.5*0.2*sqrtTwoThirds*rInvVec[6]*(75.*(mScale+bVec[4])+8.*alphaRVec[7]*X);
+    dUindCoef = -2.0*0.2*sqrtTwoThirds*rInvVec[6]*(75.*(dScale*dthole_o1+bVec[4])+8.*alphaRVec[7]*X);
+    Vij[2]   += ePermCoef*qiQJ[10];
+    Vji[10]   = ePermCoef*qiQI[2] + eUindCoef*qiUindI[1];
+    VijR[2]  += dPermCoef*qiQJ[10];
+    VjiR[10]  = dPermCoef*qiQI[2] + dUindCoef*qiUindI[1];
+    Vij[3]   += ePermCoef*qiQJ[11];
+    Vji[11]   = ePermCoef*qiQI[3] + eUindCoef*qiUindI[2];
+    VijR[3]  += dPermCoef*qiQJ[11];
+    VjiR[11]  = dPermCoef*qiQI[3] + dUindCoef*qiUindI[2];
+    Vijd[1] += eUindCoef*qiQJ[10];
+    Vijd[2] += eUindCoef*qiQJ[11];
+    // O-D and O-Uind (m=1)
+    Vij[10]   = ePermCoef*qiQJ[2] + eUindCoef*qiUindJ[1];
+    Vji[2]   += ePermCoef*qiQI[10];
+    VijR[10]  = dPermCoef*qiQJ[2] + dUindCoef*qiUindJ[1];
+    VjiR[2]  += dPermCoef*qiQI[10];
+    Vij[11]   = ePermCoef*qiQJ[3] + eUindCoef*qiUindJ[2];
+    Vji[3]   += ePermCoef*qiQI[11];
+    VijR[11]  = dPermCoef*qiQJ[3] + dUindCoef*qiUindJ[2];
+    VjiR[3]  += dPermCoef*qiQI[11];
+    Vjid[1] += eUindCoef*qiQI[10];
+    Vjid[2] += eUindCoef*qiQI[11];
+
+    // Q-O (m=0)
+    ePermCoef = rInvVec[6]*(-10.*(mScale+bVec[4]) - eightOverFortyFive*(3.+2.*alphaRVec[2])*alphaRVec[7]*X);
+    dPermCoef = 0.5*fourOverFortyFive*rInvVec[7]*(675.*(mScale+bVec[4])+2.*(27.+4.*alphaRVec[4])*alphaRVec[7]*X);
+    Vij[4]  += ePermCoef*qiQJ[9];
+    Vji[9]  += ePermCoef*qiQI[4];
+    VijR[4] += dPermCoef*qiQJ[9];
+    VjiR[9] += dPermCoef*qiQI[4];
+    // O-Q (m=0)
+    Vij[9]  -= ePermCoef*qiQJ[4];
+    Vji[4]  -= ePermCoef*qiQI[9];
+    VijR[9] -= dPermCoef*qiQJ[4];
+    VjiR[4] -= dPermCoef*qiQI[9];
+    // Q-O (m=1)
+    ePermCoef = 5.0*sqrtTwo*rInvVec[6]*(mScale+bVec[4] + eightOverSeventyFive*alphaRVec[7]*X);
+    dPermCoef = -0.5*sqrtEightOverFifteen*rInvVec[7]*(225.*(mScale+bVec[4])+8.*(2.+alphaRVec[2])*alphaRVec[7]*X);
+    Vij[5]   += ePermCoef*qiQJ[10];
+    Vji[10]  += ePermCoef*qiQI[5];
+    VijR[5]  += dPermCoef*qiQJ[10];
+    VjiR[10] += dPermCoef*qiQI[5];
+    Vij[6]   += ePermCoef*qiQJ[11];
+    Vji[11]  += ePermCoef*qiQI[6];
+    VijR[6]  += dPermCoef*qiQJ[11];
+    VjiR[11] += dPermCoef*qiQI[6];
+    // O-Q (m=1)
+    Vij[10]  -= ePermCoef*qiQJ[5];
+    Vji[5]   -= ePermCoef*qiQI[10];
+    VijR[10] -= dPermCoef*qiQJ[5];
+    VjiR[5]  -= dPermCoef*qiQI[10];
+    Vij[11]  -= ePermCoef*qiQJ[6];
+    Vji[6]   -= ePermCoef*qiQI[11];
+    VijR[11] -= dPermCoef*qiQJ[6];
+    VjiR[6]  -= dPermCoef*qiQI[11];
+    // Q-O (m=2)
+    ePermCoef = -sqrtFive*(mScale+bVec[4])*rInvVec[6];
+    dPermCoef = 0.5*twoSqrtFiveOverFifteen*rInvVec[7]*(45.*(mScale+bVec[4])+4.*alphaRVec[7]*X);
+    Vij[7]  += ePermCoef*qiQJ[12];
+    Vji[12]  = ePermCoef*qiQI[7];
+    VijR[7] += dPermCoef*qiQJ[12];
+    VjiR[12] = dPermCoef*qiQI[7];
+    Vij[8]  += ePermCoef*qiQJ[13];
+    Vji[13]  = ePermCoef*qiQI[8];
+    VijR[8] += dPermCoef*qiQJ[13];
+    VjiR[13] = dPermCoef*qiQI[8];
+    // O-Q (m=2)
+    Vij[12]  = -ePermCoef*qiQJ[7];
+    Vji[7]  -=  ePermCoef*qiQI[12];
+    VijR[12] = -dPermCoef*qiQJ[7];
+    VjiR[7] -=  dPermCoef*qiQI[12];
+    Vij[13]  = -ePermCoef*qiQJ[8];
+    Vji[8]  -=  ePermCoef*qiQI[13];
+    VijR[13] = -dPermCoef*qiQJ[8];
+    VjiR[8] -=  dPermCoef*qiQI[13];
+
+    // O-O (m=0)
+    ePermCoef = rInvVec[7]*(-20.*(mScale+bVec[5]) - eightOverOneFiveSevenFive*(15.+28.*alphaRVec[2]+28.*alphaRVec[4])*alphaRVec[7]*X);
+    dPermCoef = 0.5*fourOverTwoTwoFive*rInvVec[8]*(7875.*(mScale+bVec[5])+4.*(41. - 4.*alphaRVec[2]+4.*alphaRVec[4])*alphaRVec[9]*X);
+    Vij[9]  += ePermCoef*qiQJ[9];
+    Vji[9]  += ePermCoef*qiQI[9];
+    VijR[9] += dPermCoef*qiQJ[9];
+    VjiR[9] += dPermCoef*qiQI[9];
+    // O-O (m=1)
+    ePermCoef = rInvVec[7]*(15.*(mScale+bVec[5]) + eightOverFiveTwoFive*(-5. + 28.*alphaRVec[2])* alphaRVec[7]*X);
+    dPermCoef = -0.5*twoOverOneFiveZero*rInvVec[8]*(7875.*(mScale+bVec[5]) + 32.*(3. + 2.* alphaRVec[2])*alphaRVec[9]*X);
+    Vij[10]  += ePermCoef*qiQJ[10];
+    Vji[10]  += ePermCoef*qiQI[10];
+    VijR[10] += dPermCoef*qiQJ[10];
+    VjiR[10] += dPermCoef*qiQI[10];
+    Vij[11]  += ePermCoef*qiQJ[11];
+    Vji[11]  += ePermCoef*qiQI[11];
+    VijR[11] += dPermCoef*qiQJ[11];
+    VjiR[11] += dPermCoef*qiQI[11];
+    // O-O (m=2)
+    ePermCoef = rInvVec[7]*(-6.*(mScale+bVec[5]) - eightOverOneHundredFive*alphaRVec[7]*X);
+    dPermCoef = 0.5*rInvVec[8]*(42.*(mScale+bVec[5]) + sixteenOverFifteen*alphaRVec[9]*X);
+    Vij[12]  += ePermCoef*qiQJ[12];
+    Vji[12]  += ePermCoef*qiQI[12];
+    VijR[12] += dPermCoef*qiQJ[12];
+    VjiR[12] += dPermCoef*qiQI[12];
+    Vij[13]  += ePermCoef*qiQJ[13];
+    Vji[13]  += ePermCoef*qiQI[13];
+    VijR[13] += dPermCoef*qiQJ[13];
+    VjiR[13] += dPermCoef*qiQI[13];
+    // O-O (m=3)
+    ePermCoef = rInvVec[7]*((mScale+bVec[5]) - eightOverOneHundredFive*alphaRVec[7]*X);
+    dPermCoef = -0.5*7.*(mScale+bVec[5])*rInvVec[8];
+    Vij[14]  = ePermCoef*qiQJ[14];
+    Vji[14]  = ePermCoef*qiQI[14];
+    VijR[14] = dPermCoef*qiQJ[14];
+    VjiR[14] = dPermCoef*qiQI[14];
+    Vij[15]  = ePermCoef*qiQJ[15];
+    Vji[15]  = ePermCoef*qiQI[15];
+    VijR[15] = dPermCoef*qiQJ[15];
+    VjiR[15] = dPermCoef*qiQI[15];
+
+    // Evaluate the energies, forces and torques due to permanent+induced moments
+    // interacting with just the permanent moments.
+    T energy = 0.5*(qiQI[0]*Vij[0] + qiQJ[0]*Vji[0]);
+    T fIZ = qiQI[0]*VijR[0];
+    T fJZ = qiQJ[0]*VjiR[0];
+    T EIX = 0.0, EIY = 0.0, EIZ = 0.0, EJX = 0.0, EJY = 0.0, EJZ = 0.0;
+    for (int i = 1; i < 16; ++i) {
+        energy += 0.5*(qiQI[i]*Vij[i] + qiQJ[i]*Vji[i]);
+        fIZ += qiQI[i]*VijR[i];
+        fJZ += qiQJ[i]*VjiR[i];
+        EIX += qiQIX[i]*Vij[i];
+        EIY += qiQIY[i]*Vij[i];
+        EIZ += qiQIZ[i]*Vij[i];
+        EJX += qiQJX[i]*Vji[i];
+        EJY += qiQJY[i]*Vji[i];
+        EJZ += qiQJZ[i]*Vji[i];
+    }
+    // Define the torque intermediates for the induced dipoles. These are simply the induced dipole torque
+    // intermediates dotted with the field due to permanent moments only, at each center. We inline the
+    // induced dipole torque intermediates here, for simplicity. N.B. There are no torques on the dipoles
+    // themselves, so we accumulate the torque intermediates into separate variables to allow them to be
+    // used only in the force calculation.
+    //
+    // The torque about the x axis (needed to obtain the y force on the induced dipoles, below)
+    //    qiUindIx[0] = qiQUindI[2];    qiUindIx[1] = 0;    qiUindIx[2] = -qiQUindI[0]
+    T iEIX = qiUindI[2]*Vijd[0] - qiUindI[0]*Vijd[2];
+    T iEJX = qiUindJ[2]*Vjid[0] - qiUindJ[0]*Vjid[2];
+    // The torque about the y axis (needed to obtain the x force on the induced dipoles, below)
+    //    qiUindIy[0] = -qiQUindI[1];   qiUindIy[1] = qiQUindI[0];    qiUindIy[2] = 0
+    T iEIY = qiUindI[0]*Vijd[1] - qiUindI[1]*Vijd[0];
+    T iEJY = qiUindJ[0]*Vjid[1] - qiUindJ[1]*Vjid[0];
+    // The torque about the z axis (needed to obtain the x force on the induced dipoles, below)
+    //    qiUindIz[0] = 0;  qiUindIz[1] = -qiQUindI[2];    qiUindIz[2] = qiQUindI[1]
+    T iEIZ = qiUindI[1]*Vijd[2] - qiUindI[2]*Vijd[1];
+    T iEJZ = qiUindJ[1]*Vjid[2] - qiUindJ[2]*Vjid[1];
+
+    // Add in the induced-induced terms, if needed.
+    if (parameters.mutual) {
+        // Uind-Uind terms (m=0)
+        T eCoef = -2.0*fourThirds*rInvVec[3]*(3.0*(uScale*thole_d0 + bVec[3]) + alphaRVec[3]*X);
+        T dCoef = 2.0*rInvVec[4]*(6.0*(uScale*dthole_d0 + bVec[3]) + 4.0*alphaRVec[5]*X);
+        iEIX += eCoef*qiUindI[2]*qiUindJ[0];
+        iEJX += eCoef*qiUindJ[2]*qiUindI[0];
+        iEIY -= eCoef*qiUindI[1]*qiUindJ[0];
+        iEJY -= eCoef*qiUindJ[1]*qiUindI[0];
+        fIZ  += dCoef*qiUindI[0]*qiUindJ[0];
+        fJZ  += dCoef*qiUindJ[0]*qiUindI[0];
+        // Uind-Uind terms (m=1)
+        eCoef = 4.0*rInvVec[3]*(uScale*thole_d1 + bVec[3] - twoThirds*alphaRVec[3]*X);
+        dCoef = -6.0*rInvVec[4]*(uScale*dthole_d1 + bVec[3]);
+        iEIX -= eCoef*qiUindI[0]*qiUindJ[2];
+        iEJX -= eCoef*qiUindJ[0]*qiUindI[2];
+        iEIY += eCoef*qiUindI[0]*qiUindJ[1];
+        iEJY += eCoef*qiUindJ[0]*qiUindI[1];
+        iEIZ += eCoef*qiUindI[1]*qiUindJ[2];
+        iEJZ += eCoef*qiUindJ[1]*qiUindI[2];
+        fIZ  += dCoef*(qiUindI[1]*qiUindJ[1] + qiUindI[2]*qiUindJ[2]);
+        fJZ  += dCoef*(qiUindJ[1]*qiUindI[1] + qiUindJ[2]*qiUindI[2]);
+    }
+
+    // The quasi-internal frame forces and torques.  Note that the induced torque intermediates are
+    // used in the force expression, but not in the torques; the induced dipoles are isotropic.
+    T qiForce[3] = {rInv*(EIY+EJY+iEIY+iEJY), -rInv*(EIX+EJX+iEIX+iEJX), -(fJZ+fIZ)};
+    T qiTorqueI[3] = {-EIX, -EIY, -EIZ};
+    T qiTorqueJ[3] = {-EJX, -EJY, -EJZ};
+    qiTorqueI[0] -= particleI.anisotropic*iEIX;
+    qiTorqueI[1] -= particleI.anisotropic*iEIY;
+    qiTorqueI[2] -= particleI.anisotropic*iEIZ;
+    qiTorqueJ[0] -= particleJ.anisotropic*iEJX;
+    qiTorqueJ[1] -= particleJ.anisotropic*iEJY;
+    qiTorqueJ[2] -= particleJ.anisotropic*iEJZ;
+
+    // Rotate the forces and torques back to the lab frame
+    for (int ii = 0; ii < 3; ii++) {
+        T forceVal = 0.0;
+        T torqueIVal = 0.0;
+        T torqueJVal = 0.0;
+        for (int jj = 0; jj < 3; jj++) {
+            forceVal   += forceRotationMatrix[ii][jj] * qiForce[jj];
+            torqueIVal += forceRotationMatrix[ii][jj] * qiTorqueI[jj];
+            torqueJVal += forceRotationMatrix[ii][jj] * qiTorqueJ[jj];
+        }
+        force[ii]   = forceVal;
+        torqueI[ii] = torqueIVal;
+        torqueJ[ii] = torqueJVal;
+    }
+    return energy;
+}
+
+} // namespace MPIDQIPairKernel
+} // namespace OpenMM
+
+#endif /*MPID_OPENMM_CPU_QI_PAIR_KERNEL_H_*/
@@ -0,0 +1,486 @@
+#ifndef MPID_OPENMM_CPU_VECTORIZE_H_
+#define MPID_OPENMM_CPU_VECTORIZE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                              OpenMMMPID                                  *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include <cmath>
+#include <vector>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// The direct space loop is compiled once for every instruction set the CPU platform supports (see
+// MPIDCpuPmeForceAvx2.cpp and MPIDCpuPmeForceAvx512.cpp), and each translation unit sees different
+// definitions of the vector types.  They are put in a namespace named after the instruction set so
+// those definitions never meet in one program.
+
+#if defined(__AVX512F__)
+#define MPID_CPU_SIMD_NAMESPACE MPIDCpuAvx512
+#elif defined(__AVX2__)
+#define MPID_CPU_SIMD_NAMESPACE MPIDCpuAvx2
+#elif defined(__AVX__)
+#define MPID_CPU_SIMD_NAMESPACE MPIDCpuAvx
+#else
+#define MPID_CPU_SIMD_NAMESPACE MPIDCpuScalar
+#endif
+
+namespace MPID_CPU_SIMD_NAMESPACE {
+
+/**
+ * A per-lane mask, as produced by comparing two dvec4s.
+ */
+class dmask4 {
+public:
+#ifdef __AVX__
+    dmask4(__m256d val) : val(val) {}
+    __m256d val;
+#else
+    dmask4() {}
+    bool val[4];
+#endif
+};
+
+/**
+ * Four double precision values, one per SIMD lane, with the operations needed by the QI pair kernel.
+ * When compiled with AVX this wraps a 256 bit register; otherwise it falls back to plain loops that
+ * the compiler is free to vectorize.  Transcendental functions are evaluated lane by lane with the
+ * standard library, so each lane reproduces the scalar result.
+ */
+class dvec4 {
+public:
+    static const int numLanes = 4;
+    dvec4() {}
+#ifdef __AVX__
+    dvec4(double v) : val(_mm256_set1_pd(v)) {}
+    dvec4(double v1, double v2, double v3, double v4) : val(_mm256_set_pd(v4, v3, v2, v1)) {}
+    dvec4(__m256d v) : val(v) {}
+    static dvec4 load(const double* v) {
+        return dvec4(_mm256_loadu_pd(v));
+    }
+    void store(double* v) const {
+        _mm256_storeu_pd(v, val);
+    }
+    __m256d val;
+#else
+    dvec4(double v) {
+        for (int i = 0; i < 4; i++)
+            val[i] = v;
+    }
+    dvec4(double v1, double v2, double v3, double v4) {
+        val[0] = v1;
+        val[1] = v2;
+        val[2] = v3;
+        val[3] = v4;
+    }
+    static dvec4 load(const double* v) {
+        return dvec4(v[0], v[1], v[2], v[3]);
+    }
+    void store(double* v) const {
+        for (int i = 0; i < 4; i++)
+            v[i] = val[i];
+    }
+    double val[4];
+#endif
+    dvec4& operator+=(const dvec4& other);
+    dvec4& operator-=(const dvec4& other);
+    dvec4& operator*=(const dvec4& other);
+    dvec4& operator/=(const dvec4& other);
+};
+
+#ifdef __AVX__
+
+inline dvec4 operator+(const dvec4& a, const dvec4& b) {
+    return _mm256_add_pd(a.val, b.val);
+}
+
+inline dvec4 operator-(const dvec4& a, const dvec4& b) {
+    return _mm256_sub_pd(a.val, b.val);
+}
+
+inline dvec4 operator*(const dvec4& a, const dvec4& b) {
+    return _mm256_mul_pd(a.val, b.val);
+}
+
+inline dvec4 operator/(const dvec4& a, const dvec4& b) {
+    return _mm256_div_pd(a.val, b.val);
+}
+
+inline dvec4 operator-(const dvec4& a) {
+    return _mm256_xor_pd(a.val, _mm256_set1_pd(-0.0));
+}
+
+inline dmask4 operator==(const dvec4& a, const dvec4& b) {
+    return _mm256_cmp_pd(a.val, b.val, _CMP_EQ_OQ);
+}
+
+inline dmask4 operator!=(const dvec4& a, const dvec4& b) {
+    return _mm256_cmp_pd(a.val, b.val, _CMP_NEQ_UQ);
+}
+
+inline dmask4 operator<(const dvec4& a, const dvec4& b) {
+    return _mm256_cmp_pd(a.val, b.val, _CMP_LT_OQ);
+}
+
+inline dmask4 operator>(const dvec4& a, const dvec4& b) {
+    return _mm256_cmp_pd(a.val, b.val, _CMP_GT_OQ);
+}
+
+inline dmask4 operator<=(const dvec4& a, const dvec4& b) {
+    return _mm256_cmp_pd(a.val, b.val, _CMP_LE_OQ);
+}
+
+inline dmask4 operator>=(const dvec4& a, const dvec4& b) {
+    return _mm256_cmp_pd(a.val, b.val, _CMP_GE_OQ);
+}
+
+inline dmask4 operator&(const dmask4& a, const dmask4& b) {
+    return _mm256_and_pd(a.val, b.val);
+}
+
+inline dmask4 operator|(const dmask4& a, const dmask4& b) {
+    return _mm256_or_pd(a.val, b.val);
+}
+
+inline bool any(const dmask4& mask) {
+    return _mm256_movemask_pd(mask.val) != 0;
+}
+
+/**
+ * Select b in the lanes where mask is set and a in the others.
+ */
+inline dvec4 blend(const dvec4& a, const dvec4& b, const dmask4& mask) {
+    return _mm256_blendv_pd(a.val, b.val, mask.val);
+}
+
+inline dvec4 sqrt(const dvec4& v) {
+    return _mm256_sqrt_pd(v.val);
+}
+
+inline dvec4 fabs(const dvec4& v) {
+    return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v.val);
+}
+
+inline dvec4 floor(const dvec4& v) {
+    return _mm256_floor_pd(v.val);
+}
+
+#else
+
+#define MPID_DVEC4_BINARY_OP(op) \
+    inline dvec4 operator op(const dvec4& a, const dvec4& b) { \
+        dvec4 result; \
+        for (int i = 0; i < 4; i++) \
+            result.val[i] = a.val[i] op b.val[i]; \
+        return result; \
+    }
+MPID_DVEC4_BINARY_OP(+)
+MPID_DVEC4_BINARY_OP(-)
+MPID_DVEC4_BINARY_OP(*)
+MPID_DVEC4_BINARY_OP(/)
+#undef MPID_DVEC4_BINARY_OP
+
+#define MPID_DVEC4_COMPARISON(op) \
+    inline dmask4 operator op(const dvec4& a, const dvec4& b) { \
+        dmask4 result; \
+        for (int i = 0; i < 4; i++) \
+            result.val[i] = (a.val[i] op b.val[i]); \
+        return result; \
+    }
+MPID_DVEC4_COMPARISON(==)
+MPID_DVEC4_COMPARISON(!=)
+MPID_DVEC4_COMPARISON(<)
+MPID_DVEC4_COMPARISON(>)
+MPID_DVEC4_COMPARISON(<=)
+MPID_DVEC4_COMPARISON(>=)
+#undef MPID_DVEC4_COMPARISON
+
+inline dvec4 operator-(const dvec4& a) {
+    dvec4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = -a.val[i];
+    return result;
+}
+
+inline dmask4 operator&(const dmask4& a, const dmask4& b) {
+    dmask4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = a.val[i] && b.val[i];
+    return result;
+}
+
+inline dmask4 operator|(const dmask4& a, const dmask4& b) {
+    dmask4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = a.val[i] || b.val[i];
+    return result;
+}
+
+inline bool any(const dmask4& mask) {
+    return mask.val[0] || mask.val[1] || mask.val[2] || mask.val[3];
+}
+
+/**
+ * Select b in the lanes where mask is set and a in the others.
+ */
+inline dvec4 blend(const dvec4& a, const dvec4& b, const dmask4& mask) {
+    dvec4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = (mask.val[i] ? b.val[i] : a.val[i]);
+    return result;
+}
+
+inline dvec4 sqrt(const dvec4& v) {
+    dvec4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = std::sqrt(v.val[i]);
+    return result;
+}
+
+inline dvec4 fabs(const dvec4& v) {
+    dvec4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = std::fabs(v.val[i]);
+    return result;
+}
+
+inline dvec4 floor(const dvec4& v) {
+    dvec4 result;
+    for (int i = 0; i < 4; i++)
+        result.val[i] = std::floor(v.val[i]);
+    return result;
+}
+
+#endif
+
+inline dvec4& dvec4::operator+=(const dvec4& other) {
+    *this = *this + other;
+    return *this;
+}
+
+inline dvec4& dvec4::operator-=(const dvec4& other) {
+    *this = *this - other;
+    return *this;
+}
+
+inline dvec4& dvec4::operator*=(const dvec4& other) {
+    *this = *this * other;
+    return *this;
+}
+
+inline dvec4& dvec4::operator/=(const dvec4& other) {
+    *this = *this / other;
+    return *this;
+}
+
+inline dvec4 exp(const dvec4& v) {
+    double values[4];
+    v.store(values);
+    for (int i = 0; i < 4; i++)
+        values[i] = std::exp(values[i]);
+    return dvec4::load(values);
+}
+
+inline dvec4 erf(const dvec4& v) {
+    double values[4];
+    v.store(values);
+    for (int i = 0; i < 4; i++)
+        values[i] = std::erf(values[i]);
+    return dvec4::load(values);
+}
+
+#ifdef __AVX512F__
+
+/**
+ * A per-lane mask, as produced by comparing two dvec8s.
+ */
+class dmask8 {
+public:
+    dmask8(__mmask8 val) : val(val) {}
+    __mmask8 val;
+};
+
+/**
+ * Eight double precision values in a 512 bit register, with the same operations as dvec4.  Only
+ * AVX-512F instructions are used.
+ */
+class dvec8 {
+public:
+    static const int numLanes = 8;
+    dvec8() {}
+    dvec8(double v) : val(_mm512_set1_pd(v)) {}
+    dvec8(__m512d v) : val(v) {}
+    static dvec8 load(const double* v) {
+        return dvec8(_mm512_loadu_pd(v));
+    }
+    void store(double* v) const {
+        _mm512_storeu_pd(v, val);
+    }
+    dvec8& operator+=(const dvec8& other);
+    dvec8& operator-=(const dvec8& other);
+    dvec8& operator*=(const dvec8& other);
+    dvec8& operator/=(const dvec8& other);
+    __m512d val;
+};
+
+inline dvec8 operator+(const dvec8& a, const dvec8& b) {
+    return _mm512_add_pd(a.val, b.val);
+}
+
+inline dvec8 operator-(const dvec8& a, const dvec8& b) {
+    return _mm512_sub_pd(a.val, b.val);
+}
+
+inline dvec8 operator*(const dvec8& a, const dvec8& b) {
+    return _mm512_mul_pd(a.val, b.val);
+}
+
+inline dvec8 operator/(const dvec8& a, const dvec8& b) {
+    return _mm512_div_pd(a.val, b.val);
+}
+
+inline dvec8 operator-(const dvec8& a) {
+    return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a.val), _mm512_castpd_si512(_mm512_set1_pd(-0.0))));
+}
+
+inline dmask8 operator==(const dvec8& a, const dvec8& b) {
+    return _mm512_cmp_pd_mask(a.val, b.val, _CMP_EQ_OQ);
+}
+
+inline dmask8 operator!=(const dvec8& a, const dvec8& b) {
+    return _mm512_cmp_pd_mask(a.val, b.val, _CMP_NEQ_UQ);
+}
+
+inline dmask8 operator<(const dvec8& a, const dvec8& b) {
+    return _mm512_cmp_pd_mask(a.val, b.val, _CMP_LT_OQ);
+}
+
+inline dmask8 operator>(const dvec8& a, const dvec8& b) {
+    return _mm512_cmp_pd_mask(a.val, b.val, _CMP_GT_OQ);
+}
+
+inline dmask8 operator<=(const dvec8& a, const dvec8& b) {
+    return _mm512_cmp_pd_mask(a.val, b.val, _CMP_LE_OQ);
+}
+
+inline dmask8 operator>=(const dvec8& a, const dvec8& b) {
+    return _mm512_cmp_pd_mask(a.val, b.val, _CMP_GE_OQ);
+}
+
+inline dmask8 operator&(const dmask8& a, const dmask8& b) {
+    return (__mmask8) (a.val & b.val);
+}
+
+inline dmask8 operator|(const dmask8& a, const dmask8& b) {
+    return (__mmask8) (a.val | b.val);
+}
+
+inline bool any(const dmask8& mask) {
+    return mask.val != 0;
+}
+
+/**
+ * Select b in the lanes where mask is set and a in the others.
+ */
+inline dvec8 blend(const dvec8& a, const dvec8& b, const dmask8& mask) {
+    return _mm512_mask_blend_pd(mask.val, a.val, b.val);
+}
+
+inline dvec8 sqrt(const dvec8& v) {
+    return _mm512_sqrt_pd(v.val);
+}
+
+inline dvec8 fabs(const dvec8& v) {
+    return _mm512_abs_pd(v.val);
+}
+
+inline dvec8 floor(const dvec8& v) {
+    return _mm512_roundscale_pd(v.val, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+inline dvec8& dvec8::operator+=(const dvec8& other) {
+    *this = *this + other;
+    return *this;
+}
+
+inline dvec8& dvec8::operator-=(const dvec8& other) {
+    *this = *this - other;
+    return *this;
+}
+
+inline dvec8& dvec8::operator*=(const dvec8& other) {
+    *this = *this * other;
+    return *this;
+}
+
+inline dvec8& dvec8::operator/=(const dvec8& other) {
+    *this = *this / other;
+    return *this;
+}
+
+inline dvec8 exp(const dvec8& v) {
+    double values[8];
+    v.store(values);
+    for (int i = 0; i < 8; i++)
+        values[i] = std::exp(values[i]);
+    return dvec8::load(values);
+}
+
+inline dvec8 erf(const dvec8& v) {
+    double values[8];
+    v.store(values);
+    for (int i = 0; i < 8; i++)
+        values[i] = std::erf(values[i]);
+    return dvec8::load(values);
+}
+
+#endif
+
+/**
+ * The widest vector type available in this translation unit, which the direct space loop uses.
+ */
+#ifdef __AVX512F__
+typedef dvec8 dvec;
+typedef dmask8 dmask;
+#else
+typedef dvec4 dvec;
+typedef dmask4 dmask;
+#endif
+
+/**
+ * Load values[index[0]], values[index[1]], ... into the lanes of a vector.
+ */
+template <class VEC>
+inline VEC gather(const std::vector<double>& values, const unsigned int* index) {
+    double lanes[VEC::numLanes];
+    for (int lane = 0; lane < VEC::numLanes; lane++)
+        lanes[lane] = values[index[lane]];
+    return VEC::load(lanes);
+}
+
+} // namespace MPID_CPU_SIMD_NAMESPACE
+
+#endif /*MPID_OPENMM_CPU_VECTORIZE_H_*/
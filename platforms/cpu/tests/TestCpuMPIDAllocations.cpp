@@ -0,0 +1,199 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMMMPID                             *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2015 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,  *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests that the CPU implementation of MPIDForce makes a fixed number of heap allocations per
+ * force evaluation when its direct space loops are split between threads.  It replaces the global
+ * operator new, so it is kept out of TestCpuMPIDForce.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "OpenMMMPID.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "openmm/MPIDForce.h"
+#include "openmm/Vec3.h"
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <new>
+#include <vector>
+#include <stdlib.h>
+
+using namespace OpenMM;
+using namespace std;
+
+extern "C" OPENMM_EXPORT void registerMPIDReferenceKernelFactories();
+extern "C" OPENMM_EXPORT void registerMPIDCpuKernelFactories();
+
+// Count every heap allocation made by the process.
+
+static std::atomic<long long> allocationCount(0);
+
+void* operator new(std::size_t size) {
+    allocationCount++;
+    void* pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == NULL)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    free(pointer);
+}
+
+/**
+ * Put numPerSide^3 waters, with the parameters of the water in make_waterbox, on a cubic lattice and set
+ * the periodic box to the lattice; the box is only used by periodic nonbonded methods.  The molecules
+ * are turned by different amounts so the induced dipoles are not all the same.  Every test that uses
+ * this lattice has an identical copy of this function.
+ */
+void make_water_lattice(int numPerSide, double spacing, MPIDForce* forceField, vector<Vec3>& positions, System& system) {
+    const vector<double> od = {0.0, 0.0, 0.00755612136146};
+    const vector<double> hd = {-0.00204209484795, 0.0, -0.00307875299958};
+    const vector<double> oq = {0.000354030721139, 0.0, -0.000390257077096, 0.0, 0.0,  3.62263559571e-05};
+    const vector<double> hq = {-3.42848248983e-05, 0.0, -0.000100240875193, -1.89485963908e-06, 0.0,  0.000134525700091};
+    const vector<double> oo = { 0, 0, 0, 0, -6.285758282686837e-07, 0, -9.452653225954594e-08, 0, 0, 7.231018665791977e-07};
+    const vector<double> ho = { -2.405600937552608e-07, 0, -6.415084018183151e-08, 0, -1.152422607026746e-06,
+                                0,  -2.558537436767218e-06, 3.047102424084479e-07, 0, 3.710960043793964e-06 };
+    const vector<double> opol = {0.000837, 0.000837, 0.000837};
+    const vector<double> hpol = {0.000496, 0.000496, 0.000496};
+    const double bond = 0.09572;
+    const double halfAngle = 0.5*104.52*M_PI/180.0;
+
+    positions.clear();
+    int molecule = 0;
+    for (int i = 0; i < numPerSide; i++)
+        for (int j = 0; j < numPerSide; j++)
+            for (int k = 0; k < numPerSide; k++, molecule++) {
+                int o = 3*molecule;
+                double turn = 0.7*molecule;
+                double tilt = 0.3*(molecule%5);
+                Vec3 axis(cos(turn)*cos(tilt), sin(turn)*cos(tilt), sin(tilt));
+                Vec3 side(-sin(turn), cos(turn), 0.0);
+                Vec3 center((i+0.5)*spacing, (j+0.5)*spacing, (k+0.5)*spacing);
+                positions.push_back(center);
+                positions.push_back(center + (axis*cos(halfAngle) + side*sin(halfAngle))*bond);
+                positions.push_back(center + (axis*cos(halfAngle) - side*sin(halfAngle))*bond);
+                forceField->addMultipole(-0.51966, od, oq, oo, MPIDForce::Bisector, o+1, o+2, -1, 0.39, opol);
+                forceField->addMultipole(0.25983, hd, hq, ho, MPIDForce::ZThenX, o, o+2, -1, 0.39, hpol);
+                forceField->addMultipole(0.25983, hd, hq, ho, MPIDForce::ZThenX, o, o+1, -1, 0.39, hpol);
+                system.addParticle(15.999);
+                system.addParticle(1.008);
+                system.addParticle(1.008);
+                for (int atom = o; atom < o+3; atom++)
+                    forceField->setCovalentMap(atom, MPIDForce::PolarizationCovalent11, {o, o+1, o+2});
+                forceField->setCovalentMap(o, MPIDForce::Covalent12, {o+1, o+2});
+                forceField->setCovalentMap(o+1, MPIDForce::Covalent12, {o});
+                forceField->setCovalentMap(o+2, MPIDForce::Covalent12, {o});
+                forceField->setCovalentMap(o+1, MPIDForce::Covalent13, {o+2});
+                forceField->setCovalentMap(o+2, MPIDForce::Covalent13, {o+1});
+            }
+    double edge = numPerSide*spacing;
+    system.setDefaultPeriodicBoxVectors(Vec3(edge, 0, 0), Vec3(0, edge, 0), Vec3(0, 0, edge));
+}
+
+/**
+ * Move every particle of the lattice a little, differently for each step, so the induced dipoles
+ * have to be solved for again, and count the allocations made while computing the forces.  The
+ * moves are much smaller than the neighbor list skin, so the list is only built once.
+ */
+long long countStepAllocations(Context& context, const vector<Vec3>& positions, int step) {
+    vector<Vec3> moved(positions);
+    for (int i = 0; i < (int) moved.size(); i++)
+        moved[i] += Vec3(sin(1.3*i+step), cos(0.7*i+2*step), sin(0.9*i-step))*0.002;
+    context.setPositions(moved);
+    long long start = allocationCount;
+    {
+        State state = context.getState(State::Forces | State::Energy);
+    }
+    return allocationCount-start;
+}
+
+void testPMEAllocationsIndependentOfIterations() {
+    // Evaluate PME Mutual on four threads with a loose and a tight convergence target.  The tight
+    // target needs several more solver iterations per step, each of which fills and sums the per-thread
+    // induced fields and goes through the grid and the FFT, but once the predictor history is full
+    // both make the same, fixed number of allocations per step.
+    const int numWarmupSteps = 10;
+    const int numSteps = 4;
+    const double epsilons[2] = {1e-2, 1e-8};
+    vector<long long> allocations[2];
+    for (int i = 0; i < 2; ++i) {
+        MPIDForce* forceField = new MPIDForce();
+        vector<Vec3> positions;
+        System system;
+        make_water_lattice(4, 0.31, forceField, positions, system);
+        forceField->setNonbondedMethod(MPIDForce::PME);
+        forceField->setCutoffDistance(0.5);
+        forceField->setPMEParameters(6.0, 24, 24, 24);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedTargetEpsilon(epsilons[i]);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        map<string, string> properties;
+        properties["Threads"] = "4";
+        Context context(system, integrator, Platform::getPlatformByName("CPU"), properties);
+        for (int step = 0; step < numWarmupSteps; step++)
+            countStepAllocations(context, positions, step);
+        for (int step = numWarmupSteps; step < numWarmupSteps+numSteps; step++)
+            allocations[i].push_back(countStepAllocations(context, positions, step));
+    }
+    for (int step = 0; step < numSteps; step++) {
+        ASSERT_EQUAL(allocations[0][0], allocations[0][step]);
+        ASSERT_EQUAL(allocations[0][step], allocations[1][step]);
+    }
+}
+
+int main(int numberOfArguments, char* argv[]) {
+
+    try {
+        std::cout << "TestCpuMPIDAllocations running test..." << std::endl;
+        registerMPIDReferenceKernelFactories();
+        registerMPIDCpuKernelFactories();
+
+        testPMEAllocationsIndependentOfIterations();
+    }
+    catch(const std::exception& e) {
+        std::cout << "exception: " << e.what() << std::endl;
+        std::cout << "FAIL - ERROR.  Test failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Done" << std::endl;
+    return 0;
+}
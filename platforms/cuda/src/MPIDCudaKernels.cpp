@@ -31,7 +31,6 @@
 #include "CudaMPIDKernelSources.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/MPIDForceImpl.h"
-#include "openmm/internal/NonbondedForceImpl.h"
 #include "CudaBondedUtilities.h"
 #include "CudaFFT3D.h"
 #include "CudaForceInfo.h"
@@ -297,6 +296,20 @@ void CudaCalcMPIDForceKernel::initialize(const System& system, const MPIDForce&
     // Create workspace arrays.
 
     polarizationType = force.getPolarizationType();
+    if (polarizationType == MPIDForce::TCG1 || polarizationType == MPIDForce::TCG2)
+        throw OpenMMException("MPIDForce: the CUDA platform does not support TCG polarization");
+    if (polarizationType == MPIDForce::Mutual && force.getMutualInducedSolver() != MPIDForce::DIIS)
+        throw OpenMMException("MPIDForce: the CUDA platform only supports the DIIS mutual induced solver");
+    if (force.getNonbondedMethod() == MPIDForce::Ewald)
+        throw OpenMMException("MPIDForce: the CUDA platform does not support Ewald summation; use PME");
+    if (force.getNonbondedMethod() == MPIDForce::MSM)
+        throw OpenMMException("MPIDForce: the CUDA platform does not support multilevel summation; use PME");
+    if (force.getNonbondedMethod() == MPIDForce::FMM)
+        throw OpenMMException("MPIDForce: the CUDA platform does not support the fast multipole method; use NoCutoff");
+    if (force.getNonbondedMethod() == MPIDForce::PME && (force.getPmeOptimalInfluenceFunction() || force.getPmeInterlacedGrids()))
+        throw OpenMMException("MPIDForce: the CUDA platform does not support the optimal PME influence function or interlaced grids");
+    if (force.getNonbondedMethod() == MPIDForce::PME && force.getPmeSlabCorrection())
+        throw OpenMMException("MPIDForce: the CUDA platform does not support the PME slab correction");
     int elementSize = (cu.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
     labFramePolarizabilities = new CudaArray(cu, 6*paddedNumAtoms, elementSize, "labFramePolarizabilities");
     labFrameDipoles = new CudaArray(cu, 3*paddedNumAtoms, elementSize, "labFrameDipoles");
@@ -438,11 +451,10 @@ void CudaCalcMPIDForceKernel::initialize(const System& system, const MPIDForce&
     if (usePME) {
         int nx, ny, nz;
         force.getPMEParameters(alpha, nx, ny, nz);
+        pmeOrder = MPIDForceImpl::getPmeBSplineOrder(force);
+        cutoff = force.getCutoffDistance();
         if (nx == 0 || alpha == 0.0) {
-            NonbondedForce nb;
-            nb.setEwaldErrorTolerance(force.getEwaldErrorTolerance());
-            nb.setCutoffDistance(force.getCutoffDistance());
-            NonbondedForceImpl::calcPMEParameters(system, nb, alpha, gridSizeX, gridSizeY, gridSizeZ, false);
+            MPIDForceImpl::calcPMEParameters(system, force, force.getCutoffDistance(), alpha, gridSizeX, gridSizeY, gridSizeZ);
             gridSizeX = CudaFFT3D::findLegalDimension(gridSizeX);
             gridSizeY = CudaFFT3D::findLegalDimension(gridSizeY);
             gridSizeZ = CudaFFT3D::findLegalDimension(gridSizeZ);
@@ -504,7 +516,7 @@ void CudaCalcMPIDForceKernel::initialize(const System& system, const MPIDForce&
 
         map<string, string> pmeDefines;
         pmeDefines["EWALD_ALPHA"] = cu.doubleToString(alpha);
-        pmeDefines["PME_ORDER"] = cu.intToString(PmeOrder);
+        pmeDefines["PME_ORDER"] = cu.intToString(pmeOrder);
         pmeDefines["NUM_ATOMS"] = cu.intToString(numMultipoles);
         pmeDefines["PADDED_NUM_ATOMS"] = cu.intToString(cu.getPaddedNumAtoms());
         pmeDefines["EPSILON_FACTOR"] = cu.doubleToString(138.9354558456);
@@ -559,11 +571,11 @@ void CudaCalcMPIDForceKernel::initialize(const System& system, const MPIDForce&
 
         // Initialize the b-spline moduli.
 
-        double data[PmeOrder];
+        vector<double> data(pmeOrder);
         double x = 0.0;
         data[0] = 1.0 - x;
         data[1] = x;
-        for (int i = 2; i < PmeOrder; i++) {
+        for (int i = 2; i < pmeOrder; i++) {
             double denom = 1.0/i;
             data[i] = x*data[i-1]*denom;
             for (int j = 1; j < i; j++)
@@ -572,7 +584,7 @@ void CudaCalcMPIDForceKernel::initialize(const System& system, const MPIDForce&
         }
         int maxSize = max(max(gridSizeX, gridSizeY), gridSizeZ);
         vector<double> bsplines_data(maxSize+1, 0.0);
-        for (int i = 2; i <= PmeOrder+1; i++)
+        for (int i = 2; i <= pmeOrder+1; i++)
             bsplines_data[i] = data[i-2];
         for (int dim = 0; dim < 3; dim++) {
             int ndata = (dim == 0 ? gridSizeX : dim == 1 ? gridSizeY : gridSizeZ);
@@ -619,13 +631,13 @@ void CudaCalcMPIDForceKernel::initialize(const System& system, const MPIDForce&
                     factor = M_PI*k/ndata;
                     for (int j = 1; j <= jcut; j++) {
                         double arg = factor/(factor+M_PI*j);
-                        sum1 += pow(arg, PmeOrder);
-                        sum2 += pow(arg, 2*PmeOrder);
+                        sum1 += pow(arg, pmeOrder);
+                        sum2 += pow(arg, 2*pmeOrder);
                     }
                     for (int j = 1; j <= jcut; j++) {
                         double arg = factor/(factor-M_PI*j);
-                        sum1 += pow(arg, PmeOrder);
-                        sum2 += pow(arg, 2*PmeOrder);
+                        sum1 += pow(arg, pmeOrder);
+                        sum2 += pow(arg, 2*pmeOrder);
                     }
                     zeta = sum2/sum1;
                 }
@@ -1101,6 +1113,50 @@ void CudaCalcMPIDForceKernel::getLabFramePermanentDipoles(ContextImpl& context,
     }
 }
 
+void CudaCalcMPIDForceKernel::getLabFramePermanentMultipoles(ContextImpl& context, vector<Vec3>& dipoles,
+                                                             vector<double>& quadrupoles, vector<double>& octopoles) {
+    getLabFramePermanentDipoles(context, dipoles);
+    int numParticles = cu.getNumAtoms();
+    quadrupoles.resize(6*numParticles);
+    octopoles.resize(10*numParticles);
+    const vector<int>& order = cu.getAtomIndex();
+
+    // The device arrays hold the traceless moments without their dependent components:
+    // five for the quadrupole (XX XY XZ YY YZ) and seven for the octopole (XXX XXY XXZ XYY XYZ YYY YYZ).
+
+    vector<double> q, o;
+    if (cu.getUseDoublePrecision()) {
+        labFrameQuadrupoles->download(q);
+        labFrameOctopoles->download(o);
+    }
+    else {
+        vector<float> qf, of;
+        labFrameQuadrupoles->download(qf);
+        labFrameOctopoles->download(of);
+        q.assign(qf.begin(), qf.end());
+        o.assign(of.begin(), of.end());
+    }
+    for (int i = 0; i < numParticles; i++) {
+        double* quadrupole = &quadrupoles[6*order[i]];
+        quadrupole[0] = q[5*i];
+        quadrupole[1] = q[5*i+1];
+        quadrupole[2] = q[5*i+3];
+        quadrupole[3] = q[5*i+2];
+        quadrupole[4] = q[5*i+4];
+        quadrupole[5] = -q[5*i]-q[5*i+3];
+        double* octopole = &octopoles[10*order[i]];
+        octopole[0] = o[7*i];
+        octopole[1] = o[7*i+1];
+        octopole[2] = o[7*i+3];
+        octopole[3] = o[7*i+5];
+        octopole[4] = o[7*i+2];
+        octopole[5] = o[7*i+4];
+        octopole[6] = o[7*i+6];
+        octopole[7] = -o[7*i]-o[7*i+3];
+        octopole[8] = -o[7*i+1]-o[7*i+5];
+        octopole[9] = -o[7*i+2]-o[7*i+6];
+    }
+}
 
 void CudaCalcMPIDForceKernel::getInducedDipoles(ContextImpl& context, vector<Vec3>& dipoles) {
     ensureMultipolesValid(context);
@@ -1317,6 +1373,41 @@ void CudaCalcMPIDForceKernel::computeSystemMultipoleMoments(ContextImpl& context
 }
 
 
+void CudaCalcMPIDForceKernel::getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                                              const std::function<void (int, const vector<double>&, const vector<Vec3>&)>& processPlane) {
+    if (includeField)
+        throw OpenMMException("MPIDForce: the CUDA platform does not compute the electric field on a volume");
+
+    // one plane of points at a time through the point kernel
+
+    vector<Vec3> points(numPoints[1]*numPoints[2]);
+    vector<double> potential;
+    vector<Vec3> field;
+    for (int i = 0; i < numPoints[0]; i++) {
+        for (int j = 0; j < numPoints[1]; j++)
+            for (int k = 0; k < numPoints[2]; k++)
+                points[j*numPoints[2]+k] = origin + axes[0]*i + axes[1]*j + axes[2]*k;
+        getElectrostaticPotential(context, points, potential);
+        processPlane(i, potential, field);
+    }
+}
+
+void CudaCalcMPIDForceKernel::getElectricFields(ContextImpl& context, vector<Vec3>& fields) {
+    throw OpenMMException("MPIDForce: the CUDA platform does not compute electric fields or field gradients");
+}
+
+void CudaCalcMPIDForceKernel::getElectricFieldGradients(ContextImpl& context, vector<double>& gradients) {
+    throw OpenMMException("MPIDForce: the CUDA platform does not compute electric fields or field gradients");
+}
+
+void CudaCalcMPIDForceKernel::getElectricFieldsAtPoints(ContextImpl& context, const vector<Vec3>& points, vector<Vec3>& fields) {
+    throw OpenMMException("MPIDForce: the CUDA platform does not compute electric fields or field gradients");
+}
+
+void CudaCalcMPIDForceKernel::getElectricFieldGradientsAtPoints(ContextImpl& context, const vector<Vec3>& points, vector<double>& gradients) {
+    throw OpenMMException("MPIDForce: the CUDA platform does not compute electric fields or field gradients");
+}
+
 void CudaCalcMPIDForceKernel::getSystemMultipoleMoments(ContextImpl& context, vector<double>& outputMultipoleMoments) {
     ensureMultipolesValid(context);
     if (cu.getUseDoublePrecision())
@@ -1333,6 +1424,8 @@ void CudaCalcMPIDForceKernel::copyParametersToContext(ContextImpl& context, cons
     cu.setAsCurrent();
     if (force.getNumMultipoles() != cu.getNumAtoms())
         throw OpenMMException("updateParametersInContext: The number of multipoles has changed");
+    if (usePME)
+        MPIDForceImpl::checkPmeBSplineOrder(pmeOrder, MPIDForceImpl::getMaxMultipoleRank(force));
     
     // Record the per-multipole parameters.
     
@@ -1409,12 +1502,18 @@ void CudaCalcMPIDForceKernel::copyParametersToContext(ContextImpl& context, cons
     multipolesAreValid = false;
 }
 
-void CudaCalcMPIDForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
+void CudaCalcMPIDForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const {
     if (!usePME)
         throw OpenMMException("getPMEParametersInContext: This Context is not using PME");
     alpha = this->alpha;
     nx = gridSizeX;
     ny = gridSizeY;
     nz = gridSizeZ;
+    cutoff = this->cutoff;
+    order = pmeOrder;
+}
+
+void CudaCalcMPIDForceKernel::getFMMParameters(int& expansionOrder, int& treeDepth) const {
+    throw OpenMMException("getFMMParametersInContext: This Context is not using FMM");
 }
 
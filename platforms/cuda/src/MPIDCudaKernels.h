@@ -67,6 +67,16 @@ public:
      * @param dipoles    the induced dipole moment of particle i is stored into the i'th element
      */
     void getLabFramePermanentDipoles(ContextImpl& context, std::vector<Vec3>& dipoles);
+    /**
+     * Get the LabFrame multipole moments of all particles.
+     * 
+     * @param context        the Context for which to get the multipoles
+     * @param dipoles        the dipole moment of particle i is stored into the i'th element
+     * @param quadrupoles    the quadrupole moment of particle i is stored into elements 6*i to 6*i+5
+     * @param octopoles      the octopole moment of particle i is stored into elements 10*i to 10*i+9
+     */
+    void getLabFramePermanentMultipoles(ContextImpl& context, std::vector<Vec3>& dipoles,
+                                        std::vector<double>& quadrupoles, std::vector<double>& octopoles);
     /**
      * Get the induced dipole moments of all particles.
      * 
@@ -90,6 +100,36 @@ public:
      */
     void getElectrostaticPotential(ContextImpl& context, const std::vector< Vec3 >& inputGrid,
                                    std::vector< double >& outputElectrostaticPotential);
+    /**
+     * Compute the electrostatic potential, and optionally the field, on a regular lattice one plane at a time.
+     * The field is not supported.
+     *
+     * @param context        context
+     * @param origin         the first point of the lattice
+     * @param axes           the three step vectors of the lattice
+     * @param numPoints      the number of points along each step vector
+     * @param includeField   whether to compute the field
+     * @param processPlane   called for each plane in order with its index, the potential at its points and,
+     *                       if includeField is set, the field at its points
+     */
+    void getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                         const std::function<void (int, const std::vector<double>&, const std::vector<Vec3>&)>& processPlane);
+    /**
+     * Get the electric field at each particle.  This is not supported.
+     */
+    void getElectricFields(ContextImpl& context, std::vector<Vec3>& fields);
+    /**
+     * Get the electric field gradient at each particle.  This is not supported.
+     */
+    void getElectricFieldGradients(ContextImpl& context, std::vector<double>& gradients);
+    /**
+     * Get the electric field at a set of points.  This is not supported.
+     */
+    void getElectricFieldsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<Vec3>& fields);
+    /**
+     * Get the electric field gradient at a set of points.  This is not supported.
+     */
+    void getElectricFieldGradientsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<double>& gradients);
 
    /** 
      * Get the system multipole moments
@@ -116,8 +156,17 @@ public:
      * @param nx      the number of grid points along the X axis
      * @param ny      the number of grid points along the Y axis
      * @param nz      the number of grid points along the Z axis
+     * @param cutoff  the direct space cutoff
+     * @param order   the B-spline order
+     */
+    void getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const;
+    /**
+     * Get the parameters being used for the fast multipole method.
+     *
+     * @param expansionOrder   the order of the Taylor expansions
+     * @param treeDepth        the level of the leaves in the tree built by the last force evaluation
      */
-    void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    void getFMMParameters(int& expansionOrder, int& treeDepth) const;
 private:
     class ForceInfo;
     class SortTrait : public CudaSort::SortTrait {
@@ -138,8 +187,8 @@ private:
     template <class T, class T4, class M4> void computeSystemMultipoleMoments(ContextImpl& context, std::vector<double>& outputMultipoleMoments);
     int numMultipoles, maxInducedIterations, maxExtrapolationOrder;
     int fixedFieldThreads, inducedFieldThreads, electrostaticsThreads;
-    int gridSizeX, gridSizeY, gridSizeZ;
-    double alpha, inducedEpsilon;
+    int gridSizeX, gridSizeY, gridSizeZ, pmeOrder;
+    double alpha, cutoff, inducedEpsilon;
     bool usePME, hasQuadrupoles, hasOctopoles, hasInitializedScaleFactors, hasInitializedFFT, multipolesAreValid, hasCreatedEvent;
     MPIDForce::PolarizationType polarizationType;
     CudaContext& cu;
@@ -198,7 +247,6 @@ private:
     CUfunction initExtrapolatedKernel, iterateExtrapolatedKernel, computeExtrapolatedKernel, addExtrapolatedGradientKernel;
     CUfunction pmeTransformMultipolesKernel, pmeTransformPotentialKernel;
     CUevent syncEvent;
-    static const int PmeOrder = 6;
     static const int MaxPrevDIISDipoles = 20;
 };
 
@@ -30,67 +30,31 @@ __device__ void computeBSplinePoint(real5 *thetai, real w, real* array) {
         ARRAY(i,1) = denom * (1-w) * ARRAY(k,1);
     }
 
-    // get coefficients for the B-spline first derivative
-
-    int k = PME_ORDER - 1;
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline second derivative
-
-    k = PME_ORDER - 2;
-    ARRAY(k,PME_ORDER-1) = ARRAY(k,PME_ORDER-2);
-    for (int i = PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline third derivative
-
-    k = PME_ORDER - 3;
-    ARRAY(k,PME_ORDER-2) = ARRAY(k,PME_ORDER-3);
-    for (int i = PME_ORDER-3; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER-1) = ARRAY(k,PME_ORDER-2);
-    for (int i = PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline fourth derivative
-
-    k = PME_ORDER - 4;
-    ARRAY(k,PME_ORDER-3) = ARRAY(k,PME_ORDER-4);
-    for (int i = PME_ORDER-4; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER-2) = ARRAY(k,PME_ORDER-3);
-    for (int i = PME_ORDER-3; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER-1) = ARRAY(k,PME_ORDER-2);
-    for (int i = PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
+    // get coefficients for the B-spline derivatives by differencing the spline of order PME_ORDER-d
+    // d times.  The d-th derivative overwrites that spline, which no lower derivative needs.
+
+    ARRAY(1,1) = 1;
+    for (int d = 1; d <= 4 && d < PME_ORDER; d++) {
+        int k = PME_ORDER - d;
+        for (int m = k+1; m <= PME_ORDER; m++) {
+            ARRAY(k,m) = ARRAY(k,m-1);
+            for (int i = m-1; i >= 2; i--)
+                ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
+            ARRAY(k,1) = -ARRAY(k,1);
+        }
+    }
 
     // copy coefficients from temporary to permanent storage
 
-    for (int i = 1; i <= PME_ORDER; i++)
-        for (int d = 0; d <= 4; d++)
+    for (int i = 1; i <= PME_ORDER; i++) {
+        for (int d = 0; d < 4; d++)
             thetai[i-1][d] = ARRAY(PME_ORDER-d,i);
+#if PME_ORDER > 4
+        thetai[i-1][4] = ARRAY(PME_ORDER-4,i);
+#else
+        thetai[i-1][4] = 0;
+#endif
+    }
 }
 
 /**
@@ -122,41 +86,19 @@ __device__ void computeBSplinePoint(real4* thetai, real w, real* array) {
         ARRAY(i,1) = denom * (1-w) * ARRAY(k,1);
     }
 
-    // get coefficients for the B-spline first derivative
-
-    int k = PME_ORDER - 1;
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline second derivative
-
-    k = PME_ORDER - 2;
-    ARRAY(k,PME_ORDER-1) = ARRAY(k,PME_ORDER-2);
-    for (int i = PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline third derivative
-
-    k = PME_ORDER - 3;
-    ARRAY(k,PME_ORDER-2) = ARRAY(k,PME_ORDER-3);
-    for (int i = PME_ORDER-3; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER-1) = ARRAY(k,PME_ORDER-2);
-    for (int i = PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,PME_ORDER) = ARRAY(k,PME_ORDER-1);
-    for (int i = PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
+    // get coefficients for the B-spline derivatives by differencing the spline of order PME_ORDER-d
+    // d times.  The d-th derivative overwrites that spline, which no lower derivative needs.
+
+    ARRAY(1,1) = 1;
+    for (int d = 1; d <= 3 && d < PME_ORDER; d++) {
+        int k = PME_ORDER - d;
+        for (int m = k+1; m <= PME_ORDER; m++) {
+            ARRAY(k,m) = ARRAY(k,m-1);
+            for (int i = m-1; i >= 2; i--)
+                ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
+            ARRAY(k,1) = -ARRAY(k,1);
+        }
+    }
 
     // copy coefficients from temporary to permanent storage
 
@@ -44,9 +44,12 @@ static void registerKernelFactories() {
 #else
 extern "C" OPENMM_EXPORT void registerKernelFactories() {
 #endif
+    // Platforms derived from ReferencePlatform (e.g. CPU) may already have their own
+    // MPID kernels registered; only fill in the ones that do not.
+    std::vector<std::string> kernelNames(1, CalcMPIDForceKernel::Name());
     for (int i = 0; i < Platform::getNumPlatforms(); i++) {
         Platform& platform = Platform::getPlatform(i);
-        if (dynamic_cast<ReferencePlatform*>(&platform) != NULL) {
+        if (dynamic_cast<ReferencePlatform*>(&platform) != NULL && !platform.supportsKernels(kernelNames)) {
              MPIDReferenceKernelFactory* factory = new MPIDReferenceKernelFactory();
              platform.registerKernelFactory(CalcMPIDForceKernel::Name(), factory);
         }
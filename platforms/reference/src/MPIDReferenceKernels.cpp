@@ -29,9 +29,11 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/MPIDForce.h"
 #include "openmm/internal/MPIDForceImpl.h"
-#include "openmm/NonbondedForce.h"
-#include "openmm/internal/NonbondedForceImpl.h"
+#include "MPIDReferenceFFT.h"
+#include "MPIDReferenceMSM.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #ifdef _MSC_VER
 #include <windows.h>
@@ -73,12 +75,16 @@ static Vec3* extractBoxVectors(ContextImpl& context) {
  * -------------------------------------------------------------------------- */
 
 ReferenceCalcMPIDForceKernel::ReferenceCalcMPIDForceKernel(std::string name, const Platform& platform, const System& system) : 
-         CalcMPIDForceKernel(name, platform), system(system), numMultipoles(0), mutualInducedMaxIterations(60), mutualInducedTargetEpsilon(1.0e-03),
-                                                         usePme(false),alphaEwald(0.0), cutoffDistance(1.0) {  
+         CalcMPIDForceKernel(name, platform), system(system), numMultipoles(0), mutualInducedMaxIterations(60), mutualInducedTargetEpsilon(1.0e-03), mutualInducedSolver(MPIDForce::DIIS),
+                                                         usePme(false), useEwald(false), useMsm(false), useFmm(false), alphaEwald(0.0), cutoffDistance(1.0), pmeBSplineOrder(6),
+                                                         pmeOptimalInfluenceFunction(false), pmeInterlacedGrids(false), pmeSlabCorrection(false),
+                                                         fmmExpansionOrder(12), fmmTreeDepth(0), mpidReferenceForce(NULL) {  
 
 }
 
 ReferenceCalcMPIDForceKernel::~ReferenceCalcMPIDForceKernel() {
+    if (mpidReferenceForce)
+        delete mpidReferenceForce;
 }
 
 void ReferenceCalcMPIDForceKernel::initialize(const System& system, const MPIDForce& force) {
@@ -146,6 +152,7 @@ void ReferenceCalcMPIDForceKernel::initialize(const System& system, const MPIDFo
     if (polarizationType == MPIDForce::Mutual) {
         mutualInducedMaxIterations = force.getMutualInducedMaxIterations();
         mutualInducedTargetEpsilon = force.getMutualInducedTargetEpsilon();
+        mutualInducedSolver        = force.getMutualInducedSolver();
     } else if (polarizationType == MPIDForce::Extrapolated) {
         extrapolationCoefficients = force.getExtrapolationCoefficients();
     }
@@ -153,51 +160,147 @@ void ReferenceCalcMPIDForceKernel::initialize(const System& system, const MPIDFo
     // PME
 
     nonbondedMethod  = force.getNonbondedMethod();
-    if (nonbondedMethod == MPIDForce::PME) {
+    if (nonbondedMethod == MPIDForce::PME || nonbondedMethod == MPIDForce::Ewald || nonbondedMethod == MPIDForce::MSM) {
         usePme     = true;
+        useEwald   = (nonbondedMethod == MPIDForce::Ewald);
+        useMsm     = (nonbondedMethod == MPIDForce::MSM);
         pmeGridDimension.resize(3);
         force.getPMEParameters(alphaEwald, pmeGridDimension[0], pmeGridDimension[1], pmeGridDimension[2]);
         cutoffDistance = force.getCutoffDistance();
-        if (pmeGridDimension[0] == 0 || alphaEwald == 0.0) {
-            NonbondedForce nb;
-            nb.setEwaldErrorTolerance(force.getEwaldErrorTolerance());
-            nb.setCutoffDistance(force.getCutoffDistance());
-            int gridSizeX, gridSizeY, gridSizeZ;
-            NonbondedForceImpl::calcPMEParameters(system, nb, alphaEwald, gridSizeX, gridSizeY, gridSizeZ, false);
-            pmeGridDimension[0] = gridSizeX;
-            pmeGridDimension[1] = gridSizeY;
-            pmeGridDimension[2] = gridSizeZ;
-        }    
+        pmeBSplineOrder = MPIDForceImpl::getPmeBSplineOrder(force);
+        pmeOptimalInfluenceFunction = (nonbondedMethod == MPIDForce::PME && force.getPmeOptimalInfluenceFunction());
+        pmeInterlacedGrids = (nonbondedMethod == MPIDForce::PME && force.getPmeInterlacedGrids());
+        pmeSlabCorrection = (nonbondedMethod == MPIDForce::PME && force.getPmeSlabCorrection());
+        if (pmeSlabCorrection && fabs(totalCharge) > 1e-6)
+            throw OpenMMException("MPIDForce: the PME slab correction requires a neutral system");
+        pmeTuningCandidates.clear();
+
+        // The multilevel stencils deconvolve the B-splines, which is only possible for even orders,
+        // and every grid dimension has to survive at least one halving.
+
+        if (useMsm) {
+            if (pmeBSplineOrder%2 != 0)
+                pmeBSplineOrder++;
+            for (int ii = 0; ii < 3; ii++)
+                if (pmeGridDimension[ii] != 0)
+                    pmeGridDimension[ii] = MPIDReferenceMSM::findLegalDimension(pmeGridDimension[ii]);
+        }
+        if (useEwald) {
+
+            // For Ewald the grid dimensions are the largest reciprocal lattice indices.  The cost of
+            // the sum does not trade off against the cutoff the way the PME grid does, so there is
+            // nothing to tune.
+
+            if (pmeGridDimension[0] == 0 || alphaEwald == 0.0)
+                MPIDForceImpl::calcEwaldParameters(system, force, cutoffDistance, alphaEwald, pmeGridDimension[0], pmeGridDimension[1], pmeGridDimension[2]);
+        } else if (pmeGridDimension[0] == 0 || alphaEwald == 0.0) {
+
+            // Each candidate cutoff gets the alpha and grid that just meet the error tolerance.  Unless
+            // the cutoff is tuned, the only candidate is the requested cutoff.  Otherwise the first force
+            // evaluation times them and keeps the fastest; until then the requested cutoff is used.
+
+            int numCandidates = (tunesPmeCutoff() ? NUM_PME_TUNING_CUTOFFS : 1);
+            for (int ii = 0; ii < numCandidates; ii++) {
+                PmeTuningCandidate candidate;
+                candidate.cutoff = force.getCutoffDistance()*PME_TUNING_CUTOFF_SCALES[ii];
+                int nx, ny, nz;
+                MPIDForceImpl::calcPMEParameters(system, force, candidate.cutoff, candidate.alpha, nx, ny, nz);
+                if (useMsm) {
+                    candidate.gridDimension[0] = MPIDReferenceMSM::findLegalDimension(nx);
+                    candidate.gridDimension[1] = MPIDReferenceMSM::findLegalDimension(ny);
+                    candidate.gridDimension[2] = MPIDReferenceMSM::findLegalDimension(nz);
+                } else {
+                    candidate.gridDimension[0] = MPIDReferenceFFT::findLegalDimension(nx);
+                    candidate.gridDimension[1] = MPIDReferenceFFT::findLegalDimension(ny);
+                    candidate.gridDimension[2] = MPIDReferenceFFT::findLegalDimension(nz);
+                }
+                pmeTuningCandidates.push_back(candidate);
+            }
+            applyPmeTuningCandidate(pmeTuningCandidates[0]);
+            if (numCandidates == 1)
+                pmeTuningCandidates.clear();
+        }
     } else {
         usePme = false;
+        useEwald = false;
+        useMsm = false;
     }
+    useFmm = (nonbondedMethod == MPIDForce::FMM);
+    force.getFMMParameters(fmmExpansionOrder, fmmTreeDepth);
     scaleFactor14 = force.get14ScaleFactor();
 
+    // The covalent scale table only depends on the topology, so build it here once.
+
+    if (mpidReferenceForce)
+        delete mpidReferenceForce;
+    mpidReferenceForce = createMPIDReferenceForce();
+    mpidReferenceForce->setupScaleTable(multipoleAtomCovalentInfo);
+
     return;
 }
 
 MPIDReferenceForce* ReferenceCalcMPIDForceKernel::setupMPIDReferenceForce(ContextImpl& context)
 {
 
-    // MPIDReferenceForce is set to MPIDReferencePmeForce if 'usePme' is set
+    // MPIDReferenceForce is set to MPIDReferencePmeForce if 'usePme' is set, which also covers Ewald and MSM
+    // MPIDReferenceForce is set to MPIDReferenceFmmForce if 'useFmm' is set
     // MPIDReferenceForce is set to MPIDReferenceForce otherwise
+    //
+    // The instance is created in initialize() and kept for the lifetime of the kernel, so the
+    // FFT plan, B-spline moduli, PME grid, scale table and work arrays are only built once.  Only
+    // the periodic box is refreshed here; MPIDReferencePmeForce ignores it if it is unchanged.
 
-
-    MPIDReferenceForce* mpidReferenceForce = NULL;
     if (usePme) {
-
-        MPIDReferencePmeForce* mpidReferencePmeForce = new MPIDReferencePmeForce();
-        mpidReferencePmeForce->setAlphaEwald(alphaEwald);
-        mpidReferencePmeForce->setCutoffDistance(cutoffDistance);
-        mpidReferencePmeForce->setPmeGridDimensions(pmeGridDimension);
+        MPIDReferencePmeForce* mpidReferencePmeForce = static_cast<MPIDReferencePmeForce*>(mpidReferenceForce);
         Vec3* boxVectors = extractBoxVectors(context);
         double minAllowedSize = 1.999999*cutoffDistance;
         if (boxVectors[0][0] < minAllowedSize || boxVectors[1][1] < minAllowedSize || boxVectors[2][2] < minAllowedSize) {
             throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
         }
         mpidReferencePmeForce->setPeriodicBoxSize(boxVectors);
+    }
+
+    return mpidReferenceForce;
+
+}
+
+MPIDReferencePmeForce* ReferenceCalcMPIDForceKernel::createMPIDReferencePmeForce()
+{
+    return new MPIDReferencePmeForce();
+}
+
+bool ReferenceCalcMPIDForceKernel::tunesPmeCutoff() const
+{
+    return false;
+}
+
+MPIDReferenceForce* ReferenceCalcMPIDForceKernel::createMPIDReferenceForce()
+{
+
+    MPIDReferenceForce* mpidReferenceForce = NULL;
+    if (usePme) {
+
+        MPIDReferencePmeForce* mpidReferencePmeForce = createMPIDReferencePmeForce();
+        mpidReferencePmeForce->setAlphaEwald(alphaEwald);
+        mpidReferencePmeForce->setCutoffDistance(cutoffDistance);
+        if (useEwald) {
+            mpidReferencePmeForce->setEwaldKMax(pmeGridDimension);
+        } else {
+            mpidReferencePmeForce->setPmeOrder(pmeBSplineOrder);
+            mpidReferencePmeForce->setUseMultilevelSummation(useMsm);
+            mpidReferencePmeForce->setUseOptimalInfluenceFunction(pmeOptimalInfluenceFunction);
+            mpidReferencePmeForce->setUseInterlacedGrids(pmeInterlacedGrids);
+            mpidReferencePmeForce->setUseSlabCorrection(pmeSlabCorrection);
+            mpidReferencePmeForce->setPmeGridDimensions(pmeGridDimension);
+        }
         mpidReferenceForce = static_cast<MPIDReferenceForce*>(mpidReferencePmeForce);
 
+    } else if (useFmm) {
+
+        MPIDReferenceFmmForce* mpidReferenceFmmForce = new MPIDReferenceFmmForce();
+        mpidReferenceFmmForce->setFmmParameters(fmmExpansionOrder, fmmTreeDepth);
+        mpidReferenceForce = static_cast<MPIDReferenceForce*>(mpidReferenceFmmForce);
+
     } else {
          mpidReferenceForce = new MPIDReferenceForce(MPIDReferenceForce::NoCutoff);
     }
@@ -208,12 +311,21 @@ MPIDReferenceForce* ReferenceCalcMPIDForceKernel::setupMPIDReferenceForce(Contex
         mpidReferenceForce->setPolarizationType(MPIDReferenceForce::Mutual);
         mpidReferenceForce->setMutualInducedDipoleTargetEpsilon(mutualInducedTargetEpsilon);
         mpidReferenceForce->setMaximumMutualInducedDipoleIterations(mutualInducedMaxIterations);
+        if (mutualInducedSolver == MPIDForce::ConjugateGradient)
+            mpidReferenceForce->setMutualInducedSolver(MPIDReferenceForce::ConjugateGradient);
+        else
+            mpidReferenceForce->setMutualInducedSolver(MPIDReferenceForce::DIIS);
     } else if (polarizationType == MPIDForce::Direct) {
         mpidReferenceForce->setPolarizationType(MPIDReferenceForce::Direct);
     } else if (polarizationType == MPIDForce::Extrapolated) {
         mpidReferenceForce->setPolarizationType(MPIDReferenceForce::Extrapolated);
         mpidReferenceForce->setExtrapolationCoefficients(extrapolationCoefficients);
+    } else if (polarizationType == MPIDForce::TCG1) {
+        mpidReferenceForce->setPolarizationType(MPIDReferenceForce::TCG1);
+    } else if (polarizationType == MPIDForce::TCG2) {
+        mpidReferenceForce->setPolarizationType(MPIDReferenceForce::TCG2);
     } else {
+        delete mpidReferenceForce;
         throw OpenMMException("Polarization type not recognzied.");
     }
     mpidReferenceForce->set14ScaleFactor(scaleFactor14);
@@ -222,8 +334,64 @@ MPIDReferenceForce* ReferenceCalcMPIDForceKernel::setupMPIDReferenceForce(Contex
 
 }
 
+const int ReferenceCalcMPIDForceKernel::NUM_PME_TUNING_CUTOFFS = 5;
+const double ReferenceCalcMPIDForceKernel::PME_TUNING_CUTOFF_SCALES[] = {1.0, 0.8, 0.9, 1.1, 1.2};
+const int ReferenceCalcMPIDForceKernel::NUM_PME_TUNING_STEPS = 3;
+
+void ReferenceCalcMPIDForceKernel::applyPmeTuningCandidate(const PmeTuningCandidate& candidate) {
+    alphaEwald = candidate.alpha;
+    cutoffDistance = candidate.cutoff;
+    pmeGridDimension[0] = candidate.gridDimension[0];
+    pmeGridDimension[1] = candidate.gridDimension[1];
+    pmeGridDimension[2] = candidate.gridDimension[2];
+}
+
+void ReferenceCalcMPIDForceKernel::tunePmeParameters(ContextImpl& context) {
+
+    // All candidates meet the error tolerance, so pick the fastest on the actual configuration.  The
+    // first evaluation of each also builds the neighbor list, so the best of several is compared.
+
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3> scratchForces(numMultipoles);
+    Vec3* boxVectors = extractBoxVectors(context);
+    double maxCutoff = 0.5*std::min(std::min(boxVectors[0][0], boxVectors[1][1]), boxVectors[2][2]);
+    int bestCandidate = 0;
+    double bestTime = 0.0;
+    for (int ii = 0; ii < (int) pmeTuningCandidates.size(); ii++) {
+        if (ii > 0 && pmeTuningCandidates[ii].cutoff > maxCutoff)
+            continue;
+        applyPmeTuningCandidate(pmeTuningCandidates[ii]);
+        delete mpidReferenceForce;
+        mpidReferenceForce = createMPIDReferenceForce();
+        mpidReferenceForce->setupScaleTable(multipoleAtomCovalentInfo);
+        MPIDReferenceForce* force = setupMPIDReferenceForce(context);
+        double time = 0.0;
+        for (int step = 0; step < NUM_PME_TUNING_STEPS; step++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            force->calculateForceAndEnergy(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+                                           dampingFactors, polarity, axisTypes,
+                                           multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+                                           multipoleAtomCovalentInfo, scratchForces);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            if (step == 0 || elapsed < time)
+                time = elapsed;
+        }
+        if (ii == 0 || time < bestTime) {
+            bestCandidate = ii;
+            bestTime = time;
+        }
+    }
+    applyPmeTuningCandidate(pmeTuningCandidates[bestCandidate]);
+    delete mpidReferenceForce;
+    mpidReferenceForce = createMPIDReferenceForce();
+    mpidReferenceForce->setupScaleTable(multipoleAtomCovalentInfo);
+    pmeTuningCandidates.clear();
+}
+
 double ReferenceCalcMPIDForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
 
+    if (!pmeTuningCandidates.empty())
+        tunePmeParameters(context);
     MPIDReferenceForce* MPIDReferenceForce = setupMPIDReferenceForce(context);
 
     vector<Vec3>& posData = extractPositions(context);
@@ -233,18 +401,38 @@ double ReferenceCalcMPIDForceKernel::execute(ContextImpl& context, bool includeF
                                                                            multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
                                                                            multipoleAtomCovalentInfo, forceData);
 
-    delete MPIDReferenceForce;
+    // The getters can reuse this setup until the positions or box change.
+
+    Vec3* boxVectors = extractBoxVectors(context);
+    setupPositions = posData;
+    for (int i = 0; i < 3; i++)
+        setupBoxVectors[i] = boxVectors[i];
 
     return static_cast<double>(energy);
 }
 
+void ReferenceCalcMPIDForceKernel::checkSetupCurrent(ContextImpl& context) {
+    vector<Vec3>& posData = extractPositions(context);
+    Vec3* boxVectors = extractBoxVectors(context);
+    bool current = (posData == setupPositions);
+    for (int i = 0; i < 3; i++)
+        current = current && (boxVectors[i] == setupBoxVectors[i]);
+    if (!current) {
+        mpidReferenceForce->invalidateSetup();
+        setupPositions = posData;
+        for (int i = 0; i < 3; i++)
+            setupBoxVectors[i] = boxVectors[i];
+    }
+}
+
 void ReferenceCalcMPIDForceKernel::getInducedDipoles(ContextImpl& context, vector<Vec3>& outputDipoles) {
     int numParticles = context.getSystem().getNumParticles();
     outputDipoles.resize(numParticles);
 
-    // Create an MPIDReferenceForce to do the calculation.
+    // Use the MPIDReferenceForce owned by this kernel to do the calculation.
     
     MPIDReferenceForce* MPIDReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
     vector<Vec3>& posData = extractPositions(context);
     
     // Retrieve the induced dipoles.
@@ -254,26 +442,25 @@ void ReferenceCalcMPIDForceKernel::getInducedDipoles(ContextImpl& context, vecto
             dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs, multipoleAtomCovalentInfo, inducedDipoles);
     for (int i = 0; i < numParticles; i++)
         outputDipoles[i] = inducedDipoles[i];
-    delete MPIDReferenceForce;
 }
 
 void ReferenceCalcMPIDForceKernel::getLabFramePermanentDipoles(ContextImpl& context, vector<Vec3>& outputDipoles) {
-    int numParticles = context.getSystem().getNumParticles();
-    outputDipoles.resize(numParticles);
+    vector<double> labFrameQuadrupoles, labFrameOctopoles;
+    getLabFramePermanentMultipoles(context, outputDipoles, labFrameQuadrupoles, labFrameOctopoles);
+}
+
+void ReferenceCalcMPIDForceKernel::getLabFramePermanentMultipoles(ContextImpl& context, vector<Vec3>& outputDipoles,
+                                                                  vector<double>& outputQuadrupoles, vector<double>& outputOctopoles) {
+
+    // Use the MPIDReferenceForce owned by this kernel to do the calculation.  The permanent
+    // moments only need the rotation into the lab frame, so the induced dipoles are not solved.
 
-    // Create an MPIDReferenceForce to do the calculation.
-    
     MPIDReferenceForce* MPIDReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
     vector<Vec3>& posData = extractPositions(context);
-    
-    // Retrieve the permanent dipoles in the lab frame.
-    
-    vector<Vec3> labFramePermanentDipoles;
-    MPIDReferenceForce->calculateLabFramePermanentDipoles(posData, charges, dipoles, quadrupoles, octopoles, tholes,
-            dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs, multipoleAtomCovalentInfo, labFramePermanentDipoles);
-    for (int i = 0; i < numParticles; i++)
-        outputDipoles[i] = labFramePermanentDipoles[i];
-    delete MPIDReferenceForce;
+    MPIDReferenceForce->calculateLabFramePermanentMultipoles(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+            dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+            outputDipoles, outputQuadrupoles, outputOctopoles);
 }
 
 
@@ -281,9 +468,10 @@ void ReferenceCalcMPIDForceKernel::getTotalDipoles(ContextImpl& context, vector<
     int numParticles = context.getSystem().getNumParticles();
     outputDipoles.resize(numParticles);
 
-    // Create an MPIDReferenceForce to do the calculation.
+    // Use the MPIDReferenceForce owned by this kernel to do the calculation.
     
     MPIDReferenceForce* MPIDReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
     vector<Vec3>& posData = extractPositions(context);
     
     // Retrieve the permanent dipoles in the lab frame.
@@ -294,7 +482,6 @@ void ReferenceCalcMPIDForceKernel::getTotalDipoles(ContextImpl& context, vector<
 
     for (int i = 0; i < numParticles; i++)
         outputDipoles[i] = totalDipoles[i];
-    delete MPIDReferenceForce;
 }
 
 
@@ -303,6 +490,7 @@ void ReferenceCalcMPIDForceKernel::getElectrostaticPotential(ContextImpl& contex
                                                                         std::vector< double >& outputElectrostaticPotential) {
 
     MPIDReferenceForce* MPIDReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
     vector<Vec3>& posData                                     = extractPositions(context);
     vector<Vec3> grid(inputGrid.size());
     vector<double> potential(inputGrid.size());
@@ -318,8 +506,62 @@ void ReferenceCalcMPIDForceKernel::getElectrostaticPotential(ContextImpl& contex
     for (unsigned int ii = 0; ii < inputGrid.size(); ii++) {
         outputElectrostaticPotential[ii] = potential[ii];
     }
+}
+
+void ReferenceCalcMPIDForceKernel::getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                                                   const std::function<void (int, const vector<double>&, const vector<Vec3>&)>& processPlane) {
+
+    MPIDReferenceForce* mpidReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
+    vector<Vec3>& posData = extractPositions(context);
+    mpidReferenceForce->calculateElectrostaticPotentialVolume(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+                                                              dampingFactors, polarity, axisTypes,
+                                                              multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+                                                              multipoleAtomCovalentInfo, origin, axes, numPoints, includeField, processPlane);
+}
+
+void ReferenceCalcMPIDForceKernel::getElectricFields(ContextImpl& context, vector<Vec3>& fields) {
+
+    MPIDReferenceForce* mpidReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
+    vector<Vec3>& posData = extractPositions(context);
+    mpidReferenceForce->calculateElectricFields(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+                                                dampingFactors, polarity, axisTypes,
+                                                multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+                                                multipoleAtomCovalentInfo, &fields, NULL);
+}
 
-    delete MPIDReferenceForce;
+void ReferenceCalcMPIDForceKernel::getElectricFieldGradients(ContextImpl& context, vector<double>& gradients) {
+
+    MPIDReferenceForce* mpidReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
+    vector<Vec3>& posData = extractPositions(context);
+    mpidReferenceForce->calculateElectricFields(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+                                                dampingFactors, polarity, axisTypes,
+                                                multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+                                                multipoleAtomCovalentInfo, NULL, &gradients);
+}
+
+void ReferenceCalcMPIDForceKernel::getElectricFieldsAtPoints(ContextImpl& context, const vector<Vec3>& points, vector<Vec3>& fields) {
+
+    MPIDReferenceForce* mpidReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
+    vector<Vec3>& posData = extractPositions(context);
+    mpidReferenceForce->calculateElectricFieldsAtPoints(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+                                                        dampingFactors, polarity, axisTypes,
+                                                        multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+                                                        multipoleAtomCovalentInfo, points, &fields, NULL);
+}
+
+void ReferenceCalcMPIDForceKernel::getElectricFieldGradientsAtPoints(ContextImpl& context, const vector<Vec3>& points, vector<double>& gradients) {
+
+    MPIDReferenceForce* mpidReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
+    vector<Vec3>& posData = extractPositions(context);
+    mpidReferenceForce->calculateElectricFieldsAtPoints(posData, charges, dipoles, quadrupoles, octopoles, tholes,
+                                                        dampingFactors, polarity, axisTypes,
+                                                        multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+                                                        multipoleAtomCovalentInfo, points, NULL, &gradients);
 }
 
 void ReferenceCalcMPIDForceKernel::getSystemMultipoleMoments(ContextImpl& context, std::vector< double >& outputMultipoleMoments) {
@@ -333,13 +575,12 @@ void ReferenceCalcMPIDForceKernel::getSystemMultipoleMoments(ContextImpl& contex
     }    
 
     MPIDReferenceForce* MPIDReferenceForce = setupMPIDReferenceForce(context);
+    checkSetupCurrent(context);
     vector<Vec3>& posData                                     = extractPositions(context);
     MPIDReferenceForce->calculateMPIDSystemMultipoleMoments(masses, posData, charges, dipoles, quadrupoles, octopoles, tholes,
                                                                          dampingFactors, polarity, axisTypes, 
                                                                          multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
                                                                          multipoleAtomCovalentInfo, outputMultipoleMoments);
-
-    delete MPIDReferenceForce;
 }
 
 void ReferenceCalcMPIDForceKernel::copyParametersToContext(ContextImpl& context, const MPIDForce& force) {
@@ -368,21 +609,42 @@ void ReferenceCalcMPIDForceKernel::copyParametersToContext(ContextImpl& context,
         tholes[i] = tholeD;
         dampingFactors[i] = dampingFactorD;
         polarity[i] = polarityD;
-        for(int i = 0; i < 3; ++i)
-            octopoles[dipoleIndex++] = dipolesD[i];
-        for(int i = 0; i < 6; ++i)
-            octopoles[quadrupoleIndex++] = quadrupolesD[i];
-        for(int i = 0; i < 10; ++i)
-            octopoles[octopoleIndex++] = octopolesD[i];
+        for(int j = 0; j < 3; ++j)
+            dipoles[dipoleIndex++] = dipolesD[j];
+        for(int j = 0; j < 6; ++j)
+            quadrupoles[quadrupoleIndex++] = quadrupolesD[j];
+        for(int j = 0; j < 10; ++j)
+            octopoles[octopoleIndex++] = octopolesD[j];
+    }
+
+    // The B-spline order was fixed at initialization, so it has to suit the new multipoles too.
+
+    if (usePme && !useEwald)
+        MPIDForceImpl::checkPmeBSplineOrder(pmeBSplineOrder, MPIDForceImpl::getMaxMultipoleRank(force));
+
+    // Dipoles converged with the old parameters are no guide to the new ones.
+
+    if (mpidReferenceForce) {
+        mpidReferenceForce->resetInducedDipolePredictor();
+        mpidReferenceForce->invalidateSetup();
     }
 }
 
-void ReferenceCalcMPIDForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
+void ReferenceCalcMPIDForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const {
     if (!usePme)
         throw OpenMMException("getPMEParametersInContext: This Context is not using PME");
     alpha = alphaEwald;
     nx = pmeGridDimension[0];
     ny = pmeGridDimension[1];
     nz = pmeGridDimension[2];
+    cutoff = cutoffDistance;
+    order = (useEwald ? 0 : pmeBSplineOrder);
+}
+
+void ReferenceCalcMPIDForceKernel::getFMMParameters(int& expansionOrder, int& treeDepth) const {
+    if (!useFmm)
+        throw OpenMMException("getFMMParametersInContext: This Context is not using FMM");
+    expansionOrder = fmmExpansionOrder;
+    treeDepth = static_cast<const MPIDReferenceFmmForce*>(mpidReferenceForce)->getFmmLeafLevel();
 }
 
@@ -58,7 +58,29 @@ public:
      *
      * @return pointer to initialized instance of MPIDReferenceForce
      */
-    MPIDReferenceForce* setupMPIDReferenceForce(ContextImpl& context);
+    virtual MPIDReferenceForce* setupMPIDReferenceForce(ContextImpl& context);
+    /**
+     * Create the MPIDReferenceForce instance owned by this kernel and set the parameters
+     * that do not change between calls.
+     *
+     * @return pointer to new instance of MPIDReferenceForce
+     */
+    MPIDReferenceForce* createMPIDReferenceForce();
+    /**
+     * Create the MPIDReferencePmeForce instance used when 'usePme' is set, for PME, Ewald and MSM.  Platforms deriving from
+     * this kernel may return a subclass with a faster direct space loop.
+     *
+     * @return pointer to new instance of MPIDReferencePmeForce
+     */
+    virtual MPIDReferencePmeForce* createMPIDReferencePmeForce();
+    /**
+     * Get whether automatically chosen PME parameters are tuned by timing several cutoffs around the
+     * requested one during the first force evaluation.  The reference platform keeps the requested
+     * cutoff so that its results are reproducible; platforms deriving from this kernel may time them.
+     *
+     * @return true if the cutoff is tuned
+     */
+    virtual bool tunesPmeCutoff() const;
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -82,6 +104,17 @@ public:
      * @param dipoles    the fixed dipole moment of particle i is stored into the i'th element
      */
     void getLabFramePermanentDipoles(ContextImpl& context, std::vector<Vec3>& dipoles);
+    /**
+     * Get the fixed multipole moments of all particles in the global reference frame.  This only
+     * rotates the molecular frame moments; the induced dipoles are not computed.
+     * 
+     * @param context        the Context for which to get the fixed multipoles
+     * @param dipoles        the fixed dipole moment of particle i is stored into the i'th element
+     * @param quadrupoles    the fixed quadrupole moment of particle i is stored into elements 6*i to 6*i+5
+     * @param octopoles      the fixed octopole moment of particle i is stored into elements 10*i to 10*i+9
+     */
+    void getLabFramePermanentMultipoles(ContextImpl& context, std::vector<Vec3>& dipoles,
+                                        std::vector<double>& quadrupoles, std::vector<double>& octopoles);
     /**
      * Get the total dipole moments of all particles in the global reference frame.
      * 
@@ -98,6 +131,49 @@ public:
      */
     void getElectrostaticPotential(ContextImpl& context, const std::vector< Vec3 >& inputGrid,
                                    std::vector< double >& outputElectrostaticPotential);
+    /**
+     * Compute the electrostatic potential, and optionally the field, on a regular lattice one plane at a time.
+     *
+     * @param context        context
+     * @param origin         the first point of the lattice
+     * @param axes           the three step vectors of the lattice
+     * @param numPoints      the number of points along each step vector
+     * @param includeField   whether to compute the field
+     * @param processPlane   called for each plane in order with its index, the potential at its points and,
+     *                       if includeField is set, the field at its points
+     */
+    void getElectrostaticPotentialVolume(ContextImpl& context, const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                         const std::function<void (int, const std::vector<double>&, const std::vector<Vec3>&)>& processPlane);
+    /**
+     * Get the electric field at each particle.
+     *
+     * @param context    context
+     * @param fields     the field at particle i is stored into the i'th element
+     */
+    void getElectricFields(ContextImpl& context, std::vector<Vec3>& fields);
+    /**
+     * Get the electric field gradient at each particle.
+     *
+     * @param context    context
+     * @param gradients  the field gradient at particle i is stored into elements 6*i to 6*i+5 (XX XY YY XZ YZ ZZ)
+     */
+    void getElectricFieldGradients(ContextImpl& context, std::vector<double>& gradients);
+    /**
+     * Get the electric field at a set of points.
+     *
+     * @param context    context
+     * @param points     the points at which to compute the field
+     * @param fields     the field at point i is stored into the i'th element
+     */
+    void getElectricFieldsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<Vec3>& fields);
+    /**
+     * Get the electric field gradient at a set of points.
+     *
+     * @param context    context
+     * @param points     the points at which to compute the field gradient
+     * @param gradients  the field gradient at point i is stored into elements 6*i to 6*i+5 (XX XY YY XZ YZ ZZ)
+     */
+    void getElectricFieldGradientsAtPoints(ContextImpl& context, const std::vector<Vec3>& points, std::vector<double>& gradients);
 
     /**
      * Get the system multipole moments.
@@ -119,17 +195,56 @@ public:
      */
     void copyParametersToContext(ContextImpl& context, const MPIDForce& force);
     /**
-     * Get the parameters being used for PME.
+     * Get the parameters being used for PME.  If they are chosen automatically and tunesPmeCutoff() is
+     * true, the values are final after the first force evaluation, which times the candidates.
      * 
      * @param alpha   the separation parameter
      * @param nx      the number of grid points along the X axis
      * @param ny      the number of grid points along the Y axis
      * @param nz      the number of grid points along the Z axis
+     * @param cutoff  the direct space cutoff
+     * @param order   the B-spline order
      */
-    void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    void getPMEParameters(double& alpha, int& nx, int& ny, int& nz, double& cutoff, int& order) const;
+    /**
+     * Get the parameters being used for the fast multipole method.
+     *
+     * @param expansionOrder   the order of the Taylor expansions
+     * @param treeDepth        the level of the leaves in the tree built by the last force evaluation
+     */
+    void getFMMParameters(int& expansionOrder, int& treeDepth) const;
 
 private:
 
+    /**
+     * A cutoff with the alpha and grid that meet the Ewald error tolerance for it.
+     */
+    struct PmeTuningCandidate {
+        double cutoff;
+        double alpha;
+        int gridDimension[3];
+    };
+
+    /**
+     * Use the parameters of a candidate.  The MPIDReferenceForce must be recreated afterwards.
+     */
+    void applyPmeTuningCandidate(const PmeTuningCandidate& candidate);
+
+    /**
+     * Time force evaluations with each candidate and keep the fastest.
+     */
+    void tunePmeParameters(ContextImpl& context);
+
+    /**
+     * Discard the lab frame moments and induced dipoles the MPIDReferenceForce kept from its
+     * last setup if the positions or periodic box have changed since then.
+     */
+    void checkSetupCurrent(ContextImpl& context);
+
+    static const int NUM_PME_TUNING_CUTOFFS;
+    static const double PME_TUNING_CUTOFF_SCALES[];
+    static const int NUM_PME_TUNING_STEPS;
+
     int numMultipoles;
     MPIDForce::NonbondedMethod nonbondedMethod;
     MPIDForce::PolarizationType polarizationType;
@@ -148,14 +263,29 @@ private:
 
     int mutualInducedMaxIterations;
     double mutualInducedTargetEpsilon;
+    MPIDForce::MutualInducedSolver mutualInducedSolver;
     std::vector<double> extrapolationCoefficients;
 
     bool usePme;
+    bool useEwald;
+    bool useMsm;
+    bool useFmm;
     double alphaEwald;
     double defaultTholeWidth;
     double scaleFactor14;
     double cutoffDistance;
     std::vector<int> pmeGridDimension;
+    int pmeBSplineOrder;
+    bool pmeOptimalInfluenceFunction;
+    bool pmeInterlacedGrids;
+    bool pmeSlabCorrection;
+    std::vector<PmeTuningCandidate> pmeTuningCandidates;
+    int fmmExpansionOrder;
+    int fmmTreeDepth;
+
+    MPIDReferenceForce* mpidReferenceForce;
+    std::vector<Vec3> setupPositions;
+    Vec3 setupBoxVectors[3];
 
     const System& system;
 };
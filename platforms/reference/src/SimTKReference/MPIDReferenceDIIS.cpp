@@ -0,0 +1,188 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MPIDReferenceDIIS.h"
+#include <cmath>
+
+using std::vector;
+using OpenMM::Vec3;
+
+// A new entry whose error is this close (relative to its norm) to the span of the stored errors is
+// treated as linearly dependent on them.
+
+static const double DEPENDENCE_TOLERANCE = 1.0e-12;
+
+MPIDReferenceDIIS::MPIDReferenceDIIS() : _maxEntries(0), _numParticles(0), _numSets(0), _numEntries(0), _coefficientsValid(false) {
+}
+
+void MPIDReferenceDIIS::initialize(int maxEntries, int numParticles, int numSets)
+{
+    if (maxEntries != _maxEntries || numParticles != _numParticles || numSets != _numSets) {
+        _maxEntries   = maxEntries;
+        _numParticles = numParticles;
+        _numSets      = numSets;
+        _errors.assign(maxEntries, vector<Vec3>(numParticles));
+        _vectors.assign(numSets, vector<vector<Vec3> >(maxEntries, vector<Vec3>(numParticles)));
+        _slots.assign(maxEntries, 0);
+        _factor.assign(maxEntries*maxEntries, 0.0);
+        _overlap.assign(maxEntries, 0.0);
+        _work.assign(maxEntries, 0.0);
+        _coefficients.assign(maxEntries, 0.0);
+    }
+    _numEntries = 0;
+    _coefficientsValid = false;
+}
+
+int MPIDReferenceDIIS::getNextSlot() const
+{
+    // Entries are only added after the newest and removed from the oldest, so the slots in use are
+    // consecutive (modulo _maxEntries).  When the history is full this reuses the oldest slot; addEntry()
+    // drops that entry before looking at the new data.
+
+    if (_numEntries == 0)
+        return 0;
+    return (_slots[_numEntries-1]+1) % _maxEntries;
+}
+
+vector<Vec3>& MPIDReferenceDIIS::getNextError()
+{
+    return _errors[getNextSlot()];
+}
+
+vector<Vec3>& MPIDReferenceDIIS::getNextVector(int set)
+{
+    return _vectors[set][getNextSlot()];
+}
+
+void MPIDReferenceDIIS::removeOldestEntry()
+{
+    // With B = L.L^T, the block of B without the first row and column is L'.L'^T + v.v^T, where L' is L
+    // without its first row and column and v the rest of L's first column.  Shift L' into place and
+    // apply the rank one update.
+
+    int n = _numEntries-1;
+    for (int i = 0; i < n; i++) {
+        _work[i] = _factor[(i+1)*_maxEntries];
+        for (int j = 0; j <= i; j++)
+            _factor[i*_maxEntries+j] = _factor[(i+1)*_maxEntries+j+1];
+        _slots[i] = _slots[i+1];
+    }
+    for (int k = 0; k < n; k++) {
+        double diagonal = _factor[k*_maxEntries+k];
+        double r = sqrt(diagonal*diagonal + _work[k]*_work[k]);
+        double c = r/diagonal;
+        double s = _work[k]/diagonal;
+        _factor[k*_maxEntries+k] = r;
+        for (int i = k+1; i < n; i++) {
+            _factor[i*_maxEntries+k] = (_factor[i*_maxEntries+k] + s*_work[i])/c;
+            _work[i] = c*_work[i] - s*_factor[i*_maxEntries+k];
+        }
+    }
+    _numEntries = n;
+}
+
+void MPIDReferenceDIIS::addEntry()
+{
+    int slot = getNextSlot();
+    if (_numEntries == _maxEntries)
+        removeOldestEntry();
+
+    // The new row of the overlap matrix: one dot product with each stored error.
+
+    const vector<Vec3>& error = _errors[slot];
+    double selfOverlap = 0.0;
+    for (int i = 0; i < _numParticles; i++)
+        selfOverlap += error[i].dot(error[i]);
+    for (int j = 0; j < _numEntries; j++) {
+        const vector<Vec3>& other = _errors[_slots[j]];
+        double sum = 0.0;
+        for (int i = 0; i < _numParticles; i++)
+            sum += error[i].dot(other[i]);
+        _overlap[j] = sum;
+    }
+
+    // Extend the factor by a row, dropping the oldest entries while the new error is (numerically)
+    // a combination of the stored ones.
+
+    while (true) {
+        double pivot = selfOverlap;
+        for (int j = 0; j < _numEntries; j++) {
+            double sum = _overlap[j];
+            for (int k = 0; k < j; k++)
+                sum -= _factor[_numEntries*_maxEntries+k]*_factor[j*_maxEntries+k];
+            double value = sum/_factor[j*_maxEntries+j];
+            _factor[_numEntries*_maxEntries+j] = value;
+            pivot -= value*value;
+        }
+        if (_numEntries == 0) {
+            _factor[0] = (selfOverlap > 0.0 ? sqrt(selfOverlap) : 1.0);
+            break;
+        }
+        if (pivot > DEPENDENCE_TOLERANCE*selfOverlap) {
+            _factor[_numEntries*_maxEntries+_numEntries] = sqrt(pivot);
+            break;
+        }
+        removeOldestEntry();
+        for (int j = 0; j < _numEntries; j++)
+            _overlap[j] = _overlap[j+1];
+    }
+    _slots[_numEntries] = slot;
+    _numEntries++;
+    _coefficientsValid = false;
+}
+
+void MPIDReferenceDIIS::computeCoefficients()
+{
+    // Minimizing c.B.c subject to sum(c) = 1 gives c proportional to B^-1.(1, 1, ...).
+
+    int n = _numEntries;
+    for (int i = 0; i < n; i++) {
+        double sum = 1.0;
+        for (int k = 0; k < i; k++)
+            sum -= _factor[i*_maxEntries+k]*_work[k];
+        _work[i] = sum/_factor[i*_maxEntries+i];
+    }
+    double total = 0.0;
+    for (int i = n-1; i >= 0; i--) {
+        double sum = _work[i];
+        for (int k = i+1; k < n; k++)
+            sum -= _factor[k*_maxEntries+i]*_coefficients[k];
+        _coefficients[i] = sum/_factor[i*_maxEntries+i];
+        total += _coefficients[i];
+    }
+    for (int i = 0; i < n; i++)
+        _coefficients[i] /= total;
+    _coefficientsValid = true;
+}
+
+void MPIDReferenceDIIS::extrapolate(int set, vector<Vec3>& output)
+{
+    if (!_coefficientsValid)
+        computeCoefficients();
+    for (int i = 0; i < _numParticles; i++) {
+        Vec3 value(0.0, 0.0, 0.0);
+        for (int j = 0; j < _numEntries; j++)
+            value += _vectors[set][_slots[j]][i]*_coefficients[j];
+        output[i] = value;
+    }
+}
@@ -0,0 +1,115 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __MPIDReferenceDIIS_H__
+#define __MPIDReferenceDIIS_H__
+
+#include "openmm/Vec3.h"
+#include <vector>
+
+/**
+ * History of trial vectors and their errors for direct inversion in the iterative subspace (DIIS).
+ *
+ * The entries live in preallocated ring buffers.  Adding an entry computes only the new row of the
+ * error overlap matrix and extends its Cholesky factor; dropping the oldest entry is a rank one update
+ * of the factor.  Nothing is allocated once the history has been sized by initialize().
+ *
+ * Usage: write the new vectors into getNextError() and getNextVector(), call addEntry(), then
+ * call extrapolate() to form the DIIS combination of the stored vectors.
+ */
+class MPIDReferenceDIIS {
+
+public:
+
+    MPIDReferenceDIIS();
+
+    /**
+     * Discard the history and size the buffers.  Memory is only reallocated when the sizes change.
+     *
+     * @param maxEntries     maximum number of entries kept
+     * @param numParticles   number of particles in each vector
+     * @param numSets        number of vectors extrapolated with the same coefficients
+     */
+    void initialize(int maxEntries, int numParticles, int numSets);
+
+    /**
+     * Get the number of entries currently in the history.
+     */
+    int getNumEntries() const {
+        return _numEntries;
+    }
+
+    /**
+     * Get the buffer the error of the next entry should be written to.
+     */
+    std::vector<OpenMM::Vec3>& getNextError();
+
+    /**
+     * Get the buffer the vector of the next entry should be written to.
+     *
+     * @param set   index of the vector set
+     */
+    std::vector<OpenMM::Vec3>& getNextVector(int set);
+
+    /**
+     * Add the entry written to getNextError() and getNextVector().  If the history is full, or the new error
+     * is numerically a combination of the stored ones, the oldest entries are dropped.
+     */
+    void addEntry();
+
+    /**
+     * Form the combination of stored vectors that minimizes the norm of the combined error, subject to
+     * the coefficients summing to one.
+     *
+     * @param set          index of the vector set
+     * @param output       the combined vector
+     */
+    void extrapolate(int set, std::vector<OpenMM::Vec3>& output);
+
+private:
+
+    int getNextSlot() const;
+    void removeOldestEntry();
+    void computeCoefficients();
+
+    int _maxEntries;
+    int _numParticles;
+    int _numSets;
+    int _numEntries;
+    bool _coefficientsValid;
+
+    // ring buffers, indexed by slot; _slots lists the slots in use, oldest first
+
+    std::vector<std::vector<OpenMM::Vec3> > _errors;
+    std::vector<std::vector<std::vector<OpenMM::Vec3> > > _vectors;
+    std::vector<int> _slots;
+
+    // lower triangular Cholesky factor of the error overlap matrix, in the order of _slots
+
+    std::vector<double> _factor;
+    std::vector<double> _overlap;
+    std::vector<double> _work;
+    std::vector<double> _coefficients;
+};
+
+#endif // __MPIDReferenceDIIS_H__
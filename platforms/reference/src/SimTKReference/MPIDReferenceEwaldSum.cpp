@@ -0,0 +1,339 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MPIDReferenceEwaldSum.h"
+#include <algorithm>
+#include <cmath>
+
+using std::complex;
+using std::vector;
+using OpenMM::ThreadPool;
+using OpenMM::Vec3;
+
+namespace {
+
+// powers of x, y and z of each of the 35 potential derivatives
+
+const int COMPONENT_POWERS[35][3] = {
+    {0,0,0},
+    {1,0,0}, {0,1,0}, {0,0,1},
+    {2,0,0}, {0,2,0}, {0,0,2}, {1,1,0}, {1,0,1}, {0,1,1},
+    {3,0,0}, {0,3,0}, {0,0,3}, {2,1,0}, {2,0,1}, {1,2,0}, {0,2,1}, {1,0,2}, {0,1,2}, {1,1,1},
+    {4,0,0}, {0,4,0}, {0,0,4}, {3,1,0}, {3,0,1}, {1,3,0}, {0,3,1}, {1,0,3}, {0,1,3},
+    {2,2,0}, {2,0,2}, {0,2,2}, {2,1,1}, {1,2,1}, {1,1,2}
+};
+
+/**
+ * Run task(threadIndex, numThreads) on every thread of the pool, or on the calling thread if there is none.
+ */
+template <class Task>
+void runOnThreads(ThreadPool* threads, Task task)
+{
+    if (threads == NULL || threads->getNumThreads() == 1) {
+        task(0, 1);
+        return;
+    }
+    int numThreads = threads->getNumThreads();
+    threads->execute([&] (ThreadPool& pool, int threadIndex) {
+        task(threadIndex, numThreads);
+    });
+    threads->waitForThreads();
+}
+
+/**
+ * Get (2 pi i)^n m^q for each derivative as a real weight, with the sign of i^n folded in so only
+ * the parity of n remains.
+ */
+void getComponentWeights(const int* m, double* weight)
+{
+    for (int cc = 0; cc < 35; cc++) {
+        int order = COMPONENT_POWERS[cc][0]+COMPONENT_POWERS[cc][1]+COMPONENT_POWERS[cc][2];
+        double w = 1.0;
+        for (int axis = 0; axis < 3; axis++)
+            for (int pp = 0; pp < COMPONENT_POWERS[cc][axis]; pp++)
+                w *= 2.0*M_PI*m[axis];
+        weight[cc] = (order%4 < 2 ? w : -w);
+    }
+}
+
+inline complex<double> getPhase(const vector<complex<double> >& table, int kmax, int particle, int m)
+{
+    if (m >= 0)
+        return table[particle*(kmax+1)+m];
+    return std::conj(table[particle*(kmax+1)-m]);
+}
+
+}
+
+MPIDReferenceEwaldSum::MPIDReferenceEwaldSum(int kmaxx, int kmaxy, int kmaxz) : _numParticles(0), _alphaEwald(0.0)
+{
+    _kmax[0] = kmaxx;
+    _kmax[1] = kmaxy;
+    _kmax[2] = kmaxz;
+}
+
+void MPIDReferenceEwaldSum::setBox(const Vec3* recipBoxVectors, double alphaEwald)
+{
+    if (!_kVectors.empty() && alphaEwald == _alphaEwald && recipBoxVectors[0] == _recipBoxVectors[0] &&
+            recipBoxVectors[1] == _recipBoxVectors[1] && recipBoxVectors[2] == _recipBoxVectors[2])
+        return;
+    _alphaEwald = alphaEwald;
+    for (int ii = 0; ii < 3; ii++)
+        _recipBoxVectors[ii] = recipBoxVectors[ii];
+
+    // Only half of the lattice is stored; m and -m contribute complex conjugate terms, so each
+    // stored vector counts twice.
+
+    double volume = 1.0/(recipBoxVectors[0][0]*recipBoxVectors[1][1]*recipBoxVectors[2][2]);
+    double expFactor = M_PI*M_PI/(alphaEwald*alphaEwald);
+    double scale = 2.0/(M_PI*volume);
+    _kVectors.clear();
+    for (int mx = 0; mx <= _kmax[0]; mx++) {
+        for (int my = (mx == 0 ? 0 : -_kmax[1]); my <= _kmax[1]; my++) {
+            for (int mz = (mx == 0 && my == 0 ? 1 : -_kmax[2]); mz <= _kmax[2]; mz++) {
+                double mhx = mx*recipBoxVectors[0][0];
+                double mhy = mx*recipBoxVectors[1][0]+my*recipBoxVectors[1][1];
+                double mhz = mx*recipBoxVectors[2][0]+my*recipBoxVectors[2][1]+mz*recipBoxVectors[2][2];
+                double k2 = mhx*mhx+mhy*mhy+mhz*mhz;
+                KVector kVector;
+                kVector.m[0] = mx;
+                kVector.m[1] = my;
+                kVector.m[2] = mz;
+                kVector.influence = scale*exp(-expFactor*k2)/k2;
+                _kVectors.push_back(kVector);
+            }
+        }
+    }
+}
+
+void MPIDReferenceEwaldSum::setPositions(const vector<Vec3>& positions, ThreadPool* threads)
+{
+    _numParticles = positions.size();
+    for (int axis = 0; axis < 3; axis++)
+        _phase[axis].resize(_numParticles*(_kmax[axis]+1));
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        int start = (threadIndex*_numParticles)/numThreads;
+        int end = ((threadIndex+1)*_numParticles)/numThreads;
+        for (int ii = start; ii < end; ii++) {
+            for (int axis = 0; axis < 3; axis++) {
+
+                // The reciprocal box matrix is lower triangular, so the fractional coordinate along
+                // an axis only involves that and the following Cartesian components.
+
+                double s = 0.0;
+                for (int jj = axis; jj < 3; jj++)
+                    s += positions[ii][jj]*_recipBoxVectors[jj][axis];
+                complex<double> step = std::polar(1.0, 2.0*M_PI*s);
+                complex<double>* table = &_phase[axis][ii*(_kmax[axis]+1)];
+                table[0] = 1.0;
+                for (int m = 1; m <= _kmax[axis]; m++)
+                    table[m] = table[m-1]*step;
+            }
+        }
+    });
+}
+
+void MPIDReferenceEwaldSum::computeKVectorBlock(int numComponents, const vector<double>& multipoles, unsigned int start, unsigned int end,
+                                                vector<complex<double> >& phases, vector<double>& phi) const
+{
+    phases.resize(_numParticles);
+    for (unsigned int kk = start; kk < end; kk++) {
+        const KVector& kVector = _kVectors[kk];
+
+        double weight[35];
+        getComponentWeights(kVector.m, weight);
+
+        // structure factor
+
+        complex<double> structureFactor = 0.0;
+        for (int ii = 0; ii < _numParticles; ii++) {
+            complex<double> phase = getPhase(_phase[0], _kmax[0], ii, kVector.m[0])*
+                                    getPhase(_phase[1], _kmax[1], ii, kVector.m[1])*
+                                    getPhase(_phase[2], _kmax[2], ii, kVector.m[2]);
+            phases[ii] = phase;
+            const double* multipole = &multipoles[numComponents*ii];
+            double re = 0.0, im = 0.0;
+            for (int cc = 0; cc < numComponents; cc++) {
+                int order = COMPONENT_POWERS[cc][0]+COMPONENT_POWERS[cc][1]+COMPONENT_POWERS[cc][2];
+                if (order%2 == 0)
+                    re += multipole[cc]*weight[cc];
+                else
+                    im += multipole[cc]*weight[cc];
+            }
+            structureFactor += phase*complex<double>(re, im);
+        }
+
+        // Each derivative of the potential is the real part of i^n exp(2 pi i m.s) conj(S) times its
+        // weight and the influence function.
+
+        for (int ii = 0; ii < _numParticles; ii++) {
+            complex<double> term = phases[ii]*std::conj(structureFactor);
+            double even = kVector.influence*term.real();
+            double odd = -kVector.influence*term.imag();
+            double* particlePhi = &phi[35*ii];
+            for (int cc = 0; cc < 35; cc++) {
+                int order = COMPONENT_POWERS[cc][0]+COMPONENT_POWERS[cc][1]+COMPONENT_POWERS[cc][2];
+                particlePhi[cc] += weight[cc]*(order%2 == 0 ? even : odd);
+            }
+        }
+    }
+}
+
+void MPIDReferenceEwaldSum::computePotential(int numComponents, const vector<double>& multipoles, vector<double>& phi, ThreadPool* threads)
+{
+    phi.assign(35*_numParticles, 0.0);
+    int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+    if (numThreads == 1) {
+        _threadPhases.resize(1);
+        computeKVectorBlock(numComponents, multipoles, 0, _kVectors.size(), _threadPhases[0], phi);
+        return;
+    }
+
+    // each thread sums a block of lattice vectors into a private potential, then the private
+    // potentials are summed over blocks of particles
+
+    _threadPhases.resize(numThreads);
+    _threadPhi.resize(numThreads);
+    unsigned int numKVectors = _kVectors.size();
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        _threadPhi[threadIndex].assign(35*_numParticles, 0.0);
+        unsigned int start = (threadIndex*numKVectors)/numThreads;
+        unsigned int end = ((threadIndex+1)*numKVectors)/numThreads;
+        computeKVectorBlock(numComponents, multipoles, start, end, _threadPhases[threadIndex], _threadPhi[threadIndex]);
+    });
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        unsigned int start = (35*threadIndex*_numParticles)/numThreads;
+        unsigned int end = (35*(threadIndex+1)*_numParticles)/numThreads;
+        for (int kk = 0; kk < numThreads; kk++)
+            for (unsigned int ii = start; ii < end; ii++)
+                phi[ii] += _threadPhi[kk][ii];
+    });
+}
+
+void MPIDReferenceEwaldSum::setMultipoles(int numComponents, const vector<double>& multipoles, ThreadPool* threads)
+{
+    // structure factors, divided between the threads by lattice vector
+
+    unsigned int numKVectors = _kVectors.size();
+    _structureFactors.resize(numKVectors);
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        unsigned int start = (threadIndex*numKVectors)/numThreads;
+        unsigned int end = ((threadIndex+1)*numKVectors)/numThreads;
+        for (unsigned int kk = start; kk < end; kk++) {
+            const KVector& kVector = _kVectors[kk];
+            double weight[35];
+            getComponentWeights(kVector.m, weight);
+            complex<double> structureFactor = 0.0;
+            for (int ii = 0; ii < _numParticles; ii++) {
+                complex<double> phase = getPhase(_phase[0], _kmax[0], ii, kVector.m[0])*
+                                        getPhase(_phase[1], _kmax[1], ii, kVector.m[1])*
+                                        getPhase(_phase[2], _kmax[2], ii, kVector.m[2]);
+                const double* multipole = &multipoles[numComponents*ii];
+                double re = 0.0, im = 0.0;
+                for (int cc = 0; cc < numComponents; cc++) {
+                    int order = COMPONENT_POWERS[cc][0]+COMPONENT_POWERS[cc][1]+COMPONENT_POWERS[cc][2];
+                    if (order%2 == 0)
+                        re += multipole[cc]*weight[cc];
+                    else
+                        im += multipole[cc]*weight[cc];
+                }
+                structureFactor += phase*complex<double>(re, im);
+            }
+            _structureFactors[kk] = structureFactor;
+        }
+    });
+}
+
+void MPIDReferenceEwaldSum::computePotentialAtPoints(const vector<Vec3>& points, vector<double>& potential,
+                                                     vector<Vec3>* field, vector<double>* fieldGradient,
+                                                     ThreadPool* threads) const
+{
+    // The potential at a point is the real part of exp(2 pi i m.s) conj(S) times the influence
+    // function, summed over the lattice.  Each derivative with respect to s brings down 2 pi i m.
+
+    int numPoints = points.size();
+    unsigned int numKVectors = _kVectors.size();
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        int start = (threadIndex*numPoints)/numThreads;
+        int end = ((threadIndex+1)*numPoints)/numThreads;
+        vector<complex<double> > table[3];
+        for (int axis = 0; axis < 3; axis++)
+            table[axis].resize(_kmax[axis]+1);
+        for (int pp = start; pp < end; pp++) {
+            for (int axis = 0; axis < 3; axis++) {
+                double s = 0.0;
+                for (int jj = axis; jj < 3; jj++)
+                    s += points[pp][jj]*_recipBoxVectors[jj][axis];
+                complex<double> step = std::polar(1.0, 2.0*M_PI*s);
+                table[axis][0] = 1.0;
+                for (int m = 1; m <= _kmax[axis]; m++)
+                    table[axis][m] = table[axis][m-1]*step;
+            }
+            double sum = 0.0;
+            double gradient[3] = {0.0, 0.0, 0.0};
+            double second[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+            for (unsigned int kk = 0; kk < numKVectors; kk++) {
+                const KVector& kVector = _kVectors[kk];
+                complex<double> term = getPhase(table[0], _kmax[0], 0, kVector.m[0])*
+                                       getPhase(table[1], _kmax[1], 0, kVector.m[1])*
+                                       getPhase(table[2], _kmax[2], 0, kVector.m[2])*std::conj(_structureFactors[kk]);
+                sum += kVector.influence*term.real();
+                if (field != NULL) {
+                    double odd = -2.0*M_PI*kVector.influence*term.imag();
+                    for (int axis = 0; axis < 3; axis++)
+                        gradient[axis] += odd*kVector.m[axis];
+                }
+                if (fieldGradient != NULL) {
+                    double even = -4.0*M_PI*M_PI*kVector.influence*term.real();
+                    for (int jj = 0; jj < 3; jj++)
+                        for (int ll = jj; ll < 3; ll++)
+                            second[jj][ll] += even*kVector.m[jj]*kVector.m[ll];
+                }
+            }
+            potential[pp] += sum;
+            if (field != NULL) {
+
+                // from fractional to Cartesian derivatives
+
+                for (int jj = 0; jj < 3; jj++)
+                    (*field)[pp][jj] -= gradient[0]*_recipBoxVectors[jj][0] + gradient[1]*_recipBoxVectors[jj][1] + gradient[2]*_recipBoxVectors[jj][2];
+            }
+            if (fieldGradient != NULL) {
+                second[1][0] = second[0][1];
+                second[2][0] = second[0][2];
+                second[2][1] = second[1][2];
+                int element = 0;
+                for (int a = 0; a < 3; a++) {
+                    for (int b = a; b < 3; b++) {
+                        double cartesian = 0.0;
+                        for (int jj = 0; jj < 3; jj++)
+                            for (int kk = 0; kk < 3; kk++)
+                                cartesian += _recipBoxVectors[a][jj]*_recipBoxVectors[b][kk]*second[jj][kk];
+                        (*fieldGradient)[6*pp+element++] -= cartesian;
+                    }
+                }
+            }
+        }
+    });
+}
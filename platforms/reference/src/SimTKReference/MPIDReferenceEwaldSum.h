@@ -0,0 +1,155 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __MPIDReferenceEwaldSum_H__
+#define __MPIDReferenceEwaldSum_H__
+
+#include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
+#include <complex>
+#include <vector>
+
+/**
+ * Explicit reciprocal space part of the Ewald sum for multipoles up to octopoles.
+ *
+ * This computes the same quantity as the PME grid pipeline, the reciprocal space potential and its
+ * derivatives up to fourth order with respect to the fractional coordinates of each particle, but
+ * sums over the reciprocal lattice vectors directly instead of interpolating on a grid.  The result
+ * is exact up to the truncation at the largest lattice index along each axis, which makes it a
+ * reference for checking PME and a cheaper choice for small unit cells.
+ *
+ * Multipoles and potentials use the layout of MPIDReferencePmeForce: fractional coordinates are
+ * those of the unit cell, and the 35 derivative components are ordered 000, 100, 010, 001, 200, 020,
+ * 002, 110, 101, 011, 300, 030, 003, 210, 201, 120, 021, 102, 012, 111, 400, 040, 004, 310, 301, 130,
+ * 031, 103, 013, 220, 202, 022, 211, 121, 112.  The multipole of a particle is given by its
+ * coefficients on the first 1, 4, 10 or 20 of these, so that the energy is their dot product with the
+ * potential.
+ */
+class MPIDReferenceEwaldSum {
+
+public:
+
+    /**
+     * Create an Ewald sum over the reciprocal lattice vectors whose indices lie within the given
+     * limits.
+     *
+     * @param kmaxx   the largest lattice index along x
+     * @param kmaxy   the largest lattice index along y
+     * @param kmaxz   the largest lattice index along z
+     */
+    MPIDReferenceEwaldSum(int kmaxx, int kmaxy, int kmaxz);
+
+    /**
+     * Get the largest lattice index summed along an axis.
+     *
+     * @param axis    0, 1 or 2 for x, y or z
+     */
+    int getKMax(int axis) const {
+        return _kmax[axis];
+    }
+
+    /**
+     * Set the reciprocal box vectors and the Ewald separation parameter.  The list of lattice vectors
+     * and their influence function is only rebuilt if either changed.
+     *
+     * @param recipBoxVectors   the reciprocal box vectors
+     * @param alphaEwald        the Ewald separation parameter
+     */
+    void setBox(const OpenMM::Vec3* recipBoxVectors, double alphaEwald);
+
+    /**
+     * Set the particle positions.  This fills the tables of phase factors, which are reused by every
+     * call to computePotential() until the positions change, so the induced dipole iterations only
+     * pay for the sums themselves.
+     *
+     * @param positions   the particle positions
+     * @param threads     the thread pool to use, or NULL to run on the calling thread
+     */
+    void setPositions(const std::vector<OpenMM::Vec3>& positions, OpenMM::ThreadPool* threads);
+
+    /**
+     * Compute the reciprocal space potential and its derivatives at every particle.  The lattice
+     * vectors are divided between the threads, each accumulating into a private buffer, and the
+     * buffers are summed over blocks of particles.
+     *
+     * @param numComponents   the number of multipole coefficients per particle: 1, 4, 10 or 20
+     * @param multipoles      the multipole coefficients, numComponents per particle
+     * @param phi             on exit, the 35 potential derivatives of each particle
+     * @param threads         the thread pool to use, or NULL to run on the calling thread
+     */
+    void computePotential(int numComponents, const std::vector<double>& multipoles, std::vector<double>& phi, OpenMM::ThreadPool* threads);
+
+    /**
+     * Set the multipoles whose potential computePotentialAtPoints() evaluates.  This sums the
+     * structure factors from the phase factors of the last call to setPositions(), so any number
+     * of points can follow at the cost of the lattice sums at the points alone.
+     *
+     * @param numComponents   the number of multipole coefficients per particle: 1, 4, 10 or 20
+     * @param multipoles      the multipole coefficients, numComponents per particle
+     * @param threads         the thread pool to use, or NULL to run on the calling thread
+     */
+    void setMultipoles(int numComponents, const std::vector<double>& multipoles, OpenMM::ThreadPool* threads);
+
+    /**
+     * Compute the reciprocal space potential, and optionally the field and its gradient, of the
+     * multipoles given to setMultipoles() at arbitrary points.  The points are divided between the threads.
+     *
+     * @param points          the points at which to compute the potential
+     * @param potential       the potential at each point is added to the corresponding element
+     * @param field           if not NULL, the field (minus the gradient of the potential) at each
+     *                        point is added to the corresponding element
+     * @param fieldGradient   if not NULL, the gradient of the field at each point is added to the
+     *                        corresponding six elements, in the order xx, xy, xz, yy, yz, zz
+     * @param threads         the thread pool to use, or NULL to run on the calling thread
+     */
+    void computePotentialAtPoints(const std::vector<OpenMM::Vec3>& points, std::vector<double>& potential,
+                                  std::vector<OpenMM::Vec3>* field, std::vector<double>* fieldGradient,
+                                  OpenMM::ThreadPool* threads) const;
+
+private:
+
+    struct KVector {
+        int m[3];
+        double influence;
+    };
+
+    void computeKVectorBlock(int numComponents, const std::vector<double>& multipoles, unsigned int start, unsigned int end,
+                             std::vector<std::complex<double> >& phases, std::vector<double>& phi) const;
+
+    int _kmax[3];
+    int _numParticles;
+    OpenMM::Vec3 _recipBoxVectors[3];
+    double _alphaEwald;
+    std::vector<KVector> _kVectors;
+
+    // _phase[axis][particle*(kmax+1)+m] is exp(2 pi i m s), with s the fractional coordinate along
+    // the axis; negative indices use the complex conjugate
+
+    std::vector<std::complex<double> > _phase[3];
+    std::vector<std::vector<std::complex<double> > > _threadPhases;
+    std::vector<std::vector<double> > _threadPhi;
+    std::vector<std::complex<double> > _structureFactors;
+};
+
+#endif // __MPIDReferenceEwaldSum_H__
@@ -0,0 +1,309 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MPIDReferenceFFT.h"
+#include "fftpack.h"
+#include <algorithm>
+#include <complex>
+#include <mutex>
+#include <vector>
+#ifdef MPID_USE_FFTW
+#include <fftw3.h>
+#endif
+
+using std::complex;
+using std::vector;
+using OpenMM::ThreadPool;
+
+namespace {
+
+/**
+ * Run task(threadIndex, numThreads) on every thread of the pool, or on the calling thread if there is none.
+ */
+template <class Task>
+void runOnThreads(ThreadPool* threads, Task task)
+{
+    if (threads == NULL || threads->getNumThreads() == 1) {
+        task(0, 1);
+        return;
+    }
+    int numThreads = threads->getNumThreads();
+    threads->execute([&] (ThreadPool& pool, int threadIndex) {
+        task(threadIndex, numThreads);
+    });
+    threads->waitForThreads();
+}
+
+/**
+ * The built in implementation.  The z lines are real, so they are transformed two at a time by packing
+ * them into the real and imaginary parts of one complex fftpack transform.  That gives the half grid,
+ * which is then transformed along y and x with complex fftpack transforms.  Each pass is split over
+ * the lines of the grid, with a plan and a work line per thread since fftpack plans are not reentrant.
+ */
+class FftpackFFT : public MPIDReferenceFFT {
+
+public:
+
+    FftpackFFT(int xsize, int ysize, int zsize) : MPIDReferenceFFT(xsize, ysize, zsize) {
+    }
+
+    ~FftpackFFT() {
+        for (auto& data : _threadData)
+            for (int axis = 0; axis < 3; axis++)
+                fftpack_destroy(data.plan[axis]);
+    }
+
+    void execForward(double* grid, ThreadPool* threads) {
+        initializeThreads(threads);
+        complex<double>* complexGrid = reinterpret_cast<complex<double>*>(grid);
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            transformRealLines(grid, FFTPACK_FORWARD, threadIndex, numThreads);
+        });
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            transformComplexLines(complexGrid, 1, FFTPACK_FORWARD, threadIndex, numThreads);
+        });
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            transformComplexLines(complexGrid, 0, FFTPACK_FORWARD, threadIndex, numThreads);
+        });
+    }
+
+    void execBackward(double* grid, ThreadPool* threads) {
+        initializeThreads(threads);
+        complex<double>* complexGrid = reinterpret_cast<complex<double>*>(grid);
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            transformComplexLines(complexGrid, 0, FFTPACK_BACKWARD, threadIndex, numThreads);
+        });
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            transformComplexLines(complexGrid, 1, FFTPACK_BACKWARD, threadIndex, numThreads);
+        });
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            transformRealLines(grid, FFTPACK_BACKWARD, threadIndex, numThreads);
+        });
+    }
+
+private:
+
+    struct ThreadData {
+        fftpack_t plan[3];
+        vector<t_complex> line;
+    };
+
+    void initializeThreads(ThreadPool* threads) {
+        int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+        int size[3] = {_xsize, _ysize, _zsize};
+        while ((int) _threadData.size() < numThreads) {
+            ThreadData data;
+            for (int axis = 0; axis < 3; axis++)
+                fftpack_init_1d(&data.plan[axis], size[axis]);
+            data.line.resize(std::max(_xsize, std::max(_ysize, _zsize)));
+            _threadData.push_back(data);
+        }
+    }
+
+    /**
+     * Transform the z lines, between the real grid and the half complex grid.  Lines 2n and 2n+1 are
+     * transformed together as the real and imaginary parts of one complex line.
+     */
+    void transformRealLines(double* grid, fftpack_direction direction, int threadIndex, int numThreads) {
+        ThreadData& data = _threadData[threadIndex];
+        t_complex* line = &data.line[0];
+        int numLines = _xsize*_ysize;
+        int stride = getZStride();
+        int halfSize = _zsize/2+1;
+        for (int first = 2*threadIndex; first < numLines; first += 2*numThreads) {
+            bool hasSecond = (first+1 < numLines);
+            double* a = grid+first*stride;
+            double* b = (hasSecond ? a+stride : NULL);
+            if (direction == FFTPACK_FORWARD) {
+                for (int z = 0; z < _zsize; z++) {
+                    line[z].re = a[z];
+                    line[z].im = (hasSecond ? b[z] : 0.0);
+                }
+                fftpack_exec_1d(data.plan[2], FFTPACK_FORWARD, line, line);
+
+                // With c = a+ib, A(k) = (C(k)+C*(n-k))/2 and B(k) = (C(k)-C*(n-k))/2i.
+
+                for (int k = 0; k < halfSize; k++) {
+                    const t_complex& c = line[k];
+                    const t_complex& cm = line[(_zsize-k)%_zsize];
+                    a[2*k]   = 0.5*(c.re+cm.re);
+                    a[2*k+1] = 0.5*(c.im-cm.im);
+                    if (hasSecond) {
+                        b[2*k]   = 0.5*(c.im+cm.im);
+                        b[2*k+1] = 0.5*(cm.re-c.re);
+                    }
+                }
+            }
+            else {
+                for (int k = 0; k < _zsize; k++) {
+                    bool upper = (k >= halfSize);
+                    int index = (upper ? _zsize-k : k);
+                    double sign = (upper ? -1.0 : 1.0);
+                    double aRe = a[2*index], aIm = sign*a[2*index+1];
+                    double bRe = (hasSecond ? b[2*index] : 0.0);
+                    double bIm = (hasSecond ? sign*b[2*index+1] : 0.0);
+                    line[k].re = aRe-bIm;
+                    line[k].im = aIm+bRe;
+                }
+                fftpack_exec_1d(data.plan[2], FFTPACK_BACKWARD, line, line);
+                for (int z = 0; z < _zsize; z++) {
+                    a[z] = line[z].re;
+                    if (hasSecond)
+                        b[z] = line[z].im;
+                }
+            }
+        }
+    }
+
+    /**
+     * Transform the lines of the half complex grid along x (axis 0) or y (axis 1).
+     */
+    void transformComplexLines(complex<double>* grid, int axis, fftpack_direction direction, int threadIndex, int numThreads) {
+        ThreadData& data = _threadData[threadIndex];
+        t_complex* line = &data.line[0];
+        int halfSize = _zsize/2+1;
+        int length = (axis == 0 ? _xsize : _ysize);
+        int otherSize = (axis == 0 ? _ysize : _xsize);
+        int step = (axis == 0 ? _ysize*halfSize : halfSize);
+        int numLines = otherSize*halfSize;
+        for (int lineIndex = threadIndex; lineIndex < numLines; lineIndex += numThreads) {
+            int other = lineIndex/halfSize;
+            int z = lineIndex-other*halfSize;
+            complex<double>* start = grid + (axis == 0 ? other*halfSize : other*_ysize*halfSize) + z;
+            for (int i = 0; i < length; i++) {
+                line[i].re = start[i*step].real();
+                line[i].im = start[i*step].imag();
+            }
+            fftpack_exec_1d(data.plan[axis], direction, line, line);
+            for (int i = 0; i < length; i++)
+                start[i*step] = complex<double>(line[i].re, line[i].im);
+        }
+    }
+
+    vector<ThreadData> _threadData;
+};
+
+#ifdef MPID_USE_FFTW
+
+/**
+ * FFTW's planner, fftw_destroy_plan() and fftw_plan_with_nthreads() share state across the process and
+ * are not thread safe, so every FftwFFT makes and destroys its plans while holding this lock.  Executing
+ * a plan is thread safe and needs no lock.
+ */
+std::mutex fftwPlannerMutex;
+
+/**
+ * FFTW implementation.  Plans are made for in place transforms of unaligned data, so the same plans can
+ * be applied to any grid with new-array execution.  With the threaded FFTW library, the plans are remade
+ * whenever the number of threads changes.
+ */
+class FftwFFT : public MPIDReferenceFFT {
+
+public:
+
+    FftwFFT(int xsize, int ysize, int zsize) : MPIDReferenceFFT(xsize, ysize, zsize), _numThreads(0),
+            _forwardPlan(NULL), _backwardPlan(NULL) {
+    }
+
+    ~FftwFFT() {
+        std::lock_guard<std::mutex> lock(fftwPlannerMutex);
+        destroyPlans();
+    }
+
+    void execForward(double* grid, ThreadPool* threads) {
+        createPlans(threads);
+        fftw_execute_dft_r2c(_forwardPlan, grid, reinterpret_cast<fftw_complex*>(grid));
+    }
+
+    void execBackward(double* grid, ThreadPool* threads) {
+        createPlans(threads);
+        fftw_execute_dft_c2r(_backwardPlan, reinterpret_cast<fftw_complex*>(grid), grid);
+    }
+
+private:
+
+    /**
+     * Destroy the plans.  The caller must hold fftwPlannerMutex.
+     */
+    void destroyPlans() {
+        if (_forwardPlan != NULL)
+            fftw_destroy_plan(_forwardPlan);
+        if (_backwardPlan != NULL)
+            fftw_destroy_plan(_backwardPlan);
+        _forwardPlan = _backwardPlan = NULL;
+    }
+
+    void createPlans(ThreadPool* threads) {
+        int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+#ifndef MPID_USE_FFTW_THREADS
+        numThreads = 1;
+#endif
+        if (_forwardPlan != NULL && numThreads == _numThreads)
+            return;
+        std::lock_guard<std::mutex> lock(fftwPlannerMutex);
+        destroyPlans();
+#ifdef MPID_USE_FFTW_THREADS
+        static bool threadsInitialized = (fftw_init_threads() != 0);
+        if (threadsInitialized)
+            fftw_plan_with_nthreads(numThreads);
+#endif
+        double* grid = fftw_alloc_real(getGridSize());
+        fftw_complex* complexGrid = reinterpret_cast<fftw_complex*>(grid);
+        _forwardPlan = fftw_plan_dft_r2c_3d(_xsize, _ysize, _zsize, grid, complexGrid, FFTW_ESTIMATE | FFTW_UNALIGNED);
+        _backwardPlan = fftw_plan_dft_c2r_3d(_xsize, _ysize, _zsize, complexGrid, grid, FFTW_ESTIMATE | FFTW_UNALIGNED);
+        fftw_free(grid);
+        _numThreads = numThreads;
+    }
+
+    int _numThreads;
+    fftw_plan _forwardPlan;
+    fftw_plan _backwardPlan;
+};
+
+#endif
+
+} // namespace
+
+MPIDReferenceFFT* MPIDReferenceFFT::create(int xsize, int ysize, int zsize)
+{
+#ifdef MPID_USE_FFTW
+    return new FftwFFT(xsize, ysize, zsize);
+#else
+    return new FftpackFFT(xsize, ysize, zsize);
+#endif
+}
+
+int MPIDReferenceFFT::findLegalDimension(int minimum)
+{
+    if (minimum < 1)
+        return 1;
+    for (int size = minimum; ; size++) {
+        int unfactored = size;
+        for (int factor = 2; factor <= 5; factor++)
+            while (unfactored%factor == 0)
+                unfactored /= factor;
+        if (unfactored == 1)
+            return size;
+    }
+}
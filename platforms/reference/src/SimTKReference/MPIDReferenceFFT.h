@@ -0,0 +1,104 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __MPIDReferenceFFT_H__
+#define __MPIDReferenceFFT_H__
+
+#include "openmm/internal/ThreadPool.h"
+
+/**
+ * Three dimensional real-to-complex FFT of the PME grid.
+ *
+ * The transforms are done in place.  The real grid has dimensions xsize*ysize*zsize, stored with z
+ * fastest and each z line padded to getZStride() values.  The forward transform replaces it with the
+ * non-redundant half of the complex transform, xsize*ysize*(zsize/2+1) values, again with z fastest.
+ * The backward transform is not normalized.
+ *
+ * Use create() to get the best implementation available in this build.
+ */
+class MPIDReferenceFFT {
+
+public:
+
+    virtual ~MPIDReferenceFFT() {}
+
+    /**
+     * Create an FFT for a grid of the given size.  This uses FFTW if the plugin was built with it,
+     * and a built in implementation on top of fftpack otherwise.
+     *
+     * @param xsize   grid size along x
+     * @param ysize   grid size along y
+     * @param zsize   grid size along z
+     */
+    static MPIDReferenceFFT* create(int xsize, int ysize, int zsize);
+
+    /**
+     * Get the smallest grid size at least as large as the one requested that the FFT handles
+     * efficiently, i.e. whose only prime factors are 2, 3 and 5.
+     *
+     * @param minimum   the smallest acceptable size
+     */
+    static int findLegalDimension(int minimum);
+
+    /**
+     * Get the number of values each z line of the real grid occupies, zsize rounded up to 2*(zsize/2+1).
+     */
+    int getZStride() const {
+        return 2*(_zsize/2+1);
+    }
+
+    /**
+     * Get the number of doubles the grid occupies.
+     */
+    int getGridSize() const {
+        return _xsize*_ysize*getZStride();
+    }
+
+    /**
+     * Transform a real grid to the half complex grid, in place.
+     *
+     * @param grid      the grid
+     * @param threads   the thread pool to use, or NULL to run on the calling thread
+     */
+    virtual void execForward(double* grid, OpenMM::ThreadPool* threads) = 0;
+
+    /**
+     * Transform a half complex grid to the real grid, in place.
+     *
+     * @param grid      the grid
+     * @param threads   the thread pool to use, or NULL to run on the calling thread
+     */
+    virtual void execBackward(double* grid, OpenMM::ThreadPool* threads) = 0;
+
+protected:
+
+    MPIDReferenceFFT(int xsize, int ysize, int zsize) : _xsize(xsize), _ysize(ysize), _zsize(zsize) {
+    }
+
+    int _xsize;
+    int _ysize;
+    int _zsize;
+};
+
+#endif // __MPIDReferenceFFT_H__
@@ -0,0 +1,489 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MPIDReferenceFMM.h"
+#include <algorithm>
+#include <cmath>
+
+using std::pair;
+using std::vector;
+using OpenMM::ThreadPool;
+using OpenMM::Vec3;
+
+namespace {
+
+// powers of x, y and z of each of the 35 potential derivatives
+
+const int COMPONENT_POWERS[35][3] = {
+    {0,0,0},
+    {1,0,0}, {0,1,0}, {0,0,1},
+    {2,0,0}, {0,2,0}, {0,0,2}, {1,1,0}, {1,0,1}, {0,1,1},
+    {3,0,0}, {0,3,0}, {0,0,3}, {2,1,0}, {2,0,1}, {1,2,0}, {0,2,1}, {1,0,2}, {0,1,2}, {1,1,1},
+    {4,0,0}, {0,4,0}, {0,0,4}, {3,1,0}, {3,0,1}, {1,3,0}, {0,3,1}, {1,0,3}, {0,1,3},
+    {2,2,0}, {2,0,2}, {0,2,2}, {2,1,1}, {1,2,1}, {1,1,2}
+};
+
+// Morton codes interleave 10 bits per axis
+
+const int MAX_DEPTH = 10;
+
+// offsets between boxes are -3..3 along each axis in the interaction lists
+
+const int MAX_OFFSET = 3;
+const int OFFSET_RANGE = 2*MAX_OFFSET+1;
+
+/**
+ * Run task(threadIndex, numThreads) on every thread of the pool, or on the calling thread if there is none.
+ */
+template <class Task>
+void runOnThreads(ThreadPool* threads, Task task)
+{
+    if (threads == NULL || threads->getNumThreads() == 1) {
+        task(0, 1);
+        return;
+    }
+    int numThreads = threads->getNumThreads();
+    threads->execute([&] (ThreadPool& pool, int threadIndex) {
+        task(threadIndex, numThreads);
+    });
+    threads->waitForThreads();
+}
+
+unsigned int spreadBits(unsigned int x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x30000ff;
+    x = (x | (x << 8)) & 0x300f00f;
+    x = (x | (x << 4)) & 0x30c30c3;
+    x = (x | (x << 2)) & 0x9249249;
+    return x;
+}
+
+unsigned int getMortonCode(const int* coords)
+{
+    return (spreadBits(coords[0]) << 2) | (spreadBits(coords[1]) << 1) | spreadBits(coords[2]);
+}
+
+}
+
+MPIDReferenceFMM::MPIDReferenceFMM(int expansionOrder, int treeDepth) : _order(expansionOrder), _requestedDepth(treeDepth),
+        _depth(0), _numParticles(0), _width(1.0)
+{
+    buildTerms();
+    buildInteractionTable();
+}
+
+double MPIDReferenceFMM::getTargetError() const
+{
+    return pow(2.0, -0.5*_order);
+}
+
+void MPIDReferenceFMM::buildTerms()
+{
+    // The first 35 terms follow the potential derivatives; higher degrees are in lexical order.
+
+    _powers.clear();
+    _degree.clear();
+    _numTermsUpToDegree.resize(_order+1);
+    for (int degree = 0; degree <= _order; degree++) {
+        if (degree <= 4) {
+            for (int cc = 0; cc < 35; cc++)
+                if (COMPONENT_POWERS[cc][0]+COMPONENT_POWERS[cc][1]+COMPONENT_POWERS[cc][2] == degree) {
+                    for (int axis = 0; axis < 3; axis++)
+                        _powers.push_back(COMPONENT_POWERS[cc][axis]);
+                    _degree.push_back(degree);
+                }
+        }
+        else {
+            for (int px = degree; px >= 0; px--)
+                for (int py = degree-px; py >= 0; py--) {
+                    _powers.push_back(px);
+                    _powers.push_back(py);
+                    _powers.push_back(degree-px-py);
+                    _degree.push_back(degree);
+                }
+        }
+        _numTermsUpToDegree[degree] = _degree.size();
+    }
+    int numTerms = _degree.size();
+    int stride = _order+1;
+    _termIndex.assign(stride*stride*stride, -1);
+    _inverseFactorial.resize(numTerms);
+    _lowerTerm.assign(numTerms, -1);
+    _lowerAxis.assign(numTerms, -1);
+    for (int tt = 0; tt < numTerms; tt++) {
+        const int* powers = &_powers[3*tt];
+        _termIndex[(powers[0]*stride+powers[1])*stride+powers[2]] = tt;
+        double factorial = 1.0;
+        for (int axis = 0; axis < 3; axis++)
+            for (int pp = 2; pp <= powers[axis]; pp++)
+                factorial *= pp;
+        _inverseFactorial[tt] = 1.0/factorial;
+    }
+    for (int tt = 1; tt < numTerms; tt++) {
+        const int* powers = &_powers[3*tt];
+        int axis = (powers[0] > 0 ? 0 : (powers[1] > 0 ? 1 : 2));
+        int lower[3] = {powers[0], powers[1], powers[2]};
+        lower[axis]--;
+        _lowerAxis[tt] = axis;
+        _lowerTerm[tt] = _termIndex[(lower[0]*stride+lower[1])*stride+lower[2]];
+    }
+    _sumIndex.assign(numTerms*numTerms, -1);
+    for (int aa = 0; aa < numTerms; aa++) {
+        const int* powersA = &_powers[3*aa];
+        for (int bb = 0; bb < _numTermsUpToDegree[_order-_degree[aa]]; bb++) {
+            const int* powersB = &_powers[3*bb];
+            _sumIndex[aa*numTerms+bb] = _termIndex[((powersA[0]+powersB[0])*stride+powersA[1]+powersB[1])*stride+powersA[2]+powersB[2]];
+        }
+    }
+}
+
+void MPIDReferenceFMM::buildInteractionTable()
+{
+    // The Taylor coefficients a = D/alpha! of 1/|R| follow from
+    //
+    //     n R^2 a_alpha = -(2n-1) sum_i R_i a_(alpha-e_i) - (n-1) sum_i a_(alpha-2e_i),   n = |alpha|
+    //
+    // Offsets between touching boxes are never used and are left at zero.
+
+    int numTerms = _degree.size();
+    int stride = _order+1;
+    _interactionTable.assign(OFFSET_RANGE*OFFSET_RANGE*OFFSET_RANGE*numTerms, 0.0);
+    vector<double> coefficients(numTerms);
+    for (int dx = -MAX_OFFSET; dx <= MAX_OFFSET; dx++)
+        for (int dy = -MAX_OFFSET; dy <= MAX_OFFSET; dy++)
+            for (int dz = -MAX_OFFSET; dz <= MAX_OFFSET; dz++) {
+                if (abs(dx) <= 1 && abs(dy) <= 1 && abs(dz) <= 1)
+                    continue;
+                double delta[3] = {(double) dx, (double) dy, (double) dz};
+                double r2 = dx*dx + dy*dy + dz*dz;
+                coefficients[0] = 1.0/sqrt(r2);
+                for (int tt = 1; tt < numTerms; tt++) {
+                    const int* powers = &_powers[3*tt];
+                    int n = _degree[tt];
+                    double sum = 0.0;
+                    for (int axis = 0; axis < 3; axis++) {
+                        int lower[3] = {powers[0], powers[1], powers[2]};
+                        if (lower[axis] >= 1) {
+                            lower[axis]--;
+                            sum += (2*n-1)*delta[axis]*coefficients[_termIndex[(lower[0]*stride+lower[1])*stride+lower[2]]];
+                        }
+                        if (lower[axis] >= 1) {
+                            lower[axis]--;
+                            sum += (n-1)*coefficients[_termIndex[(lower[0]*stride+lower[1])*stride+lower[2]]];
+                        }
+                    }
+                    coefficients[tt] = -sum/(n*r2);
+                }
+                double* table = &_interactionTable[(((dx+MAX_OFFSET)*OFFSET_RANGE+dy+MAX_OFFSET)*OFFSET_RANGE+dz+MAX_OFFSET)*numTerms];
+                for (int tt = 0; tt < numTerms; tt++)
+                    table[tt] = coefficients[tt]/_inverseFactorial[tt];
+            }
+}
+
+void MPIDReferenceFMM::computeMonomials(const Vec3& delta, double* monomials) const
+{
+    // delta^alpha/alpha!
+
+    monomials[0] = 1.0;
+    int numTerms = _degree.size();
+    for (int tt = 1; tt < numTerms; tt++) {
+        int axis = _lowerAxis[tt];
+        monomials[tt] = monomials[_lowerTerm[tt]]*delta[axis]/_powers[3*tt+axis];
+    }
+}
+
+int MPIDReferenceFMM::findBox(int level, const int* coords) const
+{
+    int size = 1 << level;
+    for (int axis = 0; axis < 3; axis++)
+        if (coords[axis] < 0 || coords[axis] >= size)
+            return -1;
+    unsigned int code = getMortonCode(coords);
+    const vector<Box>& boxes = _boxes[level];
+    vector<Box>::const_iterator box = std::lower_bound(boxes.begin(), boxes.end(), code,
+            [] (const Box& box, unsigned int code) { return box.code < code; });
+    if (box == boxes.end() || box->code != code)
+        return -1;
+    return box-boxes.begin();
+}
+
+Vec3 MPIDReferenceFMM::getBoxCenter(int level, const Box& box) const
+{
+    double width = _width/(1 << level);
+    return _origin + Vec3(box.coords[0]+0.5, box.coords[1]+0.5, box.coords[2]+0.5)*width;
+}
+
+void MPIDReferenceFMM::setPositions(const vector<Vec3>& positions, double minimumLeafWidth)
+{
+    _numParticles = positions.size();
+    _positions = positions;
+    _nearPairs.clear();
+
+    // bounding cube
+
+    Vec3 lower, upper;
+    if (_numParticles > 0)
+        lower = upper = positions[0];
+    for (int ii = 1; ii < _numParticles; ii++)
+        for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::min(lower[axis], positions[ii][axis]);
+            upper[axis] = std::max(upper[axis], positions[ii][axis]);
+        }
+    _width = std::max(upper[0]-lower[0], std::max(upper[1]-lower[1], upper[2]-lower[2]));
+    _width = (_width > 0.0 ? _width*(1.0+1e-6) : 1.0);
+    _origin = lower;
+
+    // Aim for a few dozen particles per leaf unless a depth was given, but never make the leaves
+    // narrower than the near field.
+
+    if (_requestedDepth > 0)
+        _depth = std::min(_requestedDepth, MAX_DEPTH);
+    else {
+        _depth = 0;
+        while (_depth < MAX_DEPTH && _numParticles >= 32.0*pow(8.0, _depth+1))
+            _depth++;
+    }
+    while (_depth > 0 && _width/(1 << _depth) < minimumLeafWidth)
+        _depth--;
+
+    // sort the particles by leaf and collect the occupied boxes of every level
+
+    int leafSize = 1 << _depth;
+    double leafWidth = _width/leafSize;
+    vector<pair<unsigned int, int> > codes(_numParticles);
+    vector<int> leafCoords(3*_numParticles);
+    for (int ii = 0; ii < _numParticles; ii++) {
+        int* coords = &leafCoords[3*ii];
+        for (int axis = 0; axis < 3; axis++)
+            coords[axis] = std::min(std::max((int) floor((positions[ii][axis]-_origin[axis])/leafWidth), 0), leafSize-1);
+        codes[ii] = std::make_pair(getMortonCode(coords), ii);
+    }
+    std::sort(codes.begin(), codes.end());
+    _sortedParticles.resize(_numParticles);
+    _boxes.assign(_depth+1, vector<Box>());
+    for (int ii = 0; ii < _numParticles; ii++) {
+        int particle = codes[ii].second;
+        _sortedParticles[ii] = particle;
+        if (ii == 0 || codes[ii].first != codes[ii-1].first) {
+            Box box;
+            box.code = codes[ii].first;
+            for (int axis = 0; axis < 3; axis++)
+                box.coords[axis] = leafCoords[3*particle+axis];
+            box.start = ii;
+            _boxes[_depth].push_back(box);
+        }
+        _boxes[_depth].back().end = ii+1;
+    }
+    for (int level = _depth-1; level >= 0; level--) {
+        for (const Box& child : _boxes[level+1]) {
+            unsigned int code = child.code >> 3;
+            if (_boxes[level].empty() || _boxes[level].back().code != code) {
+                Box box;
+                box.code = code;
+                for (int axis = 0; axis < 3; axis++)
+                    box.coords[axis] = child.coords[axis] >> 1;
+                box.start = child.start;
+                _boxes[level].push_back(box);
+            }
+            _boxes[level].back().end = child.end;
+        }
+    }
+
+    // Near pairs are those within a leaf and between touching leaves; each pair of leaves is
+    // visited once by only looking at the 13 neighbors that come later in z, y, x.
+
+    for (const Box& leaf : _boxes[_depth]) {
+        for (int ii = leaf.start; ii < leaf.end; ii++)
+            for (int jj = ii+1; jj < leaf.end; jj++)
+                _nearPairs.push_back(std::make_pair(std::min(_sortedParticles[ii], _sortedParticles[jj]),
+                                                    std::max(_sortedParticles[ii], _sortedParticles[jj])));
+        for (int dz = 0; dz <= 1; dz++)
+            for (int dy = (dz == 0 ? 0 : -1); dy <= 1; dy++)
+                for (int dx = (dz == 0 && dy == 0 ? 1 : -1); dx <= 1; dx++) {
+                    int coords[3] = {leaf.coords[0]+dx, leaf.coords[1]+dy, leaf.coords[2]+dz};
+                    int neighbor = findBox(_depth, coords);
+                    if (neighbor < 0)
+                        continue;
+                    const Box& other = _boxes[_depth][neighbor];
+                    for (int ii = leaf.start; ii < leaf.end; ii++)
+                        for (int jj = other.start; jj < other.end; jj++)
+                            _nearPairs.push_back(std::make_pair(std::min(_sortedParticles[ii], _sortedParticles[jj]),
+                                                                std::max(_sortedParticles[ii], _sortedParticles[jj])));
+                }
+    }
+}
+
+void MPIDReferenceFMM::computePotential(int numComponents, const vector<double>& multipoles, vector<double>& phi, ThreadPool* threads)
+{
+    phi.assign(35*_numParticles, 0.0);
+    if (_depth < 2)
+        return;
+    int numTerms = _degree.size();
+    _multipoleExpansions.resize(_depth+1);
+    _localExpansions.resize(_depth+1);
+    for (int level = 2; level <= _depth; level++) {
+        _multipoleExpansions[level].assign(_boxes[level].size()*numTerms, 0.0);
+        _localExpansions[level].assign(_boxes[level].size()*numTerms, 0.0);
+    }
+
+    // particles to the multipole expansions of the leaves
+
+    const vector<Box>& leaves = _boxes[_depth];
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        vector<double> monomials(numTerms);
+        for (int bb = threadIndex; bb < (int) leaves.size(); bb += numThreads) {
+            Vec3 center = getBoxCenter(_depth, leaves[bb]);
+            double* expansion = &_multipoleExpansions[_depth][bb*numTerms];
+            for (int ii = leaves[bb].start; ii < leaves[bb].end; ii++) {
+                int particle = _sortedParticles[ii];
+                computeMonomials(_positions[particle]-center, &monomials[0]);
+                const double* multipole = &multipoles[numComponents*particle];
+                for (int cc = 0; cc < numComponents; cc++) {
+                    if (multipole[cc] == 0.0)
+                        continue;
+                    const int* sumIndex = &_sumIndex[cc*numTerms];
+                    for (int tt = 0; tt < _numTermsUpToDegree[_order-_degree[cc]]; tt++)
+                        expansion[sumIndex[tt]] += multipole[cc]*monomials[tt];
+                }
+            }
+        }
+    });
+
+    // children to parents; the children of a box follow each other in Morton order
+
+    for (int level = _depth-1; level >= 2; level--) {
+        const vector<Box>& parents = _boxes[level];
+        const vector<Box>& children = _boxes[level+1];
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            vector<double> monomials(numTerms);
+            for (int bb = threadIndex; bb < (int) parents.size(); bb += numThreads) {
+                Vec3 center = getBoxCenter(level, parents[bb]);
+                double* expansion = &_multipoleExpansions[level][bb*numTerms];
+                vector<Box>::const_iterator child = std::lower_bound(children.begin(), children.end(), parents[bb].code << 3,
+                        [] (const Box& box, unsigned int code) { return box.code < code; });
+                for (; child != children.end() && (child->code >> 3) == parents[bb].code; ++child) {
+                    computeMonomials(getBoxCenter(level+1, *child)-center, &monomials[0]);
+                    const double* childExpansion = &_multipoleExpansions[level+1][(child-children.begin())*numTerms];
+                    for (int aa = 0; aa < numTerms; aa++) {
+                        if (childExpansion[aa] == 0.0)
+                            continue;
+                        const int* sumIndex = &_sumIndex[aa*numTerms];
+                        for (int tt = 0; tt < _numTermsUpToDegree[_order-_degree[aa]]; tt++)
+                            expansion[sumIndex[tt]] += childExpansion[aa]*monomials[tt];
+                    }
+                }
+            }
+        });
+    }
+
+    // Multipole to local expansions over the interaction lists, then local expansions down to
+    // the children.  Derivatives of 1/r between boxes of width w at offset R/w scale as
+    // w^-(n+1), which is split between the source and the target.
+
+    for (int level = 2; level <= _depth; level++) {
+        const vector<Box>& boxes = _boxes[level];
+        if (level > 2) {
+            const vector<Box>& parents = _boxes[level-1];
+            runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+                vector<double> monomials(numTerms);
+                for (int bb = threadIndex; bb < (int) boxes.size(); bb += numThreads) {
+                    int parentCoords[3] = {boxes[bb].coords[0] >> 1, boxes[bb].coords[1] >> 1, boxes[bb].coords[2] >> 1};
+                    int parent = findBox(level-1, parentCoords);
+                    computeMonomials(getBoxCenter(level, boxes[bb])-getBoxCenter(level-1, parents[parent]), &monomials[0]);
+                    const double* parentExpansion = &_localExpansions[level-1][parent*numTerms];
+                    double* expansion = &_localExpansions[level][bb*numTerms];
+                    for (int aa = 0; aa < numTerms; aa++) {
+                        const int* sumIndex = &_sumIndex[aa*numTerms];
+                        double sum = 0.0;
+                        for (int tt = 0; tt < _numTermsUpToDegree[_order-_degree[aa]]; tt++)
+                            sum += parentExpansion[sumIndex[tt]]*monomials[tt];
+                        expansion[aa] += sum;
+                    }
+                }
+            });
+        }
+        double width = _width/(1 << level);
+        vector<double> sourceScale(numTerms), targetScale(numTerms);
+        for (int tt = 0; tt < numTerms; tt++) {
+            sourceScale[tt] = (_degree[tt]%2 == 0 ? 1.0 : -1.0)*pow(width, -_degree[tt]);
+            targetScale[tt] = pow(width, -_degree[tt]-1);
+        }
+        runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+            vector<double> source(numTerms), target(numTerms);
+            for (int bb = threadIndex; bb < (int) boxes.size(); bb += numThreads) {
+                const int* coords = boxes[bb].coords;
+                std::fill(target.begin(), target.end(), 0.0);
+                for (int px = (coords[0] >> 1)-1; px <= (coords[0] >> 1)+1; px++)
+                    for (int py = (coords[1] >> 1)-1; py <= (coords[1] >> 1)+1; py++)
+                        for (int pz = (coords[2] >> 1)-1; pz <= (coords[2] >> 1)+1; pz++)
+                            for (int child = 0; child < 8; child++) {
+                                int sourceCoords[3] = {2*px+(child >> 2), 2*py+((child >> 1)&1), 2*pz+(child&1)};
+                                int offset[3] = {coords[0]-sourceCoords[0], coords[1]-sourceCoords[1], coords[2]-sourceCoords[2]};
+                                if (abs(offset[0]) <= 1 && abs(offset[1]) <= 1 && abs(offset[2]) <= 1)
+                                    continue;
+                                int sourceBox = findBox(level, sourceCoords);
+                                if (sourceBox < 0)
+                                    continue;
+                                const double* expansion = &_multipoleExpansions[level][sourceBox*numTerms];
+                                for (int tt = 0; tt < numTerms; tt++)
+                                    source[tt] = expansion[tt]*sourceScale[tt];
+                                const double* table = &_interactionTable[(((offset[0]+MAX_OFFSET)*OFFSET_RANGE+offset[1]+MAX_OFFSET)*OFFSET_RANGE+offset[2]+MAX_OFFSET)*numTerms];
+                                for (int aa = 0; aa < numTerms; aa++) {
+                                    const int* sumIndex = &_sumIndex[aa*numTerms];
+                                    double sum = 0.0;
+                                    for (int tt = 0; tt < _numTermsUpToDegree[_order-_degree[aa]]; tt++)
+                                        sum += source[tt]*table[sumIndex[tt]];
+                                    target[aa] += sum;
+                                }
+                            }
+                double* expansion = &_localExpansions[level][bb*numTerms];
+                for (int tt = 0; tt < numTerms; tt++)
+                    expansion[tt] += target[tt]*targetScale[tt];
+            }
+        });
+    }
+
+    // local expansions of the leaves to the particles
+
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        vector<double> monomials(numTerms);
+        for (int bb = threadIndex; bb < (int) leaves.size(); bb += numThreads) {
+            Vec3 center = getBoxCenter(_depth, leaves[bb]);
+            const double* expansion = &_localExpansions[_depth][bb*numTerms];
+            for (int ii = leaves[bb].start; ii < leaves[bb].end; ii++) {
+                int particle = _sortedParticles[ii];
+                computeMonomials(_positions[particle]-center, &monomials[0]);
+                double* particlePhi = &phi[35*particle];
+                for (int cc = 0; cc < 35; cc++) {
+                    const int* sumIndex = &_sumIndex[cc*numTerms];
+                    double sum = 0.0;
+                    for (int tt = 0; tt < _numTermsUpToDegree[_order-_degree[cc]]; tt++)
+                        sum += expansion[sumIndex[tt]]*monomials[tt];
+                    particlePhi[cc] = sum;
+                }
+            }
+        }
+    });
+}
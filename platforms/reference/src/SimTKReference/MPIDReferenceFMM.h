@@ -0,0 +1,170 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __MPIDReferenceFMM_H__
+#define __MPIDReferenceFMM_H__
+
+#include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
+#include <utility>
+#include <vector>
+
+/**
+ * Fast multipole method for the Coulomb interaction of multipoles up to octopoles without periodic
+ * boundary conditions.
+ *
+ * The particles are sorted into a uniform octree over their bounding cube; only occupied boxes are
+ * stored.  Two leaves that touch are near each other, and the pairs of particles in near leaves are
+ * returned to the caller, which computes them exactly with its own damping and scaling.  Everything
+ * else is the far field: the multipoles of each box are collected into a Cartesian Taylor expansion
+ * of the given order about its center, translated up the tree, converted to local expansions between
+ * boxes whose parents touch but which do not touch themselves, translated down the tree and
+ * evaluated at the particles.  With a fixed order the cost is linear in the number of particles.
+ *
+ * Multipoles and potentials use the layout of MPIDReferenceEwaldSum, in Cartesian coordinates:
+ * the 35 derivative components are ordered 000, 100, 010, 001, 200, 020, 002, 110, 101, 011, 300,
+ * 030, 003, 210, 201, 120, 021, 102, 012, 111, 400, 040, 004, 310, 301, 130, 031, 103, 013, 220, 202,
+ * 022, 211, 121, 112, and the multipole of a particle is given by its coefficients on the first 1,
+ * 4, 10 or 20 of these, so that the energy is their dot product with the potential.
+ */
+class MPIDReferenceFMM {
+
+public:
+
+    /**
+     * Create a multipole tree.
+     *
+     * @param expansionOrder   the order of the Taylor expansions, at least 4
+     * @param treeDepth        the number of times the bounding cube is divided, or 0 to choose it
+     *                         from the number of particles
+     */
+    MPIDReferenceFMM(int expansionOrder, int treeDepth);
+
+    /**
+     * Get the order of the Taylor expansions.
+     */
+    int getExpansionOrder() const {
+        return _order;
+    }
+
+    /**
+     * Get the requested tree depth, or 0 if it is chosen automatically.
+     */
+    int getTreeDepth() const {
+        return _requestedDepth;
+    }
+
+    /**
+     * Get the relative error of the far field that the expansion order aims for.  It halves for every
+     * two orders, from a quarter at order 4.
+     */
+    double getTargetError() const;
+
+    /**
+     * Get the level of the leaves in the tree built by the last call to setPositions().  The far
+     * field starts two levels below the root, so there is none if this is less than 2.
+     */
+    int getLeafLevel() const {
+        return _depth;
+    }
+
+    /**
+     * Sort the particles into the tree and build the list of near pairs.  The leaves are made at
+     * least as wide as the given width, so every pair closer than it is a near pair; use this for
+     * the range of any damping or scaling of the interaction.
+     *
+     * @param positions            the particle positions
+     * @param minimumLeafWidth     the smallest allowed leaf width
+     */
+    void setPositions(const std::vector<OpenMM::Vec3>& positions, double minimumLeafWidth);
+
+    /**
+     * Get the pairs of particles (i, j), i < j, whose interaction is not in the far field.
+     */
+    const std::vector<std::pair<int, int> >& getNearPairs() const {
+        return _nearPairs;
+    }
+
+    /**
+     * Compute the far field potential and its derivatives at every particle.  Each pass over the
+     * tree is divided between the threads by boxes.
+     *
+     * @param numComponents   the number of multipole coefficients per particle: 1, 4, 10 or 20
+     * @param multipoles      the multipole coefficients, numComponents per particle
+     * @param phi             on exit, the 35 potential derivatives of each particle
+     * @param threads         the thread pool to use, or NULL to run on the calling thread
+     */
+    void computePotential(int numComponents, const std::vector<double>& multipoles, std::vector<double>& phi, OpenMM::ThreadPool* threads);
+
+private:
+
+    struct Box {
+        unsigned int code;
+        int coords[3];
+        int start, end;
+    };
+
+    int findBox(int level, const int* coords) const;
+    OpenMM::Vec3 getBoxCenter(int level, const Box& box) const;
+    void computeMonomials(const OpenMM::Vec3& delta, double* monomials) const;
+    void buildTerms();
+    void buildInteractionTable();
+
+    int _order;
+    int _requestedDepth;
+    int _depth;
+    int _numParticles;
+
+    // powers of x, y and z of each expansion term, ordered by degree, with the first 35 in the
+    // order of the potential derivatives
+    std::vector<int> _powers;
+    std::vector<int> _degree;
+    std::vector<int> _numTermsUpToDegree;
+    std::vector<double> _inverseFactorial;
+
+    // _termIndex[(x*(order+1)+y)*(order+1)+z] is the term with powers x, y and z
+    std::vector<int> _termIndex;
+
+    // _sumIndex[a*numTerms+b] is the term whose powers are those of a plus those of b, for the b
+    // whose degree is at most the order less that of a
+    std::vector<int> _sumIndex;
+
+    // the term one power of x, y or z lower, used to build monomials and derivatives recursively
+    std::vector<int> _lowerTerm;
+    std::vector<int> _lowerAxis;
+
+    // derivatives of 1/r at the integer offsets -3..3 along each axis between boxes of unit width
+    std::vector<double> _interactionTable;
+
+    OpenMM::Vec3 _origin;
+    double _width;
+    std::vector<OpenMM::Vec3> _positions;
+    std::vector<int> _sortedParticles;
+    std::vector<std::vector<Box> > _boxes;
+    std::vector<std::vector<double> > _multipoleExpansions;
+    std::vector<std::vector<double> > _localExpansions;
+    std::vector<std::pair<int, int> > _nearPairs;
+};
+
+#endif // __MPIDReferenceFMM_H__
@@ -23,8 +23,9 @@
  */
 
 #include "MPIDReferenceForce.h"
-#include "jama_svd.h"
 #include <algorithm>
+#include <limits>
+#include <set>
 
 // In case we're using some primitive version of Visual Studio this will
 // make sure that erf() and erfc() are defined.
@@ -35,6 +36,7 @@ using namespace OpenMM;
 
 MPIDReferenceForce::MPIDReferenceForce() :
                                                    _nonbondedMethod(NoCutoff),
+                                                   _mutualInducedSolver(DIIS),
                                                    _numParticles(0),
                                                    _electric(138.935455846),
                                                    _dielectric(1.0),
@@ -45,13 +47,17 @@ MPIDReferenceForce::MPIDReferenceForce() :
                                                    _mutualInducedDipoleEpsilon(1.0e+50),
                                                    _mutualInducedDipoleTargetEpsilon(1.0e-04),
                                                    _polarSOR(0.55),
-                                                   _debye(48.033324)
+                                                   _debye(48.033324),
+                                                   _threads(NULL),
+                                                   _maxInducedDipoleHistory(6),
+                                                   _maxPredictorDisplacement(0.05)
 {
     initialize();
 }
 
 MPIDReferenceForce::MPIDReferenceForce(NonbondedMethod nonbondedMethod) :
                                                    _nonbondedMethod(nonbondedMethod),
+                                                   _mutualInducedSolver(DIIS),
                                                    _numParticles(0),
                                                    _electric(138.935455846),
                                                    _dielectric(1.0),
@@ -62,7 +68,10 @@ MPIDReferenceForce::MPIDReferenceForce(NonbondedMethod nonbondedMethod) :
                                                    _mutualInducedDipoleEpsilon(1.0e+50),
                                                    _mutualInducedDipoleTargetEpsilon(1.0e-04),
                                                    _polarSOR(0.55),
-                                                   _debye(48.033324)
+                                                   _debye(48.033324),
+                                                   _threads(NULL),
+                                                   _maxInducedDipoleHistory(6),
+                                                   _maxPredictorDisplacement(0.05)
 {
     initialize();
 }
@@ -82,6 +91,8 @@ void MPIDReferenceForce::initialize()
     _pScale[index++]      = 0.0;
     _pScale[index++]      = 1.0;
     _pScale[index++]      = 1.0;
+
+    _setupValid = false;
 }
 
 void MPIDReferenceForce::set14ScaleFactor(double factor)
@@ -115,6 +126,16 @@ void MPIDReferenceForce::setPolarizationType(MPIDReferenceForce::PolarizationTyp
     _polarizationType = polarizationType;
 }
 
+MPIDReferenceForce::MutualInducedSolver MPIDReferenceForce::getMutualInducedSolver() const
+{
+    return _mutualInducedSolver;
+}
+
+void MPIDReferenceForce::setMutualInducedSolver(MPIDReferenceForce::MutualInducedSolver solver)
+{
+    _mutualInducedSolver = solver;
+}
+
 double MPIDReferenceForce::getDefaultTholeWidth() const
 {
     return _defaultTholeWidth;
@@ -165,6 +186,22 @@ void MPIDReferenceForce::setMaximumMutualInducedDipoleIterations(int maximumMutu
     _maximumMutualInducedDipoleIterations = maximumMutualInducedDipoleIterations;
 }
 
+void MPIDReferenceForce::setThreadPool(ThreadPool* threads)
+{
+    _threads = threads;
+}
+
+void MPIDReferenceForce::resetInducedDipolePredictor()
+{
+    _inducedDipoleHistory.clear();
+    _inducedDipoleHistoryPositions.clear();
+}
+
+void MPIDReferenceForce::invalidateSetup()
+{
+    _setupValid = false;
+}
+
 double MPIDReferenceForce::getMutualInducedDipoleTargetEpsilon() const
 {
     return _mutualInducedDipoleTargetEpsilon;
@@ -187,13 +224,13 @@ void MPIDReferenceForce::setMutualInducedDipoleTargetEpsilon(double mutualInduce
     _mutualInducedDipoleTargetEpsilon = mutualInducedDipoleTargetEpsilon;
 }
 
-void MPIDReferenceForce::setupScaleMaps(const vector< vector< vector<int> > >& multipoleParticleCovalentInfo)
+void MPIDReferenceForce::setupScaleTable(const vector< vector< vector<int> > >& multipoleParticleCovalentInfo)
 {
 
-    /* Setup for scaling maps:
+    /* Setup for scaling table:
      *
-     *     _scaleMaps[particleIndex][ScaleType] = map, where map[covalentIndex] = scaleFactor
-     *     _maxScaleIndex[particleIndex]        = max covalent index for particleIndex
+     *     _scaleColumn[k], k in [_scaleRowStart[ii], _scaleRowStart[ii+1]) = covalent index jj >= ii, sorted
+     *     _scaleValues[LAST_SCALE_TYPE_INDEX*k + ScaleType]                   = scaleFactor for pair (ii, jj)
      *
      *     multipoleParticleCovalentInfo[ii][jj], jj =0,1,2,3 contains covalent indices (c12, c13, c14, c15)
      *     multipoleParticleCovalentInfo[ii][jj], jj =4,5,6,7 contains covalent indices (p11, p12, p13, p14)
@@ -201,36 +238,43 @@ void MPIDReferenceForce::setupScaleMaps(const vector< vector< vector<int> > >& m
      *     only including covalent particles w/ index >= ii
      */
 
-    _scaleMaps.resize(multipoleParticleCovalentInfo.size());
-    _maxScaleIndex.resize(multipoleParticleCovalentInfo.size());
+    unsigned int numParticles = multipoleParticleCovalentInfo.size();
+    _scaleRowStart.resize(numParticles+1);
+    _scaleColumn.clear();
+    _scaleValues.clear();
 
-    for (unsigned int ii = 0; ii < multipoleParticleCovalentInfo.size(); ii++) {
+    for (unsigned int ii = 0; ii < numParticles; ii++) {
 
-        _scaleMaps[ii].resize(LAST_SCALE_TYPE_INDEX);
-        _maxScaleIndex[ii] = 0;
+        _scaleRowStart[ii] = _scaleColumn.size();
         const vector< vector<int> >& covalentInfo = multipoleParticleCovalentInfo[ii];
 
-        // pScale & mScale
+        // pScale & mScale; a particle listed under several covalent types takes the value of the last one
 
+        std::map<unsigned int, unsigned int> covalentType;
         for (unsigned jj = 0; jj < MPIDForce::PolarizationCovalent11; jj++) {
             for (int covalentIndex : covalentInfo[jj]) {
                 if (covalentIndex < ii)
                     continue;
-                _scaleMaps[ii][M_SCALE][covalentIndex] = _mScale[jj+1];
-                _scaleMaps[ii][P_SCALE][covalentIndex] = _pScale[jj+1];
-                _maxScaleIndex[ii]                     = _maxScaleIndex[ii] < covalentIndex ? covalentIndex : _maxScaleIndex[ii];
+                covalentType[covalentIndex] = jj;
             }
         }
+        for (auto& entry : covalentType) {
+            _scaleColumn.push_back(entry.first);
+            _scaleValues.push_back(_mScale[entry.second+1]);
+            _scaleValues.push_back(_pScale[entry.second+1]);
+        }
     }
+    _scaleRowStart[numParticles] = _scaleColumn.size();
 }
 
 double MPIDReferenceForce::getMultipoleScaleFactor(unsigned int particleI, unsigned int particleJ, ScaleType scaleType) const
 {
 
-    MapIntRealOpenMM  scaleMap   = _scaleMaps[particleI][scaleType];
-    MapIntRealOpenMMCI isPresent = scaleMap.find(particleJ);
-    if (isPresent != scaleMap.end()) {
-        return isPresent->second;
+    vector<unsigned int>::const_iterator begin = _scaleColumn.begin() + _scaleRowStart[particleI];
+    vector<unsigned int>::const_iterator end   = _scaleColumn.begin() + _scaleRowStart[particleI+1];
+    vector<unsigned int>::const_iterator entry = std::lower_bound(begin, end, particleJ);
+    if (entry != end && *entry == particleJ) {
+        return _scaleValues[LAST_SCALE_TYPE_INDEX*(entry-_scaleColumn.begin()) + scaleType];
     } else {
         return 1.0;
     }
@@ -242,7 +286,7 @@ void MPIDReferenceForce::getDScaleAndPScale(unsigned int particleI, unsigned int
     dScale = pScale;
 }
 
-void MPIDReferenceForce::getMultipoleScaleFactors(unsigned int particleI, unsigned int particleJ, vector<double>& scaleFactors) const
+void MPIDReferenceForce::getMultipoleScaleFactors(unsigned int particleI, unsigned int particleJ, double* scaleFactors) const
 {
     scaleFactors[P_SCALE] = getMultipoleScaleFactor(particleI, particleJ, P_SCALE);
     scaleFactors[M_SCALE] = getMultipoleScaleFactor(particleI, particleJ, M_SCALE);
@@ -343,9 +387,21 @@ void MPIDReferenceForce::loadParticleData(const vector<Vec3>& particlePositions,
 
         particleData[ii].thole                = tholes[ii];
         particleData[ii].dampingFactor        = dampingFactors[ii];
-        particleData[ii].polarity             = polarity[ii];
+        for (unsigned int jj = 0; jj < 3; jj++)
+            particleData[ii].polarity[jj]     = polarity[ii][jj];
         particleData[ii].isAnisotropic        = polarity[ii][0] != polarity[ii][1] || polarity[ii][0] != polarity[ii][2];
 
+        // sites without an axis frame keep their polarizabilities in the lab frame
+
+        for (unsigned int jj = 0; jj < 6; jj++)
+            particleData[ii].labPolarization[jj] = particleData[ii].labPolarizationInverse[jj] = 0.0;
+        particleData[ii].labPolarization[QXX] = polarity[ii][0];
+        particleData[ii].labPolarization[QYY] = polarity[ii][1];
+        particleData[ii].labPolarization[QZZ] = polarity[ii][2];
+        particleData[ii].labPolarizationInverse[QXX] = polarity[ii][0] == 0.0 ? 0.0 : 1.0/polarity[ii][0];
+        particleData[ii].labPolarizationInverse[QYY] = polarity[ii][1] == 0.0 ? 0.0 : 1.0/polarity[ii][1];
+        particleData[ii].labPolarizationInverse[QZZ] = polarity[ii][2] == 0.0 ? 0.0 : 1.0/polarity[ii][2];
+
     }
 }
 
@@ -548,6 +604,27 @@ void MPIDReferenceForce::applyRotationMatrixToParticle(      MultipoleParticleDa
     particleI.labPolarization[QYZ] = lAlpha[1][2];
     particleI.labPolarization[QZZ] = lAlpha[2][2];
 
+    // The (pseudo-)inverse polarizability, used by the conjugate gradient solver; directions
+    // with zero polarizability stay zero.
+    double lAlphaInverse[3][3] = { { 0.0, 0.0, 0.0 },
+                                   { 0.0, 0.0, 0.0 },
+                                   { 0.0, 0.0, 0.0 } };
+    for (int kk = 0; kk < 3; kk++)
+        bAlpha[kk][kk] = particleI.polarity[kk] == 0.0 ? 0.0 : 1.0/particleI.polarity[kk];
+    for (int ii = 0; ii < 3; ii++) {
+       for (int jj = ii; jj < 3; jj++) {
+          for (int kk = 0; kk < 3; kk++) {
+              lAlphaInverse[ii][jj] += rotationMatrix[kk][ii]*rotationMatrix[kk][jj]*bAlpha[kk][kk];
+          }
+       }
+    }
+    particleI.labPolarizationInverse[QXX] = lAlphaInverse[0][0];
+    particleI.labPolarizationInverse[QXY] = lAlphaInverse[0][1];
+    particleI.labPolarizationInverse[QXZ] = lAlphaInverse[0][2];
+    particleI.labPolarizationInverse[QYY] = lAlphaInverse[1][1];
+    particleI.labPolarizationInverse[QYZ] = lAlphaInverse[1][2];
+    particleI.labPolarizationInverse[QZZ] = lAlphaInverse[2][2];
+
 
     double laboPole[3][3][3] = {{{ 0.0, 0.0, 0.0 },
                                  { 0.0, 0.0, 0.0 },
@@ -803,7 +880,7 @@ void MPIDReferenceForce::applyRotationMatrix(vector<MultipoleParticleData>& part
 
 void MPIDReferenceForce::getAndScaleInverseRs(double dampI, double dampJ, double pscale,
                                                          double tholeI, double tholeJ,
-                                                         double r, vector<double>& rrI) const
+                                                         double r, int numValues, double* rrI) const
 {
 
     double rI             =  1.0/r;
@@ -811,7 +888,7 @@ void MPIDReferenceForce::getAndScaleInverseRs(double dampI, double dampJ, double
 
     rrI[0]                = rI*r2I;
     double constantFactor = 3.0;
-    for (unsigned int ii  = 1; ii < rrI.size(); ii++) {
+    for (int ii = 1; ii < numValues; ii++) {
        rrI[ii]         = constantFactor*rrI[ii-1]*r2I;
        constantFactor += 2.0;
     }
@@ -826,10 +903,13 @@ void MPIDReferenceForce::getAndScaleInverseRs(double dampI, double dampJ, double
             double expdamp = exp(-damp);
             rrI[0] *= 1.0 - expdamp*(1.0 + damp + 0.5*damp*damp);
             rrI[1] *= 1.0 - expdamp*(1.0 + damp + 0.5*damp*damp + damp*damp*damp/6.0);
-            if(rrI.size()>2)
+            if (numValues > 2)
                 rrI[2] *= 1.0 - expdamp*(1.0 + damp + 0.5*damp*damp + damp*damp*damp/6.0 + damp*damp*damp*damp/30.0);
-            if(rrI.size()>3)
+            if (numValues > 3)
                 rrI[3] *= 1.0 - expdamp*(1.0 + damp + 0.5*damp*damp + damp*damp*damp/6.0 + 4.0*damp*damp*damp*damp/105.0 + damp*damp*damp*damp*damp/210.0);
+            if (numValues > 4)
+                rrI[4] *= 1.0 - expdamp*(1.0 + damp + 0.5*damp*damp + damp*damp*damp/6.0 + 5.0*damp*damp*damp*damp/126.0 +
+                                         2.0*damp*damp*damp*damp*damp/315.0 + damp*damp*damp*damp*damp*damp/1890.0);
         }
     }
 }
@@ -845,11 +925,11 @@ void MPIDReferenceForce::calculateFixedMultipoleFieldPairIxn(const MultipolePart
     Vec3 deltaR = particleJ.position - particleI.position;
     double r = sqrt(deltaR.dot(deltaR));
 
-    vector<double> rrI(4);
+    double rrI[4];
 
     // get scaling factors, if needed
 
-    getAndScaleInverseRs(particleI.dampingFactor, particleJ.dampingFactor, pScale, particleI.thole, particleJ.thole, r, rrI);
+    getAndScaleInverseRs(particleI.dampingFactor, particleJ.dampingFactor, pScale, particleI.thole, particleJ.thole, r, 4, rrI);
     double rr3    = rrI[0];
     double rr5    = rrI[1];
     double rr7    = rrI[2];
@@ -917,14 +997,20 @@ void MPIDReferenceForce::calculateFixedMultipoleField(const vector<MultipolePart
     // skip calculations for this case
 
     for (unsigned int ii = 0; ii < _numParticles; ii++) {
+
+        // the scaled partners of ii are sorted, so walk them alongside jj
+
+        unsigned int scaleEntry = _scaleRowStart[ii];
+        unsigned int scaleEnd   = _scaleRowStart[ii+1];
         for (unsigned int jj = ii; jj < _numParticles; jj++) {
 
-            // if site jj is less than max covalent scaling index then get/apply scaling constants
+            // if site jj is a covalently scaled partner then apply scaling constants
             // otherwise add unmodified field and fieldPolar to particle fields
 
             double dScale, pScale;
-            if (jj <= _maxScaleIndex[ii]) {
-                getDScaleAndPScale(ii, jj, dScale, pScale);
+            if (scaleEntry < scaleEnd && _scaleColumn[scaleEntry] == jj) {
+                pScale = dScale = _scaleValues[LAST_SCALE_TYPE_INDEX*scaleEntry + P_SCALE];
+                scaleEntry++;
             } else {
                 dScale = pScale = 1.0;
             }
@@ -933,6 +1019,50 @@ void MPIDReferenceForce::calculateFixedMultipoleField(const vector<MultipolePart
     }
 }
 
+void MPIDReferenceForce::calculateFixedMultipoleFieldGradientPairIxn(const MultipoleParticleData& particleI,
+                                                                     const MultipoleParticleData& particleJ,
+                                                                     double dScale, double pScale,
+                                                                     vector<double>& gradients) const
+{
+
+    if (particleI.particleIndex == particleJ.particleIndex)
+        return;
+
+    Vec3 deltaR = particleJ.position - particleI.position;
+    double r = sqrt(deltaR.dot(deltaR));
+
+    // the damped powers of 1/r are the radial functions B_1 to B_5 of the field
+
+    double bn[6];
+    bn[0] = 0.0;
+    getAndScaleInverseRs(particleI.dampingFactor, particleJ.dampingFactor, pScale, particleI.thole, particleJ.thole, r, 5, bn+1);
+
+    double gradient[6];
+    calculateMultipoleFieldGradientAtPoint(particleJ, deltaR, bn, gradient);
+    for (int kk = 0; kk < 6; kk++)
+        gradients[6*particleI.particleIndex+kk] += gradient[kk]*dScale;
+    calculateMultipoleFieldGradientAtPoint(particleI, -deltaR, bn, gradient);
+    for (int kk = 0; kk < 6; kk++)
+        gradients[6*particleJ.particleIndex+kk] += gradient[kk]*dScale;
+}
+
+void MPIDReferenceForce::calculateFixedMultipoleFieldGradient(const vector<MultipoleParticleData>& particleData, vector<double>& gradients)
+{
+    gradients.assign(6*_numParticles, 0.0);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        unsigned int scaleEntry = _scaleRowStart[ii];
+        unsigned int scaleEnd   = _scaleRowStart[ii+1];
+        for (unsigned int jj = ii; jj < _numParticles; jj++) {
+            double scale = 1.0;
+            if (scaleEntry < scaleEnd && _scaleColumn[scaleEntry] == jj) {
+                scale = _scaleValues[LAST_SCALE_TYPE_INDEX*scaleEntry + P_SCALE];
+                scaleEntry++;
+            }
+            calculateFixedMultipoleFieldGradientPairIxn(particleData[ii], particleData[jj], scale, scale, gradients);
+        }
+    }
+}
+
 void MPIDReferenceForce::initializeInducedDipoles(vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleFields)
 {
 
@@ -970,14 +1100,16 @@ void MPIDReferenceForce::calculateInducedDipolePairIxns(const MultipoleParticleD
 
     Vec3 deltaR   = particleJ.position - particleI.position;
     double r      = sqrt(deltaR.dot(deltaR));
-    vector<double> rrI(2);
-    // If we're using the extrapolation algorithm, we need to compute the field gradient, so ask for one more rrI value.
-    if (getPolarizationType() == MPIDReferenceForce::Extrapolated)
-        rrI.push_back(0.0);
+    double rrI[3];
+    // If the field gradient is wanted, as for the extrapolation and TCG algorithms, ask for one more rrI value.
+    int numValues = 2;
+    for (auto& field : updateInducedDipoleFields)
+        if (field.inducedDipoleFieldGradient.size() > 0)
+            numValues = 3;
 
     double pscale = getMultipoleScaleFactor(particleI.particleIndex, particleJ.particleIndex, P_SCALE);
     getAndScaleInverseRs(particleI.dampingFactor, particleJ.dampingFactor, pscale,
-                          particleI.thole, particleJ.thole, r, rrI);
+                          particleI.thole, particleJ.thole, r, numValues, rrI);
 
     double rr3       = -rrI[0];
     double rr5       =  rrI[1];
@@ -985,7 +1117,7 @@ void MPIDReferenceForce::calculateInducedDipolePairIxns(const MultipoleParticleD
     for (auto& field : updateInducedDipoleFields) {
         calculateInducedDipolePairIxn(particleI.particleIndex, particleJ.particleIndex, rr3, rr5, deltaR,
                                        *field.inducedDipoles, field.inducedDipoleField);
-        if (getPolarizationType() == MPIDReferenceForce::Extrapolated) {
+        if (field.inducedDipoleFieldGradient.size() > 0) {
             // Compute and store the field gradient for later use.
             double dx = deltaR[0];
             double dy = deltaR[1];
@@ -1003,12 +1135,12 @@ void MPIDReferenceForce::calculateInducedDipolePairIxns(const MultipoleParticleD
             double Exz = muDotR*dx*dz*rrI[2] - (xDipole*dz + zDipole*dx)*rrI[1];
             double Eyz = muDotR*dy*dz*rrI[2] - (yDipole*dz + zDipole*dy)*rrI[1];
 
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][0] -= Exx;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][1] -= Eyy;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][2] -= Ezz;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][3] -= Exy;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][4] -= Exz;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][5] -= Eyz;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+0] -= Exx;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+1] -= Eyy;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+2] -= Ezz;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+3] -= Exy;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+4] -= Exz;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+5] -= Eyz;
 
             OpenMM::Vec3 &dipolesJ = (*field.inducedDipoles)[particleJ.particleIndex];
             xDipole = dipolesJ[0];
@@ -1022,12 +1154,12 @@ void MPIDReferenceForce::calculateInducedDipolePairIxns(const MultipoleParticleD
             Exz = muDotR*dx*dz*rrI[2] - (xDipole*dz + zDipole*dx)*rrI[1];
             Eyz = muDotR*dy*dz*rrI[2] - (yDipole*dz + zDipole*dy)*rrI[1];
 
-            field.inducedDipoleFieldGradient[particleI.particleIndex][0] += Exx;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][1] += Eyy;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][2] += Ezz;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][3] += Exy;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][4] += Exz;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][5] += Eyz;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+0] += Exx;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+1] += Eyy;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+2] += Ezz;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+3] += Exy;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+4] += Exz;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+5] += Eyz;
         }
     }
 }
@@ -1122,25 +1254,29 @@ void MPIDReferenceForce::convergeInduceDipolesBySOR(const vector<MultipolePartic
 }
 
 
-void MPIDReferenceForce::convergeInduceDipolesByExtrapolation(const vector<MultipoleParticleData>& particleData, vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleField) {
+void MPIDReferenceForce::calculatePerturbationDipoles(const vector<MultipoleParticleData>& particleData, vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleField, int numOrders) {
     // Start by storing the direct dipoles as PT0
 
     int numFields = updateInducedDipoleField.size();
     for (int i = 0; i < numFields; i++) {
         UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[i];
-        field.extrapolatedDipoles->resize(_maxPTOrder);
+        field.extrapolatedDipoles->resize(numOrders);
         (*field.extrapolatedDipoles)[0].resize(_numParticles);
         for (int atom = 0; atom < _numParticles; ++atom)
             (*field.extrapolatedDipoles)[0][atom] = (*field.inducedDipoles)[atom];
-        field.inducedDipoleFieldGradient.resize(_numParticles);
+        field.inducedDipoleFieldGradient.resize(6*_numParticles);
+
+        // the field histories are overwritten below; resizing keeps the storage of a previous call
+
+        field.extrapolatedDipoleField->resize(numOrders-1);
+        field.extrapolatedDipoleFieldGradient->resize(numOrders-1);
     }
 
     // Recursively apply alpha.Tau to the µ_(n) components to generate µ_(n+1), and store the result
 
-    vector<double> zeros(6, 0.0);
-    for (int order = 1; order < _maxPTOrder; ++order) {
+    for (int order = 1; order < numOrders; ++order) {
         for (int i = 0; i < numFields; i++)
-            std::fill(updateInducedDipoleField[i].inducedDipoleFieldGradient.begin(), updateInducedDipoleField[i].inducedDipoleFieldGradient.end(), zeros);
+            std::fill(updateInducedDipoleField[i].inducedDipoleFieldGradient.begin(), updateInducedDipoleField[i].inducedDipoleFieldGradient.end(), 0.0);
         calculateInducedDipoleFields(particleData, updateInducedDipoleField);
         for (int i = 0; i < numFields; i++) {
             UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[i];
@@ -1153,24 +1289,25 @@ void MPIDReferenceForce::convergeInduceDipolesByExtrapolation(const vector<Multi
                 (*field.inducedDipoles)[atom] = inddip;
                 (*field.extrapolatedDipoles)[order][atom] = (*field.inducedDipoles)[atom];
             }
-            vector<double> dipfield(3*_numParticles, 0.0);
+            vector<double>& dipfield = (*field.extrapolatedDipoleField)[order-1];
+            dipfield.resize(3*_numParticles);
             for (int atom = 0; atom < _numParticles; ++atom)
                 for (int component = 0; component < 3; ++component)
                     dipfield[3*atom + component] = field.inducedDipoleField[atom][component];
-            field.extrapolatedDipoleField->push_back(dipfield);
-            vector<double> fieldGrad(6*_numParticles, 0.0);
-            for (int atom = 0; atom < _numParticles; ++atom)
-                for (int component = 0; component < 6; ++component)
-                    fieldGrad[6*atom + component] = field.inducedDipoleFieldGradient[atom][component];
-            field.extrapolatedDipoleFieldGradient->push_back(fieldGrad);
+            (*field.extrapolatedDipoleFieldGradient)[order-1] = field.inducedDipoleFieldGradient;
         }
     }
+}
+
+void MPIDReferenceForce::convergeInduceDipolesByExtrapolation(const vector<MultipoleParticleData>& particleData, vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleField) {
+    calculatePerturbationDipoles(particleData, updateInducedDipoleField, _maxPTOrder);
 
     // Take a linear combination of the µ_(n) components to form the total dipole
     
+    int numFields = updateInducedDipoleField.size();
     for (int i = 0; i < numFields; i++) {
         UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[i];
-        *field.inducedDipoles = vector<Vec3>(_numParticles, Vec3());
+        std::fill(field.inducedDipoles->begin(), field.inducedDipoles->end(), Vec3());
         for (int order = 0; order < _maxPTOrder; ++order)
             for (int atom = 0; atom < _numParticles; ++atom)
                 (*field.inducedDipoles)[atom] += (*field.extrapolatedDipoles)[order][atom] * _extPartCoefficients[order];
@@ -1179,12 +1316,127 @@ void MPIDReferenceForce::convergeInduceDipolesByExtrapolation(const vector<Multi
     setMutualInducedDipoleConverged(true);
 }
 
+namespace {
+
+/**
+ * A value together with its derivative with respect to one input, used to differentiate
+ * the TCG energy with respect to the moments it is built from.
+ */
+struct TCGDual {
+    TCGDual(double value = 0.0, double derivative = 0.0) : value(value), derivative(derivative) {
+    }
+    double value, derivative;
+};
+
+TCGDual operator+(const TCGDual& a, const TCGDual& b) {
+    return TCGDual(a.value+b.value, a.derivative+b.derivative);
+}
+
+TCGDual operator-(const TCGDual& a, const TCGDual& b) {
+    return TCGDual(a.value-b.value, a.derivative-b.derivative);
+}
+
+TCGDual operator*(const TCGDual& a, const TCGDual& b) {
+    return TCGDual(a.value*b.value, a.derivative*b.value + a.value*b.derivative);
+}
+
+TCGDual operator/(const TCGDual& a, const TCGDual& b) {
+    return TCGDual(a.value/b.value, (a.derivative*b.value - a.value*b.derivative)/(b.value*b.value));
+}
+
+/**
+ * The coefficients of µ_(0), µ_(1), ... in the TCG dipoles, as functions of the moments
+ * s_n = E.alpha.(T.alpha)^n.E.  They follow from running the conjugate gradient recurrence,
+ * preconditioned by alpha and started from µ_(0) = alpha.E, with every dot product written as a moment.
+ */
+void computeTCGDipoleCoefficients(int iterations, const vector<TCGDual>& s, vector<TCGDual>& coefficients) {
+    coefficients.assign(iterations+1, TCGDual());
+    coefficients[0] = 1.0;
+    if (s[2].value == 0.0)
+        return;   // nothing is polarizable; the direct dipoles are exact
+    TCGDual one = 1.0, two = 2.0;
+    TCGDual gamma0 = s[2]/(s[2]-s[3]);
+    coefficients[1] = gamma0;
+    if (iterations == 1)
+        return;
+    TCGDual r1z1 = (one-gamma0)*(one-gamma0)*s[2] + two*gamma0*(one-gamma0)*s[3] + gamma0*gamma0*s[4];
+    if (r1z1.value == 0.0)
+        return;
+    TCGDual a1 = one - gamma0 + r1z1/s[2];
+    TCGDual a2 = gamma0;
+    TCGDual pAp = a1*a1*s[2] + two*a1*a2*s[3] + a2*a2*s[4] - (a1*a1*s[3] + two*a1*a2*s[4] + a2*a2*s[5]);
+    TCGDual gamma1 = r1z1/pAp;
+    coefficients[1] = gamma0 + gamma1*a1;
+    coefficients[2] = gamma1*a2;
+}
+
+}
+
+void MPIDReferenceForce::convergeInduceDipolesByTCG(const vector<MultipoleParticleData>& particleData, vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleField) {
+
+    // After k iterations the TCG energy -1/2 E.µ_TCG is a function f(s_0, .., s_2k+1) of the moments
+    // s_n = E.alpha.(T.alpha)^n.E, homogeneous of degree one.  Its gradient is the gradient of the energy of the
+    // response dipoles sum_n df/ds_n µ_(n) in the fixed field, which the usual induced dipole terms give, plus the
+    // µ_(l) T µ_(m) terms of the extrapolation algorithm weighted by df/ds_(l+m+1); both give the same energy.
+
+    int iterations = (getPolarizationType() == MPIDReferenceForce::TCG1 ? 1 : 2);
+    int numOrders = 2*iterations+2;
+    calculatePerturbationDipoles(particleData, updateInducedDipoleField, numOrders);
+
+    // s_n = µ_(0).T.µ_(n-1); s_0 only enters f linearly, so its value is not needed.
+
+    UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[0];
+    const vector<Vec3>& directDipoles = (*field.extrapolatedDipoles)[0];
+    vector<TCGDual> moments(numOrders);
+    for (int n = 1; n < numOrders; n++) {
+        const vector<double>& dipoleField = (*field.extrapolatedDipoleField)[n-1];
+        double sum = 0.0;
+        for (unsigned int atom = 0; atom < _numParticles; ++atom)
+            for (int component = 0; component < 3; ++component)
+                sum += directDipoles[atom][component]*dipoleField[3*atom+component];
+        moments[n] = sum;
+    }
+
+    // f = sum_n c_n s_n, so df/ds_n = c_n + sum_m dc_m/ds_n s_m.
+
+    vector<TCGDual> coefficients;
+    _tcgCoefficients.resize(numOrders);
+    for (int n = 0; n < numOrders; n++) {
+        moments[n].derivative = 1.0;
+        computeTCGDipoleCoefficients(iterations, moments, coefficients);
+        moments[n].derivative = 0.0;
+        double derivative = (n < (int) coefficients.size() ? coefficients[n].value : 0.0);
+        for (int m = 0; m < (int) coefficients.size(); m++)
+            derivative += coefficients[m].derivative*moments[m].value;
+        _tcgCoefficients[n] = derivative;
+    }
+
+    vector<Vec3>& dipoles = *field.inducedDipoles;
+    std::fill(dipoles.begin(), dipoles.end(), Vec3());
+    _tcgResponseDipole.assign(_numParticles, Vec3());
+    for (int order = 0; order < numOrders; ++order) {
+        const vector<Vec3>& orderDipoles = (*field.extrapolatedDipoles)[order];
+        for (unsigned int atom = 0; atom < _numParticles; ++atom) {
+            _tcgResponseDipole[atom] += orderDipoles[atom]*_tcgCoefficients[order];
+            if (order < (int) coefficients.size())
+                dipoles[atom] += orderDipoles[atom]*coefficients[order].value;
+        }
+    }
+
+    // The force terms need the field of the response dipoles (for PME, the induced potential on the grid).
+
+    dipoles.swap(_tcgResponseDipole);
+    calculateInducedDipoleFields(particleData, updateInducedDipoleField);
+    dipoles.swap(_tcgResponseDipole);
+    setMutualInducedDipoleIterations(numOrders-1);
+    setMutualInducedDipoleConverged(true);
+}
+
 void MPIDReferenceForce::convergeInduceDipolesByDIIS(const vector<MultipoleParticleData>& particleData, vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleField) {
     int numFields = updateInducedDipoleField.size();
-    vector<vector<vector<Vec3> > > prevDipoles(numFields);
-    vector<vector<Vec3> > prevErrors;
-    setMutualInducedDipoleConverged(false);
     int maxPrevious = 20;
+    _diis.initialize(maxPrevious, _numParticles, numFields);
+    setMutualInducedDipoleConverged(false);
     for (int iteration = 0; ; iteration++) {
         // Compute the field from the induced dipoles.
 
@@ -1193,24 +1445,21 @@ void MPIDReferenceForce::convergeInduceDipolesByDIIS(const vector<MultipoleParti
         // Record the current dipoles and the errors in them.
 
         double maxEpsilon = 0;
-        prevErrors.push_back(vector<Vec3>());
-        prevErrors.back().resize(_numParticles);
+        vector<Vec3>& prevErrors = _diis.getNextError();
         for (int k = 0; k < numFields; k++) {
             UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[k];
-            prevDipoles[k].push_back(vector<Vec3>());
-            prevDipoles[k].back().resize(_numParticles);
+            vector<Vec3>& prevDipoles = _diis.getNextVector(k);
             double epsilon = 0;
             for (int i = 0; i < _numParticles; i++) {
-                prevDipoles[k].back()[i] = (*field.inducedDipoles)[i];
                 Vec3 vx = Vec3(particleData[i].labPolarization[QXX], particleData[i].labPolarization[QXY], particleData[i].labPolarization[QXZ]);
                 Vec3 vy = Vec3(particleData[i].labPolarization[QXY], particleData[i].labPolarization[QYY], particleData[i].labPolarization[QYZ]);
                 Vec3 vz = Vec3(particleData[i].labPolarization[QXZ], particleData[i].labPolarization[QYZ], particleData[i].labPolarization[QZZ]);
                 Vec3 newDipole = (*field.fixedMultipoleField)[i] +
                                 Vec3(vx.dot(field.inducedDipoleField[i]), vy.dot(field.inducedDipoleField[i]), vz.dot(field.inducedDipoleField[i]));
                 Vec3 error = newDipole-(*field.inducedDipoles)[i];
-                prevDipoles[k].back()[i] = newDipole;
+                prevDipoles[i] = newDipole;
                 if (k == 0)
-                    prevErrors.back()[i] = error;
+                    prevErrors[i] = error;
                 epsilon += error.dot(error);
             }
             if (epsilon > maxEpsilon)
@@ -1230,64 +1479,161 @@ void MPIDReferenceForce::convergeInduceDipolesByDIIS(const vector<MultipoleParti
 
         // Select the new dipoles.
 
-        if (prevErrors.size() > maxPrevious) {
-            prevErrors.erase(prevErrors.begin());
-            for (int k = 0; k < numFields; k++)
-                prevDipoles[k].erase(prevDipoles[k].begin());
+        _diis.addEntry();
+        for (int k = 0; k < numFields; k++)
+            _diis.extrapolate(k, *updateInducedDipoleField[k].inducedDipoles);
+    }
+
+}
+
+static Vec3 multiplyBySymmetric(const double* matrix, const Vec3& vector)
+{
+    return Vec3(matrix[0]*vector[0] + matrix[1]*vector[1] + matrix[2]*vector[2],
+                matrix[1]*vector[0] + matrix[3]*vector[1] + matrix[4]*vector[2],
+                matrix[2]*vector[0] + matrix[4]*vector[1] + matrix[5]*vector[2]);
+}
+
+void MPIDReferenceForce::convergeInduceDipolesByPCG(const vector<MultipoleParticleData>& particleData, vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleField) {
+
+    // Solve (alpha^-1 - T) mu = E for the mutual dipoles.  With alpha as preconditioner the
+    // preconditioned residual alpha*r is the change a DIIS step would make to the dipoles, so
+    // the convergence test is the same as for DIIS.
+
+    UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[0];
+    vector<Vec3>& dipoles = *field.inducedDipoles;
+    vector<Vec3> residual(_numParticles), precondResidual(_numParticles), direction(_numParticles);
+    vector<UpdateInducedDipoleFieldStruct> directionField;
+    directionField.push_back(UpdateInducedDipoleFieldStruct(*field.fixedMultipoleField, direction, _ptDipoleD, _ptDipoleFieldD, _ptDipoleFieldGradientD));
+    setMutualInducedDipoleConverged(false);
+
+    int iteration = 0;
+    while (true) {
+
+        // (Re)start from the true residual of the current dipoles.
+
+        calculateInducedDipoleFields(particleData, updateInducedDipoleField);
+        double rz = 0.0;
+        double epsilon = 0.0;
+        for (unsigned int ii = 0; ii < _numParticles; ii++) {
+            precondResidual[ii] = (*field.fixedMultipoleField)[ii] + multiplyBySymmetric(particleData[ii].labPolarization, field.inducedDipoleField[ii]) - dipoles[ii];
+            residual[ii]        = multiplyBySymmetric(particleData[ii].labPolarizationInverse, precondResidual[ii]);
+            direction[ii]       = precondResidual[ii];
+            rz                 += residual[ii].dot(precondResidual[ii]);
+            epsilon            += precondResidual[ii].dot(precondResidual[ii]);
         }
-        int numPrevious = prevErrors.size();
-        vector<double> coefficients(numPrevious);
-        computeDIISCoefficients(prevErrors, coefficients);
-        for (int k = 0; k < numFields; k++) {
-            UpdateInducedDipoleFieldStruct& field = updateInducedDipoleField[k];
-            for (int i = 0; i < _numParticles; i++) {
-                Vec3 dipole(0.0, 0.0, 0.0);
-                for (int j = 0; j < numPrevious; j++)
-                    dipole += prevDipoles[k][j][i]*coefficients[j];
-                (*field.inducedDipoles)[i] = dipole;
+        epsilon = _debye*sqrt(epsilon/_numParticles);
+        if (epsilon < getMutualInducedDipoleTargetEpsilon())
+            setMutualInducedDipoleConverged(true);
+        if (epsilon < getMutualInducedDipoleTargetEpsilon() || iteration >= getMaximumMutualInducedDipoleIterations()) {
+            setMutualInducedDipoleEpsilon(epsilon);
+            setMutualInducedDipoleIterations(iteration);
+            return;
+        }
+
+        while (true) {
+            iteration++;
+
+            // A p = alpha^-1 p - T p, stored in the field of the search direction
+
+            calculateInducedDipoleFields(particleData, directionField);
+            vector<Vec3>& product = directionField[0].inducedDipoleField;
+            double pAp = 0.0;
+            for (unsigned int ii = 0; ii < _numParticles; ii++) {
+                product[ii] = multiplyBySymmetric(particleData[ii].labPolarizationInverse, direction[ii]) - product[ii];
+                pAp        += direction[ii].dot(product[ii]);
+            }
+            if (pAp <= 0.0) {
+
+                // the polarization matrix is not positive definite here (polarization catastrophe)
+
+                setMutualInducedDipoleEpsilon(epsilon);
+                setMutualInducedDipoleIterations(iteration);
+                return;
+            }
+
+            double step = rz/pAp;
+            double rzNew = 0.0;
+            epsilon = 0.0;
+            for (unsigned int ii = 0; ii < _numParticles; ii++) {
+                dipoles[ii]         += direction[ii]*step;
+                residual[ii]        -= product[ii]*step;
+                precondResidual[ii]  = multiplyBySymmetric(particleData[ii].labPolarization, residual[ii]);
+                rzNew               += residual[ii].dot(precondResidual[ii]);
+                epsilon             += precondResidual[ii].dot(precondResidual[ii]);
             }
+            epsilon = _debye*sqrt(epsilon/_numParticles);
+            if (epsilon < getMutualInducedDipoleTargetEpsilon() || iteration >= getMaximumMutualInducedDipoleIterations())
+                break;
+
+            double beta = rzNew/rz;
+            rz = rzNew;
+            for (unsigned int ii = 0; ii < _numParticles; ii++)
+                direction[ii] = precondResidual[ii] + direction[ii]*beta;
         }
     }
-
 }
 
-void MPIDReferenceForce::computeDIISCoefficients(const vector<vector<Vec3> >& prevErrors, vector<double>& coefficients) const {
-    int steps = coefficients.size();
-    if (steps == 1) {
-        coefficients[0] = 1;
-        return;
+bool MPIDReferenceForce::predictInducedDipoles(const vector<MultipoleParticleData>& particleData)
+{
+    if (_inducedDipoleHistory.size() == 0 || _inducedDipoleHistoryPositions.size() != _numParticles)
+        return false;
+
+    // a jump in the positions (e.g. a call to setPositions) invalidates the history
+
+    double maxDisplacement2 = 0.0;
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        Vec3 delta = particleData[ii].position - _inducedDipoleHistoryPositions[ii];
+        maxDisplacement2 = std::max(maxDisplacement2, delta.dot(delta));
+    }
+    if (maxDisplacement2 > _maxPredictorDisplacement*_maxPredictorDisplacement) {
+        resetInducedDipolePredictor();
+        return false;
     }
 
-    // Create the DIIS matrix.
+    // at the same positions, or with a single entry, the newest dipoles are the best guess
 
-    int rank = steps+1;
-    Array2D<double> b(rank, rank);
-    b[0][0] = 0;
-    for (int i = 0; i < steps; i++)
-        b[i+1][0] = b[0][i+1] = -1;
-    for (int i = 0; i < steps; i++)
-        for (int j = i; j < steps; j++) {
-            double sum = 0;
-            for (int k = 0; k < _numParticles; k++)
-                sum += prevErrors[i][k].dot(prevErrors[j][k]);
-            b[i+1][j+1] = b[j+1][i+1] = sum;
-        }
+    unsigned int numHistory = _inducedDipoleHistory.size();
+    if (maxDisplacement2 == 0.0 || numHistory == 1) {
+        _inducedDipole = _inducedDipoleHistory.back();
+        return true;
+    }
 
-    // Solve using SVD.  Since the right hand side is (-1, 0, 0, 0, ...), this is simpler than the general case.
+    // ASPC coefficients (Kolafa, J. Comput. Chem. 25, 335 (2004)) for k = numHistory-2:
+    // B_j = (-1)^(j+1) j C(2k+4, k+2-j)/C(2k+2, k+1), applied to the j'th most recent entry
+
+    int k = numHistory-2;
+    double denominator = 1.0;
+    for (int ii = 1; ii <= k+1; ii++)
+        denominator *= (double) (k+1+ii)/ii;
+    std::fill(_inducedDipole.begin(), _inducedDipole.end(), Vec3());
+    for (int jj = 1; jj <= k+2; jj++) {
+        double binomial = 1.0;
+        for (int ii = 1; ii <= k+2-jj; ii++)
+            binomial *= (double) (k+2+jj+ii)/ii;
+        double coefficient = ((jj%2 == 1) ? 1.0 : -1.0)*jj*binomial/denominator;
+        const vector<Vec3>& dipoles = _inducedDipoleHistory[numHistory-jj];
+        for (unsigned int ii = 0; ii < _numParticles; ii++)
+            _inducedDipole[ii] += dipoles[ii]*coefficient;
+    }
+    return true;
+}
+
+void MPIDReferenceForce::recordInducedDipoleHistory(const vector<MultipoleParticleData>& particleData)
+{
+    bool samePositions = (_inducedDipoleHistory.size() > 0 && _inducedDipoleHistoryPositions.size() == _numParticles);
+    for (unsigned int ii = 0; ii < _numParticles && samePositions; ii++)
+        samePositions = (particleData[ii].position == _inducedDipoleHistoryPositions[ii]);
 
-    JAMA::SVD<double> svd(b);
-    Array2D<double> u, v;
-    svd.getU(u);
-    svd.getV(v);
-    Array1D<double> s;
-    svd.getSingularValues(s);
-    int effectiveRank = svd.rank();
-    for (int i = 1; i < rank; i++) {
-        double d = 0;
-        for (int j = 0; j < effectiveRank; j++)
-            d -= u[0][j]*v[i][j]/s[j];
-        coefficients[i-1] = d;
+    if (!samePositions) {
+        if (_inducedDipoleHistory.size() == _maxInducedDipoleHistory)
+            std::rotate(_inducedDipoleHistory.begin(), _inducedDipoleHistory.begin()+1, _inducedDipoleHistory.end());
+        else
+            _inducedDipoleHistory.push_back(vector<Vec3>());
+        _inducedDipoleHistoryPositions.resize(_numParticles);
+        for (unsigned int ii = 0; ii < _numParticles; ii++)
+            _inducedDipoleHistoryPositions[ii] = particleData[ii].position;
     }
+    _inducedDipoleHistory.back() = _inducedDipole;
 }
 
 void MPIDReferenceForce::calculateInducedDipoles(const vector<MultipoleParticleData>& particleData)
@@ -1297,6 +1643,7 @@ void MPIDReferenceForce::calculateInducedDipoles(const vector<MultipoleParticleD
 
     zeroFixedMultipoleFields();
     calculateFixedMultipoleField(particleData);
+    _fixedElectricField = _fixedMultipoleField;
 
     // initialize inducedDipoles
     // if polarization type is 'Direct', then return after initializing; otherwise
@@ -1322,15 +1669,33 @@ void MPIDReferenceForce::calculateInducedDipoles(const vector<MultipoleParticleD
 
     // UpdateInducedDipoleFieldStruct contains induced dipole, fixed multipole fields and fields
     // due to other induced dipoles at each site
-    if (getPolarizationType() == MPIDReferenceForce::Mutual)
-        convergeInduceDipolesByDIIS(particleData, updateInducedDipoleField);
+    if (getPolarizationType() == MPIDReferenceForce::Mutual) {
+        bool predicted = predictInducedDipoles(particleData);
+        if (getMutualInducedSolver() == MPIDReferenceForce::ConjugateGradient)
+            convergeInduceDipolesByPCG(particleData, updateInducedDipoleField);
+        else
+            convergeInduceDipolesByDIIS(particleData, updateInducedDipoleField);
+        if (predicted && !getMutualInducedDipoleConverged()) {
+            // the prediction was no help; start over from the direct dipoles
+            resetInducedDipolePredictor();
+            initializeInducedDipoles(updateInducedDipoleField);
+            if (getMutualInducedSolver() == MPIDReferenceForce::ConjugateGradient)
+                convergeInduceDipolesByPCG(particleData, updateInducedDipoleField);
+            else
+                convergeInduceDipolesByDIIS(particleData, updateInducedDipoleField);
+        }
+        if (getMutualInducedDipoleConverged())
+            recordInducedDipoleHistory(particleData);
+    }
     else if (getPolarizationType() == MPIDReferenceForce::Extrapolated)
         convergeInduceDipolesByExtrapolation(particleData, updateInducedDipoleField);
+    else if (getPolarizationType() == MPIDReferenceForce::TCG1 || getPolarizationType() == MPIDReferenceForce::TCG2)
+        convergeInduceDipolesByTCG(particleData, updateInducedDipoleField);
 }
 
 double MPIDReferenceForce::calculateElectrostaticPairIxn(const MultipoleParticleData& particleI,
                                                                         const MultipoleParticleData& particleJ,
-                                                                        const vector<double>& scalingFactors,
+                                                                        const double* scalingFactors,
                                                                         vector<Vec3>& forces,
                                                                         vector<Vec3>& torque) const
 {
@@ -2135,59 +2500,76 @@ double MPIDReferenceForce::calculateElectrostatic(const vector<MultipoleParticle
                                                              vector<Vec3>& forces)
 {
     double energy = 0.0;
-    vector<double> scaleFactors(LAST_SCALE_TYPE_INDEX);
+    double scaleFactors[LAST_SCALE_TYPE_INDEX];
     for (auto& s : scaleFactors)
         s = 1.0;
 
     // main loop over particle pairs
 
     for (unsigned int ii = 0; ii < particleData.size(); ii++) {
+        unsigned int scaleEntry = _scaleRowStart[ii];
+        unsigned int scaleEnd   = _scaleRowStart[ii+1];
         for (unsigned int jj = ii+1; jj < particleData.size(); jj++) {
 
-            if (jj <= _maxScaleIndex[ii]) {
-                getMultipoleScaleFactors(ii, jj, scaleFactors);
-            }
+            while (scaleEntry < scaleEnd && _scaleColumn[scaleEntry] < jj)
+                scaleEntry++;
+            bool isScaled = (scaleEntry < scaleEnd && _scaleColumn[scaleEntry] == jj);
+            for (unsigned int kk = 0; kk < LAST_SCALE_TYPE_INDEX; kk++)
+                scaleFactors[kk] = isScaled ? _scaleValues[LAST_SCALE_TYPE_INDEX*scaleEntry + kk] : 1.0;
 
             energy += calculateElectrostaticPairIxn(particleData[ii], particleData[jj], scaleFactors, forces, torques);
-
-            if (jj <= _maxScaleIndex[ii]) {
-                for (unsigned int kk = 0; kk < LAST_SCALE_TYPE_INDEX; kk++) {
-                    scaleFactors[kk] = 1.0;
-                }
-            }
         }
     }
-    if (getPolarizationType() == MPIDReferenceForce::Extrapolated) {
-        double prefac = (_electric/_dielectric);
-        for (int i = 0; i < _numParticles; i++) {
-            // Compute the µ(m) T µ(n) force contributions here
-            for (int l = 0; l < _maxPTOrder-1; ++l) {
-                for (int m = 0; m < _maxPTOrder-1-l; ++m) {
-                    double p = _extPartCoefficients[l+m+1];
-                    if(std::fabs(p) < 1e-6) continue;
-                    forces[i][0] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+0]
-                                            + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+3]
-                                            + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+4]);
-                    forces[i][1] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+3]
-                                            + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+1]
-                                            + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+5]);
-                    forces[i][2] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+4]
-                                            + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+5]
-                                            + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+2]);
-                    if(particleData[i].isAnisotropic){
-                        torques[i][0] += p*prefac*(_ptDipoleD[l][i][1]*_ptDipoleFieldD[m][3*i+2]
-                                                 - _ptDipoleD[l][i][2]*_ptDipoleFieldD[m][3*i+1]);
-                        torques[i][1] += p*prefac*(_ptDipoleD[l][i][2]*_ptDipoleFieldD[m][3*i+0]
-                                                 - _ptDipoleD[l][i][0]*_ptDipoleFieldD[m][3*i+2]);
-                        torques[i][2] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldD[m][3*i+1]
-                                                 - _ptDipoleD[l][i][1]*_ptDipoleFieldD[m][3*i+0]);
-                    }
+    if (usesPerturbationDipoles())
+        addPerturbationDipoleForces(particleData, torques, forces);
+
+    return energy;
+}
+
+bool MPIDReferenceForce::usesPerturbationDipoles() const
+{
+    return (getPolarizationType() == MPIDReferenceForce::Extrapolated ||
+            getPolarizationType() == MPIDReferenceForce::TCG1 ||
+            getPolarizationType() == MPIDReferenceForce::TCG2);
+}
+
+const vector<double>& MPIDReferenceForce::getPerturbationCoefficients() const
+{
+    return (getPolarizationType() == MPIDReferenceForce::Extrapolated ? _extPartCoefficients : _tcgCoefficients);
+}
+
+void MPIDReferenceForce::addPerturbationDipoleForces(const vector<MultipoleParticleData>& particleData,
+                                                     vector<Vec3>& torques, vector<Vec3>& forces) const
+{
+    double prefac = (_electric/_dielectric);
+    const vector<double>& coefficients = getPerturbationCoefficients();
+    int numOrders = coefficients.size();
+    for (int i = 0; i < _numParticles; i++) {
+        // Compute the µ(m) T µ(n) force contributions here
+        for (int l = 0; l < numOrders-1; ++l) {
+            for (int m = 0; m < numOrders-1-l; ++m) {
+                double p = coefficients[l+m+1];
+                if (p == 0.0) continue;
+                forces[i][0] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+0]
+                                        + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+3]
+                                        + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+4]);
+                forces[i][1] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+3]
+                                        + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+1]
+                                        + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+5]);
+                forces[i][2] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+4]
+                                        + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+5]
+                                        + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+2]);
+                if(particleData[i].isAnisotropic){
+                    torques[i][0] += p*prefac*(_ptDipoleD[l][i][1]*_ptDipoleFieldD[m][3*i+2]
+                                             - _ptDipoleD[l][i][2]*_ptDipoleFieldD[m][3*i+1]);
+                    torques[i][1] += p*prefac*(_ptDipoleD[l][i][2]*_ptDipoleFieldD[m][3*i+0]
+                                             - _ptDipoleD[l][i][0]*_ptDipoleFieldD[m][3*i+2]);
+                    torques[i][2] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldD[m][3*i+1]
+                                             - _ptDipoleD[l][i][1]*_ptDipoleFieldD[m][3*i+0]);
                 }
             }
         }
     }
-
-    return energy;
 }
 
 void MPIDReferenceForce::setup(const vector<Vec3>& particlePositions,
@@ -2214,15 +2596,20 @@ void MPIDReferenceForce::setup(const vector<Vec3>& particlePositions,
     // get induced dipoles
     // check if induced dipoles converged
 
+    _setupValid = false;
     _numParticles = particlePositions.size();
     loadParticleData(particlePositions, charges, dipoles, quadrupoles, octopoles,
                       tholes, dampingFactors, polarity, particleData);
+    selectPeriodicImages(particleData);
 
     checkChiral(particleData, multipoleAtomXs, multipoleAtomYs, multipoleAtomZs, axisTypes);
 
     applyRotationMatrix(particleData, multipoleAtomXs, multipoleAtomYs, multipoleAtomZs, axisTypes);
 
-    setupScaleMaps(multipoleAtomCovalentInfo);
+    // the covalent info does not change over the lifetime of the force, so the scale table is only built once
+
+    if (_scaleRowStart.size() != _numParticles+1)
+        setupScaleTable(multipoleAtomCovalentInfo);
 
     calculateInducedDipoles(particleData);
 
@@ -2233,6 +2620,7 @@ void MPIDReferenceForce::setup(const vector<Vec3>& particlePositions,
         message << " eps="             << getMutualInducedDipoleEpsilon();
         throw OpenMMException(message.str());
     }
+    _setupValid = true;
 }
 
 double MPIDReferenceForce::calculateForceAndEnergy(const vector<Vec3>& particlePositions,
@@ -2251,18 +2639,25 @@ double MPIDReferenceForce::calculateForceAndEnergy(const vector<Vec3>& particleP
                                                              vector<Vec3>& forces)
 {
 
-    // setup, including calculating induced dipoles
+    // setup, including calculating induced dipoles; this always runs, and the result is kept for the getters
     // calculate electrostatic ixns including torques
     // map torques to forces
 
-    vector<MultipoleParticleData> particleData;
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
     setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
            dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
            multipoleAtomCovalentInfo, particleData);
 
+    // with TCG, the energy and forces are those of the response dipoles
+
+    bool useResponseDipoles = (getPolarizationType() == MPIDReferenceForce::TCG1 || getPolarizationType() == MPIDReferenceForce::TCG2);
+    if (useResponseDipoles)
+        _inducedDipole.swap(_tcgResponseDipole);
     vector<Vec3> torques;
     initializeVec3Vector(torques);
     double energy = calculateElectrostatic(particleData, torques, forces);
+    if (useResponseDipoles)
+        _inducedDipole.swap(_tcgResponseDipole);
 
     mapTorqueToForce(particleData, multipoleAtomXs, multipoleAtomYs, multipoleAtomZs, axisTypes, torques, forces);
 
@@ -2283,12 +2678,13 @@ void MPIDReferenceForce::calculateInducedDipoles(const vector<Vec3>& particlePos
                                                             const vector<int>& multipoleAtomYs,
                                                             const vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
                                                             vector<Vec3>& outputInducedDipoles) {
-    // setup, including calculating induced dipoles
+    // setup, including calculating induced dipoles, unless the last setup still holds
 
-    vector<MultipoleParticleData> particleData;
-    setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
-           dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
-           multipoleAtomCovalentInfo, particleData);
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
     outputInducedDipoles = _inducedDipole;
 }
 
@@ -2309,12 +2705,13 @@ void MPIDReferenceForce::calculateLabFramePermanentDipoles(const vector<Vec3>& p
                                                                       const vector<int>& multipoleAtomYs,
                                                                       const vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
                                                                       vector<Vec3>& outputRotatedPermanentDipoles) {
-    // setup, including calculating permanent dipoles
+    // setup, including calculating permanent dipoles, unless the last setup still holds
 
-    vector<MultipoleParticleData> particleData;
-    setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
-           dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
-           multipoleAtomCovalentInfo, particleData);
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
     outputRotatedPermanentDipoles.resize(_numParticles);
     for (int i = 0; i < _numParticles; i++)
         outputRotatedPermanentDipoles[i] = particleData[i].dipole;
@@ -2334,18 +2731,98 @@ void MPIDReferenceForce::calculateTotalDipoles(const vector<Vec3>& particlePosit
                                                           const vector<int>& multipoleAtomYs,
                                                           const vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
                                                           vector<Vec3>& outputTotalDipoles) {
-    // setup, including calculating permanent dipoles
+    // setup, including calculating permanent dipoles, unless the last setup still holds
 
-    vector<MultipoleParticleData> particleData;
-    setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
-           dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
-           multipoleAtomCovalentInfo, particleData);
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
     outputTotalDipoles.resize(_numParticles);
     for (int i = 0; i < _numParticles; i++)
         for (int j = 0; j < 3; j++)
             outputTotalDipoles[i][j] = particleData[i].dipole[j] + _inducedDipole[i][j];
 }
 
+void MPIDReferenceForce::calculateLabFramePermanentMultipoles(const vector<Vec3>& particlePositions,
+                                                             const vector<double>& charges,
+                                                             const vector<double>& dipoles,
+                                                             const vector<double>& quadrupoles,
+                                                             const vector<double>& octopoles,
+                                                             const vector<double>& tholes,
+                                                             const vector<double>& dampingFactors,
+                                                             const vector<std::vector<double> >& polarity,
+                                                             const vector<int>& axisTypes,
+                                                             const vector<int>& multipoleAtomZs,
+                                                             const vector<int>& multipoleAtomXs,
+                                                             const vector<int>& multipoleAtomYs,
+                                                             vector<Vec3>& outputDipoles,
+                                                             vector<double>& outputQuadrupoles,
+                                                             vector<double>& outputOctopoles)
+{
+
+    // load particle parameters, unless the last setup still holds
+    // check for inverted chiral centers and rotate to the lab frame; each particle
+    // only reads the positions of its axis particles, so the particles are independent
+
+    vector<MultipoleParticleData> rotatedData;
+    const vector<MultipoleParticleData>* particleData = &_setupParticleData;
+    if (!_setupValid) {
+        _numParticles = particlePositions.size();
+        loadParticleData(particlePositions, charges, dipoles, quadrupoles, octopoles,
+                          tholes, dampingFactors, polarity, rotatedData);
+        auto rotateParticles = [&] (unsigned int start, unsigned int end) {
+            for (unsigned int ii = start; ii < end; ii++) {
+                if (multipoleAtomYs[ii] > -1)
+                    checkChiralCenterAtParticle(rotatedData[ii], axisTypes[ii], rotatedData[multipoleAtomZs[ii]],
+                                                rotatedData[multipoleAtomXs[ii]], rotatedData[multipoleAtomYs[ii]]);
+                if (multipoleAtomZs[ii] >= 0)
+                    applyRotationMatrixToParticle(rotatedData[ii], &rotatedData[multipoleAtomZs[ii]],
+                                                  multipoleAtomXs[ii] > -1 ? &rotatedData[multipoleAtomXs[ii]] : NULL,
+                                                  multipoleAtomYs[ii] > -1 ? &rotatedData[multipoleAtomYs[ii]] : NULL, axisTypes[ii]);
+            }
+        };
+        if (_threads == NULL || _threads->getNumThreads() == 1)
+            rotateParticles(0, _numParticles);
+        else {
+            int numThreads = _threads->getNumThreads();
+            _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+                rotateParticles((_numParticles*threadIndex)/numThreads, (_numParticles*(threadIndex+1))/numThreads);
+            });
+            _threads->waitForThreads();
+        }
+        particleData = &rotatedData;
+    }
+
+    // copy out the moments in the order they were given in
+
+    outputDipoles.resize(_numParticles);
+    outputQuadrupoles.resize(6*_numParticles);
+    outputOctopoles.resize(10*_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        const MultipoleParticleData& particle = (*particleData)[ii];
+        outputDipoles[ii] = particle.dipole;
+        double* quadrupole = &outputQuadrupoles[6*ii];
+        quadrupole[0] = particle.quadrupole[QXX];
+        quadrupole[1] = particle.quadrupole[QXY];
+        quadrupole[2] = particle.quadrupole[QYY];
+        quadrupole[3] = particle.quadrupole[QXZ];
+        quadrupole[4] = particle.quadrupole[QYZ];
+        quadrupole[5] = particle.quadrupole[QZZ];
+        double* octopole = &outputOctopoles[10*ii];
+        octopole[0] = particle.octopole[QXXX];
+        octopole[1] = particle.octopole[QXXY];
+        octopole[2] = particle.octopole[QXYY];
+        octopole[3] = particle.octopole[QYYY];
+        octopole[4] = particle.octopole[QXXZ];
+        octopole[5] = particle.octopole[QXYZ];
+        octopole[6] = particle.octopole[QYYZ];
+        octopole[7] = particle.octopole[QXZZ];
+        octopole[8] = particle.octopole[QYZZ];
+        octopole[9] = particle.octopole[QZZZ];
+    }
+}
+
 void MPIDReferenceForce::calculateMPIDSystemMultipoleMoments(const vector<double>& masses,
                                                                           const vector<Vec3>& particlePositions,
                                                                           const vector<double>& charges,
@@ -2363,14 +2840,15 @@ void MPIDReferenceForce::calculateMPIDSystemMultipoleMoments(const vector<double
                                                                           vector<double>& outputMultipoleMoments)
 {
 
-    // setup, including calculating induced dipoles
+    // setup, including calculating induced dipoles, unless the last setup still holds
     // remove center of mass
     // calculate system moments
 
-    vector<MultipoleParticleData> particleData;
-    setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
-           dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
-           multipoleAtomCovalentInfo, particleData);
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
 
     double totalMass = 0.0;
     Vec3 centerOfMass = Vec3(0.0, 0.0, 0.0);
@@ -2461,31 +2939,178 @@ void MPIDReferenceForce::calculateMPIDSystemMultipoleMoments(const vector<double
     }
 }
 
-double MPIDReferenceForce::calculateElectrostaticPotentialForParticleGridPoint(const MultipoleParticleData& particleI, const Vec3& gridPoint) const
+double MPIDReferenceForce::calculateMultipolePotentialAtPoint(const MultipoleParticleData& particleI, const Vec3& deltaR, const double* bn) const
 {
+    const double* quadrupole = particleI.quadrupole;
+    const double* octopole   = particleI.octopole;
+    double dx = deltaR[0];
+    double dy = deltaR[1];
+    double dz = deltaR[2];
+
+    double potential     = particleI.charge*bn[0];
+    potential           -= particleI.dipole.dot(deltaR)*bn[1];
+
+    double scq           = dx*(quadrupole[QXX]*dx + quadrupole[QXY]*dy + quadrupole[QXZ]*dz);
+          scq           += dy*(quadrupole[QXY]*dx + quadrupole[QYY]*dy + quadrupole[QYZ]*dz);
+          scq           += dz*(quadrupole[QXZ]*dx + quadrupole[QYZ]*dy + quadrupole[QZZ]*dz);
+    double traceQ        = quadrupole[QXX] + quadrupole[QYY] + quadrupole[QZZ];
+    potential           += scq*bn[2] - traceQ*bn[1];
+
+    // the octopole contracted with deltaR three times, and once with its trace
+
+    double sco           = octopole[QXXX]*dx*dx*dx + octopole[QYYY]*dy*dy*dy + octopole[QZZZ]*dz*dz*dz;
+          sco           += 3.0*(octopole[QXXY]*dx*dx*dy + octopole[QXXZ]*dx*dx*dz + octopole[QXYY]*dx*dy*dy +
+                                octopole[QXZZ]*dx*dz*dz + octopole[QYYZ]*dy*dy*dz + octopole[QYZZ]*dy*dz*dz);
+          sco           += 6.0*octopole[QXYZ]*dx*dy*dz;
+    double traceO        = dx*(octopole[QXXX] + octopole[QXYY] + octopole[QXZZ]);
+          traceO        += dy*(octopole[QXXY] + octopole[QYYY] + octopole[QYZZ]);
+          traceO        += dz*(octopole[QXXZ] + octopole[QYYZ] + octopole[QZZZ]);
+    potential           -= sco*bn[3] - 3.0*traceO*bn[2];
+    return potential;
+}
 
-    Vec3 deltaR = particleI.position - gridPoint;
-
-    getPeriodicDelta(deltaR);
-
-    double r2            = deltaR.dot(deltaR);
-    double r             = sqrt(r2);
-
-    double rr1           = 1.0/r;
-    double rr2           = rr1*rr1;
-    double rr3           = rr1*rr2;
-    double potential     = particleI.charge*rr1;
+Vec3 MPIDReferenceForce::calculateMultipoleFieldAtPoint(const MultipoleParticleData& particleI, const Vec3& deltaR, const double* bn) const
+{
+    const double* quadrupole = particleI.quadrupole;
+    const double* octopole   = particleI.octopole;
+    double dx = deltaR[0];
+    double dy = deltaR[1];
+    double dz = deltaR[2];
+
+    // Each radial function B_n differentiates to -deltaR B_(n+1).
+
+    Vec3 field           = deltaR*(-particleI.charge*bn[1]);
+    field               += particleI.dipole*(-bn[1]) + deltaR*(particleI.dipole.dot(deltaR)*bn[2]);
+
+    Vec3 qr(quadrupole[QXX]*dx + quadrupole[QXY]*dy + quadrupole[QXZ]*dz,
+            quadrupole[QXY]*dx + quadrupole[QYY]*dy + quadrupole[QYZ]*dz,
+            quadrupole[QXZ]*dx + quadrupole[QYZ]*dy + quadrupole[QZZ]*dz);
+    double traceQ        = quadrupole[QXX] + quadrupole[QYY] + quadrupole[QZZ];
+    field               += qr*(2.0*bn[2]) + deltaR*((traceQ*bn[2] - qr.dot(deltaR)*bn[3]));
+
+    // the octopole contracted with deltaR twice, and its trace
+
+    Vec3 orr(octopole[QXXX]*dx*dx + octopole[QXYY]*dy*dy + octopole[QXZZ]*dz*dz +
+             2.0*(octopole[QXXY]*dx*dy + octopole[QXXZ]*dx*dz + octopole[QXYZ]*dy*dz),
+             octopole[QXXY]*dx*dx + octopole[QYYY]*dy*dy + octopole[QYZZ]*dz*dz +
+             2.0*(octopole[QXYY]*dx*dy + octopole[QXYZ]*dx*dz + octopole[QYYZ]*dy*dz),
+             octopole[QXXZ]*dx*dx + octopole[QYYZ]*dy*dy + octopole[QZZZ]*dz*dz +
+             2.0*(octopole[QXYZ]*dx*dy + octopole[QXZZ]*dx*dz + octopole[QYZZ]*dy*dz));
+    Vec3 traceO(octopole[QXXX] + octopole[QXYY] + octopole[QXZZ],
+                octopole[QXXY] + octopole[QYYY] + octopole[QYZZ],
+                octopole[QXXZ] + octopole[QYYZ] + octopole[QZZZ]);
+    field               += orr*(-3.0*bn[3]) + traceO*(3.0*bn[2]);
+    field               += deltaR*(orr.dot(deltaR)*bn[4] - 3.0*traceO.dot(deltaR)*bn[3]);
+    return field;
+}
 
-    double scd           = particleI.dipole.dot(deltaR);
-    double scu           = _inducedDipole[particleI.particleIndex].dot(deltaR);
-    potential           -= (scd + scu)*rr3;
+void MPIDReferenceForce::calculateMultipoleFieldGradientAtPoint(const MultipoleParticleData& particleI, const Vec3& deltaR, const double* bn, double* gradient) const
+{
+    const double* quadrupole = particleI.quadrupole;
+    const double* octopole   = particleI.octopole;
+    double dx = deltaR[0];
+    double dy = deltaR[1];
+    double dz = deltaR[2];
+
+    // The second derivatives of the potential with respect to deltaR have the form
+    // c1 delta_ab + c2 R_a R_b + v_a R_b + v_b R_a + M_ab; the field gradient is minus them.
+
+    Vec3 qr(quadrupole[QXX]*dx + quadrupole[QXY]*dy + quadrupole[QXZ]*dz,
+            quadrupole[QXY]*dx + quadrupole[QYY]*dy + quadrupole[QYZ]*dz,
+            quadrupole[QXZ]*dx + quadrupole[QYZ]*dy + quadrupole[QZZ]*dz);
+    double scq           = qr.dot(deltaR);
+    double traceQ        = quadrupole[QXX] + quadrupole[QYY] + quadrupole[QZZ];
+
+    // the octopole contracted with deltaR once, twice and three times, and its trace
+
+    double orx[6] = {octopole[QXXX]*dx + octopole[QXXY]*dy + octopole[QXXZ]*dz,
+                     octopole[QXXY]*dx + octopole[QXYY]*dy + octopole[QXYZ]*dz,
+                     octopole[QXXZ]*dx + octopole[QXYZ]*dy + octopole[QXZZ]*dz,
+                     octopole[QXYY]*dx + octopole[QYYY]*dy + octopole[QYYZ]*dz,
+                     octopole[QXYZ]*dx + octopole[QYYZ]*dy + octopole[QYZZ]*dz,
+                     octopole[QXZZ]*dx + octopole[QYZZ]*dy + octopole[QZZZ]*dz};
+    Vec3 orr(orx[QXX]*dx + orx[QXY]*dy + orx[QXZ]*dz,
+             orx[QXY]*dx + orx[QYY]*dy + orx[QYZ]*dz,
+             orx[QXZ]*dx + orx[QYZ]*dy + orx[QZZ]*dz);
+    double sco           = orr.dot(deltaR);
+    Vec3 traceO(octopole[QXXX] + octopole[QXYY] + octopole[QXZZ],
+                octopole[QXXY] + octopole[QYYY] + octopole[QYZZ],
+                octopole[QXXZ] + octopole[QYYZ] + octopole[QZZZ]);
+    double tor           = traceO.dot(deltaR);
+    double dipoleDelta   = particleI.dipole.dot(deltaR);
+
+    double c1 = -particleI.charge*bn[1] + dipoleDelta*bn[2] - scq*bn[3] + traceQ*bn[2] + sco*bn[4] - 3.0*tor*bn[3];
+    double c2 =  particleI.charge*bn[2] - dipoleDelta*bn[3] + scq*bn[4] - traceQ*bn[3] - sco*bn[5] + 3.0*tor*bn[4];
+    Vec3 v    = particleI.dipole*bn[2] - qr*(2.0*bn[3]) + orr*(3.0*bn[4]) - traceO*(3.0*bn[3]);
+
+    const int index[3][3] = {{QXX, QXY, QXZ}, {QXY, QYY, QYZ}, {QXZ, QYZ, QZZ}};
+    for (int a = 0; a < 3; a++) {
+        for (int b = a; b < 3; b++) {
+            int ab = index[a][b];
+            double second = c2*deltaR[a]*deltaR[b] + v[a]*deltaR[b] + v[b]*deltaR[a] + 2.0*quadrupole[ab]*bn[2] - 6.0*orx[ab]*bn[3];
+            if (a == b)
+                second += c1;
+            gradient[ab] = -second;
+        }
+    }
+}
 
-    double rr5           = 3.0*rr3*rr2;
-    double scq           = deltaR[0]*(particleI.quadrupole[QXX]*deltaR[0] + particleI.quadrupole[QXY]*deltaR[1] + particleI.quadrupole[QXZ]*deltaR[2]);
-          scq           += deltaR[1]*(particleI.quadrupole[QXY]*deltaR[0] + particleI.quadrupole[QYY]*deltaR[1] + particleI.quadrupole[QYZ]*deltaR[2]);
-          scq           += deltaR[2]*(particleI.quadrupole[QXZ]*deltaR[0] + particleI.quadrupole[QYZ]*deltaR[1] + particleI.quadrupole[QZZ]*deltaR[2]);
-    potential           += scq*rr5;
-    return potential;
+void MPIDReferenceForce::calculateElectrostaticPotentialAtPoints(const vector<MultipoleParticleData>& sources,
+                                                                 const vector<Vec3>& points,
+                                                                 vector<double>& potential,
+                                                                 vector<Vec3>* field,
+                                                                 vector<double>* fieldGradient)
+{
+    potential.assign(points.size(), 0.0);
+    if (field != NULL)
+        field->assign(points.size(), Vec3());
+    if (fieldGradient != NULL)
+        fieldGradient->assign(6*points.size(), 0.0);
+    unsigned int numPoints = points.size();
+    auto computePoints = [&] (unsigned int start, unsigned int end) {
+        for (unsigned int jj = start; jj < end; jj++) {
+            double sum = 0.0;
+            Vec3 fieldSum;
+            double gradientSum[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+            for (unsigned int ii = 0; ii < _numParticles; ii++) {
+                Vec3 deltaR = sources[ii].position - points[jj];
+                getPeriodicDelta(deltaR);
+                double rr1 = 1.0/sqrt(deltaR.dot(deltaR));
+                double rr2 = rr1*rr1;
+                double bn[6];
+                bn[0] = rr1;
+                bn[1] = rr1*rr2;
+                bn[2] = 3.0*bn[1]*rr2;
+                bn[3] = 5.0*bn[2]*rr2;
+                bn[4] = 7.0*bn[3]*rr2;
+                bn[5] = 9.0*bn[4]*rr2;
+                sum += calculateMultipolePotentialAtPoint(sources[ii], deltaR, bn);
+                if (field != NULL)
+                    fieldSum += calculateMultipoleFieldAtPoint(sources[ii], deltaR, bn);
+                if (fieldGradient != NULL) {
+                    double gradient[6];
+                    calculateMultipoleFieldGradientAtPoint(sources[ii], deltaR, bn, gradient);
+                    for (int kk = 0; kk < 6; kk++)
+                        gradientSum[kk] += gradient[kk];
+                }
+            }
+            potential[jj] = sum;
+            if (field != NULL)
+                (*field)[jj] = fieldSum;
+            if (fieldGradient != NULL)
+                for (int kk = 0; kk < 6; kk++)
+                    (*fieldGradient)[6*jj+kk] = gradientSum[kk];
+        }
+    };
+    if (_threads == NULL || _threads->getNumThreads() == 1)
+        computePoints(0, numPoints);
+    else {
+        int numThreads = _threads->getNumThreads();
+        _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+            computePoints((numPoints*threadIndex)/numThreads, (numPoints*(threadIndex+1))/numThreads);
+        });
+        _threads->waitForThreads();
+    }
 }
 
 void MPIDReferenceForce::calculateElectrostaticPotential(const vector<Vec3>& particlePositions,
@@ -2505,29 +3130,189 @@ void MPIDReferenceForce::calculateElectrostaticPotential(const vector<Vec3>& par
                                                                     vector<double>& potential)
 {
 
-    // setup, including calculating induced dipoles
-    // initialize potential
-    // calculate contribution of each particle to potential at grid point
+    // setup, including calculating induced dipoles, unless the last setup still holds
+    // add the induced dipoles to the fixed ones; at a point they act the same way
+    // calculate contribution of the particles to potential at grid points
     // apply prefactor
 
-    vector<MultipoleParticleData> particleData;
-    setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
-           dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
-           multipoleAtomCovalentInfo, particleData);
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
+
+    vector<MultipoleParticleData> sources(particleData);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        sources[ii].dipole += _inducedDipole[ii];
+    prepareElectrostaticPotential(sources);
+    calculateElectrostaticPotentialAtPoints(sources, grid, potential, NULL, NULL);
 
-    potential.resize(grid.size());
+    double term = _electric/_dielectric;
     for (auto& p : potential)
-        p = 0.0;
+        p *= term;
+}
 
-    for (unsigned int ii = 0; ii < _numParticles; ii++) {
-        for (unsigned int jj = 0; jj < grid.size(); jj++) {
-            potential[jj] += calculateElectrostaticPotentialForParticleGridPoint(particleData[ii], grid[jj]);
+void MPIDReferenceForce::calculateElectrostaticPotentialVolume(const vector<Vec3>& particlePositions,
+                                                               const vector<double>& charges,
+                                                               const vector<double>& dipoles,
+                                                               const vector<double>& quadrupoles,
+                                                               const vector<double>& octopoles,
+                                                               const vector<double>& tholes,
+                                                               const vector<double>& dampingFactors,
+                                                               const std::vector<std::vector<double> > &polarity,
+                                                               const vector<int>& axisTypes,
+                                                               const vector<int>& multipoleAtomZs,
+                                                               const vector<int>& multipoleAtomXs,
+                                                               const vector<int>& multipoleAtomYs,
+                                                               const vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
+                                                               const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                                               const std::function<void (int, const vector<double>&, const vector<Vec3>&)>& processPlane)
+{
+
+    // setup and sources as for calculateElectrostaticPotential(), prepared once for all planes
+
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
+
+    vector<MultipoleParticleData> sources(particleData);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        sources[ii].dipole += _inducedDipole[ii];
+    prepareElectrostaticPotential(sources);
+
+    double term = _electric/_dielectric;
+    vector<Vec3> points(numPoints[1]*numPoints[2]);
+    vector<double> potential;
+    vector<Vec3> field;
+    for (int ii = 0; ii < numPoints[0]; ii++) {
+        for (int jj = 0; jj < numPoints[1]; jj++)
+            for (int kk = 0; kk < numPoints[2]; kk++)
+                points[jj*numPoints[2]+kk] = origin + axes[0]*ii + axes[1]*jj + axes[2]*kk;
+        calculateElectrostaticPotentialAtPoints(sources, points, potential, includeField ? &field : NULL, NULL);
+        for (auto& p : potential)
+            p *= term;
+        for (auto& f : field)
+            f *= term;
+        processPlane(ii, potential, field);
+    }
+}
+
+void MPIDReferenceForce::calculateElectricFields(const vector<Vec3>& particlePositions,
+                                                 const vector<double>& charges,
+                                                 const vector<double>& dipoles,
+                                                 const vector<double>& quadrupoles,
+                                                 const vector<double>& octopoles,
+                                                 const vector<double>& tholes,
+                                                 const vector<double>& dampingFactors,
+                                                 const std::vector<std::vector<double> > &polarity,
+                                                 const vector<int>& axisTypes,
+                                                 const vector<int>& multipoleAtomZs,
+                                                 const vector<int>& multipoleAtomXs,
+                                                 const vector<int>& multipoleAtomYs,
+                                                 const vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
+                                                 vector<Vec3>* outputFields,
+                                                 vector<double>* outputFieldGradients)
+{
+
+    // setup, including calculating induced dipoles, unless the last setup still holds
+
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
+
+    // The solver's last field is that of the dipoles before its final update, so the field of the
+    // converged induced dipoles is computed once more, along with its gradient if requested.
+
+    vector<UpdateInducedDipoleFieldStruct> updateInducedDipoleField;
+    updateInducedDipoleField.push_back(UpdateInducedDipoleFieldStruct(_fixedElectricField, _inducedDipole, _ptDipoleD, _ptDipoleFieldD, _ptDipoleFieldGradientD));
+    if (outputFieldGradients != NULL)
+        updateInducedDipoleField[0].inducedDipoleFieldGradient.assign(6*_numParticles, 0.0);
+    calculateInducedDipoleFields(particleData, updateInducedDipoleField);
+
+    double term = _electric/_dielectric;
+    if (outputFields != NULL) {
+        outputFields->resize(_numParticles);
+        for (unsigned int ii = 0; ii < _numParticles; ii++)
+            (*outputFields)[ii] = (_fixedElectricField[ii] + updateInducedDipoleField[0].inducedDipoleField[ii])*term;
+    }
+    if (outputFieldGradients != NULL) {
+        vector<double> fixedGradients;
+        calculateFixedMultipoleFieldGradient(particleData, fixedGradients);
+        const vector<double>& inducedGradients = updateInducedDipoleField[0].inducedDipoleFieldGradient;
+        outputFieldGradients->resize(6*_numParticles);
+        for (unsigned int ii = 0; ii < _numParticles; ii++) {
+            const double* fixed   = &fixedGradients[6*ii];
+            const double* induced = &inducedGradients[6*ii];
+            double* gradient      = &(*outputFieldGradients)[6*ii];
+            gradient[0] = (fixed[QXX] + induced[0])*term;
+            gradient[1] = (fixed[QXY] + induced[3])*term;
+            gradient[2] = (fixed[QYY] + induced[1])*term;
+            gradient[3] = (fixed[QXZ] + induced[4])*term;
+            gradient[4] = (fixed[QYZ] + induced[5])*term;
+            gradient[5] = (fixed[QZZ] + induced[2])*term;
         }
     }
+}
+
+void MPIDReferenceForce::calculateElectricFieldsAtPoints(const vector<Vec3>& particlePositions,
+                                                         const vector<double>& charges,
+                                                         const vector<double>& dipoles,
+                                                         const vector<double>& quadrupoles,
+                                                         const vector<double>& octopoles,
+                                                         const vector<double>& tholes,
+                                                         const vector<double>& dampingFactors,
+                                                         const std::vector<std::vector<double> > &polarity,
+                                                         const vector<int>& axisTypes,
+                                                         const vector<int>& multipoleAtomZs,
+                                                         const vector<int>& multipoleAtomXs,
+                                                         const vector<int>& multipoleAtomYs,
+                                                         const vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
+                                                         const vector<Vec3>& points,
+                                                         vector<Vec3>* outputFields,
+                                                         vector<double>* outputFieldGradients)
+{
+
+    // setup and sources as for calculateElectrostaticPotential()
+
+    vector<MultipoleParticleData>& particleData = _setupParticleData;
+    if (!_setupValid)
+        setup(particlePositions, charges, dipoles, quadrupoles, octopoles, tholes,
+               dampingFactors, polarity, axisTypes, multipoleAtomZs, multipoleAtomXs, multipoleAtomYs,
+               multipoleAtomCovalentInfo, particleData);
+
+    vector<MultipoleParticleData> sources(particleData);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        sources[ii].dipole += _inducedDipole[ii];
+    prepareElectrostaticPotential(sources);
+    vector<double> potential;
+    vector<Vec3> field;
+    vector<double> fieldGradient;
+    calculateElectrostaticPotentialAtPoints(sources, points, potential, outputFields != NULL ? &field : NULL,
+                                            outputFieldGradients != NULL ? &fieldGradient : NULL);
 
     double term = _electric/_dielectric;
-    for (auto& p : potential)
-        p *= term;
+    if (outputFields != NULL) {
+        outputFields->resize(points.size());
+        for (unsigned int ii = 0; ii < points.size(); ii++)
+            (*outputFields)[ii] = field[ii]*term;
+    }
+    if (outputFieldGradients != NULL) {
+        outputFieldGradients->resize(6*points.size());
+        for (unsigned int ii = 0; ii < points.size(); ii++) {
+            const double* pointGradient = &fieldGradient[6*ii];
+            double* gradient            = &(*outputFieldGradients)[6*ii];
+            gradient[0] = pointGradient[QXX]*term;
+            gradient[1] = pointGradient[QXY]*term;
+            gradient[2] = pointGradient[QYY]*term;
+            gradient[3] = pointGradient[QXZ]*term;
+            gradient[4] = pointGradient[QYZ]*term;
+            gradient[5] = pointGradient[QZZ]*term;
+        }
+    }
 }
 
 MPIDReferenceForce::UpdateInducedDipoleFieldStruct::UpdateInducedDipoleFieldStruct(vector<OpenMM::Vec3>& inputFixed_E_Field, vector<OpenMM::Vec3>& inputInducedDipoles, vector<vector<Vec3> >& extrapolatedDipoles,  vector<vector<double> >& extrapolatedDipoleField,  vector<vector<double> >& extrapolatedDipoleFieldGradient) :
@@ -2536,27 +3321,39 @@ MPIDReferenceForce::UpdateInducedDipoleFieldStruct::UpdateInducedDipoleFieldStru
 }
 
 
-const int MPIDReferencePmeForce::MPID_PME_ORDER = 6;
-
 const double MPIDReferencePmeForce::SQRT_PI = 1.77245385091;
 
 MPIDReferencePmeForce::MPIDReferencePmeForce() :
-               MPIDReferenceForce(PME),
+               MPIDReferenceForce(PME), _pmeOrder(6),
                _cutoffDistance(1.0), _cutoffDistanceSquared(1.0),
-               _pmeGridSize(0), _totalGridSize(0), _alphaEwald(0.0)
+               _pmeGridSize(0), _totalGridSize(0), _pmeGridZStride(0), _alphaEwald(0.0), _influenceAlphaEwald(0.0),
+               _neighborListCutoff(0.0), _neighborListSkin(0.1)
 {
 
-    _fftplan = NULL;
+    _fft = NULL;
+    _ewaldSum = NULL;
+    _useMultilevelSummation = false;
+    _msm = NULL;
+    _useOptimalInfluenceFunction = false;
+    _useInterlacedGrids = false;
+    _useSlabCorrection = false;
+    _slabGridDimensions = IntVec(-1, -1, -1);
     _pmeGrid = NULL;
     _pmeGridDimensions = IntVec(-1, -1, -1);
 }
 
 MPIDReferencePmeForce::~MPIDReferencePmeForce()
 {
-    if (_fftplan) {
-        fftpack_destroy(_fftplan);
+    if (_fft) {
+        delete _fft;
     }
-    if (_pmeGrid) {
+    if (_ewaldSum) {
+        delete _ewaldSum;
+    }
+    if (_msm) {
+        delete _msm;
+    }
+    if (_pmeGrid) {
         delete [] _pmeGrid;
     }
 };
@@ -2592,18 +3389,76 @@ void MPIDReferencePmeForce::getPmeGridDimensions(vector<int>& pmeGridDimensions)
     pmeGridDimensions[2] = _pmeGridDimensions[2];
 };
 
+int MPIDReferencePmeForce::getPmeOrder() const
+{
+    return _pmeOrder;
+}
+
+void MPIDReferencePmeForce::setPmeOrder(int order)
+{
+    if (order < 4 || order > 6) {
+        std::stringstream message;
+        message << "PME B-spline order " << order << " is not supported.";
+        throw OpenMMException(message.str());
+    }
+    if (order == _pmeOrder)
+        return;
+
+    // The wraparound tables and B-spline moduli depend on the order; make the next call to
+    // setPmeGridDimensions() rebuild them.
+
+    _pmeOrder = order;
+    _pmeGridDimensions = IntVec(-1, -1, -1);
+}
+
 void MPIDReferencePmeForce::setPmeGridDimensions(vector<int>& pmeGridDimensions)
+{
+    // With the slab correction the grid is only created once the height of the slab is known.
+
+    if (_useSlabCorrection) {
+        _slabGridDimensions = IntVec(pmeGridDimensions[0], pmeGridDimensions[1], pmeGridDimensions[2]);
+        return;
+    }
+    setActivePmeGridDimensions(pmeGridDimensions);
+}
+
+void MPIDReferencePmeForce::setActivePmeGridDimensions(const vector<int>& pmeGridDimensions)
 {
 
+    if (_ewaldSum) {
+        delete _ewaldSum;
+        _ewaldSum = NULL;
+        _pmeGridDimensions = IntVec(-1, -1, -1);
+        setNonbondedMethod(PME);
+    }
     if ((pmeGridDimensions[0] == _pmeGridDimensions[0]) &&
         (pmeGridDimensions[1] == _pmeGridDimensions[1]) &&
         (pmeGridDimensions[2] == _pmeGridDimensions[2]))
         return;
 
-    if (_fftplan) {
-        fftpack_destroy(_fftplan);
+    if (_fft) {
+        delete _fft;
+        _fft = NULL;
+    }
+    if (_msm) {
+        delete _msm;
+        _msm = NULL;
+    }
+    if (_useMultilevelSummation)
+        _msm = new MPIDReferenceMSM(pmeGridDimensions[0], pmeGridDimensions[1], pmeGridDimensions[2], _pmeOrder);
+    else
+        _fft = MPIDReferenceFFT::create(pmeGridDimensions[0], pmeGridDimensions[1], pmeGridDimensions[2]);
+    _pmeGridZStride = 2*(pmeGridDimensions[2]/2+1);
+    _influenceFunction.clear();
+    _influenceM2.clear();
+
+    // Lookup tables for the periodic wraparound of the spreading stencil.
+
+    for (int ii = 0; ii < 3; ii++) {
+        _gridWrap[ii].resize(pmeGridDimensions[ii]+_pmeOrder);
+        for (int jj = 0; jj < (int) _gridWrap[ii].size(); jj++)
+            _gridWrap[ii][jj] = jj % pmeGridDimensions[ii];
     }
-    fftpack_init_3d(&_fftplan,pmeGridDimensions[0], pmeGridDimensions[1], pmeGridDimensions[2]);
 
     _pmeGridDimensions[0] = pmeGridDimensions[0];
     _pmeGridDimensions[1] = pmeGridDimensions[1];
@@ -2612,6 +3467,75 @@ void MPIDReferencePmeForce::setPmeGridDimensions(vector<int>& pmeGridDimensions)
     initializeBSplineModuli();
 };
 
+void MPIDReferencePmeForce::setEwaldKMax(const vector<int>& kmax)
+{
+    if (_ewaldSum && _ewaldSum->getKMax(0) == kmax[0] && _ewaldSum->getKMax(1) == kmax[1] && _ewaldSum->getKMax(2) == kmax[2])
+        return;
+    if (_ewaldSum) {
+        delete _ewaldSum;
+    }
+    if (_fft) {
+        delete _fft;
+        _fft = NULL;
+    }
+    if (_msm) {
+        delete _msm;
+        _msm = NULL;
+    }
+    _useMultilevelSummation = false;
+    _ewaldSum = new MPIDReferenceEwaldSum(kmax[0], kmax[1], kmax[2]);
+
+    // With one grid point per cell edge the fractional coordinates, multipoles and potentials used by
+    // the PME code are those of the unit cell, which is what the Ewald sum works with.
+
+    _pmeGridDimensions = IntVec(1, 1, 1);
+    setNonbondedMethod(Ewald);
+}
+
+void MPIDReferencePmeForce::setUseMultilevelSummation(bool use)
+{
+    if (use == _useMultilevelSummation)
+        return;
+    if (use && _pmeOrder%2 != 0) {
+        std::stringstream message;
+        message << "Multilevel summation needs an even B-spline order, not " << _pmeOrder << ".";
+        throw OpenMMException(message.str());
+    }
+
+    // Make the next call to setPmeGridDimensions() create the FFT or the grid hierarchy.
+
+    _useMultilevelSummation = use;
+    _pmeGridDimensions = IntVec(-1, -1, -1);
+    setNonbondedMethod(use ? MSM : PME);
+}
+
+void MPIDReferencePmeForce::setUseOptimalInfluenceFunction(bool use)
+{
+    if (use != _useOptimalInfluenceFunction) {
+        _influenceFunction.clear();
+        _influenceM2.clear();
+    }
+    _useOptimalInfluenceFunction = use;
+}
+
+void MPIDReferencePmeForce::setUseInterlacedGrids(bool use)
+{
+    if (use != _useInterlacedGrids) {
+        _influenceFunction.clear();
+        _influenceM2.clear();
+    }
+    _useInterlacedGrids = use;
+}
+
+void MPIDReferencePmeForce::setUseSlabCorrection(bool use)
+{
+    if (use == _useSlabCorrection)
+        return;
+    _useSlabCorrection = use;
+    _pmeGridDimensions = IntVec(-1, -1, -1);
+    _slabGridDimensions = IntVec(-1, -1, -1);
+}
+
 void MPIDReferencePmeForce::setPeriodicBoxSize(OpenMM::Vec3* vectors)
 {
 
@@ -2620,6 +3544,21 @@ void MPIDReferencePmeForce::setPeriodicBoxSize(OpenMM::Vec3* vectors)
         message << "Box size of zero is invalid.";
         throw OpenMMException(message.str());
     }
+    if (_useSlabCorrection) {
+        for (int ii = 0; ii < 3; ii++)
+            _slabBoxVectors[ii] = vectors[ii];
+        return;
+    }
+    setActivePeriodicBox(vectors);
+}
+
+void MPIDReferencePmeForce::setActivePeriodicBox(const OpenMM::Vec3* vectors)
+{
+
+    // Nothing depends on the box but the reciprocal vectors; skip the update if it is unchanged.
+
+    if (vectors[0] == _periodicBoxVectors[0] && vectors[1] == _periodicBoxVectors[1] && vectors[2] == _periodicBoxVectors[2])
+        return;
 
     _periodicBoxVectors[0] = vectors[0];
     _periodicBoxVectors[1] = vectors[1];
@@ -2632,6 +3571,18 @@ void MPIDReferencePmeForce::setPeriodicBoxSize(OpenMM::Vec3* vectors)
     _recipBoxVectors[2] = Vec3(vectors[1][0]*vectors[2][1]-vectors[1][1]*vectors[2][0], -vectors[0][0]*vectors[2][1], vectors[0][0]*vectors[1][1])*scale;
 };
 
+double MPIDReferencePmeForce::getNeighborListSkin() const
+{
+     return _neighborListSkin;
+};
+
+void MPIDReferencePmeForce::setNeighborListSkin(double skin)
+{
+     _neighborListSkin = skin;
+     _neighborList.clear();
+     _neighborListPositions.clear();
+};
+
 int compareInt2(const int2& v1, const int2& v2)
 {
     return v1[1] < v2[1];
@@ -2640,23 +3591,29 @@ int compareInt2(const int2& v1, const int2& v2)
 void MPIDReferencePmeForce::resizePmeArrays()
 {
 
-    _totalGridSize = _pmeGridDimensions[0]*_pmeGridDimensions[1]*_pmeGridDimensions[2];
+    _totalGridSize = _pmeGridDimensions[0]*_pmeGridDimensions[1]*_pmeGridZStride;
     if (_pmeGridSize < _totalGridSize) {
         if (_pmeGrid) {
-            delete _pmeGrid;
+            delete [] _pmeGrid;
         }
-        _pmeGrid      = new t_complex[_totalGridSize];
+        _pmeGrid      = new double[_totalGridSize];
         _pmeGridSize  = _totalGridSize;
     }
 
     for (unsigned int ii = 0; ii < 3; ii++) {
        _pmeBsplineModuli[ii].resize(_pmeGridDimensions[ii]);
-       _thetai[ii].resize(MPID_PME_ORDER*_numParticles);
+       _thetai[ii].resize(_pmeOrder*_numParticles);
     }
 
     _iGrid.resize(_numParticles);
     _phi.resize(35*_numParticles);
     _phidp.resize(35*_numParticles);
+    if (_useInterlacedGrids) {
+        for (unsigned int ii = 0; ii < 3; ii++)
+            _interlacedThetai[ii].resize(_pmeOrder*_numParticles);
+        _interlacedIGrid.resize(_numParticles);
+        _interlacedPhi.resize(35*_numParticles);
+    }
 }
 
 void MPIDReferencePmeForce::initializePmeGrid()
@@ -2665,7 +3622,7 @@ void MPIDReferencePmeForce::initializePmeGrid()
         return;
 
     for (int jj = 0; jj < _totalGridSize; jj++)
-        _pmeGrid[jj].re = _pmeGrid[jj].im = 0.0;
+        _pmeGrid[jj] = 0.0;
 }
 
 void MPIDReferencePmeForce::getPeriodicDelta(Vec3& deltaR) const
@@ -2675,16 +3632,163 @@ void MPIDReferencePmeForce::getPeriodicDelta(Vec3& deltaR) const
     deltaR -= _periodicBoxVectors[0]*floor(deltaR[0]*_recipBoxVectors[0][0]+0.5);
 }
 
+void MPIDReferencePmeForce::selectPeriodicImages(vector<MultipoleParticleData>& particleData)
+{
+    if (!_useSlabCorrection || _numParticles == 0)
+        return;
+    if (_slabGridDimensions[0] < 0 || _slabBoxVectors[2][2] == 0.0)
+        throw OpenMMException("The slab correction needs the grid dimensions and box of the full system.");
+
+    // Cut the box along z in the middle of the widest empty layer, and move every particle to its image
+    // just above the cut.  The occupied region is then in one piece, as the dipole moment needs it.
+
+    const Vec3* box = _slabBoxVectors;
+    vector<double> heights(_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        double height = particleData[ii].position[2]/box[2][2];
+        heights[ii] = height-floor(height);
+    }
+    std::sort(heights.begin(), heights.end());
+    double gapStart = heights[_numParticles-1]-1.0;
+    double gapWidth = heights[0]-gapStart;
+    for (unsigned int ii = 1; ii < _numParticles; ii++) {
+        if (heights[ii]-heights[ii-1] > gapWidth) {
+            gapStart = heights[ii-1];
+            gapWidth = heights[ii]-heights[ii-1];
+        }
+    }
+    double cut = gapStart+0.5*gapWidth;
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        particleData[ii].position -= box[2]*floor(particleData[ii].position[2]/box[2][2]-cut);
+
+    // The images along z have to be about three slab heights apart for the correction to hold, and
+    // more than the cutoff for the direct space sum to not see them.  The grid keeps the spacing of
+    // the full one, and is only resized when the slab no longer fits or would fit a much smaller box,
+    // so the FFT is not planned again on every step.
+
+    double thickness = (1.0-gapWidth)*box[2][2];
+    double height = std::max(3.0*thickness, std::max(thickness+_cutoffDistance, 2.0*_cutoffDistance));
+    int fullSize = _slabGridDimensions[2];
+    double spacing = box[2][2]/fullSize;
+    int gridSizeZ = _pmeGridDimensions[2];
+    bool valid = (_pmeGridDimensions[0] == _slabGridDimensions[0] && _pmeGridDimensions[1] == _slabGridDimensions[1] && gridSizeZ > 0);
+    if (valid)
+        valid = ((height <= gridSizeZ*spacing || gridSizeZ == fullSize) && height >= 0.6*gridSizeZ*spacing);
+    if (!valid) {
+        int minimum = std::max((int) ceil(1.2*height/spacing), _pmeOrder);
+        gridSizeZ = (_useMultilevelSummation ? MPIDReferenceMSM::findLegalDimension(minimum) : MPIDReferenceFFT::findLegalDimension(minimum));
+        gridSizeZ = std::min(gridSizeZ, fullSize);
+    }
+    Vec3 boxVectors[3] = {box[0], box[1], box[2]*(gridSizeZ/(double) fullSize)};
+    setActivePeriodicBox(boxVectors);
+    vector<int> gridDimensions = {_slabGridDimensions[0], _slabGridDimensions[1], gridSizeZ};
+    setActivePmeGridDimensions(gridDimensions);
+}
+
+void MPIDReferencePmeForce::addSlabCorrectionPotential(double dipoleZ, const vector<MultipoleParticleData>* particleData, vector<double>& phi) const
+{
+    // The potential is linear in z, so only the value and the first derivative along the third grid
+    // axis are nonzero; the other axes have no z component.
+
+    double volume = _periodicBoxVectors[0][0]*_periodicBoxVectors[1][1]*_periodicBoxVectors[2][2];
+    double slope = 4.0*M_PI*dipoleZ/volume;
+    double fractionalSlope = slope*_periodicBoxVectors[2][2]/_pmeGridDimensions[2];
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        if (particleData != NULL)
+            phi[35*ii] += slope*(*particleData)[ii].position[2];
+        phi[35*ii+3] += fractionalSlope;
+    }
+}
+
+void MPIDReferencePmeForce::updateNeighborList(const vector<MultipoleParticleData>& particleData)
+{
+
+    // the list holds every pair within cutoff+skin, so it stays valid until two particles
+    // have closed that gap, i.e. until some particle has moved by more than half the skin
+
+    double listCutoff = _cutoffDistance + _neighborListSkin;
+    double maxCutoff  = 0.5*std::min(_periodicBoxVectors[0][0], std::min(_periodicBoxVectors[1][1], _periodicBoxVectors[2][2]));
+    listCutoff        = std::max(_cutoffDistance, std::min(listCutoff, maxCutoff));
+
+    bool rebuild = (_neighborListPositions.size() != _numParticles || _neighborListCutoff != listCutoff);
+    for (unsigned int ii = 0; ii < 3 && !rebuild; ii++)
+        rebuild = !(_neighborListBoxVectors[ii] == _periodicBoxVectors[ii]);
+    if (!rebuild) {
+        double halfSkin2 = 0.25*(listCutoff - _cutoffDistance)*(listCutoff - _cutoffDistance);
+        for (unsigned int ii = 0; ii < _numParticles && !rebuild; ii++) {
+            Vec3 delta = particleData[ii].position - _neighborListPositions[ii];
+            rebuild = (delta.dot(delta) > halfSkin2);
+        }
+    }
+    if (!rebuild)
+        return;
+
+    _neighborListPositions.resize(_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        _neighborListPositions[ii] = particleData[ii].position;
+    for (unsigned int ii = 0; ii < 3; ii++)
+        _neighborListBoxVectors[ii] = _periodicBoxVectors[ii];
+    _neighborListCutoff = listCutoff;
+
+    // covalently scaled pairs still need their direct space terms, so nothing is excluded here
+
+    NeighborList pairs;
+    vector<set<int> > exclusions(_numParticles);
+    computeNeighborListVoxelHash(pairs, _numParticles, _neighborListPositions, exclusions, _periodicBoxVectors, true, listCutoff);
+
+    _neighborList.resize(pairs.size());
+    for (unsigned int ii = 0; ii < pairs.size(); ii++) {
+        _neighborList[ii].particleI = std::min(pairs[ii].first, pairs[ii].second);
+        _neighborList[ii].particleJ = std::max(pairs[ii].first, pairs[ii].second);
+    }
+
+    // sort so that the pairs of each particle are contiguous, then pick up the scale table
+    // entries by walking each particle's row alongside its partners
+
+    std::sort(_neighborList.begin(), _neighborList.end(),
+              [](const NeighborPair& a, const NeighborPair& b) {
+                  return a.particleI < b.particleI || (a.particleI == b.particleI && a.particleJ < b.particleJ);
+              });
+
+    unsigned int scaleEntry = 0;
+    unsigned int scaleEnd   = 0;
+    for (unsigned int ii = 0; ii < _neighborList.size(); ii++) {
+        NeighborPair& pair = _neighborList[ii];
+        if (ii == 0 || pair.particleI != _neighborList[ii-1].particleI) {
+            scaleEntry = _scaleRowStart[pair.particleI];
+            scaleEnd   = _scaleRowStart[pair.particleI+1];
+        }
+        while (scaleEntry < scaleEnd && _scaleColumn[scaleEntry] < pair.particleJ)
+            scaleEntry++;
+        pair.scaleEntry = (scaleEntry < scaleEnd && _scaleColumn[scaleEntry] == pair.particleJ) ? static_cast<int>(scaleEntry) : -1;
+    }
+}
+
+int MPIDReferencePmeForce::getNumThreads() const
+{
+    return (_threads == NULL) ? 1 : _threads->getNumThreads();
+}
+
+void MPIDReferencePmeForce::getNeighborListBlock(int threadIndex, int numThreads, unsigned int& start, unsigned int& end) const
+{
+    start = (_neighborList.size()*threadIndex)/numThreads;
+    end   = (_neighborList.size()*(threadIndex+1))/numThreads;
+}
+
+void MPIDReferencePmeForce::getParticleBlock(int threadIndex, int numThreads, unsigned int& start, unsigned int& end) const
+{
+    start = (_numParticles*threadIndex)/numThreads;
+    end   = (_numParticles*(threadIndex+1))/numThreads;
+}
+
 void MPIDReferencePmeForce::getDampedInverseDistances(const MultipoleParticleData& particleI,
                                                                  const MultipoleParticleData& particleJ,
                                                                  double dscale, double pscale, double r,
-                                                                 std::vector<double>& dampedDInverseDistances,
-                                                                 std::vector<double>& dampedPInverseDistances) const
+                                                                 double dampedDInverseDistances[4],
+                                                                 double dampedPInverseDistances[4]) const
 {
 
-    std::vector<double> scaleFactor(4, 1.0);
-    dampedDInverseDistances.reserve(4);
-    dampedPInverseDistances.reserve(4);
+    double scaleFactor[4] = {1.0, 1.0, 1.0, 1.0};
     double damp = particleI.dampingFactor*particleJ.dampingFactor;
     if (damp != 0.0) {
 
@@ -2728,11 +3832,11 @@ void MPIDReferencePmeForce::initializeBSplineModuli()
         maxSize = maxSize  > _pmeGridDimensions[ii] ? maxSize : _pmeGridDimensions[ii];
     }
 
-    double array[MPID_PME_ORDER];
+    vector<double> array(_pmeOrder);
     double x = 0.0;
     array[0]     = 1.0 - x;
     array[1]     = x;
-    for (int k = 2; k < MPID_PME_ORDER; k++) {
+    for (int k = 2; k < _pmeOrder; k++) {
         double denom = 1.0/k;
         array[k] = x*array[k-1]*denom;
         for (int i = 1; i < k; i++) {
@@ -2742,7 +3846,7 @@ void MPIDReferencePmeForce::initializeBSplineModuli()
     }
 
     vector<double> bsarray(maxSize+1, 0.0);
-    for (int i = 2; i <= MPID_PME_ORDER+1; i++) {
+    for (int i = 2; i <= _pmeOrder+1; i++) {
         bsarray[i] = array[i-2];
     }
     for (int dim = 0; dim < 3; dim++) {
@@ -2794,13 +3898,13 @@ void MPIDReferencePmeForce::initializeBSplineModuli()
                 factor = M_PI*k/size;
                 for (int j = 1; j <= jcut; j++) {
                     double arg = factor/(factor+M_PI*j);
-                    sum1 = sum1 + pow(arg,   MPID_PME_ORDER);
-                    sum2 = sum2 + pow(arg, 2*MPID_PME_ORDER);
+                    sum1 = sum1 + pow(arg,   _pmeOrder);
+                    sum2 = sum2 + pow(arg, 2*_pmeOrder);
                 }
                 for (int j = 1; j <= jcut; j++) {
                     double arg  = factor/(factor-M_PI*j);
-                    sum1 += pow(arg,   MPID_PME_ORDER);
-                    sum2 += pow(arg, 2*MPID_PME_ORDER);
+                    sum1 += pow(arg,   _pmeOrder);
+                    sum2 += pow(arg, 2*_pmeOrder);
                 }
                 zeta = sum2/sum1;
             }
@@ -2813,6 +3917,14 @@ void MPIDReferencePmeForce::calculateFixedMultipoleFieldPairIxn(const MultipoleP
                                                                            const MultipoleParticleData& particleJ,
                                                                            double dscale, double pscale)
 {
+    calculateFixedMultipoleFieldPairIxn(particleI, particleJ, dscale, pscale, _fixedMultipoleField);
+}
+
+void MPIDReferencePmeForce::calculateFixedMultipoleFieldPairIxn(const MultipoleParticleData& particleI,
+                                                                           const MultipoleParticleData& particleJ,
+                                                                           double dscale, double pscale,
+                                                                           vector<Vec3>& field) const
+{
 
     unsigned int iIndex    = particleI.particleIndex;
     unsigned int jIndex    = particleJ.particleIndex;
@@ -2853,8 +3965,8 @@ void MPIDReferencePmeForce::calculateFixedMultipoleFieldPairIxn(const MultipoleP
 
     // compute the error function scaled and unscaled terms
 
-    std::vector<double> dampedDInverseDistances;
-    std::vector<double> dampedPInverseDistances;
+    double dampedDInverseDistances[4];
+    double dampedPInverseDistances[4];
     getDampedInverseDistances(particleI, particleJ, dscale, pscale, r, dampedDInverseDistances, dampedPInverseDistances);
 
     double drr3        = dampedDInverseDistances[0];
@@ -2914,8 +4026,8 @@ void MPIDReferencePmeForce::calculateFixedMultipoleFieldPairIxn(const MultipoleP
     fid += -oJ*(3.0*drr7) + deltaR*drr9*oJ.dot(deltaR);
     fjd += -oI*(3.0*drr7) + deltaR*drr9*oI.dot(deltaR);
     // increment the field at each site due to this interaction
-    _fixedMultipoleField[iIndex] += fim - fid;
-    _fixedMultipoleField[jIndex] += fjm - fjd;
+    field[iIndex] += fim - fid;
+    field[jIndex] += fjm - fjd;
 
 }
 
@@ -2924,14 +4036,7 @@ void MPIDReferencePmeForce::calculateFixedMultipoleField(const vector<MultipoleP
 
     // first calculate reciprocal space fixed multipole fields
 
-    resizePmeArrays();
-    computeMPIDBsplines(particleData);
-    initializePmeGrid();
-    spreadFixedMultipolesOntoGrid(particleData);
-    fftpack_exec_3d(_fftplan, FFTPACK_FORWARD, _pmeGrid, _pmeGrid);
-    performMPIDReciprocalConvolution();
-    fftpack_exec_3d(_fftplan, FFTPACK_BACKWARD, _pmeGrid, _pmeGrid);
-    computeFixedPotentialFromGrid();
+    computeReciprocalSpaceFixedPotential(particleData);
     recordFixedMultipoleField();
 
     // include self-energy portion of the multipole field
@@ -2943,20 +4048,168 @@ void MPIDReferencePmeForce::calculateFixedMultipoleField(const vector<MultipoleP
         _fixedMultipoleField[jj] += selfEnergy;
     }
 
-    // include direct space fixed multipole fields
+    // include direct space fixed multipole fields; this is the first direct space pass of each
+    // evaluation, so bring the neighbor list up to date here and reuse it for the rest
 
-    this->MPIDReferenceForce::calculateFixedMultipoleField(particleData);
+    updateNeighborList(particleData);
+
+    int numThreads = getNumThreads();
+    if (numThreads == 1) {
+        for (const NeighborPair& pair : _neighborList) {
+            double scale = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + P_SCALE];
+            calculateFixedMultipoleFieldPairIxn(particleData[pair.particleI], particleData[pair.particleJ], scale, scale, _fixedMultipoleField);
+        }
+        return;
+    }
+
+    // each thread accumulates its block of pairs into a private field, then the
+    // private fields are summed over blocks of particles
+
+    _threadFixedMultipoleField.resize(numThreads);
+    _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+        vector<Vec3>& field = _threadFixedMultipoleField[threadIndex];
+        field.assign(_numParticles, Vec3());
+        unsigned int start, end;
+        getNeighborListBlock(threadIndex, numThreads, start, end);
+        for (unsigned int ii = start; ii < end; ii++) {
+            const NeighborPair& pair = _neighborList[ii];
+            double scale = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + P_SCALE];
+            calculateFixedMultipoleFieldPairIxn(particleData[pair.particleI], particleData[pair.particleJ], scale, scale, field);
+        }
+    });
+    _threads->waitForThreads();
+    _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+        unsigned int start, end;
+        getParticleBlock(threadIndex, numThreads, start, end);
+        for (int kk = 0; kk < numThreads; kk++)
+            for (unsigned int ii = start; ii < end; ii++)
+                _fixedMultipoleField[ii] += _threadFixedMultipoleField[kk][ii];
+    });
+    _threads->waitForThreads();
 }
 
-#define ARRAY(x,y) array[(x)-1+((y)-1)*MPID_PME_ORDER]
+void MPIDReferencePmeForce::calculateFixedMultipoleFieldGradientPairIxn(const MultipoleParticleData& particleI,
+                                                                        const MultipoleParticleData& particleJ,
+                                                                        double dScale, double pScale,
+                                                                        vector<double>& gradients) const
+{
+    if (particleI.particleIndex == particleJ.particleIndex)
+        return;
+
+    Vec3 deltaR = particleJ.position - particleI.position;
+    getPeriodicDelta(deltaR);
+    double r2 = deltaR.dot(deltaR);
+    if (r2 > _cutoffDistanceSquared)
+        return;
+    double r = sqrt(r2);
+
+    // As for the field, the erfc radial functions less the bare ones reduced by the scaled damping:
+    // the scaled and damped part is the only one the reciprocal space sum does not already hold.
+
+    double rrI[5];
+    getAndScaleInverseRs(particleI.dampingFactor, particleJ.dampingFactor, pScale, particleI.thole, particleJ.thole, r, 5, rrI);
+    double exp2a  = exp(-_alphaEwald*_alphaEwald*r2);
+    double alsq2  = 2.0*_alphaEwald*_alphaEwald;
+    double alsq2n = 1.0/(SQRT_PI*_alphaEwald);
+    double bn[6];
+    double bare   = 1.0/r;
+    bn[0] = erfc(_alphaEwald*r)/r;
+    for (int n = 1; n < 6; n++) {
+        alsq2n *= alsq2;
+        bn[n]   = ((2*n-1)*bn[n-1]+alsq2n*exp2a)/r2;
+    }
+    for (int n = 1; n < 6; n++) {
+        bare   *= (2*n-1)/r2;
+        bn[n]  += dScale*rrI[n-1] - bare;
+    }
+
+    double gradient[6];
+    calculateMultipoleFieldGradientAtPoint(particleJ, deltaR, bn, gradient);
+    for (int kk = 0; kk < 6; kk++)
+        gradients[6*particleI.particleIndex+kk] += gradient[kk];
+    calculateMultipoleFieldGradientAtPoint(particleI, -deltaR, bn, gradient);
+    for (int kk = 0; kk < 6; kk++)
+        gradients[6*particleJ.particleIndex+kk] += gradient[kk];
+}
+
+void MPIDReferencePmeForce::calculateFixedMultipoleFieldGradient(const vector<MultipoleParticleData>& particleData, vector<double>& gradients)
+{
+
+    // reciprocal space: minus the second derivatives of the potential kept by the last setup
+
+    vector<double> cphi(20*_numParticles);
+    transformPotentialToCartesianCoordinates(_phi, cphi);
+    gradients.resize(6*_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        double* gradient = &gradients[6*ii];
+        gradient[QXX] = -cphi[20*ii+4];
+        gradient[QYY] = -cphi[20*ii+5];
+        gradient[QZZ] = -cphi[20*ii+6];
+        gradient[QXY] = -cphi[20*ii+7];
+        gradient[QXZ] = -cphi[20*ii+8];
+        gradient[QYZ] = -cphi[20*ii+9];
+    }
+
+    // remove each particle's own Gaussian, whose radial functions at zero distance are
+    // B_n(0) = (2 alpha/sqrt(pi)) (2 alpha^2)^n/(2n+1)
+
+    double bn[6];
+    double alsq2n = 2.0*_alphaEwald/SQRT_PI;
+    for (int n = 0; n < 6; n++) {
+        bn[n]   = alsq2n/(2*n+1);
+        alsq2n *= 2.0*_alphaEwald*_alphaEwald;
+    }
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        double selfGradient[6];
+        calculateMultipoleFieldGradientAtPoint(particleData[ii], Vec3(), bn, selfGradient);
+        for (int kk = 0; kk < 6; kk++)
+            gradients[6*ii+kk] -= selfGradient[kk];
+    }
+
+    // direct space pairs of the neighbor list, split between the threads as for the field
+
+    int numThreads = getNumThreads();
+    if (numThreads == 1) {
+        for (const NeighborPair& pair : _neighborList) {
+            double scale = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + P_SCALE];
+            calculateFixedMultipoleFieldGradientPairIxn(particleData[pair.particleI], particleData[pair.particleJ], scale, scale, gradients);
+        }
+        return;
+    }
+    vector<vector<double> > threadGradients(numThreads);
+    _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+        vector<double>& gradient = threadGradients[threadIndex];
+        gradient.assign(6*_numParticles, 0.0);
+        unsigned int start, end;
+        getNeighborListBlock(threadIndex, numThreads, start, end);
+        for (unsigned int ii = start; ii < end; ii++) {
+            const NeighborPair& pair = _neighborList[ii];
+            double scale = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + P_SCALE];
+            calculateFixedMultipoleFieldGradientPairIxn(particleData[pair.particleI], particleData[pair.particleJ], scale, scale, gradient);
+        }
+    });
+    _threads->waitForThreads();
+    _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+        unsigned int start, end;
+        getParticleBlock(threadIndex, numThreads, start, end);
+        for (int kk = 0; kk < numThreads; kk++)
+            for (unsigned int ii = 6*start; ii < 6*end; ii++)
+                gradients[ii] += threadGradients[kk][ii];
+    });
+    _threads->waitForThreads();
+}
+
+#define ARRAY(x,y) array[(x)-1+((y)-1)*ORDER]
 
 /**
- * This is called from computeBsplines().  It calculates the spline coefficients for a single atom along a single axis.
+ * Calculate the spline coefficients and their first four derivatives for a single atom along a
+ * single axis.  The order is a template parameter so the recursions are unrolled for each order.
  */
-void MPIDReferencePmeForce::computeBSplinePoint(vector<double5>& thetai, double w)
+template <int ORDER>
+static void computeBSplinePointOfOrder(double5* thetai, double w)
 {
 
-    double array[MPID_PME_ORDER*MPID_PME_ORDER];
+    double array[ORDER*ORDER];
 
     // initialization to get to 2nd order recursion
 
@@ -2971,7 +4224,7 @@ void MPIDReferencePmeForce::computeBSplinePoint(vector<double5>& thetai, double
 
     // compute standard B-spline recursion to desired order
 
-    for (int i = 4; i <= MPID_PME_ORDER; i++) {
+    for (int i = 4; i <= ORDER; i++) {
         int k = i - 1;
         double denom = 1.0 / k;
         ARRAY(i,i) = denom * w * ARRAY(k,k);
@@ -2980,73 +4233,52 @@ void MPIDReferencePmeForce::computeBSplinePoint(vector<double5>& thetai, double
         ARRAY(i,1) = denom * (1.0-w) * ARRAY(k,1);
     }
 
-    // get coefficients for the B-spline first derivative
-
-    int k = MPID_PME_ORDER - 1;
-    ARRAY(k,MPID_PME_ORDER) = ARRAY(k,MPID_PME_ORDER-1);
-    for (int i = MPID_PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline second derivative
-
-    k = MPID_PME_ORDER - 2;
-    ARRAY(k,MPID_PME_ORDER-1) = ARRAY(k,MPID_PME_ORDER-2);
-    for (int i = MPID_PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,MPID_PME_ORDER) = ARRAY(k,MPID_PME_ORDER-1);
-    for (int i = MPID_PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-    // get coefficients for the B-spline third derivative
-
-    k = MPID_PME_ORDER - 3;
-    ARRAY(k,MPID_PME_ORDER-2) = ARRAY(k,MPID_PME_ORDER-3);
-    for (int i = MPID_PME_ORDER-3; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,MPID_PME_ORDER-1) = ARRAY(k,MPID_PME_ORDER-2);
-    for (int i = MPID_PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,MPID_PME_ORDER) = ARRAY(k,MPID_PME_ORDER-1);
-    for (int i = MPID_PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-
-
-    // get coefficients for the B-spline fourth derivative
-
-    k = MPID_PME_ORDER - 4;
-    ARRAY(k,MPID_PME_ORDER-3) = ARRAY(k,MPID_PME_ORDER-4);
-    for (int i = MPID_PME_ORDER-4; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,MPID_PME_ORDER-2) = ARRAY(k,MPID_PME_ORDER-3);
-    for (int i = MPID_PME_ORDER-3; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,MPID_PME_ORDER-1) = ARRAY(k,MPID_PME_ORDER-2);
-    for (int i = MPID_PME_ORDER-2; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
-    ARRAY(k,MPID_PME_ORDER) = ARRAY(k,MPID_PME_ORDER-1);
-    for (int i = MPID_PME_ORDER-1; i >= 2; i--)
-        ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
-    ARRAY(k,1) = -ARRAY(k,1);
+    // get coefficients for the B-spline derivatives by differencing the spline of order ORDER-d
+    // d times.  The d-th derivative overwrites that spline, which no lower derivative needs.  The
+    // spline of order 1 is only used by the highest derivative of an order 5 spline; derivatives
+    // of order ORDER and above vanish.
+
+    ARRAY(1,1) = 1.0;
+    for (int d = 1; d <= 4 && d < ORDER; d++) {
+        int k = ORDER - d;
+        for (int m = k+1; m <= ORDER; m++) {
+            ARRAY(k,m) = ARRAY(k,m-1);
+            for (int i = m-1; i >= 2; i--)
+                ARRAY(k,i) = ARRAY(k,i-1) - ARRAY(k,i);
+            ARRAY(k,1) = -ARRAY(k,1);
+        }
+    }
 
     // copy coefficients from temporary to permanent storage
 
-    for (int i = 1; i <= MPID_PME_ORDER; i++)
-        thetai[i-1] = double5(ARRAY(MPID_PME_ORDER,i), ARRAY(MPID_PME_ORDER-1,i), ARRAY(MPID_PME_ORDER-2,i), ARRAY(MPID_PME_ORDER-3,i), ARRAY(MPID_PME_ORDER-4, i));
+    for (int i = 1; i <= ORDER; i++)
+        thetai[i-1] = double5(ARRAY(ORDER,i), ARRAY(ORDER-1,i), ARRAY(ORDER-2,i), ARRAY(ORDER-3,i), (ORDER > 4 ? ARRAY(ORDER-4,i) : 0.0));
+}
+
+#undef ARRAY
+
+/**
+ * This is called from computeBsplines().  It calculates the spline coefficients for a single atom along a single axis.
+ */
+void MPIDReferencePmeForce::computeBSplinePoint(double5* thetai, double w)
+{
+    switch (_pmeOrder) {
+        case 4:
+            computeBSplinePointOfOrder<4>(thetai, w);
+            break;
+        case 5:
+            computeBSplinePointOfOrder<5>(thetai, w);
+            break;
+        default:
+            computeBSplinePointOfOrder<6>(thetai, w);
+            break;
+    }
 }
 
 /**
  * Compute b-spline coefficients.
  */
-void MPIDReferencePmeForce::computeMPIDBsplines(const vector<MultipoleParticleData>& particleData)
+void MPIDReferencePmeForce::computeMPIDBsplines(const vector<MultipoleParticleData>& particleData, double gridShift)
 {
     //  get the B-spline coefficients for each multipole site
 
@@ -3057,21 +4289,111 @@ void MPIDReferencePmeForce::computeMPIDBsplines(const vector<MultipoleParticleDa
         for (unsigned int jj = 0; jj < 3; jj++) {
 
             double w  = position[0]*_recipBoxVectors[0][jj]+position[1]*_recipBoxVectors[1][jj]+position[2]*_recipBoxVectors[2][jj];
-            double fr = _pmeGridDimensions[jj]*(w-(int)(w+0.5)+0.5);
+            double fr = _pmeGridDimensions[jj]*(w-(int)(w+0.5)+0.5)+gridShift;
             int ifr   = static_cast<int>(floor(fr));
             w         = fr - ifr;
-            igrid[jj] = ifr - MPID_PME_ORDER + 1;
+            igrid[jj] = ifr - _pmeOrder + 1;
             igrid[jj] += igrid[jj] < 0 ? _pmeGridDimensions[jj] : 0;
-            vector<double5> thetaiTemp(MPID_PME_ORDER);
-            computeBSplinePoint(thetaiTemp, w);
-            for (unsigned int kk = 0; kk < MPID_PME_ORDER; kk++)
-                _thetai[jj][ii*MPID_PME_ORDER+kk] = thetaiTemp[kk];
+            computeBSplinePoint(&_thetai[jj][ii*_pmeOrder], w);
         }
 
         // Record the grid point.
 
         _iGrid[ii]               = igrid;
     }
+    binAtomsByGridPlane();
+}
+
+void MPIDReferencePmeForce::swapInterlacedGrid()
+{
+    for (int ii = 0; ii < 3; ii++)
+        _thetai[ii].swap(_interlacedThetai[ii]);
+    _iGrid.swap(_interlacedIGrid);
+    _atomOrder.swap(_interlacedAtomOrder);
+    _spreadBlockStart.swap(_interlacedSpreadBlockStart);
+}
+
+void MPIDReferencePmeForce::averageInterlacedPotential(vector<double>& phi)
+{
+    for (unsigned int ii = 0; ii < phi.size(); ii++)
+        phi[ii] = 0.5*(phi[ii]+_interlacedPhi[ii]);
+}
+
+void MPIDReferencePmeForce::binAtomsByGridPlane()
+{
+    // Split the x planes into an even number of blocks at least _pmeOrder planes wide.  The
+    // stencil of an atom whose first plane is in block b then only reaches into block b+1, so all
+    // even blocks can be spread at the same time, followed by all odd ones.
+
+    int gridSizeX = _pmeGridDimensions[0];
+    int numBlocks = gridSizeX/_pmeOrder;
+    if (numBlocks%2 == 1 && numBlocks > 1)
+        numBlocks--;
+    if (numBlocks < 1)
+        numBlocks = 1;
+
+    // Counting sort of the atoms by block; atoms within a block stay in index order.
+
+    _spreadBlockStart.assign(numBlocks+1, 0);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        _spreadBlockStart[_iGrid[ii][0]*numBlocks/gridSizeX+1]++;
+    for (int block = 0; block < numBlocks; block++)
+        _spreadBlockStart[block+1] += _spreadBlockStart[block];
+    _spreadBlockCursor.assign(_spreadBlockStart.begin(), _spreadBlockStart.end()-1);
+    _atomOrder.resize(_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        _atomOrder[_spreadBlockCursor[_iGrid[ii][0]*numBlocks/gridSizeX]++] = ii;
+}
+
+template <class SpreadAtom>
+void MPIDReferencePmeForce::spreadAtomsOntoGrid(const SpreadAtom& spreadAtom)
+{
+    // The order in which atoms contribute to each grid point only depends on the grid, not on the
+    // number of threads, so the result is reproducible.  The functions handed to the thread pool
+    // only capture one reference, so wrapping them never allocates, however often this is called
+    // by the induced dipole solver.
+
+    int numBlocks = _spreadBlockStart.size()-1;
+    int numThreads = getNumThreads();
+    for (int phase = 0; phase < 2; phase++) {
+        auto spreadBlocks = [&] (int threadIndex) {
+            for (int block = phase+2*threadIndex; block < numBlocks; block += 2*numThreads)
+                for (int ii = _spreadBlockStart[block]; ii < _spreadBlockStart[block+1]; ii++)
+                    spreadAtom(_atomOrder[ii]);
+        };
+        if (numThreads == 1)
+            spreadBlocks(0);
+        else {
+            _threads->execute([&spreadBlocks] (ThreadPool& threads, int threadIndex) {
+                spreadBlocks(threadIndex);
+            });
+            _threads->waitForThreads();
+        }
+    }
+}
+
+template <class GatherAtom>
+void MPIDReferencePmeForce::gatherAtomsFromGrid(const GatherAtom& gatherAtom)
+{
+    // Atoms are independent here; visiting them in block order keeps each thread on a compact
+    // part of the grid.
+
+    int numThreads = getNumThreads();
+    if (numThreads == 1) {
+        for (int atomIndex : _atomOrder)
+            gatherAtom(atomIndex);
+        return;
+    }
+    auto gatherBlock = [&] (int threadIndex) {
+        unsigned int start, end;
+        getParticleBlock(threadIndex, numThreads, start, end);
+        for (unsigned int ii = start; ii < end; ii++)
+            gatherAtom(_atomOrder[ii]);
+    };
+    _threads->execute([&gatherBlock] (ThreadPool& threads, int threadIndex) {
+        gatherBlock(threadIndex);
+    });
+    _threads->waitForThreads();
 }
 
 void MPIDReferencePmeForce::transformMultipolesToFractionalCoordinates(const vector<MultipoleParticleData>& particleData) {
@@ -3270,15 +4592,16 @@ void MPIDReferencePmeForce::spreadFixedMultipolesOntoGrid(const vector<Multipole
 {
 
     transformMultipolesToFractionalCoordinates(particleData);
+    int zStride = _pmeGridZStride;
 
     // Clear the grid.
 
     for (int gridIndex = 0; gridIndex < _totalGridSize; gridIndex++)
-        _pmeGrid[gridIndex] = t_complex(0, 0);
+        _pmeGrid[gridIndex] = 0.0;
 
     // Loop over atoms and spread them on the grid.
 
-    for (int atomIndex = 0; atomIndex < _numParticles; atomIndex++) {
+    spreadAtomsOntoGrid([&] (int atomIndex) {
         double atomCharge = _transformed[atomIndex].charge;
         Vec3 atomDipole = Vec3(_transformed[atomIndex].dipole[0],
                                _transformed[atomIndex].dipole[1],
@@ -3301,15 +4624,15 @@ void MPIDReferencePmeForce::spreadFixedMultipolesOntoGrid(const vector<Multipole
         double atomOctopoleYZZ  = _transformed[atomIndex].octopole[QYZZ];
         double atomOctopoleZZZ  = _transformed[atomIndex].octopole[QZZZ];
         IntVec& gridPoint = _iGrid[atomIndex];
-        for (int ix = 0; ix < MPID_PME_ORDER; ix++) {
-            int x = (gridPoint[0]+ix) % _pmeGridDimensions[0];
-            for (int iy = 0; iy < MPID_PME_ORDER; iy++) {
-                int y = (gridPoint[1]+iy) % _pmeGridDimensions[1];
-                for (int iz = 0; iz < MPID_PME_ORDER; iz++) {
-                    int z = (gridPoint[2]+iz) % _pmeGridDimensions[2];
-                    double5 t = _thetai[0][atomIndex*MPID_PME_ORDER+ix];
-                    double5 u = _thetai[1][atomIndex*MPID_PME_ORDER+iy];
-                    double5 v = _thetai[2][atomIndex*MPID_PME_ORDER+iz];
+        for (int ix = 0; ix < _pmeOrder; ix++) {
+            int x = _gridWrap[0][gridPoint[0]+ix];
+            for (int iy = 0; iy < _pmeOrder; iy++) {
+                int y = _gridWrap[1][gridPoint[1]+iy];
+                for (int iz = 0; iz < _pmeOrder; iz++) {
+                    int z = _gridWrap[2][gridPoint[2]+iz];
+                    double5 t = _thetai[0][atomIndex*_pmeOrder+ix];
+                    double5 u = _thetai[1][atomIndex*_pmeOrder+iy];
+                    double5 v = _thetai[2][atomIndex*_pmeOrder+iz];
                     double term0 = atomCharge*u[0]*v[0] + atomDipole[1]*u[1]*v[0] + atomDipole[2]*u[0]*v[1]
                                  + atomQuadrupoleYY*u[2]*v[0] + atomQuadrupoleZZ*u[0]*v[2] + atomQuadrupoleYZ*u[1]*v[1]
                                  + atomOctopoleYYY*u[3]*v[0] + atomOctopoleYYZ*u[2]*v[1] + atomOctopoleYZZ*u[1]*v[2] + atomOctopoleZZZ*u[0]*v[3];
@@ -3318,58 +4641,181 @@ void MPIDReferencePmeForce::spreadFixedMultipolesOntoGrid(const vector<Multipole
                     double term2 = atomQuadrupoleXX * u[0] * v[0]
                                  + atomOctopoleXXY*u[1]*v[0] + atomOctopoleXXZ*u[0]*v[1];
                     double term3 = atomOctopoleXXX*u[0]*v[0];
-                    t_complex& gridValue = _pmeGrid[x*_pmeGridDimensions[1]*_pmeGridDimensions[2]+y*_pmeGridDimensions[2]+z];
-                    gridValue.re += term0*t[0] + term1*t[1] + term2*t[2] + term3*t[3];
+                    double& gridValue = _pmeGrid[x*_pmeGridDimensions[1]*zStride+y*zStride+z];
+                    gridValue += term0*t[0] + term1*t[1] + term2*t[2] + term3*t[3];
                 }
             }
         }
-    }
+    });
 }
 
-void MPIDReferencePmeForce::performMPIDReciprocalConvolution()
+void MPIDReferencePmeForce::updateInfluenceFunction()
 {
+    // The influence function depends on the grid, alpha and the box.  The grid is fixed between calls
+    // to setPmeGridDimensions(), which clears the cache.
+
+    int zSize = _pmeGridDimensions[2]/2+1;
+    int numElements = _pmeGridDimensions[0]*_pmeGridDimensions[1]*zSize;
+    bool valid = ((int) _influenceFunction.size() == numElements && _influenceAlphaEwald == _alphaEwald);
+    for (int ii = 0; ii < 3 && valid; ii++)
+        valid = (_periodicBoxVectors[ii] == _influenceBoxVectors[ii]);
+    if (valid)
+        return;
 
-    double expFactor   = (M_PI*M_PI)/(_alphaEwald*_alphaEwald);
-    double scaleFactor = 1.0/(M_PI*_periodicBoxVectors[0][0]*_periodicBoxVectors[1][1]*_periodicBoxVectors[2][2]);
-
-    for (int index = 0; index < _totalGridSize; index++)
-    {
-        int kx = index/(_pmeGridDimensions[1]*_pmeGridDimensions[2]);
-        int remainder = index-kx*_pmeGridDimensions[1]*_pmeGridDimensions[2];
-        int ky = remainder/_pmeGridDimensions[2];
-        int kz = remainder-ky*_pmeGridDimensions[2];
+    // |m|^2 and the B-spline moduli only depend on the shape of the box.  If the box was rescaled
+    // isotropically, as by a MonteCarloBarostat, |m|^2 just scales and only the Gaussian is redone.
 
-        if (kx == 0 && ky == 0 && kz == 0) {
-            _pmeGrid[index].re = _pmeGrid[index].im = 0.0;
-            continue;
+    double scale = 0.0;
+    bool sameShape = ((int) _influenceM2.size() == numElements && !_useOptimalInfluenceFunction);
+    if (sameShape) {
+        scale = _periodicBoxVectors[0][0]/_influenceShapeBoxVectors[0][0];
+        for (int ii = 0; ii < 3 && sameShape; ii++)
+            for (int jj = 0; jj < 3 && sameShape; jj++)
+                sameShape = (fabs(_periodicBoxVectors[ii][jj]-scale*_influenceShapeBoxVectors[ii][jj]) <= 1e-12*_periodicBoxVectors[ii][ii]);
+    }
+    if (!sameShape) {
+
+        // With interlaced grids the odd aliases cancel, and the denominator becomes the mean of the
+        // squared interpolation sums of the two grids.  Along each axis these are A = sum_j r_j^2 and
+        // B = sum_j (-1)^j r_j^2, with r_j = ((k/K)/(k/K+j))^order the B-spline weight of alias j.
+
+        vector<double> interlaceRatio[3];
+        if (_useInterlacedGrids) {
+            int jcut = 50;
+            for (int dim = 0; dim < 3; dim++) {
+                int size = _pmeGridDimensions[dim];
+                interlaceRatio[dim].resize(size);
+                for (int k = 0; k < size; k++) {
+                    int m = (k < (size+1)/2) ? k : k-size;
+                    double a = 1.0;
+                    double b = 1.0;
+                    if (m != 0) {
+                        double x = m/(double) size;
+                        for (int j = 1; j <= jcut; j++) {
+                            double sign = (j%2 == 0 ? 1.0 : -1.0);
+                            double term = pow(x/(x+j), 2*_pmeOrder)+pow(x/(x-j), 2*_pmeOrder);
+                            a += term;
+                            b += sign*term;
+                        }
+                    }
+                    interlaceRatio[dim][k] = b/a;
+                }
+            }
         }
+        _influenceM2.resize(numElements);
+        _influenceModuli.resize(numElements);
+        for (int index = 0; index < numElements; index++)
+        {
+            int kx = index/(_pmeGridDimensions[1]*zSize);
+            int remainder = index-kx*_pmeGridDimensions[1]*zSize;
+            int ky = remainder/zSize;
+            int kz = remainder-ky*zSize;
+
+            int mx = (kx < (_pmeGridDimensions[0]+1)/2) ? kx : (kx-_pmeGridDimensions[0]);
+            int my = (ky < (_pmeGridDimensions[1]+1)/2) ? ky : (ky-_pmeGridDimensions[1]);
+            int mz = (kz < (_pmeGridDimensions[2]+1)/2) ? kz : (kz-_pmeGridDimensions[2]);
+
+            double mhx = mx*_recipBoxVectors[0][0];
+            double mhy = mx*_recipBoxVectors[1][0]+my*_recipBoxVectors[1][1];
+            double mhz = mx*_recipBoxVectors[2][0]+my*_recipBoxVectors[2][1]+mz*_recipBoxVectors[2][2];
+
+            _influenceM2[index] = mhx*mhx+mhy*mhy+mhz*mhz;
+            _influenceModuli[index] = _pmeBsplineModuli[0][kx]*_pmeBsplineModuli[1][ky]*_pmeBsplineModuli[2][kz];
+            if (_useInterlacedGrids) {
+                double ratio = interlaceRatio[0][kx]*interlaceRatio[1][ky]*interlaceRatio[2][kz];
+                _influenceModuli[index] *= 0.5*(1.0+ratio*ratio);
+            }
+        }
+        for (int ii = 0; ii < 3; ii++)
+            _influenceShapeBoxVectors[ii] = _periodicBoxVectors[ii];
+        scale = 1.0;
+    }
 
-        int mx = (kx < (_pmeGridDimensions[0]+1)/2) ? kx : (kx-_pmeGridDimensions[0]);
-        int my = (ky < (_pmeGridDimensions[1]+1)/2) ? ky : (ky-_pmeGridDimensions[1]);
-        int mz = (kz < (_pmeGridDimensions[2]+1)/2) ? kz : (kz-_pmeGridDimensions[2]);
-
-        double mhx = mx*_recipBoxVectors[0][0];
-        double mhy = mx*_recipBoxVectors[1][0]+my*_recipBoxVectors[1][1];
-        double mhz = mx*_recipBoxVectors[2][0]+my*_recipBoxVectors[2][1]+mz*_recipBoxVectors[2][2];
+    double expFactor   = (M_PI*M_PI)/(_alphaEwald*_alphaEwald);
+    double scaleFactor = 1.0/(M_PI*_periodicBoxVectors[0][0]*_periodicBoxVectors[1][1]*_periodicBoxVectors[2][2]);
+    double m2Scale     = 1.0/(scale*scale);
+    _influenceFunction.resize(numElements);
+    _influenceFunction[0] = 0.0;
+    if (!_useOptimalInfluenceFunction) {
+        for (int index = 1; index < numElements; index++) {
+            double m2 = _influenceM2[index]*m2Scale;
+            _influenceFunction[index] = scaleFactor*exp(-expFactor*m2)/(m2*_influenceModuli[index]);
+        }
+    }
+    else {
+        // The optimal influence function (Hockney and Eastwood) replaces the Gaussian at m by the
+        // sum over its aliases m+j*K, each weighted by its squared B-spline weight r_j^2 relative to
+        // the alias j = 0.  The weights fall off as (k/K)^(2*order)/j^(2*order), so |j| <= 1 suffices.
+
+        vector<double> aliasWeight[3];
+        for (int dim = 0; dim < 3; dim++) {
+            int size = _pmeGridDimensions[dim];
+            aliasWeight[dim].resize(3*size);
+            for (int k = 0; k < size; k++) {
+                int m = (k < (size+1)/2) ? k : k-size;
+                double x = m/(double) size;
+                for (int j = -1; j <= 1; j++)
+                    aliasWeight[dim][3*k+j+1] = (j == 0 ? 1.0 : (m == 0 ? 0.0 : pow(x/(x+j), 2*_pmeOrder)));
+            }
+        }
+        for (int index = 1; index < numElements; index++) {
+            int kx = index/(_pmeGridDimensions[1]*zSize);
+            int remainder = index-kx*_pmeGridDimensions[1]*zSize;
+            int ky = remainder/zSize;
+            int kz = remainder-ky*zSize;
+            int mx = (kx < (_pmeGridDimensions[0]+1)/2) ? kx : (kx-_pmeGridDimensions[0]);
+            int my = (ky < (_pmeGridDimensions[1]+1)/2) ? ky : (ky-_pmeGridDimensions[1]);
+            int mz = (kz < (_pmeGridDimensions[2]+1)/2) ? kz : (kz-_pmeGridDimensions[2]);
+            double sum = 0.0;
+            for (int jx = -1; jx <= 1; jx++) {
+                double wx = aliasWeight[0][3*kx+jx+1];
+                if (wx == 0.0)
+                    continue;
+                int ax = mx+jx*_pmeGridDimensions[0];
+                for (int jy = -1; jy <= 1; jy++) {
+                    double wxy = wx*aliasWeight[1][3*ky+jy+1];
+                    if (wxy == 0.0)
+                        continue;
+                    int ay = my+jy*_pmeGridDimensions[1];
+                    for (int jz = -1; jz <= 1; jz++) {
+                        double w = wxy*aliasWeight[2][3*kz+jz+1];
+                        if (w == 0.0)
+                            continue;
+                        int az = mz+jz*_pmeGridDimensions[2];
+                        double mhx = ax*_recipBoxVectors[0][0];
+                        double mhy = ax*_recipBoxVectors[1][0]+ay*_recipBoxVectors[1][1];
+                        double mhz = ax*_recipBoxVectors[2][0]+ay*_recipBoxVectors[2][1]+az*_recipBoxVectors[2][2];
+                        double m2 = mhx*mhx+mhy*mhy+mhz*mhz;
+                        sum += w*exp(-expFactor*m2)/m2;
+                    }
+                }
+            }
+            _influenceFunction[index] = scaleFactor*sum/_influenceModuli[index];
+        }
+    }
+    for (int ii = 0; ii < 3; ii++)
+        _influenceBoxVectors[ii] = _periodicBoxVectors[ii];
+    _influenceAlphaEwald = _alphaEwald;
+}
 
-        double bx = _pmeBsplineModuli[0][kx];
-        double by = _pmeBsplineModuli[1][ky];
-        double bz = _pmeBsplineModuli[2][kz];
+void MPIDReferencePmeForce::performMPIDReciprocalConvolution()
+{
+    updateInfluenceFunction();
 
-        double m2 = mhx*mhx+mhy*mhy+mhz*mhz;
-        double denom = m2*bx*by*bz;
-        double eterm = scaleFactor*exp(-expFactor*m2)/denom;
+    // The grid holds the half of the transform with kz <= zsize/2; the rest follows from symmetry.
 
-        _pmeGrid[index].re *= eterm;
-        _pmeGrid[index].im *= eterm;
-    }
+    complex<double>* grid = reinterpret_cast<complex<double>*>(_pmeGrid);
+    int numElements = _influenceFunction.size();
+    for (int index = 0; index < numElements; index++)
+        grid[index] *= _influenceFunction[index];
 }
 
 void MPIDReferencePmeForce::computeFixedPotentialFromGrid()
 {
     // extract the permanent multipole field at each site
 
-    for (int m = 0; m < _numParticles; m++) {
+    int zStride = _pmeGridZStride;
+    gatherAtomsFromGrid([&] (int m) {
         IntVec gridPoint = _iGrid[m];
         double tuv000 = 0.0;
         double tuv001 = 0.0;
@@ -3406,9 +4852,9 @@ void MPIDReferencePmeForce::computeFixedPotentialFromGrid()
         double tuv211 = 0.0;
         double tuv121 = 0.0;
         double tuv112 = 0.0;
-        for (int iz = 0; iz < MPID_PME_ORDER; iz++) {
-            int k = gridPoint[2]+iz-(gridPoint[2]+iz >= _pmeGridDimensions[2] ? _pmeGridDimensions[2] : 0);
-            double5 v = _thetai[2][m*MPID_PME_ORDER+iz];
+        for (int iz = 0; iz < _pmeOrder; iz++) {
+            int k = _gridWrap[2][gridPoint[2]+iz];
+            double5 v = _thetai[2][m*_pmeOrder+iz];
             double tu00 = 0.0;
             double tu10 = 0.0;
             double tu01 = 0.0;
@@ -3424,15 +4870,15 @@ void MPIDReferencePmeForce::computeFixedPotentialFromGrid()
             double tu31 = 0.0;
             double tu13 = 0.0;
             double tu22 = 0.0;
-            for (int iy = 0; iy < MPID_PME_ORDER; iy++) {
-                int j = gridPoint[1]+iy-(gridPoint[1]+iy >= _pmeGridDimensions[1] ? _pmeGridDimensions[1] : 0);
-                double5 u = _thetai[1][m*MPID_PME_ORDER+iy];
+            for (int iy = 0; iy < _pmeOrder; iy++) {
+                int j = _gridWrap[1][gridPoint[1]+iy];
+                double5 u = _thetai[1][m*_pmeOrder+iy];
                 double5 t = double5(0.0, 0.0, 0.0, 0.0, 0.0);
-                for (int ix = 0; ix < MPID_PME_ORDER; ix++) {
-                    int i = gridPoint[0]+ix-(gridPoint[0]+ix >= _pmeGridDimensions[0] ? _pmeGridDimensions[0] : 0);
-                    int gridIndex = i*_pmeGridDimensions[1]*_pmeGridDimensions[2] + j*_pmeGridDimensions[2] + k;
-                    double tq = _pmeGrid[gridIndex].re;
-                    double5 tadd = _thetai[0][m*MPID_PME_ORDER+ix];
+                for (int ix = 0; ix < _pmeOrder; ix++) {
+                    int i = _gridWrap[0][gridPoint[0]+ix];
+                    int gridIndex = i*_pmeGridDimensions[1]*zStride + j*zStride + k;
+                    double tq = _pmeGrid[gridIndex];
+                    double5 tadd = _thetai[0][m*_pmeOrder+ix];
                     t[0] += tq*tadd[0];
                     t[1] += tq*tadd[1];
                     t[2] += tq*tadd[2];
@@ -3526,7 +4972,7 @@ void MPIDReferencePmeForce::computeFixedPotentialFromGrid()
         _phi[35*m+32] = tuv211;
         _phi[35*m+33] = tuv121;
         _phi[35*m+34] = tuv112;
-    }
+    });
 }
 
 void MPIDReferencePmeForce::spreadInducedDipolesOnGrid(const vector<Vec3>& inputInducedDipole) {
@@ -3536,47 +4982,48 @@ void MPIDReferencePmeForce::spreadInducedDipolesOnGrid(const vector<Vec3>& input
     for (int i = 0; i < 3; i++)
         for (int j = 0; j < 3; j++)
             cartToFrac[j][i] = _pmeGridDimensions[j]*_recipBoxVectors[i][j];
+    int zStride = _pmeGridZStride;
 
     // Clear the grid.
 
     for (int gridIndex = 0; gridIndex < _totalGridSize; gridIndex++)
-        _pmeGrid[gridIndex] = t_complex(0, 0);
+        _pmeGrid[gridIndex] = 0.0;
 
     // Loop over atoms and spread them on the grid.
 
-    for (int atomIndex = 0; atomIndex < _numParticles; atomIndex++) {
+    spreadAtomsOntoGrid([&] (int atomIndex) {
         Vec3 inducedDipole = Vec3(inputInducedDipole[atomIndex][0]*cartToFrac[0][0] + inputInducedDipole[atomIndex][1]*cartToFrac[0][1] + inputInducedDipole[atomIndex][2]*cartToFrac[0][2],
                                   inputInducedDipole[atomIndex][0]*cartToFrac[1][0] + inputInducedDipole[atomIndex][1]*cartToFrac[1][1] + inputInducedDipole[atomIndex][2]*cartToFrac[1][2],
                                   inputInducedDipole[atomIndex][0]*cartToFrac[2][0] + inputInducedDipole[atomIndex][1]*cartToFrac[2][1] + inputInducedDipole[atomIndex][2]*cartToFrac[2][2]);
         IntVec& gridPoint = _iGrid[atomIndex];
-        for (int ix = 0; ix < MPID_PME_ORDER; ix++) {
-            int x = (gridPoint[0]+ix) % _pmeGridDimensions[0];
-            for (int iy = 0; iy < MPID_PME_ORDER; iy++) {
-                int y = (gridPoint[1]+iy) % _pmeGridDimensions[1];
-                for (int iz = 0; iz < MPID_PME_ORDER; iz++) {
-                    int z = (gridPoint[2]+iz) % _pmeGridDimensions[2];
+        for (int ix = 0; ix < _pmeOrder; ix++) {
+            int x = _gridWrap[0][gridPoint[0]+ix];
+            for (int iy = 0; iy < _pmeOrder; iy++) {
+                int y = _gridWrap[1][gridPoint[1]+iy];
+                for (int iz = 0; iz < _pmeOrder; iz++) {
+                    int z = _gridWrap[2][gridPoint[2]+iz];
 
-                    double5 t = _thetai[0][atomIndex*MPID_PME_ORDER+ix];
-                    double5 u = _thetai[1][atomIndex*MPID_PME_ORDER+iy];
-                    double5 v = _thetai[2][atomIndex*MPID_PME_ORDER+iz];
+                    double5 t = _thetai[0][atomIndex*_pmeOrder+ix];
+                    double5 u = _thetai[1][atomIndex*_pmeOrder+iy];
+                    double5 v = _thetai[2][atomIndex*_pmeOrder+iz];
 
                     double term01 = inducedDipole[1]*u[1]*v[0] + inducedDipole[2]*u[0]*v[1];
                     double term11 = inducedDipole[0]*u[0]*v[0];
 
-                    t_complex& gridValue = _pmeGrid[x*_pmeGridDimensions[1]*_pmeGridDimensions[2]+y*_pmeGridDimensions[2]+z];
-                    gridValue.re += term01*t[0] + term11*t[1];
-                    gridValue.im = 0.0;
+                    double& gridValue = _pmeGrid[x*_pmeGridDimensions[1]*zStride+y*zStride+z];
+                    gridValue += term01*t[0] + term11*t[1];
                 }
             }
         }
-    }
+    });
 }
 
 void MPIDReferencePmeForce::computeInducedPotentialFromGrid()
 {
     // extract the induced dipole field at each site
 
-    for (int m = 0; m < _numParticles; m++) {
+    int zStride = _pmeGridZStride;
+    gatherAtomsFromGrid([&] (int m) {
         IntVec gridPoint = _iGrid[m];
         double tuv000 = 0.0;
         double tuv001 = 0.0;
@@ -3613,9 +5060,9 @@ void MPIDReferencePmeForce::computeInducedPotentialFromGrid()
         double tuv211 = 0.0;
         double tuv121 = 0.0;
         double tuv112 = 0.0;
-        for (int iz = 0; iz < MPID_PME_ORDER; iz++) {
-            int k = gridPoint[2]+iz-(gridPoint[2]+iz >= _pmeGridDimensions[2] ? _pmeGridDimensions[2] : 0);
-            double5 v = _thetai[2][m*MPID_PME_ORDER+iz];
+        for (int iz = 0; iz < _pmeOrder; iz++) {
+            int k = _gridWrap[2][gridPoint[2]+iz];
+            double5 v = _thetai[2][m*_pmeOrder+iz];
             double tu00 = 0.0;
             double tu10 = 0.0;
             double tu01 = 0.0;
@@ -3631,15 +5078,15 @@ void MPIDReferencePmeForce::computeInducedPotentialFromGrid()
             double tu31 = 0.0;
             double tu13 = 0.0;
             double tu22 = 0.0;
-            for (int iy = 0; iy < MPID_PME_ORDER; iy++) {
-                int j = gridPoint[1]+iy-(gridPoint[1]+iy >= _pmeGridDimensions[1] ? _pmeGridDimensions[1] : 0);
-                double5 u = _thetai[1][m*MPID_PME_ORDER+iy];
+            for (int iy = 0; iy < _pmeOrder; iy++) {
+                int j = _gridWrap[1][gridPoint[1]+iy];
+                double5 u = _thetai[1][m*_pmeOrder+iy];
                 double5 t = double5(0.0, 0.0, 0.0, 0.0, 0.0);
-                for (int ix = 0; ix < MPID_PME_ORDER; ix++) {
-                    int i = gridPoint[0]+ix-(gridPoint[0]+ix >= _pmeGridDimensions[0] ? _pmeGridDimensions[0] : 0);
-                    int gridIndex = i*_pmeGridDimensions[1]*_pmeGridDimensions[2] + j*_pmeGridDimensions[2] + k;
-                    double tq = _pmeGrid[gridIndex].re;
-                    double5 tadd = _thetai[0][m*MPID_PME_ORDER+ix];
+                for (int ix = 0; ix < _pmeOrder; ix++) {
+                    int i = _gridWrap[0][gridPoint[0]+ix];
+                    int gridIndex = i*_pmeGridDimensions[1]*zStride + j*zStride + k;
+                    double tq = _pmeGrid[gridIndex];
+                    double5 tadd = _thetai[0][m*_pmeOrder+ix];
                     t[0] += tq*tadd[0];
                     t[1] += tq*tadd[1];
                     t[2] += tq*tadd[2];
@@ -3733,7 +5180,7 @@ void MPIDReferencePmeForce::computeInducedPotentialFromGrid()
         _phidp[35*m+32] = tuv211;
         _phidp[35*m+33] = tuv121;
         _phidp[35*m+34] = tuv112;
-    }
+    });
 }
 
 double MPIDReferencePmeForce::computeReciprocalSpaceFixedMultipoleForceAndEnergy(const vector<MultipoleParticleData>& particleData,
@@ -4023,6 +5470,418 @@ double MPIDReferencePmeForce::computeReciprocalSpaceInducedDipoleForceAndEnergy(
     return (0.25*_electric*energy);
 }
 
+void MPIDReferencePmeForce::convolvePmeGrid()
+{
+    if (_msm) {
+        _msm->setBox(_periodicBoxVectors, _recipBoxVectors, _alphaEwald, _cutoffDistance);
+        _msm->convolve(_pmeGrid, _pmeGridZStride, _threads);
+        return;
+    }
+    _fft->execForward(_pmeGrid, _threads);
+    performMPIDReciprocalConvolution();
+    _fft->execBackward(_pmeGrid, _threads);
+}
+
+void MPIDReferencePmeForce::computeReciprocalSpaceFixedPotential(const vector<MultipoleParticleData>& particleData)
+{
+    if (_ewaldSum == NULL) {
+        resizePmeArrays();
+        computeMPIDBsplines(particleData);
+        initializePmeGrid();
+        spreadFixedMultipolesOntoGrid(particleData);
+        convolvePmeGrid();
+        computeFixedPotentialFromGrid();
+        if (_useInterlacedGrids) {
+
+            // Repeat on the shifted grid, whose B-splines are then kept for the induced dipoles.
+
+            _interlacedPhi.swap(_phi);
+            swapInterlacedGrid();
+            computeMPIDBsplines(particleData, 0.5);
+            initializePmeGrid();
+            spreadFixedMultipolesOntoGrid(particleData);
+            convolvePmeGrid();
+            computeFixedPotentialFromGrid();
+            swapInterlacedGrid();
+            averageInterlacedPotential(_phi);
+        }
+        if (_useSlabCorrection) {
+            double dipoleZ = 0.0;
+            for (unsigned int ii = 0; ii < _numParticles; ii++)
+                dipoleZ += particleData[ii].charge*particleData[ii].position[2] + particleData[ii].dipole[2];
+            addSlabCorrectionPotential(dipoleZ, &particleData, _phi);
+        }
+        return;
+    }
+
+    // The phase factors computed here are reused for the induced dipoles until the next evaluation.
+
+    transformMultipolesToFractionalCoordinates(particleData);
+    vector<Vec3> positions(_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        positions[ii] = particleData[ii].position;
+    _ewaldSum->setBox(_recipBoxVectors, _alphaEwald);
+    _ewaldSum->setPositions(positions, _threads);
+    vector<double> multipoles;
+    getFractionalMultipoleCoefficients(multipoles);
+    _ewaldSum->computePotential(20, multipoles, _phi, _threads);
+    _phidp.resize(35*_numParticles);
+}
+
+void MPIDReferencePmeForce::getFractionalMultipoleCoefficients(vector<double>& multipoles) const
+{
+    // coefficients in the order of the potential derivatives: 000, 100, 010, 001, 200, 020, 002,
+    // 110, 101, 011, 300, 030, 003, 210, 201, 120, 021, 102, 012, 111
+
+    multipoles.resize(20*_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        const TransformedMultipole& transformed = _transformed[ii];
+        double* multipole = &multipoles[20*ii];
+        multipole[0]  = transformed.charge;
+        multipole[1]  = transformed.dipole[0];
+        multipole[2]  = transformed.dipole[1];
+        multipole[3]  = transformed.dipole[2];
+        multipole[4]  = transformed.quadrupole[QXX];
+        multipole[5]  = transformed.quadrupole[QYY];
+        multipole[6]  = transformed.quadrupole[QZZ];
+        multipole[7]  = transformed.quadrupole[QXY];
+        multipole[8]  = transformed.quadrupole[QXZ];
+        multipole[9]  = transformed.quadrupole[QYZ];
+        multipole[10] = transformed.octopole[QXXX];
+        multipole[11] = transformed.octopole[QYYY];
+        multipole[12] = transformed.octopole[QZZZ];
+        multipole[13] = transformed.octopole[QXXY];
+        multipole[14] = transformed.octopole[QXXZ];
+        multipole[15] = transformed.octopole[QXYY];
+        multipole[16] = transformed.octopole[QYYZ];
+        multipole[17] = transformed.octopole[QXZZ];
+        multipole[18] = transformed.octopole[QYZZ];
+        multipole[19] = transformed.octopole[QXYZ];
+    }
+}
+
+void MPIDReferencePmeForce::prepareElectrostaticPotential(const vector<MultipoleParticleData>& sources)
+{
+    if (_useSlabCorrection)
+        throw OpenMMException("MPIDForce: the electrostatic potential is not available with the PME slab correction");
+    if (_ewaldSum) {
+
+        // The phase factors of the particles are still those of the last setup.
+
+        transformMultipolesToFractionalCoordinates(sources);
+        vector<double> multipoles;
+        getFractionalMultipoleCoefficients(multipoles);
+        _ewaldSum->setMultipoles(20, multipoles, _threads);
+        return;
+    }
+
+    // The grid left by the last setup only holds the induced dipoles, so the combined density is
+    // spread and convolved once more, on each grid when they are interlaced.  The B-splines of the
+    // particles are still those of the last setup.
+
+    int numGrids = (_useInterlacedGrids ? 2 : 1);
+    for (int grid = 0; grid < numGrids; grid++) {
+        if (grid == 1)
+            swapInterlacedGrid();
+        initializePmeGrid();
+        spreadFixedMultipolesOntoGrid(sources);
+        convolvePmeGrid();
+        if (grid == 1)
+            swapInterlacedGrid();
+        _potentialGrid[grid].assign(_pmeGrid, _pmeGrid+_totalGridSize);
+    }
+}
+
+void MPIDReferencePmeForce::computeReciprocalSpacePotentialAtPoints(const vector<Vec3>& points, vector<double>& potential,
+                                                                    vector<Vec3>* field, vector<double>* fieldGradient)
+{
+    if (_ewaldSum) {
+        _ewaldSum->computePotentialAtPoints(points, potential, field, fieldGradient, _threads);
+        return;
+    }
+
+    // derivatives with respect to the grid coordinates are converted with A[i][j] = N_j*recip[i][j]
+
+    double fracToCart[3][3];
+    for (int ii = 0; ii < 3; ii++)
+        for (int jj = 0; jj < 3; jj++)
+            fracToCart[ii][jj] = _pmeGridDimensions[jj]*_recipBoxVectors[ii][jj];
+
+    int numThreads = getNumThreads();
+    unsigned int numPoints = points.size();
+    int numGrids = (_useInterlacedGrids ? 2 : 1);
+    for (int grid = 0; grid < numGrids; grid++) {
+        const double* gridValues = &_potentialGrid[grid][0];
+        double gridShift = 0.5*grid;
+        double weight    = 1.0/numGrids;
+        auto interpolatePoints = [&] (unsigned int start, unsigned int end) {
+            double5 theta[3][6];
+            for (unsigned int pp = start; pp < end; pp++) {
+                Vec3 position = points[pp];
+                getPeriodicDelta(position);
+                IntVec igrid;
+                for (unsigned int jj = 0; jj < 3; jj++) {
+                    double w  = position[0]*_recipBoxVectors[0][jj]+position[1]*_recipBoxVectors[1][jj]+position[2]*_recipBoxVectors[2][jj];
+                    double fr = _pmeGridDimensions[jj]*(w-(int)(w+0.5)+0.5)+gridShift;
+                    int ifr   = static_cast<int>(floor(fr));
+                    w         = fr - ifr;
+                    igrid[jj] = ifr - _pmeOrder + 1;
+                    igrid[jj] += igrid[jj] < 0 ? _pmeGridDimensions[jj] : 0;
+                    computeBSplinePoint(theta[jj], w);
+                }
+
+                // the potential and its derivatives with respect to the grid coordinates
+
+                double sum = 0.0;
+                double gradient[3] = {0.0, 0.0, 0.0};
+                double second[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+                for (int ix = 0; ix < _pmeOrder; ix++) {
+                    int x = _gridWrap[0][igrid[0]+ix];
+                    for (int iy = 0; iy < _pmeOrder; iy++) {
+                        int y = _gridWrap[1][igrid[1]+iy];
+                        const double* row = &gridValues[x*_pmeGridDimensions[1]*_pmeGridZStride + y*_pmeGridZStride];
+                        double sumZ = 0.0, sumDZ = 0.0, sumDDZ = 0.0;
+                        for (int iz = 0; iz < _pmeOrder; iz++) {
+                            double value = row[_gridWrap[2][igrid[2]+iz]];
+                            sumZ   += theta[2][iz][0]*value;
+                            sumDZ  += theta[2][iz][1]*value;
+                            sumDDZ += theta[2][iz][2]*value;
+                        }
+                        sum         += theta[0][ix][0]*theta[1][iy][0]*sumZ;
+                        gradient[0] += theta[0][ix][1]*theta[1][iy][0]*sumZ;
+                        gradient[1] += theta[0][ix][0]*theta[1][iy][1]*sumZ;
+                        gradient[2] += theta[0][ix][0]*theta[1][iy][0]*sumDZ;
+                        if (fieldGradient != NULL) {
+                            second[0][0] += theta[0][ix][2]*theta[1][iy][0]*sumZ;
+                            second[1][1] += theta[0][ix][0]*theta[1][iy][2]*sumZ;
+                            second[2][2] += theta[0][ix][0]*theta[1][iy][0]*sumDDZ;
+                            second[0][1] += theta[0][ix][1]*theta[1][iy][1]*sumZ;
+                            second[0][2] += theta[0][ix][1]*theta[1][iy][0]*sumDZ;
+                            second[1][2] += theta[0][ix][0]*theta[1][iy][1]*sumDZ;
+                        }
+                    }
+                }
+                potential[pp] += weight*sum;
+                if (field != NULL) {
+                    for (int jj = 0; jj < 3; jj++)
+                        (*field)[pp][jj] -= weight*(gradient[0]*fracToCart[jj][0] + gradient[1]*fracToCart[jj][1] +
+                                                    gradient[2]*fracToCart[jj][2]);
+                }
+                if (fieldGradient != NULL) {
+                    second[1][0] = second[0][1];
+                    second[2][0] = second[0][2];
+                    second[2][1] = second[1][2];
+                    const int index[3][3] = {{QXX, QXY, QXZ}, {QXY, QYY, QYZ}, {QXZ, QYZ, QZZ}};
+                    for (int a = 0; a < 3; a++) {
+                        for (int b = a; b < 3; b++) {
+                            double cartesian = 0.0;
+                            for (int jj = 0; jj < 3; jj++)
+                                for (int kk = 0; kk < 3; kk++)
+                                    cartesian += fracToCart[a][jj]*fracToCart[b][kk]*second[jj][kk];
+                            (*fieldGradient)[6*pp+index[a][b]] -= weight*cartesian;
+                        }
+                    }
+                }
+            }
+        };
+        if (numThreads == 1)
+            interpolatePoints(0, numPoints);
+        else {
+            _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+                interpolatePoints((numPoints*threadIndex)/numThreads, (numPoints*(threadIndex+1))/numThreads);
+            });
+            _threads->waitForThreads();
+        }
+    }
+}
+
+void MPIDReferencePmeForce::computeDirectSpacePotentialAtPoints(const vector<MultipoleParticleData>& sources,
+                                                                const vector<Vec3>& points, vector<double>& potential,
+                                                                vector<Vec3>* field, vector<double>* fieldGradient) const
+{
+    // Bin in fractional coordinates so triclinic boxes work too.  A cell is at least a cutoff
+    // wide, measured perpendicular to the opposite faces of the box; along an axis with fewer
+    // than three cells every cell is a neighbor.
+
+    int numCells[3];
+    Vec3 recipColumn[3];
+    for (int ii = 0; ii < 3; ii++) {
+        recipColumn[ii] = Vec3(_recipBoxVectors[0][ii], _recipBoxVectors[1][ii], _recipBoxVectors[2][ii]);
+        double width = 1.0/sqrt(recipColumn[ii].dot(recipColumn[ii]));
+        numCells[ii] = std::max(1, static_cast<int>(floor(width/_cutoffDistance)));
+    }
+    auto getCell = [&] (const Vec3& position, int* cell) {
+        for (int ii = 0; ii < 3; ii++) {
+            double s = position.dot(recipColumn[ii]);
+            s -= floor(s);
+            cell[ii] = std::min(static_cast<int>(s*numCells[ii]), numCells[ii]-1);
+        }
+        return (cell[0]*numCells[1]+cell[1])*numCells[2]+cell[2];
+    };
+    vector<int> neighborCells[3];
+    vector<int> neighborStart[3];
+    for (int ii = 0; ii < 3; ii++) {
+        neighborStart[ii].push_back(0);
+        for (int cell = 0; cell < numCells[ii]; cell++) {
+            if (numCells[ii] < 3) {
+                for (int neighbor = 0; neighbor < numCells[ii]; neighbor++)
+                    neighborCells[ii].push_back(neighbor);
+            }
+            else {
+                for (int offset = -1; offset <= 1; offset++)
+                    neighborCells[ii].push_back((cell+offset+numCells[ii])%numCells[ii]);
+            }
+            neighborStart[ii].push_back(neighborCells[ii].size());
+        }
+    }
+
+    // counting sorts of the particles and of the points by cell
+
+    int totalCells = numCells[0]*numCells[1]*numCells[2];
+    vector<int> cellStart(totalCells+1, 0);
+    vector<int> particleCell(_numParticles);
+    int cell[3];
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        particleCell[ii] = getCell(sources[ii].position, cell);
+        cellStart[particleCell[ii]+1]++;
+    }
+    for (int ii = 0; ii < totalCells; ii++)
+        cellStart[ii+1] += cellStart[ii];
+    vector<int> cellCursor(cellStart.begin(), cellStart.end()-1);
+    vector<int> cellParticles(_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        cellParticles[cellCursor[particleCell[ii]]++] = ii;
+
+    unsigned int numPoints = points.size();
+    vector<int> pointCell(numPoints);
+    vector<int> pointStart(totalCells+1, 0);
+    for (unsigned int pp = 0; pp < numPoints; pp++) {
+        pointCell[pp] = getCell(points[pp], cell);
+        pointStart[pointCell[pp]+1]++;
+    }
+    for (int ii = 0; ii < totalCells; ii++)
+        pointStart[ii+1] += pointStart[ii];
+    vector<int> pointOrder(numPoints);
+    for (unsigned int pp = 0; pp < numPoints; pp++)
+        pointOrder[pointStart[pointCell[pp]]++] = pp;
+
+    auto computePoints = [&] (unsigned int start, unsigned int end) {
+        for (unsigned int index = start; index < end; index++) {
+            int pp = pointOrder[index];
+            int pointCellIndex[3];
+            getCell(points[pp], pointCellIndex);
+            double sum = 0.0;
+            Vec3 fieldSum;
+            double gradientSum[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+            for (int nx = neighborStart[0][pointCellIndex[0]]; nx < neighborStart[0][pointCellIndex[0]+1]; nx++) {
+                for (int ny = neighborStart[1][pointCellIndex[1]]; ny < neighborStart[1][pointCellIndex[1]+1]; ny++) {
+                    for (int nz = neighborStart[2][pointCellIndex[2]]; nz < neighborStart[2][pointCellIndex[2]+1]; nz++) {
+                        int neighbor = (neighborCells[0][nx]*numCells[1]+neighborCells[1][ny])*numCells[2]+neighborCells[2][nz];
+                        for (int jj = cellStart[neighbor]; jj < cellStart[neighbor+1]; jj++) {
+                            const MultipoleParticleData& particle = sources[cellParticles[jj]];
+                            Vec3 deltaR = particle.position - points[pp];
+                            getPeriodicDelta(deltaR);
+                            double r2 = deltaR.dot(deltaR);
+                            if (r2 > _cutoffDistanceSquared)
+                                continue;
+                            double r      = sqrt(r2);
+                            double exp2a  = exp(-_alphaEwald*_alphaEwald*r2);
+                            double alsq2  = 2.0*_alphaEwald*_alphaEwald;
+                            double alsq2n = 1.0/(SQRT_PI*_alphaEwald);
+                            double bn[6];
+                            bn[0] = erfc(_alphaEwald*r)/r;
+                            for (int n = 1; n < 6; n++) {
+                                alsq2n *= alsq2;
+                                bn[n]   = ((2*n-1)*bn[n-1]+alsq2n*exp2a)/r2;
+                            }
+                            sum += calculateMultipolePotentialAtPoint(particle, deltaR, bn);
+                            if (field != NULL)
+                                fieldSum += calculateMultipoleFieldAtPoint(particle, deltaR, bn);
+                            if (fieldGradient != NULL) {
+                                double gradient[6];
+                                calculateMultipoleFieldGradientAtPoint(particle, deltaR, bn, gradient);
+                                for (int kk = 0; kk < 6; kk++)
+                                    gradientSum[kk] += gradient[kk];
+                            }
+                        }
+                    }
+                }
+            }
+            potential[pp] += sum;
+            if (field != NULL)
+                (*field)[pp] += fieldSum;
+            if (fieldGradient != NULL)
+                for (int kk = 0; kk < 6; kk++)
+                    (*fieldGradient)[6*pp+kk] += gradientSum[kk];
+        }
+    };
+    int numThreads = getNumThreads();
+    if (numThreads == 1)
+        computePoints(0, numPoints);
+    else {
+        _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+            computePoints((numPoints*threadIndex)/numThreads, (numPoints*(threadIndex+1))/numThreads);
+        });
+        _threads->waitForThreads();
+    }
+}
+
+void MPIDReferencePmeForce::calculateElectrostaticPotentialAtPoints(const vector<MultipoleParticleData>& sources,
+                                                                    const vector<Vec3>& points,
+                                                                    vector<double>& potential,
+                                                                    vector<Vec3>* field,
+                                                                    vector<double>* fieldGradient)
+{
+    potential.assign(points.size(), 0.0);
+    if (field != NULL)
+        field->assign(points.size(), Vec3());
+    if (fieldGradient != NULL)
+        fieldGradient->assign(6*points.size(), 0.0);
+    computeReciprocalSpacePotentialAtPoints(points, potential, field, fieldGradient);
+    computeDirectSpacePotentialAtPoints(sources, points, potential, field, fieldGradient);
+}
+
+void MPIDReferencePmeForce::computeReciprocalSpaceInducedPotential(const vector<Vec3>& inducedDipoles)
+{
+    if (_ewaldSum == NULL) {
+        initializePmeGrid();
+        spreadInducedDipolesOnGrid(inducedDipoles);
+        convolvePmeGrid();
+        computeInducedPotentialFromGrid();
+        if (_useInterlacedGrids) {
+            _interlacedPhi.swap(_phidp);
+            swapInterlacedGrid();
+            initializePmeGrid();
+            spreadInducedDipolesOnGrid(inducedDipoles);
+            convolvePmeGrid();
+            computeInducedPotentialFromGrid();
+            swapInterlacedGrid();
+            averageInterlacedPotential(_phidp);
+        }
+        if (_useSlabCorrection) {
+
+            // Only the derivatives of the induced dipole potential are used.
+
+            double dipoleZ = 0.0;
+            for (unsigned int ii = 0; ii < _numParticles; ii++)
+                dipoleZ += inducedDipoles[ii][2];
+            addSlabCorrectionPotential(dipoleZ, NULL, _phidp);
+        }
+        return;
+    }
+    Vec3 cartToFrac[3];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            cartToFrac[j][i] = _pmeGridDimensions[j]*_recipBoxVectors[i][j];
+    vector<double> multipoles(4*_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        multipoles[4*ii] = 0.0;
+        for (int jj = 0; jj < 3; jj++)
+            multipoles[4*ii+1+jj] = cartToFrac[jj].dot(inducedDipoles[ii]);
+    }
+    _ewaldSum->computePotential(4, multipoles, _phidp, _threads);
+}
+
 void MPIDReferencePmeForce::recordFixedMultipoleField()
 {
     Vec3 fracToCart[3];
@@ -4061,12 +5920,7 @@ void MPIDReferencePmeForce::calculateReciprocalSpaceInducedDipoleField(vector<Up
 {
     // Perform PME for the induced dipoles.
 
-    initializePmeGrid();
-    spreadInducedDipolesOnGrid(*updateInducedDipoleFields[0].inducedDipoles);
-    fftpack_exec_3d(_fftplan, FFTPACK_FORWARD, _pmeGrid, _pmeGrid);
-    performMPIDReciprocalConvolution();
-    fftpack_exec_3d(_fftplan, FFTPACK_BACKWARD, _pmeGrid, _pmeGrid);
-    computeInducedPotentialFromGrid();
+    computeReciprocalSpaceInducedPotential(*updateInducedDipoleFields[0].inducedDipoles);
     recordInducedDipoleField(updateInducedDipoleFields[0].inducedDipoleField);
 }
 
@@ -4079,19 +5933,68 @@ void MPIDReferencePmeForce::calculateInducedDipoleFields(const vector<MultipoleP
     for (auto& field : updateInducedDipoleFields)
         std::fill(field.inducedDipoleField.begin(), field.inducedDipoleField.end(), zeroVec);
 
-    // Add fields from direct space interactions.
+    // Add fields from direct space interactions, using the neighbor list built for the fixed field.
 
-    for (unsigned int ii = 0; ii < particleData.size(); ii++) {
-        for (unsigned int jj = ii + 1; jj < particleData.size(); jj++) {
-            calculateDirectInducedDipolePairIxns(particleData[ii], particleData[jj], updateInducedDipoleFields);
-        }
+    int numThreads = getNumThreads();
+    if (numThreads == 1) {
+        for (const NeighborPair& pair : _neighborList)
+            calculateDirectInducedDipolePairIxns(particleData[pair.particleI], particleData[pair.particleJ], pair.scaleEntry, updateInducedDipoleFields);
+    }
+    else {
+        // the per-thread copies share the dipoles being solved for and only own the fields, which
+        // start from zero so that anything the caller's gradients hold on entry is counted once;
+        // as in spreadAtomsOntoGrid(), the pool is handed functions that capture one reference
+
+        _threadInducedDipoleFields.resize(numThreads);
+        auto accumulateBlock = [&] (int threadIndex) {
+            vector<UpdateInducedDipoleFieldStruct>& fields = _threadInducedDipoleFields[threadIndex];
+            if (fields.size() > updateInducedDipoleFields.size())
+                fields.erase(fields.begin()+updateInducedDipoleFields.size(), fields.end());
+            for (unsigned int ff = 0; ff < updateInducedDipoleFields.size(); ff++) {
+                if (ff == fields.size())
+                    fields.push_back(updateInducedDipoleFields[ff]);
+                UpdateInducedDipoleFieldStruct& field = fields[ff];
+                field.inducedDipoles = updateInducedDipoleFields[ff].inducedDipoles;
+                field.inducedDipoleField.assign(_numParticles, Vec3());
+                field.inducedDipoleFieldGradient.assign(updateInducedDipoleFields[ff].inducedDipoleFieldGradient.size(), 0.0);
+            }
+            unsigned int start, end;
+            getNeighborListBlock(threadIndex, numThreads, start, end);
+            for (unsigned int ii = start; ii < end; ii++)
+                calculateDirectInducedDipolePairIxns(particleData[_neighborList[ii].particleI], particleData[_neighborList[ii].particleJ],
+                                                     _neighborList[ii].scaleEntry, fields);
+        };
+        auto reduceBlock = [&] (int threadIndex) {
+            unsigned int start, end;
+            getParticleBlock(threadIndex, numThreads, start, end);
+            for (unsigned int ff = 0; ff < updateInducedDipoleFields.size(); ff++) {
+                UpdateInducedDipoleFieldStruct& field = updateInducedDipoleFields[ff];
+                for (int kk = 0; kk < numThreads; kk++) {
+                    const UpdateInducedDipoleFieldStruct& threadField = _threadInducedDipoleFields[kk][ff];
+                    for (unsigned int ii = start; ii < end; ii++)
+                        field.inducedDipoleField[ii] += threadField.inducedDipoleField[ii];
+                    if (field.inducedDipoleFieldGradient.size() == 0)
+                        continue;
+                    for (unsigned int ii = 6*start; ii < 6*end; ii++)
+                        field.inducedDipoleFieldGradient[ii] += threadField.inducedDipoleFieldGradient[ii];
+                }
+            }
+        };
+        _threads->execute([&accumulateBlock] (ThreadPool& threads, int threadIndex) {
+            accumulateBlock(threadIndex);
+        });
+        _threads->waitForThreads();
+        _threads->execute([&reduceBlock] (ThreadPool& threads, int threadIndex) {
+            reduceBlock(threadIndex);
+        });
+        _threads->waitForThreads();
     }
 
     // reciprocal space ixns
 
     calculateReciprocalSpaceInducedDipoleField(updateInducedDipoleFields);
 
-    if(getPolarizationType() == MPIDReferenceForce::Extrapolated) {
+    if (updateInducedDipoleFields[0].inducedDipoleFieldGradient.size() > 0) {
         // While we have the reciprocal space (fractional coordinate) field gradient available, add it to the real space
         // terms computed above, after transforming to Cartesian coordinates.  This allows real and reciprocal space
         // dipole response force contributions to be computed together.
@@ -4119,12 +6022,12 @@ void MPIDReferencePmeForce::calculateInducedDipoleFields(const vector<MultipoleP
                     Eyz += fracToCart[1][k] * EmatD[k][l] * fracToCart[2][l];
                 }
             }
-            updateInducedDipoleFields[0].inducedDipoleFieldGradient[i][0] -= Exx;
-            updateInducedDipoleFields[0].inducedDipoleFieldGradient[i][1] -= Eyy;
-            updateInducedDipoleFields[0].inducedDipoleFieldGradient[i][2] -= Ezz;
-            updateInducedDipoleFields[0].inducedDipoleFieldGradient[i][3] -= Exy;
-            updateInducedDipoleFields[0].inducedDipoleFieldGradient[i][4] -= Exz;
-            updateInducedDipoleFields[0].inducedDipoleFieldGradient[i][5] -= Eyz;
+            updateInducedDipoleFields[0].inducedDipoleFieldGradient[6*i+0] -= Exx;
+            updateInducedDipoleFields[0].inducedDipoleFieldGradient[6*i+1] -= Eyy;
+            updateInducedDipoleFields[0].inducedDipoleFieldGradient[6*i+2] -= Ezz;
+            updateInducedDipoleFields[0].inducedDipoleFieldGradient[6*i+3] -= Exy;
+            updateInducedDipoleFields[0].inducedDipoleFieldGradient[6*i+4] -= Exz;
+            updateInducedDipoleFields[0].inducedDipoleFieldGradient[6*i+5] -= Eyz;
         }
     }
 
@@ -4159,15 +6062,12 @@ void MPIDReferencePmeForce::calculateDirectInducedDipolePairIxn(unsigned int iIn
 }
 
 void MPIDReferencePmeForce::calculateDirectInducedDipolePairIxns(const MultipoleParticleData& particleI,
-                                                                 const MultipoleParticleData& particleJ,
+                                                                 const MultipoleParticleData& particleJ, int scaleEntry,
                                                                  vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleFields)
 {
 
     // compute the real space portion of the Ewald summation
 
-    double uscale = 1.0;
-    double pscale = getMultipoleScaleFactor(particleI.particleIndex, particleJ.particleIndex, P_SCALE);
-
     Vec3 deltaR = particleJ.position - particleI.position;
 
     // periodic boundary conditions
@@ -4178,6 +6078,9 @@ void MPIDReferencePmeForce::calculateDirectInducedDipolePairIxns(const Multipole
     if (r2 > _cutoffDistanceSquared)
         return;
 
+    double uscale = 1.0;
+    double pscale = (scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*scaleEntry + P_SCALE];
+
     double r           = sqrt(r2);
 
     // calculate the error function damping terms
@@ -4233,7 +6136,7 @@ void MPIDReferencePmeForce::calculateDirectInducedDipolePairIxns(const Multipole
     for (auto& field : updateInducedDipoleFields) {
         calculateDirectInducedDipolePairIxn(particleI.particleIndex, particleJ.particleIndex, preFactor1, preFactor2, deltaR,
                                             *field.inducedDipoles, field.inducedDipoleField);
-        if (getPolarizationType() == MPIDReferenceForce::Extrapolated) {
+        if (field.inducedDipoleFieldGradient.size() > 0) {
             // Compute and store the field gradient for later use.
             double dx = deltaR[0];
             double dy = deltaR[1];
@@ -4251,12 +6154,12 @@ void MPIDReferencePmeForce::calculateDirectInducedDipolePairIxns(const Multipole
             double Exz = muDotR*dx*dz*preFactor3 - (xDipole*dz + zDipole*dx)*preFactor2;
             double Eyz = muDotR*dy*dz*preFactor3 - (yDipole*dz + zDipole*dy)*preFactor2;
 
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][0] -= Exx;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][1] -= Eyy;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][2] -= Ezz;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][3] -= Exy;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][4] -= Exz;
-            field.inducedDipoleFieldGradient[particleJ.particleIndex][5] -= Eyz;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+0] -= Exx;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+1] -= Eyy;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+2] -= Ezz;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+3] -= Exy;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+4] -= Exz;
+            field.inducedDipoleFieldGradient[6*particleJ.particleIndex+5] -= Eyz;
 
             OpenMM::Vec3 &dipolesJ = (*field.inducedDipoles)[particleJ.particleIndex];
             xDipole = dipolesJ[0];
@@ -4270,12 +6173,12 @@ void MPIDReferencePmeForce::calculateDirectInducedDipolePairIxns(const Multipole
             Exz = muDotR*dx*dz*preFactor3 - (xDipole*dz + zDipole*dx)*preFactor2;
             Eyz = muDotR*dy*dz*preFactor3 - (yDipole*dz + zDipole*dy)*preFactor2;
 
-            field.inducedDipoleFieldGradient[particleI.particleIndex][0] += Exx;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][1] += Eyy;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][2] += Ezz;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][3] += Exy;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][4] += Exz;
-            field.inducedDipoleFieldGradient[particleI.particleIndex][5] += Eyz;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+0] += Exx;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+1] += Eyy;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+2] += Ezz;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+3] += Exy;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+4] += Exz;
+            field.inducedDipoleFieldGradient[6*particleI.particleIndex+5] += Eyz;
         }
     }
 }
@@ -4334,7 +6237,7 @@ void MPIDReferencePmeForce::calculatePmeSelfTorque(const vector<MultipoleParticl
 
 double MPIDReferencePmeForce::calculatePmeDirectElectrostaticPairIxn(const MultipoleParticleData& particleI,
                                                                                     const MultipoleParticleData& particleJ,
-                                                                                    const vector<double>& scalingFactors,
+                                                                                    const double* scalingFactors,
                                                                                     vector<Vec3>& forces,
                                                                                     vector<Vec3>& torques) const
 {
@@ -4919,30 +6822,59 @@ double MPIDReferencePmeForce::calculatePmeDirectElectrostaticPairIxn(const Multi
 
 }
 
+double MPIDReferencePmeForce::calculatePmeDirectElectrostaticBlock(const vector<MultipoleParticleData>& particleData,
+                                                                  unsigned int start, unsigned int end,
+                                                                  vector<Vec3>& forces, vector<Vec3>& torques)
+{
+    double energy = 0.0;
+    double scaleFactors[LAST_SCALE_TYPE_INDEX];
+    for (unsigned int ii = start; ii < end; ii++) {
+        const NeighborPair& pair = _neighborList[ii];
+        for (unsigned int kk = 0; kk < LAST_SCALE_TYPE_INDEX; kk++)
+            scaleFactors[kk] = (pair.scaleEntry < 0) ? 1.0 : _scaleValues[LAST_SCALE_TYPE_INDEX*pair.scaleEntry + kk];
+        energy += calculatePmeDirectElectrostaticPairIxn(particleData[pair.particleI], particleData[pair.particleJ], scaleFactors, forces, torques);
+    }
+    return energy;
+}
+
 double MPIDReferencePmeForce::calculateElectrostatic(const vector<MultipoleParticleData>& particleData,
                                                                 vector<Vec3>& torques, vector<Vec3>& forces)
 {
     double energy = 0.0;
-    vector<double> scaleFactors(LAST_SCALE_TYPE_INDEX);
-    for (auto& s : scaleFactors)
-        s = 1.0;
 
-    // loop over particle pairs for direct space interactions
+    // loop over the neighbor list for direct space interactions
 
-    for (unsigned int ii = 0; ii < particleData.size(); ii++) {
-        for (unsigned int jj = ii+1; jj < particleData.size(); jj++) {
-
-            if (jj <= _maxScaleIndex[ii]) {
-                getMultipoleScaleFactors(ii, jj, scaleFactors);
-            }
-
-            energy += calculatePmeDirectElectrostaticPairIxn(particleData[ii], particleData[jj], scaleFactors, forces, torques);
-
-            if (jj <= _maxScaleIndex[ii]) {
-                for (auto& s : scaleFactors)
-                    s = 1.0;
+    int numThreads = getNumThreads();
+    if (numThreads == 1) {
+        energy += calculatePmeDirectElectrostaticBlock(particleData, 0, _neighborList.size(), forces, torques);
+    }
+    else {
+        _threadForces.resize(numThreads);
+        _threadTorques.resize(numThreads);
+        _threadEnergy.resize(numThreads);
+        _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+            vector<Vec3>& threadForces  = _threadForces[threadIndex];
+            vector<Vec3>& threadTorques = _threadTorques[threadIndex];
+            threadForces.assign(_numParticles, Vec3());
+            threadTorques.assign(_numParticles, Vec3());
+            unsigned int start, end;
+            getNeighborListBlock(threadIndex, numThreads, start, end);
+            _threadEnergy[threadIndex] = calculatePmeDirectElectrostaticBlock(particleData, start, end, threadForces, threadTorques);
+        });
+        _threads->waitForThreads();
+        _threads->execute([&] (ThreadPool& threads, int threadIndex) {
+            unsigned int start, end;
+            getParticleBlock(threadIndex, numThreads, start, end);
+            for (int kk = 0; kk < numThreads; kk++) {
+                for (unsigned int ii = start; ii < end; ii++) {
+                    forces[ii]  += _threadForces[kk][ii];
+                    torques[ii] += _threadTorques[kk][ii];
+                }
             }
-        }
+        });
+        _threads->waitForThreads();
+        for (int kk = 0; kk < numThreads; kk++)
+            energy += _threadEnergy[kk];
     }
 
     // The polarization energy
@@ -4953,34 +6885,271 @@ double MPIDReferencePmeForce::calculateElectrostatic(const vector<MultipoleParti
 
     // Now that both the direct and reciprocal space contributions have been added, we can compute the dipole
     // response contributions to the forces, if we're using the extrapolated polarization algorithm.
-    if (getPolarizationType() == MPIDReferenceForce::Extrapolated) {
-        double prefac = (_electric/_dielectric);
-        for (int i = 0; i < _numParticles; i++) {
-            // Compute the µ(m) T µ(n) force contributions here
-            for (int l = 0; l < _maxPTOrder-1; ++l) {
-                for (int m = 0; m < _maxPTOrder-1-l; ++m) {
-                    double p = _extPartCoefficients[l+m+1];
-                    if(std::fabs(p) < 1e-6) continue;
-                    forces[i][0] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+0]
-                                            + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+3]
-                                            + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+4]);
-                    forces[i][1] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+3]
-                                            + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+1]
-                                            + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+5]);
-                    forces[i][2] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldGradientD[m][6*i+4]
-                                            + _ptDipoleD[l][i][1]*_ptDipoleFieldGradientD[m][6*i+5]
-                                            + _ptDipoleD[l][i][2]*_ptDipoleFieldGradientD[m][6*i+2]);
-                    if(particleData[i].isAnisotropic){
-                        torques[i][0] += p*prefac*(_ptDipoleD[l][i][1]*_ptDipoleFieldD[m][3*i+2]
-                                                 - _ptDipoleD[l][i][2]*_ptDipoleFieldD[m][3*i+1]);
-                        torques[i][1] += p*prefac*(_ptDipoleD[l][i][2]*_ptDipoleFieldD[m][3*i+0]
-                                                 - _ptDipoleD[l][i][0]*_ptDipoleFieldD[m][3*i+2]);
-                        torques[i][2] += p*prefac*(_ptDipoleD[l][i][0]*_ptDipoleFieldD[m][3*i+1]
-                                                 - _ptDipoleD[l][i][1]*_ptDipoleFieldD[m][3*i+0]);
-                    }
-                }
+    if (usesPerturbationDipoles())
+        addPerturbationDipoleForces(particleData, torques, forces);
+    return energy;
+}
+
+// FMM_DERIVATIVE[i][k] is the index in the MPIDReferenceFMM potential of the derivative along axis i
+// of its component k, for the first 20 components.
+
+static const int FMM_DERIVATIVE[3][20] = {
+    {1, 4, 7, 8, 10, 15, 17, 13, 14, 19, 20, 25, 27, 23, 24, 29, 33, 30, 34, 32},
+    {2, 7, 5, 9, 13, 11, 18, 15, 19, 16, 23, 21, 28, 29, 32, 25, 26, 34, 31, 33},
+    {3, 8, 9, 6, 14, 16, 12, 19, 17, 18, 24, 26, 22, 32, 30, 33, 31, 27, 28, 34}
+};
+
+MPIDReferenceFmmForce::MPIDReferenceFmmForce() : MPIDReferenceForce(FMM), _fmm(12, 0)
+{
+}
+
+void MPIDReferenceFmmForce::setFmmParameters(int expansionOrder, int treeDepth)
+{
+    if (expansionOrder != _fmm.getExpansionOrder() || treeDepth != _fmm.getTreeDepth())
+        _fmm = MPIDReferenceFMM(expansionOrder, treeDepth);
+}
+
+int MPIDReferenceFmmForce::getFmmExpansionOrder() const
+{
+    return _fmm.getExpansionOrder();
+}
+
+int MPIDReferenceFmmForce::getFmmTreeDepth() const
+{
+    return _fmm.getTreeDepth();
+}
+
+int MPIDReferenceFmmForce::getFmmLeafLevel() const
+{
+    return _fmm.getLeafLevel();
+}
+
+double MPIDReferenceFmmForce::getMinimumLeafWidth(const vector<MultipoleParticleData>& particleData) const
+{
+    // Pairs in the far field are computed without Thole damping, with pgamma the default width for all
+    // pairs that are not covalently scaled; those are near pairs anyway.  Every damping factor differs
+    // from one by at most exp(-u)*(1 + u + u^2/2 + u^3/4 + u^4/12 + u^5/72 + u^6/600), taking the largest
+    // coefficient of each power over all of them, with u = pgamma*r/(dampI*dampJ).  Past the u where that
+    // falls below the target error of the expansions, leaving out the damping costs no more accuracy than
+    // the far field already gives up.
+
+    if (_defaultTholeWidth <= 0.0)
+        return std::numeric_limits<double>::infinity();
+    double maxDampingFactor = 0.0;
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        maxDampingFactor = std::max(maxDampingFactor, fabs(particleData[ii].dampingFactor));
+    double targetError = _fmm.getTargetError();
+    double u = 0.0;
+    while (u < 50.0 && exp(-u)*(1.0 + u*(1.0 + u*(1.0/2.0 + u*(1.0/4.0 + u*(1.0/12.0 + u*(1.0/72.0 + u/600.0)))))) >= targetError)
+        u += 0.1;
+    double width = u*maxDampingFactor*maxDampingFactor/_defaultTholeWidth;
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        for (unsigned int entry = _scaleRowStart[ii]; entry < _scaleRowStart[ii+1]; entry++) {
+            Vec3 deltaR = particleData[_scaleColumn[entry]].position - particleData[ii].position;
+            width = std::max(width, sqrt(deltaR.dot(deltaR)));
+        }
+    }
+    return width;
+}
+
+void MPIDReferenceFmmForce::loadFmmMultipoles(const vector<MultipoleParticleData>& particleData, vector<double>& multipoles) const
+{
+    multipoles.resize(20*_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        const MultipoleParticleData& particle = particleData[ii];
+        double* multipole = &multipoles[20*ii];
+        multipole[0] = particle.charge;
+        multipole[1] = particle.dipole[0];
+        multipole[2] = particle.dipole[1];
+        multipole[3] = particle.dipole[2];
+        multipole[4] = particle.quadrupole[QXX];
+        multipole[5] = particle.quadrupole[QYY];
+        multipole[6] = particle.quadrupole[QZZ];
+        multipole[7] = particle.quadrupole[QXY]*2.0;
+        multipole[8] = particle.quadrupole[QXZ]*2.0;
+        multipole[9] = particle.quadrupole[QYZ]*2.0;
+        multipole[10] = particle.octopole[QXXX];
+        multipole[11] = particle.octopole[QYYY];
+        multipole[12] = particle.octopole[QZZZ];
+        multipole[13] = particle.octopole[QXXY]*3.0;
+        multipole[14] = particle.octopole[QXXZ]*3.0;
+        multipole[15] = particle.octopole[QXYY]*3.0;
+        multipole[16] = particle.octopole[QYYZ]*3.0;
+        multipole[17] = particle.octopole[QXZZ]*3.0;
+        multipole[18] = particle.octopole[QYZZ]*3.0;
+        multipole[19] = particle.octopole[QXYZ]*6.0;
+    }
+}
+
+void MPIDReferenceFmmForce::loadFmmDipoles(const vector<Vec3>& dipoles, vector<double>& multipoles) const
+{
+    multipoles.resize(4*_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        multipoles[4*ii]   = 0.0;
+        multipoles[4*ii+1] = dipoles[ii][0];
+        multipoles[4*ii+2] = dipoles[ii][1];
+        multipoles[4*ii+3] = dipoles[ii][2];
+    }
+}
+
+void MPIDReferenceFmmForce::calculateFixedMultipoleField(const vector<MultipoleParticleData>& particleData)
+{
+    vector<Vec3> positions(_numParticles);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        positions[ii] = particleData[ii].position;
+    _fmm.setPositions(positions, getMinimumLeafWidth(particleData));
+
+    for (const auto& pair : _fmm.getNearPairs()) {
+        double dScale, pScale;
+        getDScaleAndPScale(pair.first, pair.second, dScale, pScale);
+        calculateFixedMultipoleFieldPairIxn(particleData[pair.first], particleData[pair.second], dScale, pScale);
+    }
+
+    loadFmmMultipoles(particleData, _fmmMultipoles);
+    _fmm.computePotential(20, _fmmMultipoles, _fmmPotential, _threads);
+    for (unsigned int ii = 0; ii < _numParticles; ii++)
+        _fixedMultipoleField[ii] -= Vec3(_fmmPotential[35*ii+1], _fmmPotential[35*ii+2], _fmmPotential[35*ii+3]);
+}
+
+void MPIDReferenceFmmForce::calculateFixedMultipoleFieldGradient(const vector<MultipoleParticleData>& particleData, vector<double>& gradients)
+{
+    gradients.assign(6*_numParticles, 0.0);
+    for (const auto& pair : _fmm.getNearPairs()) {
+        double dScale, pScale;
+        getDScaleAndPScale(pair.first, pair.second, dScale, pScale);
+        calculateFixedMultipoleFieldGradientPairIxn(particleData[pair.first], particleData[pair.second], dScale, pScale, gradients);
+    }
+
+    // the potential of the fixed multipoles has been overwritten by the induced dipoles since the setup
+
+    loadFmmMultipoles(particleData, _fmmMultipoles);
+    _fmm.computePotential(20, _fmmMultipoles, _fmmPotential, _threads);
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        const double* phi = &_fmmPotential[35*ii];
+        double* gradient  = &gradients[6*ii];
+        gradient[QXX] -= phi[4];
+        gradient[QYY] -= phi[5];
+        gradient[QZZ] -= phi[6];
+        gradient[QXY] -= phi[7];
+        gradient[QXZ] -= phi[8];
+        gradient[QYZ] -= phi[9];
+    }
+}
+
+void MPIDReferenceFmmForce::calculateInducedDipoleFields(const vector<MultipoleParticleData>& particleData,
+                                                         vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleFields)
+{
+    Vec3 zeroVec(0.0, 0.0, 0.0);
+    for (auto& field : updateInducedDipoleFields)
+        std::fill(field.inducedDipoleField.begin(), field.inducedDipoleField.end(), zeroVec);
+
+    for (const auto& pair : _fmm.getNearPairs())
+        calculateInducedDipolePairIxns(particleData[pair.first], particleData[pair.second], updateInducedDipoleFields);
+
+    // the far field is minus the gradient of the potential, and its gradient minus the second derivatives
+
+    for (auto& field : updateInducedDipoleFields) {
+        loadFmmDipoles(*field.inducedDipoles, _fmmMultipoles);
+        _fmm.computePotential(4, _fmmMultipoles, _fmmPotential, _threads);
+        for (unsigned int ii = 0; ii < _numParticles; ii++) {
+            const double* phi = &_fmmPotential[35*ii];
+            field.inducedDipoleField[ii] -= Vec3(phi[1], phi[2], phi[3]);
+            if (field.inducedDipoleFieldGradient.size() > 0)
+                for (int kk = 0; kk < 6; kk++)
+                    field.inducedDipoleFieldGradient[6*ii+kk] -= phi[4+kk];
+        }
+    }
+}
+
+Vec3 MPIDReferenceFmmForce::calculateFarFieldTorque(const MultipoleParticleData& particleI, const Vec3& dipole, const double* phi) const
+{
+    // The torque from rotating a rank l moment T in the potential is -l eps_amd T_d... phi_a..., with
+    // the full symmetric tensors of the moments and of the potential derivatives.
+
+    const int quadrupoleIndex[3][3] = {{QXX, QXY, QXZ}, {QXY, QYY, QYZ}, {QXZ, QYZ, QZZ}};
+    const int octopoleIndex[3][3][3] = {{{QXXX, QXXY, QXXZ}, {QXXY, QXYY, QXYZ}, {QXXZ, QXYZ, QXZZ}},
+                                        {{QXXY, QXYY, QXYZ}, {QXYY, QYYY, QYYZ}, {QXYZ, QYYZ, QYZZ}},
+                                        {{QXXZ, QXYZ, QXZZ}, {QXYZ, QYYZ, QYZZ}, {QXZZ, QYZZ, QZZZ}}};
+    double contraction[3][3];
+    for (int a = 0; a < 3; a++) {
+        for (int d = 0; d < 3; d++) {
+            double sum = dipole[d]*phi[1+a];
+            for (int b = 0; b < 3; b++) {
+                int phiAB = FMM_DERIVATIVE[a][1+b];
+                sum += 2.0*particleI.quadrupole[quadrupoleIndex[d][b]]*phi[phiAB];
+                for (int c = 0; c < 3; c++)
+                    sum += 3.0*particleI.octopole[octopoleIndex[d][b][c]]*phi[FMM_DERIVATIVE[c][phiAB]];
             }
+            contraction[a][d] = sum;
         }
     }
+    Vec3 torque;
+    for (int m = 0; m < 3; m++) {
+        int a = (m+2)%3;
+        int d = (m+1)%3;
+        torque[m] = contraction[d][a]-contraction[a][d];
+    }
+    return torque*_electric;
+}
+
+double MPIDReferenceFmmForce::calculateElectrostatic(const vector<MultipoleParticleData>& particleData,
+                                                     vector<Vec3>& torques, vector<Vec3>& forces)
+{
+    double energy = 0.0;
+    double scaleFactors[LAST_SCALE_TYPE_INDEX];
+    for (const auto& pair : _fmm.getNearPairs()) {
+        getMultipoleScaleFactors(pair.first, pair.second, scaleFactors);
+        energy += calculateElectrostaticPairIxn(particleData[pair.first], particleData[pair.second], scaleFactors, forces, torques);
+    }
+
+    // Far field, as for the reciprocal space part of PME: the fixed multipoles and induced dipoles
+    // interact with the potential of the fixed multipoles, and the fixed multipoles, and for mutual
+    // polarization the induced dipoles, with that of the induced dipoles.
+
+    const int* deriv1 = FMM_DERIVATIVE[0];
+    const int* deriv2 = FMM_DERIVATIVE[1];
+    const int* deriv3 = FMM_DERIVATIVE[2];
+    vector<double> fixedPotential;
+    loadFmmMultipoles(particleData, _fmmMultipoles);
+    _fmm.computePotential(20, _fmmMultipoles, fixedPotential, _threads);
+    vector<double> inducedDipoles;
+    loadFmmDipoles(_inducedDipole, inducedDipoles);
+    _fmm.computePotential(4, inducedDipoles, _fmmPotential, _threads);
+    bool mutual = (getPolarizationType() == MPIDReferenceForce::Mutual);
+    double farEnergy = 0.0;
+    for (unsigned int ii = 0; ii < _numParticles; ii++) {
+        const double* multipole = &_fmmMultipoles[20*ii];
+        const double* fixedPhi = &fixedPotential[35*ii];
+        const double* inducedPhi = &_fmmPotential[35*ii];
+
+        Vec3 dipole = particleData[ii].dipole;
+        if (particleData[ii].isAnisotropic)
+            dipole += _inducedDipole[ii];
+        torques[ii] += calculateFarFieldTorque(particleData[ii], dipole, fixedPhi);
+        dipole = particleData[ii].dipole;
+        if (mutual && particleData[ii].isAnisotropic)
+            dipole += _inducedDipole[ii];
+        torques[ii] += calculateFarFieldTorque(particleData[ii], dipole, inducedPhi);
+
+        Vec3 f;
+        for (int kk = 0; kk < 20; kk++) {
+            farEnergy += multipole[kk]*fixedPhi[kk];
+            f += Vec3(fixedPhi[deriv1[kk]] + inducedPhi[deriv1[kk]],
+                      fixedPhi[deriv2[kk]] + inducedPhi[deriv2[kk]],
+                      fixedPhi[deriv3[kk]] + inducedPhi[deriv3[kk]])*multipole[kk];
+        }
+        for (int kk = 1; kk < 4; kk++) {
+            double inducedDipole = inducedDipoles[4*ii+kk];
+            farEnergy += inducedDipole*fixedPhi[kk];
+            f += Vec3(fixedPhi[deriv1[kk]], fixedPhi[deriv2[kk]], fixedPhi[deriv3[kk]])*inducedDipole;
+            if (mutual)
+                f += Vec3(inducedPhi[deriv1[kk]], inducedPhi[deriv2[kk]], inducedPhi[deriv3[kk]])*inducedDipole;
+        }
+        forces[ii] -= f*_electric;
+    }
+    energy += 0.5*_electric*farEnergy;
+
+    if (usesPerturbationDipoles())
+        addPerturbationDipoleForces(particleData, torques, forces);
     return energy;
 }
@@ -26,9 +26,16 @@
 
 #include "openmm/MPIDForce.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
 #include <map>
-#include "fftpack.h"
+#include "MPIDReferenceEwaldSum.h"
+#include "MPIDReferenceFFT.h"
+#include "MPIDReferenceFMM.h"
+#include "MPIDReferenceMSM.h"
+#include "ReferenceNeighborList.h"
+#include "MPIDReferenceDIIS.h"
 #include <complex>
+#include <functional>
 #include <vector>
 
 using namespace std;
@@ -423,7 +430,25 @@ public:
          * Periodic boundary conditions are used, and Particle-Mesh Ewald (PME) summation is used to compute the interaction of each particle
          * with all periodic copies of every other particle.
          */
-        PME = 1
+        PME = 1,
+
+        /**
+         * Periodic boundary conditions are used, and the reciprocal space part of the Ewald sum is evaluated
+         * explicitly over the reciprocal lattice vectors.
+         */
+        Ewald = 2,
+
+        /**
+         * Periodic boundary conditions are used, and the PME grid convolution is done by multilevel summation
+         * on nested grids instead of with FFTs.
+         */
+        MSM = 3,
+
+        /**
+         * No cutoff is applied; interactions between distant groups of particles are computed with the
+         * fast multipole method.
+         */
+        FMM = 4
     };
 
     enum PolarizationType {
@@ -441,7 +466,30 @@ public:
         /**
          * Extrapolated perturbation theory
          */
-        Extrapolated = 2
+        Extrapolated = 2,
+
+        /**
+         * Truncated conjugate gradient, one iteration
+         */
+        TCG1 = 3,
+
+        /**
+         * Truncated conjugate gradient, two iterations
+         */
+        TCG2 = 4
+    };
+
+    enum MutualInducedSolver {
+
+        /** 
+         * Direct inversion in the iterative subspace
+         */
+        DIIS = 0,
+
+        /**
+         * Conjugate gradient preconditioned by the polarizability of each site
+         */
+        ConjugateGradient = 1
     };
 
     /**
@@ -505,6 +553,20 @@ public:
      */
     void setPolarizationType(PolarizationType polarizationType);
 
+    /**
+     * Get the solver used to converge mutual induced dipoles.
+     * 
+     * @return mutual induced dipole solver
+     */
+    MutualInducedSolver getMutualInducedSolver() const;
+
+    /**
+     * Set the solver used to converge mutual induced dipoles.
+     * 
+     * @param  solver mutual induced dipole solver
+     */
+    void setMutualInducedSolver(MutualInducedSolver solver);
+
     /**
      * Get flag indicating if mutual induced dipoles are converged.
      *
@@ -580,6 +642,40 @@ public:
      */
     void setMaximumMutualInducedDipoleIterations(int maximumMutualInducedDipoleIterations);
 
+    /**
+     * Build the compressed table of covalently scaled pairs from the covalent info.
+     * The table only depends on the topology and the 1-4 scale factor, so it is built
+     * once and reused by every subsequent evaluation.
+     *
+     * @param  multipoleAtomCovalentInfo vector of vectors containing the covalent info
+     *
+     */
+    void setupScaleTable(const std::vector< std::vector< std::vector<int> > >& multipoleAtomCovalentInfo);
+
+    /**
+     * Set the thread pool used to split up the direct space pair loops.  Each thread
+     * accumulates into its own buffers, which are summed once the loop is done.
+     *
+     * @param threads thread pool to use, or NULL (the default) to run the loops serially
+     *
+     */
+    void setThreadPool(ThreadPool* threads);
+
+    /**
+     * Discard the history of converged mutual induced dipoles used to predict the starting
+     * dipoles of the next solve.  This must be called whenever the parameters change.
+     *
+     */
+    void resetInducedDipolePredictor();
+
+    /**
+     * Discard the lab frame moments and induced dipoles kept from the last setup, so the next
+     * call to one of the dipole, potential or moment methods repeats it.  This must be called
+     * whenever the positions, periodic box or parameters change.
+     *
+     */
+    void invalidateSetup();
+
     /**
      * Get the maximum number of iterations to be executed in converging mutual induced dipoles.
      *
@@ -728,6 +824,43 @@ public:
                                const std::vector< vector< vector<int> > >& multipoleAtomCovalentInfo,
                                std::vector<Vec3>& outputRotatedPermanentDipoles);
 
+    /**
+     * Calculate the permanent multipoles of all particles in the lab frame.  Only the rotation from
+     * the molecular frames is done, so this is O(N) and does not compute the induced dipoles; if the
+     * last setup still holds, its rotated moments are returned instead.
+     *
+     * @param particlePositions         Cartesian coordinates of particles
+     * @param charges                   scalar charges for each particle
+     * @param dipoles                   molecular frame dipoles for each particle
+     * @param quadrupoles               molecular frame quadrupoles for each particle
+     * @param octopoles                 molecular frame octopoles for each particle
+     * @param tholes                    Thole factors for each particle
+     * @param dampingFactors            dampling factors for each particle
+     * @param polarity                  diagonal elements of the polarizability tensor for each particle
+     * @param axisTypes                 axis type (Z-then-X, ...) for each particle
+     * @param multipoleAtomZs           indicies of particle specifying the molecular frame z-axis for each particle
+     * @param multipoleAtomXs           indicies of particle specifying the molecular frame x-axis for each particle
+     * @param multipoleAtomYs           indicies of particle specifying the molecular frame y-axis for each particle
+     * @param outputDipoles             output lab frame dipoles
+     * @param outputQuadrupoles         output lab frame quadrupoles, six per particle in the same order as the input
+     * @param outputOctopoles           output lab frame octopoles, ten per particle in the same order as the input
+     */
+    void calculateLabFramePermanentMultipoles(const std::vector<Vec3>& particlePositions,
+                                              const std::vector<double>& charges,
+                                              const std::vector<double>& dipoles,
+                                              const std::vector<double>& quadrupoles,
+                                              const std::vector<double>& octopoles,
+                                              const std::vector<double>& tholes,
+                                              const std::vector<double>& dampingFactors,
+                                              const vector<std::vector<double> > &polarity,
+                                              const std::vector<int>& axisTypes,
+                                              const std::vector<int>& multipoleAtomZs,
+                                              const std::vector<int>& multipoleAtomXs,
+                                              const std::vector<int>& multipoleAtomYs,
+                                              std::vector<Vec3>& outputDipoles,
+                                              std::vector<double>& outputQuadrupoles,
+                                              std::vector<double>& outputOctopoles);
+
 
 
     /**
@@ -800,6 +933,127 @@ public:
                                          const std::vector<Vec3>& inputGrid,
                                          std::vector<double>& outputPotential);
 
+    /**
+     * Calculate the electrostatic potential, and optionally the electric field, on a regular lattice.
+     * Point (i, j, k) is origin + i*axes[0] + j*axes[1] + k*axes[2].  The lattice is computed one
+     * plane of constant i at a time, which is passed on before the next one is started; within a
+     * plane k varies fastest.  Setup, and the reciprocal space density with PME or Ewald, are only
+     * computed once for all planes.
+     *
+     * @param particlePositions         Cartesian coordinates of particles
+     * @param charges                   scalar charges for each particle
+     * @param dipoles                   molecular frame dipoles for each particle
+     * @param quadrupoles               molecular frame quadrupoles for each particle
+     * @param octopoles                 molecular frame octopoles for each particle
+     * @param tholes                    Thole factors for each particle
+     * @param dampingFactors            dampling factors for each particle
+     * @param polarity                  diagonal elements of the polarizability tensor for each particle
+     * @param axisTypes                 axis type (Z-then-X, ...) for each particle
+     * @param multipoleAtomZs           indicies of particle specifying the molecular frame z-axis for each particle
+     * @param multipoleAtomXs           indicies of particle specifying the molecular frame x-axis for each particle
+     * @param multipoleAtomYs           indicies of particle specifying the molecular frame y-axis for each particle
+     * @param multipoleAtomCovalentInfo covalent info needed to set scaling factors
+     * @param origin                    the first lattice point
+     * @param axes                      the three lattice step vectors
+     * @param numPoints                 the number of lattice points along each step vector
+     * @param includeField              whether to compute the electric field as well
+     * @param processPlane              called with the index i of each plane, the potential at its points and,
+     *                                  if includeField is set, the field at its points
+     */
+    void calculateElectrostaticPotentialVolume(const std::vector<OpenMM::Vec3>& particlePositions,
+                                               const std::vector<double>& charges,
+                                               const std::vector<double>& dipoles,
+                                               const std::vector<double>& quadrupoles,
+                                               const std::vector<double>& octopoles,
+                                               const std::vector<double>& tholes,
+                                               const std::vector<double>& dampingFactors,
+                                               const std::vector<std::vector<double> >& polarity,
+                                               const std::vector<int>& axisTypes,
+                                               const std::vector<int>& multipoleAtomZs,
+                                               const std::vector<int>& multipoleAtomXs,
+                                               const std::vector<int>& multipoleAtomYs,
+                                               const std::vector< std::vector< std::vector<int> > >& multipoleAtomCovalentInfo,
+                                               const Vec3& origin, const Vec3* axes, const int* numPoints, bool includeField,
+                                               const std::function<void (int, const std::vector<double>&, const std::vector<Vec3>&)>& processPlane);
+
+    /**
+     * Calculate the electric field, and optionally its gradient, at each particle due to the fixed multipoles
+     * and induced dipoles of the other particles, with the covalent scaling and Thole damping used for the
+     * induced dipoles.  The field of the fixed multipoles is the one kept by the last setup; the field of the
+     * induced dipoles, and the gradients, take one more pass over the pairs.
+     *
+     * @param particlePositions         Cartesian coordinates of particles
+     * @param charges                   scalar charges for each particle
+     * @param dipoles                   molecular frame dipoles for each particle
+     * @param quadrupoles               molecular frame quadrupoles for each particle
+     * @param octopoles                 molecular frame octopoles for each particle
+     * @param tholes                    Thole factors for each particle
+     * @param dampingFactors            dampling factors for each particle
+     * @param polarity                  diagonal elements of the polarizability tensor for each particle
+     * @param axisTypes                 axis type (Z-then-X, ...) for each particle
+     * @param multipoleAtomZs           indicies of particle specifying the molecular frame z-axis for each particle
+     * @param multipoleAtomXs           indicies of particle specifying the molecular frame x-axis for each particle
+     * @param multipoleAtomYs           indicies of particle specifying the molecular frame y-axis for each particle
+     * @param multipoleAtomCovalentInfo covalent info needed to set scaling factors
+     * @param outputFields              if not NULL, output field at each particle
+     * @param outputFieldGradients      if not NULL, output field gradient at each particle, six elements per particle
+     *                                  in the order XX XY YY XZ YZ ZZ
+     */
+    void calculateElectricFields(const std::vector<OpenMM::Vec3>& particlePositions,
+                                 const std::vector<double>& charges,
+                                 const std::vector<double>& dipoles,
+                                 const std::vector<double>& quadrupoles,
+                                 const std::vector<double>& octopoles,
+                                 const std::vector<double>& tholes,
+                                 const std::vector<double>& dampingFactors,
+                                 const std::vector<std::vector<double> >& polarity,
+                                 const std::vector<int>& axisTypes,
+                                 const std::vector<int>& multipoleAtomZs,
+                                 const std::vector<int>& multipoleAtomXs,
+                                 const std::vector<int>& multipoleAtomYs,
+                                 const std::vector< std::vector< std::vector<int> > >& multipoleAtomCovalentInfo,
+                                 std::vector<OpenMM::Vec3>* outputFields,
+                                 std::vector<double>* outputFieldGradients);
+
+    /**
+     * Calculate the electric field, and optionally its gradient, at a set of points: the derivatives of the
+     * potential from calculateElectrostaticPotential().
+     *
+     * @param particlePositions         Cartesian coordinates of particles
+     * @param charges                   scalar charges for each particle
+     * @param dipoles                   molecular frame dipoles for each particle
+     * @param quadrupoles               molecular frame quadrupoles for each particle
+     * @param octopoles                 molecular frame octopoles for each particle
+     * @param tholes                    Thole factors for each particle
+     * @param dampingFactors            dampling factors for each particle
+     * @param polarity                  diagonal elements of the polarizability tensor for each particle
+     * @param axisTypes                 axis type (Z-then-X, ...) for each particle
+     * @param multipoleAtomZs           indicies of particle specifying the molecular frame z-axis for each particle
+     * @param multipoleAtomXs           indicies of particle specifying the molecular frame x-axis for each particle
+     * @param multipoleAtomYs           indicies of particle specifying the molecular frame y-axis for each particle
+     * @param multipoleAtomCovalentInfo covalent info needed to set scaling factors
+     * @param points                    points at which to compute the field
+     * @param outputFields              if not NULL, output field at each point
+     * @param outputFieldGradients      if not NULL, output field gradient at each point, six elements per point
+     *                                  in the order XX XY YY XZ YZ ZZ
+     */
+    void calculateElectricFieldsAtPoints(const std::vector<OpenMM::Vec3>& particlePositions,
+                                         const std::vector<double>& charges,
+                                         const std::vector<double>& dipoles,
+                                         const std::vector<double>& quadrupoles,
+                                         const std::vector<double>& octopoles,
+                                         const std::vector<double>& tholes,
+                                         const std::vector<double>& dampingFactors,
+                                         const std::vector<std::vector<double> >& polarity,
+                                         const std::vector<int>& axisTypes,
+                                         const std::vector<int>& multipoleAtomZs,
+                                         const std::vector<int>& multipoleAtomXs,
+                                         const std::vector<int>& multipoleAtomYs,
+                                         const std::vector< std::vector< std::vector<int> > >& multipoleAtomCovalentInfo,
+                                         const std::vector<Vec3>& points,
+                                         std::vector<OpenMM::Vec3>* outputFields,
+                                         std::vector<double>* outputFieldGradients);
+
 protected:
 
     enum MultipoleParticleDataEnum { PARTICLE_POSITION, PARTICLE_CHARGE, PARTICLE_DIPOLE, PARTICLE_QUADRUPOLE,
@@ -825,8 +1079,9 @@ protected:
             double sphericalOctopole[7];
             double thole;
             double dampingFactor;
-            std::vector<double> polarity;
+            double polarity[3];
             double labPolarization[6];
+            double labPolarizationInverse[6];
             bool isAnisotropic;
     };
     
@@ -852,26 +1107,49 @@ protected:
             std::vector<std::vector<double> >* extrapolatedDipoleField;
             std::vector<std::vector<double> >* extrapolatedDipoleFieldGradient;
             std::vector<OpenMM::Vec3> inducedDipoleField;
-            std::vector<std::vector<double> > inducedDipoleFieldGradient;
+            std::vector<double> inducedDipoleFieldGradient; // xx, yy, zz, xy, xz, yz for each particle
     };
 
     unsigned int _numParticles;
 
     NonbondedMethod _nonbondedMethod;
     PolarizationType _polarizationType;
+    MutualInducedSolver _mutualInducedSolver;
 
     double _electric;
     double _dielectric;
 
     enum ScaleType { M_SCALE, P_SCALE, LAST_SCALE_TYPE_INDEX };
-    std::vector<  std::vector< MapIntRealOpenMM > > _scaleMaps;
-    std::vector<unsigned int> _maxScaleIndex;
+
+    /*
+     * Covalently scaled pairs (i, j), j >= i, in compressed sparse row form: the pairs for particle i
+     * are stored in [_scaleRowStart[i], _scaleRowStart[i+1]) of _scaleColumn, sorted by j, and
+     * _scaleValues holds LAST_SCALE_TYPE_INDEX scale factors for each pair.
+     */
+    std::vector<unsigned int> _scaleRowStart;
+    std::vector<unsigned int> _scaleColumn;
+    std::vector<double> _scaleValues;
+
+    ThreadPool* _threads;
+
     double _mScale[5];
     double _pScale[5];
 
     std::vector<TransformedMultipole> _transformed;
     std::vector<Vec3> _fixedMultipoleField;
     std::vector<Vec3> _inducedDipole;
+
+    // The field of the fixed multipoles from the last setup, before _fixedMultipoleField is multiplied
+    // by the polarizabilities; the electric field methods report it.
+    std::vector<Vec3> _fixedElectricField;
+
+    /*
+     * The particle data from the last setup().  While _setupValid is set, it and _inducedDipole
+     * are served to the dipole, potential and moment methods without repeating the setup.
+     */
+    std::vector<MultipoleParticleData> _setupParticleData;
+    bool _setupValid;
+    MPIDReferenceDIIS _diis;
     std::vector<std::vector<Vec3> > _ptDipoleD;
     std::vector<std::vector<double> > _ptDipoleFieldD;
     std::vector<std::vector<double> > _ptDipoleFieldGradientD;
@@ -883,11 +1161,29 @@ protected:
     int _maxPTOrder;
     std::vector<double>  _extrapolationCoefficients;
     std::vector<double>  _extPartCoefficients;
+
+    /*
+     * For the TCG polarization types, the derivatives of the polarization energy with respect to the
+     * moments E.alpha.(T.alpha)^n.E; these weight the µ_(n) in the response dipoles, whose interaction
+     * with the fixed multipoles gives the TCG energy and forces.  _tcgResponseDipole holds those
+     * response dipoles while _inducedDipole holds the TCG dipoles themselves.
+     */
+    std::vector<double>  _tcgCoefficients;
+    std::vector<Vec3>    _tcgResponseDipole;
     double  _mutualInducedDipoleEpsilon;
     double  _mutualInducedDipoleTargetEpsilon;
     double  _polarSOR;
     double  _debye;
 
+    /*
+     * Converged mutual induced dipoles of the most recent configurations, oldest first, and the
+     * positions belonging to the newest entry.  Used to predict the starting dipoles of the next solve.
+     */
+    std::vector<std::vector<Vec3> > _inducedDipoleHistory;
+    std::vector<Vec3> _inducedDipoleHistoryPositions;
+    unsigned int _maxInducedDipoleHistory;
+    double _maxPredictorDisplacement;
+
     /**
      * Helper constructor method to centralize initialization of objects.
      *
@@ -926,6 +1222,16 @@ protected:
      */
     virtual void calculateFixedMultipoleField(const vector<MultipoleParticleData>& particleData);
 
+    /**
+     * Calculate the gradient of the fixed multipole field at each particle, with the same scaling and
+     * damping as calculateFixedMultipoleField().  This is only needed on request, so it is not part of
+     * the setup.
+     *
+     * @param particleData vector of particle data
+     * @param gradients    output field gradient at each particle, six elements per particle indexed by QuadrupoleIndices
+     */
+    virtual void calculateFixedMultipoleFieldGradient(const std::vector<MultipoleParticleData>& particleData, std::vector<double>& gradients);
+
     /**
      * Set flag indicating if mutual induced dipoles are converged.
      * 
@@ -950,14 +1256,6 @@ protected:
      */
     void setMutualInducedDipoleEpsilon(double epsilon);
 
-    /**
-     * Setup scale factors given covalent info.
-     *
-     * @param  multipoleAtomCovalentInfo vector of vectors containing the covalent info
-     *
-     */
-    void setupScaleMaps(const std::vector< std::vector< std::vector<int> > >& multipoleAtomCovalentInfo);
-
     /**
      * Get multipole scale factor for particleI & particleJ
      * 
@@ -976,9 +1274,9 @@ protected:
      * @param  particleJ           index of particleJ whose scale factor is to be retrieved
      * @param  scaleType           scale type (D_SCALE, P_SCALE, M_SCAL)
      *
-     * @return array of scaleFactors 
+     * @param  scaleFactors        output array of LAST_SCALE_TYPE_INDEX scale factors
      */
-    void getMultipoleScaleFactors(unsigned int particleI, unsigned int particleJ, std::vector<double>& scaleFactors) const;
+    void getMultipoleScaleFactors(unsigned int particleI, unsigned int particleJ, double* scaleFactors) const;
 
     /**
      * Get p- and d-scale factors for particleI & particleJ ixn
@@ -993,13 +1291,17 @@ protected:
     /**
      * Calculate damped powers of 1/r.
      *
-     * @param  particleI           index of particleI 
-     * @param  particleJ           index of particleJ
-     * @param  dScale              output d-scale factor
-     * @param  pScale              output p-scale factor
+     * @param  dampI               damping factor of particle I
+     * @param  dampJ               damping factor of particle J
+     * @param  pscale              p-scale factor for the pair
+     * @param  tholeI              Thole factor of particle I
+     * @param  tholeJ              Thole factor of particle J
+     * @param  r                   distance between the particles
+     * @param  numValues           number of powers to compute (2 to 5)
+     * @param  rrI                 output damped 1/r^3, 3/r^5, 15/r^7, 105/r^9, 945/r^11
      */
     void getAndScaleInverseRs(double dampI, double dampJ, double pscale, double tholeI, double tholeJ,
-                              double r, std::vector<double>& rrI) const;
+                              double r, int numValues, double* rrI) const;
 
     /**
      * Check if multipoles at chiral site should be inverted.
@@ -1117,6 +1419,18 @@ protected:
     virtual void calculateFixedMultipoleFieldPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
                                                      double dScale, double pScale);
 
+    /**
+     * Calculate the gradient of the field at particle I due fixed multipoles at particle J and vice versa.
+     *
+     * @param particleI               positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle I
+     * @param particleJ               positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle J
+     * @param dScale                  d-scale value for i-j interaction
+     * @param pScale                  p-scale value for i-j interaction
+     * @param gradients               field gradients to add to, six elements per particle indexed by QuadrupoleIndices
+     */
+    virtual void calculateFixedMultipoleFieldGradientPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
+                                                             double dScale, double pScale, std::vector<double>& gradients) const;
+
     /**
      * Initialize induced dipoles
      *
@@ -1159,6 +1473,53 @@ protected:
      */
     virtual void calculateInducedDipoleFields(const std::vector<MultipoleParticleData>& particleData,
                                               std::vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleFields);
+    /**
+     * Get whether the polarization type builds the induced dipoles from perturbation theory
+     * dipoles µ_(n) = (alpha.T)^n µ_(0), whose pair interactions then contribute to the forces.
+     *
+     * @return true for the Extrapolated and TCG polarization types
+     */
+    bool usesPerturbationDipoles() const;
+
+    /**
+     * Get the weight of each µ_(l) T µ_(m) force contribution, indexed by l+m+1.
+     *
+     * @return the extrapolation or TCG coefficients
+     */
+    const std::vector<double>& getPerturbationCoefficients() const;
+
+    /**
+     * Add the µ_(l) T µ_(m) force and torque contributions of the perturbation theory dipoles.
+     *
+     * @param particleData      vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param torques           output torques
+     * @param forces            output forces
+     */
+    void addPerturbationDipoleForces(const std::vector<MultipoleParticleData>& particleData,
+                                     std::vector<OpenMM::Vec3>& torques, std::vector<OpenMM::Vec3>& forces) const;
+
+    /**
+     * Calculate the perturbation theory dipoles µ_(0) .. µ_(numOrders-1), starting from the
+     * direct dipoles, and store them together with their fields and field gradients.
+     *
+     * @param particleData              vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param updateInducedDipoleFields vector of UpdateInducedDipoleFieldStruct containing input induced dipoles and output fields
+     * @param numOrders                 number of dipoles to generate
+     */
+    void calculatePerturbationDipoles(const std::vector<MultipoleParticleData>& particleData,
+                                      std::vector<UpdateInducedDipoleFieldStruct>& calculateInducedDipoleField, int numOrders);
+
+    /**
+     * Calculate induced dipoles by one or two truncated conjugate gradient iterations, started from
+     * the direct dipoles and preconditioned by the polarizabilities.  The energy is written as a function
+     * of the moments E.alpha.(T.alpha)^n.E, which gives analytic forces with a fixed number of field evaluations.
+     *
+     * @param particleData              vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param updateInducedDipoleFields vector of UpdateInducedDipoleFieldStruct containing input induced dipoles and output fields
+     */
+    void convergeInduceDipolesByTCG(const std::vector<MultipoleParticleData>& particleData,
+                                    std::vector<UpdateInducedDipoleFieldStruct>& calculateInducedDipoleField);
+
     /**
      * Calculated induced dipoles using extrapolated perturbation theory.
      *
@@ -1183,14 +1544,36 @@ protected:
      */
     void convergeInduceDipolesByDIIS(const std::vector<MultipoleParticleData>& particleData,
                                      std::vector<UpdateInducedDipoleFieldStruct>& calculateInducedDipoleField);
-    
+
     /**
-     * Use DIIS to compute the weighting coefficients for the new induced dipoles.
+     * Converge induced dipoles with the conjugate gradient method, using the polarizability of
+     * each site as preconditioner.  The solver restarts from the true residual whenever the
+     * recurrence says it has converged, so the final dipoles and fields are consistent.
      * 
-     * @param prevErrors    the vector of errors from previous iterations
-     * @param coefficients  the coefficients will be stored into this
+     * @param particleData              vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param updateInducedDipoleFields vector of UpdateInducedDipoleFieldStruct containing input induced dipoles and output fields
+     */
+    void convergeInduceDipolesByPCG(const std::vector<MultipoleParticleData>& particleData,
+                                    std::vector<UpdateInducedDipoleFieldStruct>& calculateInducedDipoleField);
+
+    /**
+     * Replace the starting induced dipoles by an always stable predictor-corrector (ASPC)
+     * extrapolation of the dipoles converged for previous configurations.  The history is
+     * discarded if some particle has moved further than a molecular dynamics step could take it.
+     *
+     * @param particleData              vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     *
+     * @return true if the starting dipoles were predicted from the history
+     */
+    bool predictInducedDipoles(const std::vector<MultipoleParticleData>& particleData);
+
+    /**
+     * Add the converged induced dipoles to the history used by predictInducedDipoles(); a
+     * repeated evaluation at the same positions replaces the newest entry instead.
+     *
+     * @param particleData              vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
      */
-    void computeDIISCoefficients(const std::vector<std::vector<Vec3> >& prevErrors, std::vector<double>& coefficients) const;
+    void recordInducedDipoleHistory(const std::vector<MultipoleParticleData>& particleData);
 
     /**
      * Update fields due to induced dipoles for each particle.
@@ -1269,7 +1652,7 @@ protected:
      * @param torque            vector of particle torques to be updated
      */
     double calculateElectrostaticPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleK,
-                                         const std::vector<double>& scalingFactors, std::vector<OpenMM::Vec3>& forces, std::vector<Vec3>& torque) const;
+                                         const double* scalingFactors, std::vector<OpenMM::Vec3>& forces, std::vector<Vec3>& torque) const;
 
     /**
      * Map particle torque to force.
@@ -1356,15 +1739,66 @@ protected:
     void copyVec3Vector(const std::vector<OpenMM::Vec3>& inputVector, std::vector<OpenMM::Vec3>& outputVector) const;
 
     /**
-     * Calculate potential at grid point due to a particle
+     * Calculate the potential at a point due to the multipoles of a particle, given the radial
+     * functions of the interaction.  For bare Coulomb these are 1/r, 1/r^3, 3/r^5 and 15/r^7.
      *
-     * @param particleData            vector of parameters (charge, labFrame dipoles, quadrupoles, ...) for particles
-     * @param gridPoint               grid point
+     * @param particleI               parameters of the particle, whose dipole is the total (fixed plus induced) one
+     * @param deltaR                  position of the particle relative to the point
+     * @param bn                      radial functions B_0 to B_3 at the distance of deltaR
      *
-     * @return potential at grid point
-     * 
+     * @return potential at the point, without the electric constant
      */
-    double calculateElectrostaticPotentialForParticleGridPoint(const MultipoleParticleData& particleI, const Vec3& gridPoint) const;
+    double calculateMultipolePotentialAtPoint(const MultipoleParticleData& particleI, const Vec3& deltaR, const double* bn) const;
+
+    /**
+     * Calculate the field at a point due to the multipoles of a particle, the gradient of
+     * calculateMultipolePotentialAtPoint() with respect to deltaR.
+     *
+     * @param particleI               parameters of the particle, whose dipole is the total (fixed plus induced) one
+     * @param deltaR                  position of the particle relative to the point
+     * @param bn                      radial functions B_0 to B_4 at the distance of deltaR
+     *
+     * @return field at the point, without the electric constant
+     */
+    Vec3 calculateMultipoleFieldAtPoint(const MultipoleParticleData& particleI, const Vec3& deltaR, const double* bn) const;
+
+    /**
+     * Calculate the gradient of the field at a point due to the multipoles of a particle, the derivative of
+     * calculateMultipoleFieldAtPoint() with respect to the point.
+     *
+     * @param particleI               parameters of the particle, whose dipole is the total (fixed plus induced) one
+     * @param deltaR                  position of the particle relative to the point
+     * @param bn                      radial functions B_0 to B_5 at the distance of deltaR; B_0 is not used
+     * @param gradient                output field gradient at the point, indexed by QuadrupoleIndices, without the electric constant
+     */
+    void calculateMultipoleFieldGradientAtPoint(const MultipoleParticleData& particleI, const Vec3& deltaR, const double* bn, double* gradient) const;
+
+    /**
+     * Compute whatever calculateElectrostaticPotentialAtPoints() needs from the sources alone, so
+     * it is shared by all calls for the same sources.  Nothing is needed by default.
+     *
+     * @param sources                 parameters of the particles, whose dipoles are the total (fixed plus induced) ones
+     */
+    virtual void prepareElectrostaticPotential(const std::vector<MultipoleParticleData>& sources) {};
+
+    /**
+     * Calculate the potential, and optionally the field and its gradient, at each point due to all
+     * particles, without the electric constant.  By default this is the direct sum with bare Coulomb
+     * interactions, with the points divided between the threads.  prepareElectrostaticPotential()
+     * must have been called for the same sources.
+     *
+     * @param sources                 parameters of the particles, whose dipoles are the total (fixed plus induced) ones
+     * @param points                  points at which to compute the potential
+     * @param potential               output potential at each point
+     * @param field                   if not NULL, output field at each point
+     * @param fieldGradient           if not NULL, output field gradient at each point, six elements per point
+     *                                indexed by QuadrupoleIndices
+     */
+    virtual void calculateElectrostaticPotentialAtPoints(const std::vector<MultipoleParticleData>& sources,
+                                                         const std::vector<Vec3>& points,
+                                                         std::vector<double>& potential,
+                                                         std::vector<Vec3>* field,
+                                                         std::vector<double>* fieldGradient);
 
     /**
      * Apply periodic boundary conditions to difference in positions
@@ -1373,6 +1807,14 @@ protected:
      * 
      */
     virtual void getPeriodicDelta(Vec3& deltaR) const {};
+
+    /**
+     * Move particles to the periodic images the nonbonded method works with.  This is called from setup()
+     * right after the particle data is loaded; by default the positions are used as given.
+     *
+     * @param particleData      vector of particle positions and parameters
+     */
+    virtual void selectPeriodicImages(std::vector<MultipoleParticleData>& particleData) {};
 };
 
 
@@ -1441,6 +1883,65 @@ public:
      */
     void setPmeGridDimensions(std::vector<int>& pmeGridDimensions);
 
+    /**
+     * Get the PME B-spline order.
+     *
+     * @return B-spline order
+     */
+    int getPmeOrder() const;
+
+    /**
+     * Set the PME B-spline order (4, 5 or 6).  Call this before setPmeGridDimensions().
+     *
+     * @param order B-spline order
+     */
+    void setPmeOrder(int order);
+
+    /**
+     * Evaluate the reciprocal space sum explicitly over the lattice vectors with indices up to kmax
+     * along each axis instead of with PME.  Calling setPmeGridDimensions() switches back to PME.
+     *
+     * @param kmax the largest lattice index along each axis
+     */
+    void setEwaldKMax(const std::vector<int>& kmax);
+
+    /**
+     * Convolve the grid by multilevel summation instead of with FFTs.  The B-spline order must be
+     * even.  Call this before setPmeGridDimensions().
+     *
+     * @param use whether to use multilevel summation
+     */
+    void setUseMultilevelSummation(bool use);
+
+    /**
+     * Use the influence function that minimizes the aliasing error of the B-spline interpolation
+     * (Hockney and Eastwood) in place of the smooth PME one.  This gives the same accuracy on a
+     * coarser grid.
+     *
+     * @param use whether to use the optimal influence function
+     */
+    void setUseOptimalInfluenceFunction(bool use);
+
+    /**
+     * Evaluate the reciprocal space potential on two grids, the second shifted by half a grid spacing
+     * along every axis, and average the results.  This cancels the leading aliasing errors.
+     *
+     * @param use whether to use interlaced grids
+     */
+    void setUseInterlacedGrids(bool use);
+
+    /**
+     * Treat the system as a slab that is periodic along x and y only, and add the Yeh-Berkowitz correction
+     * for the total dipole moment along z, including the induced dipoles.  The system must be neutral.
+     * Along z the Ewald sum then only needs a box about three times the height of the occupied region,
+     * which is found on every call; the grid keeps the spacing of the dimensions passed to
+     * setPmeGridDimensions() for the full box and shrinks with it.  Call this before
+     * setPmeGridDimensions() and setPeriodicBoxSize().
+     *
+     * @param use whether to use the slab correction
+     */
+    void setUseSlabCorrection(bool use);
+
     /**
      * Set periodic box size.
      *
@@ -1448,11 +1949,27 @@ public:
      */
      void setPeriodicBoxSize(OpenMM::Vec3* vectors);
 
-private:
+    /**
+     * Get the skin added to the cutoff when building the direct space neighbor list.
+     *
+     * @return neighbor list skin
+     */
+    double getNeighborListSkin() const;
+
+    /**
+     * Set the skin added to the cutoff when building the direct space neighbor list.  The list
+     * is only rebuilt once some particle has moved by more than half the skin.
+     *
+     * @param skin neighbor list skin
+     */
+    void setNeighborListSkin(double skin);
+
+protected:
 
-    static const int MPID_PME_ORDER;
     static const double SQRT_PI;
 
+    int _pmeOrder;
+
     double _alphaEwald;
     double _cutoffDistance;
     double _cutoffDistanceSquared;
@@ -1461,12 +1978,22 @@ private:
     Vec3 _periodicBoxVectors[3];
 
     int _totalGridSize;
+    int _pmeGridZStride;
     IntVec _pmeGridDimensions;
 
-    fftpack_t   _fftplan;
+    MPIDReferenceFFT* _fft;
+
+    // Set instead of _fft when the reciprocal space sum is evaluated explicitly; the potential is then
+    // computed in fractional coordinates of the unit cell, i.e. with _pmeGridDimensions set to 1
+    MPIDReferenceEwaldSum* _ewaldSum;
+
+    // Set instead of _fft when the grid is convolved by multilevel summation
+    bool _useMultilevelSummation;
+    MPIDReferenceMSM* _msm;
 
+    // The real PME grid, padded along z so that it can hold its half complex transform in place
     unsigned int _pmeGridSize;
-    t_complex* _pmeGrid;
+    double* _pmeGrid;
  
     std::vector<double> _pmeBsplineModuli[3];
     std::vector<double5> _thetai[3];
@@ -1476,6 +2003,71 @@ private:
     std::vector<double4> _pmeBsplineTheta;
     std::vector<double4> _pmeBsplineDtheta;
 
+    // The influence function of the reciprocal convolution on the half complex grid, with the box and
+    // alpha it was computed for.  |m|^2 and the product of the B-spline moduli are kept for the box
+    // shape, given by _influenceShapeBoxVectors, so isotropic rescaling only redoes the Gaussian.
+    std::vector<double> _influenceFunction;
+    std::vector<double> _influenceM2;
+    std::vector<double> _influenceModuli;
+    Vec3 _influenceBoxVectors[3];
+    Vec3 _influenceShapeBoxVectors[3];
+    double _influenceAlphaEwald;
+
+    // Options of the grid convolution, see setUseOptimalInfluenceFunction() and setUseInterlacedGrids()
+    bool _useOptimalInfluenceFunction;
+    bool _useInterlacedGrids;
+
+    // The B-splines and atom blocks of the shifted grid when interlacing, exchanged with the ones of the
+    // unshifted grid by swapInterlacedGrid(), and the potential from the grid that is not current
+    std::vector<double5> _interlacedThetai[3];
+    std::vector<IntVec> _interlacedIGrid;
+    std::vector<int> _interlacedAtomOrder;
+    std::vector<int> _interlacedSpreadBlockStart;
+    std::vector<double> _interlacedPhi;
+
+    // With the slab correction, the box and grid dimensions passed in for the full box.  _periodicBoxVectors
+    // and _pmeGridDimensions are those shortened along z by selectPeriodicImages().
+    bool _useSlabCorrection;
+    Vec3 _slabBoxVectors[3];
+    IntVec _slabGridDimensions;
+
+    // The convolved density of the sources of the electrostatic potential on each grid, kept by
+    // prepareElectrostaticPotential() so it can be interpolated at any number of points
+    std::vector<double> _potentialGrid[2];
+
+    // _gridWrap[d][i] is i modulo the grid size along d, for i < size+_pmeOrder
+    std::vector<int> _gridWrap[3];
+
+    // The atoms sorted by the block of x planes their stencil starts in; the atoms of block b are
+    // _atomOrder[_spreadBlockStart[b]] to _atomOrder[_spreadBlockStart[b+1]-1].
+    std::vector<int> _atomOrder;
+    std::vector<int> _spreadBlockStart;
+    std::vector<int> _spreadBlockCursor;
+
+    /**
+     * A direct space pair (particleI < particleJ) within the cutoff plus skin; scaleEntry indexes
+     * the covalent scale table, or is -1 if the pair is not scaled.
+     */
+    struct NeighborPair {
+        unsigned int particleI;
+        unsigned int particleJ;
+        int scaleEntry;
+    };
+    std::vector<NeighborPair> _neighborList;
+    std::vector<Vec3> _neighborListPositions;
+    Vec3 _neighborListBoxVectors[3];
+    double _neighborListCutoff;
+    double _neighborListSkin;
+
+    /*
+     * Per-thread accumulation buffers for the threaded direct space loops.
+     */
+    std::vector<std::vector<Vec3> > _threadFixedMultipoleField;
+    std::vector<std::vector<UpdateInducedDipoleFieldStruct> > _threadInducedDipoleFields;
+    std::vector<std::vector<Vec3> > _threadForces;
+    std::vector<std::vector<Vec3> > _threadTorques;
+    std::vector<double> _threadEnergy;
+
     /**
      * Resize PME arrays.
      * 
@@ -1495,6 +2087,74 @@ private:
      */
     void getPeriodicDelta(Vec3& deltaR) const;
 
+    /**
+     * Set the box the sums are evaluated in, and the reciprocal box vectors.
+     *
+     * @param vectors    the vectors defining the periodic box
+     */
+    void setActivePeriodicBox(const OpenMM::Vec3* vectors);
+
+    /**
+     * Create the FFT or grid hierarchy, B-spline moduli and wraparound tables for a grid, unless they
+     * are already set up for it.
+     *
+     * @param pmeGridDimensions the grid dimensions
+     */
+    void setActivePmeGridDimensions(const std::vector<int>& pmeGridDimensions);
+
+    /**
+     * With the slab correction, put the occupied region in one piece along z, and fit the box and grid
+     * the sums are evaluated in to its height.
+     *
+     * @param particleData            vector of particle positions and parameters
+     */
+    void selectPeriodicImages(std::vector<MultipoleParticleData>& particleData);
+
+    /**
+     * Add the potential of the slab correction, 4*pi/V times the total dipole moment along z times z, to a
+     * reciprocal space potential in fractional coordinates.
+     *
+     * @param dipoleZ                 total dipole moment along z of the multipoles the potential is from
+     * @param particleData            the particle positions, or NULL to only add the derivatives
+     * @param phi                     the potential, 35 values per particle
+     */
+    void addSlabCorrectionPotential(double dipoleZ, const std::vector<MultipoleParticleData>* particleData, std::vector<double>& phi) const;
+
+    /**
+     * Rebuild the direct space neighbor list if it is missing, the box or cutoff changed, or some
+     * particle has moved by more than half the skin since the list was built.
+     *
+     * @param particleData            vector of particle positions and parameters
+     */
+    void updateNeighborList(const std::vector<MultipoleParticleData>& particleData);
+
+    /**
+     * Get the number of threads used for the direct space loops.
+     *
+     * @return number of threads in the thread pool, or 1 if none was set
+     */
+    int getNumThreads() const;
+
+    /**
+     * Get the block of the neighbor list handled by one thread.
+     *
+     * @param threadIndex             index of the thread
+     * @param numThreads              number of threads the list is split between
+     * @param start                   first pair handled by the thread
+     * @param end                     one past the last pair handled by the thread
+     */
+    void getNeighborListBlock(int threadIndex, int numThreads, unsigned int& start, unsigned int& end) const;
+
+    /**
+     * Get the block of particles handled by one thread when reducing the per-thread buffers.
+     *
+     * @param threadIndex             index of the thread
+     * @param numThreads              number of threads the particles are split between
+     * @param start                   first particle handled by the thread
+     * @param end                     one past the last particle handled by the thread
+     */
+    void getParticleBlock(int threadIndex, int numThreads, unsigned int& start, unsigned int& end) const;
+
     /**
      * Calculate damped inverse distances.
      * 
@@ -1507,7 +2167,7 @@ private:
      */
     void getDampedInverseDistances(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
                                    double dscale, double pscale, double r,
-                                   std::vector<double> &dampedDInverseDistances, std::vector<double> &dampedPInverseDistances) const;
+                                   double dampedDInverseDistances[4], double dampedPInverseDistances[4]) const;
     
     /**
      * Initialize B-spline moduli.
@@ -1525,6 +2185,19 @@ private:
      */
     void calculateFixedMultipoleFieldPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
                                              double dscale, double pscale);
+
+    /**
+     * Calculate direct-space field at site I due fixed multipoles at site J and vice versa,
+     * accumulating into the given field rather than _fixedMultipoleField.
+     * 
+     * @param particleI               positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle I
+     * @param particleJ               positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle J
+     * @param dScale                  d-scale value for i-j interaction
+     * @param pScale                  p-scale value for i-j interaction
+     * @param field                   field to accumulate into
+     */
+    void calculateFixedMultipoleFieldPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
+                                             double dscale, double pscale, std::vector<Vec3>& field) const;
     
     /**
      * Calculate fixed multipole fields.
@@ -1534,20 +2207,75 @@ private:
      */
     void calculateFixedMultipoleField(const vector<MultipoleParticleData>& particleData);
 
+    /**
+     * Calculate the direct space gradient of the field at site I due fixed multipoles at site J and vice versa.
+     *
+     * @param particleI               positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle I
+     * @param particleJ               positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle J
+     * @param dScale                  d-scale value for i-j interaction
+     * @param pScale                  p-scale value for i-j interaction
+     * @param gradients               field gradients to add to, six elements per particle indexed by QuadrupoleIndices
+     */
+    void calculateFixedMultipoleFieldGradientPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
+                                                     double dScale, double pScale, std::vector<double>& gradients) const;
+
+    /**
+     * Calculate the gradient of the fixed multipole field at each particle: the second derivatives of the
+     * reciprocal space potential kept by the last setup, less those of each particle's own multipoles,
+     * plus the direct space pairs of the neighbor list.
+     *
+     * @param particleData vector particle data
+     * @param gradients    output field gradient at each particle, six elements per particle indexed by QuadrupoleIndices
+     */
+    void calculateFixedMultipoleFieldGradient(const std::vector<MultipoleParticleData>& particleData, std::vector<double>& gradients);
+
     /**
      * This is called from computeMPIDBsplines().  It calculates the spline coefficients for a single atom along a single axis.
      * 
-     * @param thetai output spline coefficients
+     * @param thetai output spline coefficients, _pmeOrder entries
      * @param w offset from grid point
      */
-    void computeBSplinePoint(vector<double5> &thetai, double w);
+    void computeBSplinePoint(double5* thetai, double w);
     
     /**
      * Compute bspline coefficients.
      *
      * @param particleData   vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param gridShift      offset of the grid in units of the grid spacing, 0.5 for the second interlaced grid
+     */
+    void computeMPIDBsplines(const std::vector<MultipoleParticleData>& particleData, double gridShift = 0.0);
+
+    /**
+     * Exchange the B-splines and atom blocks of the two interlaced grids.
      */
-    void computeMPIDBsplines(const std::vector<MultipoleParticleData>& particleData);
+    void swapInterlacedGrid();
+
+    /**
+     * Average the potential in _interlacedPhi, from the unshifted grid, into phi.
+     */
+    void averageInterlacedPotential(std::vector<double>& phi);
+
+    /**
+     * Sort the atoms into blocks of x planes of the PME grid, for spreading in parallel.  This is
+     * called from computeMPIDBsplines().
+     */
+    void binAtomsByGridPlane();
+
+    /**
+     * Call spreadAtom for every atom, in parallel where the stencils of the atoms cannot overlap.
+     *
+     * @param spreadAtom     adds the contribution of the atom with the given index to the PME grid
+     */
+    template <class SpreadAtom>
+    void spreadAtomsOntoGrid(const SpreadAtom& spreadAtom);
+
+    /**
+     * Call gatherAtom for every atom, split between the threads.
+     *
+     * @param gatherAtom     interpolates the grid at the atom with the given index
+     */
+    template <class GatherAtom>
+    void gatherAtomsFromGrid(const GatherAtom& gatherAtom);
 
     /**
      * Transform multipoles from cartesian coordinates to fractional coordinates.
@@ -1566,12 +2294,24 @@ private:
      */
     void spreadFixedMultipolesOntoGrid(const vector<MultipoleParticleData>& particleData);
 
+    /**
+     * Recompute the influence function of the reciprocal convolution if the box or alpha changed
+     * since it was last computed.
+     */
+    void updateInfluenceFunction();
+
     /**
      * Perform reciprocal convolution.
      * 
      */
     void performMPIDReciprocalConvolution();
 
+    /**
+     * Turn the spread grid into the potential grid, either by FFT and reciprocal convolution or
+     * by multilevel summation.
+     */
+    void convolvePmeGrid();
+
     /**
      * Compute reciprocal potential due fixed multipoles at each particle site.
      * 
@@ -1584,6 +2324,83 @@ private:
      */
     void computeInducedPotentialFromGrid();
 
+    /**
+     * Compute the reciprocal space potential and its derivatives due to the fixed multipoles at each
+     * particle site, filling _phi, either on the PME grid or with the explicit Ewald sum.
+     *
+     * @param particleData vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     */
+    void computeReciprocalSpaceFixedPotential(const vector<MultipoleParticleData>& particleData);
+
+    /**
+     * Compute the reciprocal space potential and its derivatives due to induced dipoles at each
+     * particle site, filling _phidp, either on the PME grid or with the explicit Ewald sum.
+     *
+     * @param inducedDipoles the induced dipoles
+     */
+    void computeReciprocalSpaceInducedPotential(const std::vector<Vec3>& inducedDipoles);
+
+    /**
+     * Get the coefficients of the multipoles last transformed to fractional coordinates, 20 per
+     * particle, in the order used by MPIDReferenceEwaldSum.
+     *
+     * @param multipoles the coefficients
+     */
+    void getFractionalMultipoleCoefficients(std::vector<double>& multipoles) const;
+
+    /**
+     * Spread the sources on the grid and convolve them, keeping a copy of each grid, or set them
+     * as the multipoles of the explicit Ewald sum.  This relies on the B-splines or phase factors
+     * computed by the last setup for the same positions.
+     *
+     * @param sources     parameters of the particles, whose dipoles are the total (fixed plus induced) ones
+     */
+    void prepareElectrostaticPotential(const std::vector<MultipoleParticleData>& sources);
+
+    /**
+     * Add the reciprocal space potential, and optionally the field and its gradient, at each point,
+     * interpolated from the grids kept by prepareElectrostaticPotential() or from the explicit Ewald sum.
+     *
+     * @param points          points at which to compute the potential
+     * @param potential       the potential at each point is added to the corresponding element
+     * @param field           if not NULL, the field at each point is added to the corresponding element
+     * @param fieldGradient   if not NULL, the field gradient at each point is added to the corresponding six elements
+     */
+    void computeReciprocalSpacePotentialAtPoints(const std::vector<Vec3>& points, std::vector<double>& potential,
+                                                 std::vector<Vec3>* field, std::vector<double>* fieldGradient);
+
+    /**
+     * Add the direct space potential, and optionally the field and its gradient, at each point.  The
+     * particles are binned into cells at least a cutoff wide and the points are sorted by cell, so each
+     * point only visits the particles in the neighboring cells and the threads work on compact groups of points.
+     *
+     * @param sources         parameters of the particles, whose dipoles are the total (fixed plus induced) ones
+     * @param points          points at which to compute the potential
+     * @param potential       the potential at each point is added to the corresponding element
+     * @param field           if not NULL, the field at each point is added to the corresponding element
+     * @param fieldGradient   if not NULL, the field gradient at each point is added to the corresponding six elements
+     */
+    void computeDirectSpacePotentialAtPoints(const std::vector<MultipoleParticleData>& sources,
+                                             const std::vector<Vec3>& points, std::vector<double>& potential,
+                                             std::vector<Vec3>* field, std::vector<double>* fieldGradient) const;
+
+    /**
+     * Calculate the Ewald potential, and optionally the field and its gradient, at each point due to
+     * all particles, as the sum of the direct and reciprocal space parts.
+     *
+     * @param sources                 parameters of the particles, whose dipoles are the total (fixed plus induced) ones
+     * @param points                  points at which to compute the potential
+     * @param potential               output potential at each point
+     * @param field                   if not NULL, output field at each point
+     * @param fieldGradient           if not NULL, output field gradient at each point, six elements per point
+     *                                indexed by QuadrupoleIndices
+     */
+    void calculateElectrostaticPotentialAtPoints(const std::vector<MultipoleParticleData>& sources,
+                                                 const std::vector<Vec3>& points,
+                                                 std::vector<double>& potential,
+                                                 std::vector<Vec3>* field,
+                                                 std::vector<double>* fieldGradient);
+
     /**
      * Calculate reciprocal space energy and force due to fixed multipoles.
      * 
@@ -1631,10 +2448,11 @@ private:
      * 
      * @param particleI                 positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle I
      * @param particleJ                 positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle J
+     * @param scaleEntry                the pair's entry in the covalent scale table, or -1 if it is not scaled
      * @param updateInducedDipoleFields vector of UpdateInducedDipoleFieldStruct containing input induced dipoles and output fields
      */
     void calculateDirectInducedDipolePairIxns(const MultipoleParticleData& particleI,
-                                              const MultipoleParticleData& particleJ,
+                                              const MultipoleParticleData& particleJ, int scaleEntry,
                                               std::vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleFields);
 
     /**
@@ -1693,9 +2511,25 @@ private:
      * @param torques           vector of particle torques to be updated
      */
     double calculatePmeDirectElectrostaticPairIxn(const MultipoleParticleData& particleI, const MultipoleParticleData& particleJ,
-                                                  const std::vector<double>& scalingFactors,
+                                                  const double* scalingFactors,
                                                   std::vector<Vec3>& forces, std::vector<Vec3>& torques) const;
 
+    /**
+     * Calculate the direct space electrostatic interactions of a contiguous block of the neighbor list.
+     * Subclasses may override this to evaluate several pairs at once.
+     *
+     * @param particleData      vector of parameters (charge, labFrame dipoles, quadrupoles, ...) for particles
+     * @param start             index of the first neighbor list entry
+     * @param end               one past the index of the last neighbor list entry
+     * @param forces            vector of particle forces to be updated
+     * @param torques           vector of particle torques to be updated
+     *
+     * @return energy
+     */
+    virtual double calculatePmeDirectElectrostaticBlock(const std::vector<MultipoleParticleData>& particleData,
+                                                        unsigned int start, unsigned int end,
+                                                        std::vector<Vec3>& forces, std::vector<Vec3>& torques);
+
     /**
      * Calculate reciprocal space energy/force/torque for dipole interaction.
      * 
@@ -1724,6 +2558,140 @@ private:
 
 };
 
+class MPIDReferenceFmmForce : public MPIDReferenceForce {
+
+public:
+
+    /**
+     * Constructor
+     * 
+     */
+    MPIDReferenceFmmForce();
+ 
+    /**
+     * Destructor
+     * 
+     */
+    ~MPIDReferenceFmmForce() {};
+
+    /**
+     * Set the parameters of the fast multipole method.
+     *
+     * @param expansionOrder  the order of the Taylor expansions, at least 4
+     * @param treeDepth       the number of times the system is divided along each axis, or 0 to
+     *                        choose it from the number of particles
+     */
+    void setFmmParameters(int expansionOrder, int treeDepth);
+
+    /**
+     * Get the order of the Taylor expansions.
+     *
+     * @return expansion order
+     */
+    int getFmmExpansionOrder() const;
+
+    /**
+     * Get the requested tree depth.
+     *
+     * @return tree depth, or 0 if it is chosen automatically
+     */
+    int getFmmTreeDepth() const;
+
+    /**
+     * Get the level of the leaves in the tree built by the last evaluation, after the depth was
+     * reduced to keep the leaves wide enough for the damping and scaling.
+     *
+     * @return leaf level, or 0 before the first evaluation
+     */
+    int getFmmLeafLevel() const;
+
+protected:
+
+    /**
+     * Get the smallest leaf width for which every covalently scaled pair is a near pair, and so is
+     * every pair whose Thole damping changes the interaction by more than the target error of the
+     * expansions, so that the far field can be treated as plain Coulomb interactions.
+     *
+     * @param particleData      vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     *
+     * @return minimum leaf width
+     */
+    double getMinimumLeafWidth(const std::vector<MultipoleParticleData>& particleData) const;
+
+    /**
+     * Load the permanent multipoles in the layout of MPIDReferenceFMM.
+     *
+     * @param particleData      vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param multipoles        output multipoles, 20 per particle
+     */
+    void loadFmmMultipoles(const std::vector<MultipoleParticleData>& particleData, std::vector<double>& multipoles) const;
+
+    /**
+     * Load dipoles in the layout of MPIDReferenceFMM.
+     *
+     * @param dipoles           the dipoles
+     * @param multipoles        output multipoles, 4 per particle
+     */
+    void loadFmmDipoles(const std::vector<Vec3>& dipoles, std::vector<double>& multipoles) const;
+
+    /**
+     * Calculate the torque on the multipoles of a particle in the far field potential.
+     *
+     * @param particleI         positions and parameters (charge, labFrame dipoles, quadrupoles, ...) for particle I
+     * @param dipole            the dipole to use instead of the permanent dipole, e.g. with the induced dipole added
+     * @param phi               the 35 potential derivatives at the particle, as returned by MPIDReferenceFMM
+     *
+     * @return torque
+     */
+    Vec3 calculateFarFieldTorque(const MultipoleParticleData& particleI, const Vec3& dipole, const double* phi) const;
+
+    /**
+     * Sort the particles into the tree, then calculate the fixed multipole fields from the near
+     * pairs and the far field.
+     *
+     * @param particleData      vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     */
+    void calculateFixedMultipoleField(const std::vector<MultipoleParticleData>& particleData);
+
+    /**
+     * Calculate the gradient of the fixed multipole field at each particle from the near pairs and the
+     * far field, using the tree built by the last setup.
+     *
+     * @param particleData      vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param gradients         output field gradient at each particle, six elements per particle indexed by QuadrupoleIndices
+     */
+    void calculateFixedMultipoleFieldGradient(const std::vector<MultipoleParticleData>& particleData, std::vector<double>& gradients);
+
+    /**
+     * Calculate the induced dipole fields from the near pairs and the far field.
+     *
+     * @param particleData              vector of particle positions and parameters (charge, labFrame dipoles, quadrupoles, ...)
+     * @param updateInducedDipoleFields vector of UpdateInducedDipoleFieldStruct containing input induced dipoles and output fields
+     */
+    void calculateInducedDipoleFields(const std::vector<MultipoleParticleData>& particleData,
+                                      std::vector<UpdateInducedDipoleFieldStruct>& updateInducedDipoleFields);
+
+    /**
+     * Calculate electrostatic forces from the near pairs and the far field.
+     * 
+     * @param particleData            vector of parameters (charge, labFrame dipoles, quadrupoles, ...) for particles
+     * @param torques                 output torques
+     * @param forces                  output forces 
+     *
+     * @return energy
+     */
+    double calculateElectrostatic(const std::vector<MultipoleParticleData>& particleData, 
+                                  std::vector<OpenMM::Vec3>& torques,
+                                  std::vector<OpenMM::Vec3>& forces);
+
+private:
+
+    // The tree is rebuilt by calculateFixedMultipoleField(), which every evaluation calls first.
+    MPIDReferenceFMM _fmm;
+    std::vector<double> _fmmMultipoles;
+    std::vector<double> _fmmPotential;
+};
+
 } // namespace OpenMM
 
 #endif // _MPIDReferenceForce___
@@ -0,0 +1,457 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "MPIDReferenceMSM.h"
+#include "openmm/OpenMMException.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <sstream>
+
+using std::complex;
+using std::vector;
+using OpenMM::OpenMMException;
+using OpenMM::ThreadPool;
+using OpenMM::Vec3;
+
+namespace {
+
+// Period used to compute the deconvolution filter; the filter decays geometrically, so this is
+// effectively the infinite lattice.
+
+const int FILTER_PERIOD = 256;
+const double FILTER_TOLERANCE = 1e-10;
+
+/**
+ * Run task(threadIndex, numThreads) on every thread of the pool, or on the calling thread if there is none.
+ */
+template <class Task>
+void runOnThreads(ThreadPool* threads, Task task)
+{
+    if (threads == NULL || threads->getNumThreads() == 1) {
+        task(0, 1);
+        return;
+    }
+    int numThreads = threads->getNumThreads();
+    threads->execute([&] (ThreadPool& pool, int threadIndex) {
+        task(threadIndex, numThreads);
+    });
+    threads->waitForThreads();
+}
+
+inline int wrap(int index, int size)
+{
+    index %= size;
+    return (index < 0 ? index+size : index);
+}
+
+/**
+ * Squared modulus of the Fourier series of the sampled B-spline at the angle theta.
+ */
+double bsplineModulus(const vector<double>& samples, double theta)
+{
+    double sum1 = 0.0, sum2 = 0.0;
+    for (int k = 0; k < (int) samples.size(); k++) {
+        sum1 += samples[k]*cos(theta*k);
+        sum2 += samples[k]*sin(theta*k);
+    }
+    return sum1*sum1 + sum2*sum2;
+}
+
+}
+
+MPIDReferenceMSM::MPIDReferenceMSM(int xsize, int ysize, int zsize, int order) : _order(order), _alphaEwald(0.0), _cutoff(0.0)
+{
+    if (order%2 != 0) {
+        std::stringstream message;
+        message << "Multilevel summation needs an even B-spline order, not " << order << ".";
+        throw OpenMMException(message.str());
+    }
+
+    // Build the hierarchy; a grid that cannot be halved even once would leave all of the work to
+    // the dense top level.
+
+    Level level;
+    level.size[0] = xsize;
+    level.size[1] = ysize;
+    level.size[2] = zsize;
+    _levels.push_back(level);
+    while (true) {
+        const int* size = _levels.back().size;
+        bool canCoarsen = true;
+        for (int ii = 0; ii < 3; ii++)
+            canCoarsen &= (size[ii]%2 == 0 && size[ii]/2 >= 4);
+        if (!canCoarsen)
+            break;
+        for (int ii = 0; ii < 3; ii++)
+            level.size[ii] = size[ii]/2;
+        _levels.push_back(level);
+    }
+    if (_levels.size() < 2) {
+        std::stringstream message;
+        message << "Multilevel summation grid " << xsize << "x" << ysize << "x" << zsize << " cannot be coarsened; use even sizes of at least 8.";
+        throw OpenMMException(message.str());
+    }
+    for (Level& grid : _levels) {
+        int numPoints = grid.size[0]*grid.size[1]*grid.size[2];
+        grid.charge.resize(numPoints);
+        grid.potential.resize(numPoints);
+    }
+
+    // The B-spline of order p at the integers 1..p-1, by the usual recursion.
+
+    vector<double> spline(order+1, 0.0);
+    spline[1] = 1.0;
+    for (int n = 2; n <= order; n++) {
+        vector<double> next(order+1, 0.0);
+        for (int k = 1; k < n; k++)
+            next[k] = (k*spline[k] + (n-k)*spline[k-1])/(n-1);
+        spline = next;
+    }
+    _bsplineSamples.assign(spline.begin()+1, spline.begin()+order);
+
+    // Two-scale relation M_p(x/2) = sum_k 2^(1-p) binomial(p, k) M_p(x-k).
+
+    _restrictionWeights.resize(order+1);
+    double binomial = 1.0;
+    for (int k = 0; k <= order; k++) {
+        _restrictionWeights[k] = binomial*pow(2.0, 1-order);
+        binomial = binomial*(order-k)/(k+1);
+    }
+
+    // The deconvolution filter inverts the sampled B-spline on both the spreading and the
+    // gathering side, so its symbol is 1/|B|^2.
+
+    vector<double> inverseModuli(FILTER_PERIOD);
+    for (int m = 0; m < FILTER_PERIOD; m++)
+        inverseModuli[m] = 1.0/bsplineModulus(_bsplineSamples, 2.0*M_PI*m/FILTER_PERIOD);
+    for (int n = 0; n < FILTER_PERIOD/2; n++) {
+        double sum = 0.0;
+        for (int m = 0; m < FILTER_PERIOD; m++)
+            sum += inverseModuli[m]*cos(2.0*M_PI*m*n/FILTER_PERIOD);
+        sum /= FILTER_PERIOD;
+        if (n > 0 && fabs(sum) < FILTER_TOLERANCE*fabs(_filter[0]))
+            break;
+        _filter.push_back(sum);
+    }
+}
+
+int MPIDReferenceMSM::findLegalDimension(int minimum)
+{
+    int best = -1;
+    for (int top = 4; top <= 7; top++) {
+        int size = 2*top;
+        while (size < minimum)
+            size *= 2;
+        if (best < 0 || size < best)
+            best = size;
+    }
+    return best;
+}
+
+void MPIDReferenceMSM::setBox(const Vec3* periodicBoxVectors, const Vec3* recipBoxVectors, double alphaEwald, double cutoff)
+{
+    bool changed = (alphaEwald != _alphaEwald || cutoff != _cutoff);
+    for (int ii = 0; ii < 3; ii++)
+        changed |= !(periodicBoxVectors[ii] == _periodicBoxVectors[ii]);
+    if (!changed)
+        return;
+    _alphaEwald = alphaEwald;
+    _cutoff = cutoff;
+    for (int ii = 0; ii < 3; ii++) {
+        _periodicBoxVectors[ii] = periodicBoxVectors[ii];
+        _recipBoxVectors[ii] = recipBoxVectors[ii];
+    }
+    for (int level = 0; level < (int) _levels.size()-1; level++)
+        buildShortRangeStencil(level);
+    buildTopLevelStencil();
+}
+
+void MPIDReferenceMSM::buildShortRangeStencil(int levelIndex)
+{
+    Level& level = _levels[levelIndex];
+    const int* size = level.size;
+    double alpha1 = _alphaEwald/(1 << levelIndex);
+    double alpha2 = 0.5*alpha1;
+    double range = 2.0*_cutoff*(1 << levelIndex);
+    int filterWidth = _filter.size()-1;
+
+    // A fractional displacement along an axis is bounded by the Cartesian distance times the
+    // norm of the corresponding column of the reciprocal box matrix.
+
+    int radius[3], width[3], samples[3];
+    for (int dd = 0; dd < 3; dd++) {
+        double columnNorm = sqrt(_recipBoxVectors[0][dd]*_recipBoxVectors[0][dd] + _recipBoxVectors[1][dd]*_recipBoxVectors[1][dd] +
+                                 _recipBoxVectors[2][dd]*_recipBoxVectors[2][dd]);
+        radius[dd] = (int) ceil(range*size[dd]*columnNorm);
+        width[dd] = radius[dd]+filterWidth;
+        samples[dd] = 2*width[dd]+1;
+    }
+
+    // Sample the difference kernel over the stencil widened by the filter.
+
+    vector<double> kernel(samples[0]*samples[1]*samples[2]);
+    double selfValue = 2.0*(alpha1-alpha2)/sqrt(M_PI);
+    for (int ix = 0; ix < samples[0]; ix++)
+        for (int iy = 0; iy < samples[1]; iy++)
+            for (int iz = 0; iz < samples[2]; iz++) {
+                Vec3 delta = _periodicBoxVectors[0]*((ix-width[0])/(double) size[0]) +
+                             _periodicBoxVectors[1]*((iy-width[1])/(double) size[1]) +
+                             _periodicBoxVectors[2]*((iz-width[2])/(double) size[2]);
+                double r = sqrt(delta.dot(delta));
+                kernel[(ix*samples[1]+iy)*samples[2]+iz] = (r == 0.0 ? selfValue : (erf(alpha1*r)-erf(alpha2*r))/r);
+            }
+
+    // Deconvolve one axis at a time, trimming the filter margin off that axis.
+
+    int inSize[3] = {samples[0], samples[1], samples[2]};
+    for (int axis = 0; axis < 3; axis++) {
+        int outSize[3] = {inSize[0], inSize[1], inSize[2]};
+        outSize[axis] = 2*radius[axis]+1;
+        vector<double> filtered(outSize[0]*outSize[1]*outSize[2], 0.0);
+        int inStride[3] = {inSize[1]*inSize[2], inSize[2], 1};
+        int outStride[3] = {outSize[1]*outSize[2], outSize[2], 1};
+        for (int ix = 0; ix < outSize[0]; ix++)
+            for (int iy = 0; iy < outSize[1]; iy++)
+                for (int iz = 0; iz < outSize[2]; iz++) {
+                    int index[3] = {ix, iy, iz};
+                    int base = 0;
+                    for (int dd = 0; dd < 3; dd++)
+                        base += (dd == axis ? index[dd]+filterWidth : index[dd])*inStride[dd];
+                    double sum = _filter[0]*kernel[base];
+                    for (int tt = 1; tt <= filterWidth; tt++)
+                        sum += _filter[tt]*(kernel[base+tt*inStride[axis]] + kernel[base-tt*inStride[axis]]);
+                    filtered[ix*outStride[0]+iy*outStride[1]+iz] = sum;
+                }
+        kernel.swap(filtered);
+        for (int dd = 0; dd < 3; dd++)
+            inSize[dd] = outSize[dd];
+    }
+
+    // Fold the stencil onto the periodic grid; offsets that are congruent modulo the grid size
+    // are periodic images of each other.
+
+    vector<double> folded(size[0]*size[1]*size[2], 0.0);
+    vector<bool> used(folded.size(), false);
+    for (int ix = 0; ix < inSize[0]; ix++)
+        for (int iy = 0; iy < inSize[1]; iy++)
+            for (int iz = 0; iz < inSize[2]; iz++) {
+                int index = (wrap(ix-radius[0], size[0])*size[1] + wrap(iy-radius[1], size[1]))*size[2] + wrap(iz-radius[2], size[2]);
+                folded[index] += kernel[(ix*inSize[1]+iy)*inSize[2]+iz];
+                used[index] = true;
+            }
+    level.stencil.clear();
+    for (int ix = 0; ix < size[0]; ix++)
+        for (int iy = 0; iy < size[1]; iy++)
+            for (int iz = 0; iz < size[2]; iz++) {
+                int index = (ix*size[1]+iy)*size[2]+iz;
+                if (!used[index])
+                    continue;
+                StencilEntry entry;
+                entry.offset[0] = ix;
+                entry.offset[1] = iy;
+                entry.offset[2] = iz;
+                entry.value = folded[index];
+                level.stencil.push_back(entry);
+            }
+}
+
+void MPIDReferenceMSM::buildTopLevelStencil()
+{
+    // The remainder erf(alpha_L r)/r is periodic and smooth enough for the coarsest grid, where
+    // it is applied as a dense table: the PME influence function of that grid, transformed back
+    // to real space.
+
+    Level& level = _levels.back();
+    const int* size = level.size;
+    double alphaTop = _alphaEwald/(1 << (_levels.size()-1));
+    double volume = _periodicBoxVectors[0][0]*_periodicBoxVectors[1][1]*_periodicBoxVectors[2][2];
+    double expFactor = M_PI*M_PI/(alphaTop*alphaTop);
+    vector<double> moduli[3];
+    for (int dd = 0; dd < 3; dd++) {
+        moduli[dd].resize(size[dd]);
+        for (int m = 0; m < size[dd]; m++)
+            moduli[dd][m] = bsplineModulus(_bsplineSamples, 2.0*M_PI*m/size[dd]);
+    }
+    int numPoints = size[0]*size[1]*size[2];
+    vector<complex<double> > table(numPoints, 0.0);
+    for (int mx = 0; mx < size[0]; mx++)
+        for (int my = 0; my < size[1]; my++)
+            for (int mz = 0; mz < size[2]; mz++) {
+                if (mx == 0 && my == 0 && mz == 0)
+                    continue;
+                int kx = (mx <= size[0]/2 ? mx : mx-size[0]);
+                int ky = (my <= size[1]/2 ? my : my-size[1]);
+                int kz = (mz <= size[2]/2 ? mz : mz-size[2]);
+                double mhx = kx*_recipBoxVectors[0][0];
+                double mhy = kx*_recipBoxVectors[1][0]+ky*_recipBoxVectors[1][1];
+                double mhz = kx*_recipBoxVectors[2][0]+ky*_recipBoxVectors[2][1]+kz*_recipBoxVectors[2][2];
+                double m2 = mhx*mhx+mhy*mhy+mhz*mhz;
+                table[(mx*size[1]+my)*size[2]+mz] = exp(-expFactor*m2)/(M_PI*volume*m2*moduli[0][mx]*moduli[1][my]*moduli[2][mz]);
+            }
+
+    // inverse transform, one axis at a time
+
+    int stride[3] = {size[1]*size[2], size[2], 1};
+    for (int axis = 0; axis < 3; axis++) {
+        vector<complex<double> > line(size[axis]);
+        for (int ii = 0; ii < numPoints; ii++) {
+            int position = (ii/stride[axis])%size[axis];
+            if (position != 0)
+                continue;
+            for (int nn = 0; nn < size[axis]; nn++) {
+                line[nn] = 0.0;
+                for (int m = 0; m < size[axis]; m++)
+                    line[nn] += table[ii+m*stride[axis]]*std::polar(1.0, 2.0*M_PI*m*nn/size[axis]);
+            }
+            for (int nn = 0; nn < size[axis]; nn++)
+                table[ii+nn*stride[axis]] = line[nn];
+        }
+    }
+
+    // The difference kernels of the finer levels have a nonzero mean, which telescopes to
+    // pi/V (1/alpha_L^2 - 1/alpha^2); remove it so the sum matches PME, which has no m = 0 term.
+
+    double mean = M_PI/volume*(1.0/(alphaTop*alphaTop) - 1.0/(_alphaEwald*_alphaEwald));
+    level.stencil.resize(numPoints);
+    for (int ix = 0; ix < size[0]; ix++)
+        for (int iy = 0; iy < size[1]; iy++)
+            for (int iz = 0; iz < size[2]; iz++) {
+                int index = (ix*size[1]+iy)*size[2]+iz;
+                StencilEntry& entry = level.stencil[index];
+                entry.offset[0] = ix;
+                entry.offset[1] = iy;
+                entry.offset[2] = iz;
+                entry.value = table[index].real()-mean;
+            }
+}
+
+void MPIDReferenceMSM::applyStencil(Level& level, ThreadPool* threads) const
+{
+    // Each thread owns a block of x planes of the potential.  The z lines are contiguous, so each
+    // stencil entry becomes two shifted axpy's per line.
+
+    const int* size = level.size;
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        int start = (threadIndex*size[0])/numThreads;
+        int end = ((threadIndex+1)*size[0])/numThreads;
+        std::fill(level.potential.begin()+start*size[1]*size[2], level.potential.begin()+end*size[1]*size[2], 0.0);
+        for (const StencilEntry& entry : level.stencil) {
+            int oz = entry.offset[2];
+            double value = entry.value;
+            for (int gx = start; gx < end; gx++) {
+                int sx = wrap(gx-entry.offset[0], size[0]);
+                for (int gy = 0; gy < size[1]; gy++) {
+                    int sy = wrap(gy-entry.offset[1], size[1]);
+                    const double* charge = &level.charge[(sx*size[1]+sy)*size[2]];
+                    double* potential = &level.potential[(gx*size[1]+gy)*size[2]];
+                    for (int gz = 0; gz < oz; gz++)
+                        potential[gz] += value*charge[gz-oz+size[2]];
+                    for (int gz = oz; gz < size[2]; gz++)
+                        potential[gz] += value*charge[gz-oz];
+                }
+            }
+        }
+    });
+}
+
+void MPIDReferenceMSM::restrictCharges(const Level& fine, Level& coarse, ThreadPool* threads) const
+{
+    const int* fineSize = fine.size;
+    const int* coarseSize = coarse.size;
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        int start = (threadIndex*coarseSize[0])/numThreads;
+        int end = ((threadIndex+1)*coarseSize[0])/numThreads;
+        for (int cx = start; cx < end; cx++)
+            for (int cy = 0; cy < coarseSize[1]; cy++)
+                for (int cz = 0; cz < coarseSize[2]; cz++) {
+                    double sum = 0.0;
+                    for (int kx = 0; kx <= _order; kx++) {
+                        int fx = wrap(2*cx+kx, fineSize[0]);
+                        for (int ky = 0; ky <= _order; ky++) {
+                            int fy = wrap(2*cy+ky, fineSize[1]);
+                            const double* charge = &fine.charge[(fx*fineSize[1]+fy)*fineSize[2]];
+                            double weightXY = _restrictionWeights[kx]*_restrictionWeights[ky];
+                            for (int kz = 0; kz <= _order; kz++)
+                                sum += weightXY*_restrictionWeights[kz]*charge[wrap(2*cz+kz, fineSize[2])];
+                        }
+                    }
+                    coarse.charge[(cx*coarseSize[1]+cy)*coarseSize[2]+cz] = sum;
+                }
+    });
+}
+
+void MPIDReferenceMSM::prolongatePotential(const Level& coarse, Level& fine, ThreadPool* threads) const
+{
+    // The transpose of the restriction: fine point g collects coarse point G with weight J_k
+    // whenever 2G+k is g modulo the fine grid size.  The fine sizes are even, so only k of the
+    // parity of g contribute.
+
+    const int* fineSize = fine.size;
+    const int* coarseSize = coarse.size;
+    runOnThreads(threads, [&] (int threadIndex, int numThreads) {
+        int start = (threadIndex*fineSize[0])/numThreads;
+        int end = ((threadIndex+1)*fineSize[0])/numThreads;
+        for (int fx = start; fx < end; fx++)
+            for (int fy = 0; fy < fineSize[1]; fy++)
+                for (int fz = 0; fz < fineSize[2]; fz++) {
+                    double sum = 0.0;
+                    for (int kx = fx%2; kx <= _order; kx += 2) {
+                        int cx = wrap(fx-kx, fineSize[0])/2;
+                        for (int ky = fy%2; ky <= _order; ky += 2) {
+                            int cy = wrap(fy-ky, fineSize[1])/2;
+                            const double* potential = &coarse.potential[(cx*coarseSize[1]+cy)*coarseSize[2]];
+                            double weightXY = _restrictionWeights[kx]*_restrictionWeights[ky];
+                            for (int kz = fz%2; kz <= _order; kz += 2)
+                                sum += weightXY*_restrictionWeights[kz]*potential[wrap(fz-kz, fineSize[2])/2];
+                        }
+                    }
+                    fine.potential[(fx*fineSize[1]+fy)*fineSize[2]+fz] += sum;
+                }
+    });
+}
+
+void MPIDReferenceMSM::convolve(double* grid, int zStride, ThreadPool* threads)
+{
+    Level& finest = _levels[0];
+    const int* size = finest.size;
+    for (int ix = 0; ix < size[0]; ix++)
+        for (int iy = 0; iy < size[1]; iy++)
+            std::copy(grid+(ix*size[1]+iy)*zStride, grid+(ix*size[1]+iy)*zStride+size[2], &finest.charge[(ix*size[1]+iy)*size[2]]);
+
+    // Restrict the charges down the hierarchy, apply every level's stencil, then add the
+    // coarse potentials back up.
+
+    int numLevels = _levels.size();
+    for (int level = 0; level < numLevels-1; level++)
+        restrictCharges(_levels[level], _levels[level+1], threads);
+    for (int level = 0; level < numLevels; level++)
+        applyStencil(_levels[level], threads);
+    for (int level = numLevels-2; level >= 0; level--)
+        prolongatePotential(_levels[level+1], _levels[level], threads);
+
+    for (int ix = 0; ix < size[0]; ix++)
+        for (int iy = 0; iy < size[1]; iy++)
+            std::copy(&finest.potential[(ix*size[1]+iy)*size[2]], &finest.potential[(ix*size[1]+iy)*size[2]]+size[2], grid+(ix*size[1]+iy)*zStride);
+}
@@ -0,0 +1,145 @@
+/* Portions copyright (c) 2006-2015 Stanford University and Simbios.
+ * Contributors: Pande Group
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __MPIDReferenceMSM_H__
+#define __MPIDReferenceMSM_H__
+
+#include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
+#include <vector>
+
+/**
+ * Multilevel summation of the reciprocal space convolution.
+ *
+ * This replaces the FFT, influence function and inverse FFT of PME.  It takes the same spread
+ * grid and returns the same potential grid, so B-spline spreading and gathering and the
+ * fractional coordinate transforms are shared with PME.  The smooth Ewald kernel erf(alpha r)/r is
+ * split as
+ *
+ *     erf(alpha r)/r = sum_l [erf(alpha_l r) - erf(alpha_(l+1) r)]/r + erf(alpha_L r)/r,   alpha_l = alpha/2^l
+ *
+ * Level l handles the l-th difference on a grid coarsened l times.  Each difference is short
+ * ranged and its range doubles with the grid spacing, so every level applies a local stencil of
+ * the same size in grid points.  Charges are restricted to the coarser grids and potentials
+ * prolongated back using the two-scale relation of the B-splines.  The top level is a grid of a
+ * few points per side, where the periodic remainder is applied as a dense table.  The cost is
+ * linear in the number of grid points and needs no global transforms.
+ *
+ * The stencils are the kernel samples deconvolved by the B-spline interpolation filter, the real
+ * space counterpart of dividing by the B-spline moduli in PME.  This needs an even order, as the
+ * sampled B-splines of odd order are not invertible.
+ */
+class MPIDReferenceMSM {
+
+public:
+
+    /**
+     * Create the grid hierarchy for a finest grid of the given size.  Each dimension is halved
+     * until one of them becomes odd or would drop below four points, so the dimensions should
+     * contain a few factors of 2; see findLegalDimension().
+     *
+     * @param xsize   grid size along x
+     * @param ysize   grid size along y
+     * @param zsize   grid size along z
+     * @param order   the B-spline order, which must be even
+     */
+    MPIDReferenceMSM(int xsize, int ysize, int zsize, int order);
+
+    /**
+     * Get the smallest grid size at least as large as the one requested that can be coarsened
+     * at least once and ends on a top level of four to seven points, i.e. t*2^k with t in 4..7
+     * and k >= 1.
+     *
+     * @param minimum   the smallest acceptable size
+     */
+    static int findLegalDimension(int minimum);
+
+    /**
+     * Get the number of grid levels, including the top one.
+     */
+    int getNumLevels() const {
+        return _levels.size();
+    }
+
+    /**
+     * Set the periodic box, the Ewald separation parameter and the direct space cutoff.  The
+     * stencils are only rebuilt if one of them changed.  The cutoff sets the range of the
+     * finest stencil: the first difference kernel decays like erfc(alpha r/2)/r, which matches
+     * the error of the direct space sum at twice the cutoff.
+     *
+     * @param periodicBoxVectors   the periodic box vectors
+     * @param recipBoxVectors      the reciprocal box vectors
+     * @param alphaEwald           the Ewald separation parameter
+     * @param cutoff               the direct space cutoff
+     */
+    void setBox(const OpenMM::Vec3* periodicBoxVectors, const OpenMM::Vec3* recipBoxVectors, double alphaEwald, double cutoff);
+
+    /**
+     * Convolve a spread grid with the reciprocal space kernel, in place.
+     *
+     * @param grid      the grid, stored with z fastest and each z line padded to zStride values
+     * @param zStride   the number of values each z line occupies
+     * @param threads   the thread pool to use, or NULL to run on the calling thread
+     */
+    void convolve(double* grid, int zStride, OpenMM::ThreadPool* threads);
+
+private:
+
+    struct StencilEntry {
+        int offset[3];
+        double value;
+    };
+
+    struct Level {
+        int size[3];
+        std::vector<double> charge;
+        std::vector<double> potential;
+        std::vector<StencilEntry> stencil;
+    };
+
+    void buildShortRangeStencil(int level);
+    void buildTopLevelStencil();
+    void applyStencil(Level& level, OpenMM::ThreadPool* threads) const;
+    void restrictCharges(const Level& fine, Level& coarse, OpenMM::ThreadPool* threads) const;
+    void prolongatePotential(const Level& coarse, Level& fine, OpenMM::ThreadPool* threads) const;
+
+    int _order;
+    std::vector<Level> _levels;
+
+    // two-scale coefficients 2^(1-p) binomial(p, k) of the B-spline of order p
+    std::vector<double> _restrictionWeights;
+
+    // symmetric B-spline deconvolution filter, entries 0 to the truncation width
+    std::vector<double> _filter;
+
+    // sampled B-spline at the integers inside its support, used for the top level moduli
+    std::vector<double> _bsplineSamples;
+
+    OpenMM::Vec3 _periodicBoxVectors[3];
+    OpenMM::Vec3 _recipBoxVectors[3];
+    double _alphaEwald;
+    double _cutoff;
+};
+
+#endif // __MPIDReferenceMSM_H__
@@ -46,6 +46,7 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -1698,6 +1699,995 @@ void test14ScalingPME() {
     ASSERT_EQUAL_TOL(energy, 0.0, 1E-3);
 }
 
+void testChangingBoxPME() {
+    // The reference kernel keeps its PME setup between evaluations, so make sure a change
+    // in the periodic box is picked up and gives the same result as a fresh Context.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    double newBoxEdgeLength = 22*OpenMM::NmPerAngstrom;
+    const double alpha = 3.0;
+    const int grid = 64;
+    const int numAtoms = 6;
+    MPIDForce* forceField1 = new MPIDForce();
+    MPIDForce* forceField2 = new MPIDForce();
+    vector<Vec3> positions;
+    System system1, system2;
+
+    make_waterbox(numAtoms, boxEdgeLength, forceField1,  positions, system1);
+    forceField1->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField1->setPMEParameters(alpha, grid, grid, grid);
+    forceField1->setDefaultTholeWidth(3.0);
+    forceField1->setCutoffDistance(cutoff);
+    forceField1->setPolarizationType(MPIDForce::Extrapolated);
+    system1.addForce(forceField1);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system1, integrator1, Platform::getPlatformByName("Reference"));
+    context1.setPositions(positions);
+    context1.getState(State::Forces | State::Energy);
+    context1.setPeriodicBoxVectors(Vec3(newBoxEdgeLength, 0, 0), Vec3(0, newBoxEdgeLength, 0), Vec3(0, 0, newBoxEdgeLength));
+    State state1 = context1.getState(State::Forces | State::Energy);
+
+    make_waterbox(numAtoms, newBoxEdgeLength, forceField2,  positions, system2);
+    forceField2->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField2->setPMEParameters(alpha, grid, grid, grid);
+    forceField2->setDefaultTholeWidth(3.0);
+    forceField2->setCutoffDistance(cutoff);
+    forceField2->setPolarizationType(MPIDForce::Extrapolated);
+    system2.addForce(forceField2);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system2, integrator2, Platform::getPlatformByName("Reference"));
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1E-6);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(state2.getForces()[n], state1.getForces()[n], 1E-6);
+}
+
+
+void testNeighborListReusePME() {
+    // Moving the atoms by less than half the neighbor list skin reuses the direct space
+    // pair list from the previous step; the result must match a fresh Context.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double alpha = 3.0;
+    const int grid = 64;
+    const int numAtoms = 6;
+    MPIDForce* forceField1 = new MPIDForce();
+    MPIDForce* forceField2 = new MPIDForce();
+    vector<Vec3> positions;
+    System system1, system2;
+
+    make_waterbox(numAtoms, boxEdgeLength, forceField1,  positions, system1);
+    forceField1->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField1->setPMEParameters(alpha, grid, grid, grid);
+    forceField1->setDefaultTholeWidth(3.0);
+    forceField1->setCutoffDistance(cutoff);
+    forceField1->setPolarizationType(MPIDForce::Mutual);
+    forceField1->setMutualInducedTargetEpsilon(1e-8);
+    system1.addForce(forceField1);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system1, integrator1, Platform::getPlatformByName("Reference"));
+    context1.setPositions(positions);
+    context1.getState(State::Forces | State::Energy);
+    for (int n = 3; n < numAtoms; ++n)
+        positions[n] += Vec3(0.01, -0.005, 0.008);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+
+    make_waterbox(numAtoms, boxEdgeLength, forceField2,  positions, system2);
+    for (int n = 3; n < numAtoms; ++n)
+        positions[n] += Vec3(0.01, -0.005, 0.008);
+    forceField2->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField2->setPMEParameters(alpha, grid, grid, grid);
+    forceField2->setDefaultTholeWidth(3.0);
+    forceField2->setCutoffDistance(cutoff);
+    forceField2->setPolarizationType(MPIDForce::Mutual);
+    forceField2->setMutualInducedTargetEpsilon(1e-8);
+    system2.addForce(forceField2);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system2, integrator2, Platform::getPlatformByName("Reference"));
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1E-6);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(state2.getForces()[n], state1.getForces()[n], 1E-6);
+}
+void testEwaldMatchesPME() {
+    // The explicit Ewald sum converges to the same energy and forces as a fine PME grid, including
+    // the induced dipoles, and its own forces and torques are consistent with its energy.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double alpha = 3.0;
+    const int numAtoms = 6;
+    vector<State> states;
+    vector<Vec3> positions;
+    for (int method = MPIDForce::PME; method <= MPIDForce::Ewald; ++method) {
+        MPIDForce* forceField = new MPIDForce();
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        forceField->setNonbondedMethod(static_cast<MPIDForce::NonbondedMethod>(method));
+        if (method == MPIDForce::PME)
+            forceField->setPMEParameters(alpha, 64, 64, 64);
+        else
+            forceField->setPMEParameters(alpha, 12, 12, 12);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedTargetEpsilon(1e-8);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+        if (method == MPIDForce::Ewald) {
+            double reportedAlpha, reportedCutoff;
+            int kx, ky, kz, order;
+            forceField->getPMEParametersInContext(context, reportedAlpha, kx, ky, kz, reportedCutoff, order);
+            ASSERT_EQUAL(12, kx);
+            ASSERT_EQUAL(0, order);
+            check_finite_differences(states.back().getForces(), context, positions);
+        }
+    }
+
+    ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[1].getPotentialEnergy(), 1E-4);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(states[0].getForces()[n], states[1].getForces()[n], 1E-3);
+}
+
+void testMSMMatchesPME() {
+    // Multilevel summation only replaces the FFT convolution, so with a matching grid it must agree
+    // with PME to within the stencil truncation, and its forces must still follow from its energy.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double alpha = 3.0;
+    const int numAtoms = 6;
+    vector<State> states;
+    vector<Vec3> positions;
+    MPIDForce::NonbondedMethod methods[] = {MPIDForce::PME, MPIDForce::MSM};
+    for (MPIDForce::NonbondedMethod method : methods) {
+        MPIDForce* forceField = new MPIDForce();
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        forceField->setNonbondedMethod(method);
+        forceField->setPMEParameters(alpha, 40, 40, 40);
+        forceField->setPmeBSplineOrder(6);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedTargetEpsilon(1e-8);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+        if (method == MPIDForce::MSM)
+            check_finite_differences(states.back().getForces(), context, positions);
+    }
+
+    ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[1].getPotentialEnergy(), 1E-3);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(states[0].getForces()[n], states[1].getForces()[n], 1E-2);
+}
+
+void testInterlacedPMEMatchesEwald() {
+    // On a grid too coarse for smooth PME, compare each PME variant with the explicit Ewald sum with
+    // the same alpha.  The optimal influence function alone must be no worse than smooth PME, and
+    // interlaced grids alone must be clearly better.  Together, they must still reproduce the Ewald
+    // sum and beat either on its own.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    const double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double alpha = 3.0;
+    const int numAtoms = 375;
+    const int numVariants = 5;
+    const bool optimal[numVariants] = {false, false, true, false, true};
+    const bool interlaced[numVariants] = {false, false, false, true, true};
+    vector<State> states;
+    vector<Vec3> positions;
+    for (int variant = 0; variant < numVariants; variant++) {
+        MPIDForce* forceField = new MPIDForce();
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        if (variant == 0) {
+            forceField->setNonbondedMethod(MPIDForce::Ewald);
+            forceField->setPMEParameters(alpha, 15, 15, 15);
+        }
+        else {
+            forceField->setNonbondedMethod(MPIDForce::PME);
+            forceField->setPMEParameters(alpha, 10, 10, 10);
+            forceField->setPmeBSplineOrder(6);
+            forceField->setPmeOptimalInfluenceFunction(optimal[variant]);
+            forceField->setPmeInterlacedGrids(interlaced[variant]);
+        }
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedTargetEpsilon(1e-8);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+    }
+
+    ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[4].getPotentialEnergy(), 2E-3);
+    double error[numVariants] = {0.0}, norm = 0.0;
+    for (int n = 0; n < numAtoms; ++n) {
+        norm += states[0].getForces()[n].dot(states[0].getForces()[n]);
+        for (int i = 1; i < numVariants; i++) {
+            Vec3 delta = states[i].getForces()[n]-states[0].getForces()[n];
+            error[i] += delta.dot(delta);
+        }
+    }
+    ASSERT(error[2] <= error[1]);
+    ASSERT(error[3] < 0.2*error[1]);
+    ASSERT(sqrt(error[4]/norm) < 5E-4);
+    ASSERT(error[4] < 0.1*error[1]);
+    ASSERT(error[4] < error[3]);
+}
+
+void testAutomaticInterlacedPMEParameters() {
+    // With interlaced grids, and again with the optimal influence function as well, the automatic
+    // parameters use a wider grid spacing than for smooth PME.  The coarser grids must still meet
+    // the Ewald error tolerance against an Ewald sum converged far beyond it, and be no less
+    // accurate than the grid chosen for smooth PME.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    const double tolerance = 5e-3;
+    const double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const int numAtoms = 375;
+    const int numVariants = 3;
+    vector<Vec3> positions;
+
+    MPIDForce* ewaldForceField = new MPIDForce();
+    System ewaldSystem;
+    make_waterbox(numAtoms, boxEdgeLength, ewaldForceField,  positions, ewaldSystem);
+    ewaldForceField->setNonbondedMethod(MPIDForce::Ewald);
+    ewaldForceField->setEwaldErrorTolerance(1e-6);
+    ewaldForceField->setDefaultTholeWidth(3.0);
+    ewaldForceField->setCutoffDistance(cutoff);
+    ewaldForceField->setPolarizationType(MPIDForce::Extrapolated);
+    ewaldSystem.addForce(ewaldForceField);
+    VerletIntegrator ewaldIntegrator(0.01);
+    Context ewaldContext(ewaldSystem, ewaldIntegrator, Platform::getPlatformByName("Reference"));
+    ewaldContext.setPositions(positions);
+    vector<Vec3> ewaldForces = ewaldContext.getState(State::Forces).getForces();
+
+    double error[numVariants];
+    int gridSize[numVariants];
+    for (int variant = 0; variant < numVariants; variant++) {
+        MPIDForce* forceField = new MPIDForce();
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        forceField->setNonbondedMethod(MPIDForce::PME);
+        forceField->setEwaldErrorTolerance(tolerance);
+        forceField->setPmeInterlacedGrids(variant > 0);
+        forceField->setPmeOptimalInfluenceFunction(variant == 2);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Extrapolated);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.01);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        State state = context.getState(State::Forces);
+
+        double alpha, reportedCutoff;
+        int ny, nz, order;
+        forceField->getPMEParametersInContext(context, alpha, gridSize[variant], ny, nz, reportedCutoff, order);
+        double diff = 0.0, norm = 0.0;
+        for (int n = 0; n < numAtoms; ++n) {
+            Vec3 delta = state.getForces()[n]-ewaldForces[n];
+            diff += delta.dot(delta);
+            norm += ewaldForces[n].dot(ewaldForces[n]);
+        }
+        error[variant] = sqrt(diff/norm);
+        ASSERT(error[variant] < tolerance);
+    }
+    ASSERT(gridSize[1] < gridSize[0]);
+    ASSERT(gridSize[2] < gridSize[1]);
+    ASSERT(error[1] <= error[0]);
+    ASSERT(error[2] <= error[0]);
+}
+
+void testSlabCorrectionPME() {
+    // With the slab correction the grid only covers the occupied region, so the result must not
+    // depend on how much vacuum is put above the slab.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    const double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double alpha = 3.0;
+    const int numAtoms = 375;
+    vector<State> states;
+    vector<Vec3> positions;
+    for (int variant = 0; variant < 2; variant++) {
+        const double height = (variant == 0 ? 6.0 : 12.0);
+        MPIDForce* forceField = new MPIDForce();
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        system.setDefaultPeriodicBoxVectors(Vec3(boxEdgeLength, 0, 0), Vec3(0, boxEdgeLength, 0), Vec3(0, 0, height));
+        forceField->setNonbondedMethod(MPIDForce::PME);
+        forceField->setPMEParameters(alpha, 20, 20, (int) (10*height));
+        forceField->setPmeSlabCorrection(true);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Direct);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+        if (variant == 0)
+            check_finite_differences(states[0].getForces(), context, positions);
+    }
+
+    ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[1].getPotentialEnergy(), 1E-6);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(states[0].getForces()[n], states[1].getForces()[n], 1E-5);
+}
+
+/**
+ * Put numPerSide^3 waters, with the parameters of the water in make_waterbox, on a cubic lattice and set
+ * the periodic box to the lattice; the box is only used by periodic nonbonded methods.  The molecules
+ * are turned by different amounts so the induced dipoles are not all the same.  Every test that uses
+ * this lattice has an identical copy of this function.
+ */
+void make_water_lattice(int numPerSide, double spacing, MPIDForce* forceField, vector<Vec3>& positions, System& system) {
+    const vector<double> od = {0.0, 0.0, 0.00755612136146};
+    const vector<double> hd = {-0.00204209484795, 0.0, -0.00307875299958};
+    const vector<double> oq = {0.000354030721139, 0.0, -0.000390257077096, 0.0, 0.0,  3.62263559571e-05};
+    const vector<double> hq = {-3.42848248983e-05, 0.0, -0.000100240875193, -1.89485963908e-06, 0.0,  0.000134525700091};
+    const vector<double> oo = { 0, 0, 0, 0, -6.285758282686837e-07, 0, -9.452653225954594e-08, 0, 0, 7.231018665791977e-07};
+    const vector<double> ho = { -2.405600937552608e-07, 0, -6.415084018183151e-08, 0, -1.152422607026746e-06,
+                                0,  -2.558537436767218e-06, 3.047102424084479e-07, 0, 3.710960043793964e-06 };
+    const vector<double> opol = {0.000837, 0.000837, 0.000837};
+    const vector<double> hpol = {0.000496, 0.000496, 0.000496};
+    const double bond = 0.09572;
+    const double halfAngle = 0.5*104.52*M_PI/180.0;
+
+    positions.clear();
+    int molecule = 0;
+    for (int i = 0; i < numPerSide; i++)
+        for (int j = 0; j < numPerSide; j++)
+            for (int k = 0; k < numPerSide; k++, molecule++) {
+                int o = 3*molecule;
+                double turn = 0.7*molecule;
+                double tilt = 0.3*(molecule%5);
+                Vec3 axis(cos(turn)*cos(tilt), sin(turn)*cos(tilt), sin(tilt));
+                Vec3 side(-sin(turn), cos(turn), 0.0);
+                Vec3 center((i+0.5)*spacing, (j+0.5)*spacing, (k+0.5)*spacing);
+                positions.push_back(center);
+                positions.push_back(center + (axis*cos(halfAngle) + side*sin(halfAngle))*bond);
+                positions.push_back(center + (axis*cos(halfAngle) - side*sin(halfAngle))*bond);
+                forceField->addMultipole(-0.51966, od, oq, oo, MPIDForce::Bisector, o+1, o+2, -1, 0.39, opol);
+                forceField->addMultipole(0.25983, hd, hq, ho, MPIDForce::ZThenX, o, o+2, -1, 0.39, hpol);
+                forceField->addMultipole(0.25983, hd, hq, ho, MPIDForce::ZThenX, o, o+1, -1, 0.39, hpol);
+                system.addParticle(15.999);
+                system.addParticle(1.008);
+                system.addParticle(1.008);
+                for (int atom = o; atom < o+3; atom++)
+                    forceField->setCovalentMap(atom, MPIDForce::PolarizationCovalent11, {o, o+1, o+2});
+                forceField->setCovalentMap(o, MPIDForce::Covalent12, {o+1, o+2});
+                forceField->setCovalentMap(o+1, MPIDForce::Covalent12, {o});
+                forceField->setCovalentMap(o+2, MPIDForce::Covalent12, {o});
+                forceField->setCovalentMap(o+1, MPIDForce::Covalent13, {o+2});
+                forceField->setCovalentMap(o+2, MPIDForce::Covalent13, {o+1});
+            }
+    double edge = numPerSide*spacing;
+    system.setDefaultPeriodicBoxVectors(Vec3(edge, 0, 0), Vec3(0, edge, 0), Vec3(0, 0, edge));
+}
+
+void testFMMMatchesNoCutoff() {
+    // The fast multipole method computes the near pairs exactly and the rest from truncated
+    // expansions, so it must agree with the full N^2 sum to within the truncation error.  With the
+    // usual Thole width of 3 the damping range must still leave most pairs to the far field.
+    const int numPerSide = 8;
+    const int numAtoms = 3*numPerSide*numPerSide*numPerSide;
+    vector<State> states;
+    vector<Vec3> positions;
+    int treeDepth = 0;
+    MPIDForce::NonbondedMethod methods[] = {MPIDForce::NoCutoff, MPIDForce::FMM};
+    for (MPIDForce::NonbondedMethod method : methods) {
+        MPIDForce* forceField = new MPIDForce();
+        System system;
+        make_water_lattice(numPerSide, 0.31, forceField, positions, system);
+        forceField->setNonbondedMethod(method);
+        forceField->setFMMParameters(16, 3);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedTargetEpsilon(1e-8);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+        if (method == MPIDForce::FMM) {
+            int expansionOrder;
+            forceField->getFMMParametersInContext(context, expansionOrder, treeDepth);
+            ASSERT_EQUAL(16, expansionOrder);
+        }
+    }
+
+    // Count the pairs in leaves that do not touch, which are the ones in the far field.
+
+    Vec3 lower = positions[0], upper = positions[0];
+    for (const Vec3& position : positions)
+        for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::min(lower[axis], position[axis]);
+            upper[axis] = std::max(upper[axis], position[axis]);
+        }
+    double width = std::max(upper[0]-lower[0], std::max(upper[1]-lower[1], upper[2]-lower[2]))*(1.0+1e-6);
+    double leafWidth = width/(1 << treeDepth);
+    long long numFarPairs = 0;
+    for (int i = 0; i < numAtoms; i++)
+        for (int j = i+1; j < numAtoms; j++)
+            for (int axis = 0; axis < 3; axis++)
+                if (fabs(floor((positions[i][axis]-lower[axis])/leafWidth)-floor((positions[j][axis]-lower[axis])/leafWidth)) > 1) {
+                    numFarPairs++;
+                    break;
+                }
+    ASSERT(numFarPairs > 0.25*numAtoms*(numAtoms-1)/2);
+
+    ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[1].getPotentialEnergy(), 1E-3);
+    double diff = 0.0, norm = 0.0;
+    for (int n = 0; n < numAtoms; ++n) {
+        Vec3 delta = states[1].getForces()[n]-states[0].getForces()[n];
+        diff += delta.dot(delta);
+        norm += states[0].getForces()[n].dot(states[0].getForces()[n]);
+    }
+    ASSERT(sqrt(diff/norm) < 1E-2);
+}
+
+static bool isFastFFTSize(int size) {
+    for (int factor = 2; factor <= 5; factor++)
+        while (size%factor == 0)
+            size /= factor;
+    return (size == 1);
+}
+
+void testAutomaticPMEParameters(bool fullMultipoles, int expectedOrder) {
+    // With alpha left at 0 the reference platform chooses the PME parameters from the Ewald error
+    // tolerance at the requested cutoff.  The B-spline order follows the multipoles present, the
+    // forces must be within the tolerance of an Ewald sum converged far beyond it, and the reported
+    // parameters must reproduce the same energy and forces when set explicitly.
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    const double tolerance = 5e-3;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const int numAtoms = 6;
+    MPIDForce* forceField1 = new MPIDForce();
+    MPIDForce* forceField2 = new MPIDForce();
+    MPIDForce* forceField3 = new MPIDForce();
+    vector<Vec3> positions;
+    System system1, system2, system3;
+
+    bool full = fullMultipoles;
+    make_waterbox(numAtoms, boxEdgeLength, forceField1,  positions, system1, true, full, full, full, full);
+    forceField1->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField1->setEwaldErrorTolerance(tolerance);
+    forceField1->setDefaultTholeWidth(3.0);
+    forceField1->setCutoffDistance(cutoff);
+    forceField1->setPolarizationType(MPIDForce::Extrapolated);
+    system1.addForce(forceField1);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system1, integrator1, Platform::getPlatformByName("Reference"));
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+
+    double alpha, reportedCutoff;
+    int nx, ny, nz, order;
+    forceField1->getPMEParametersInContext(context1, alpha, nx, ny, nz, reportedCutoff, order);
+    ASSERT(alpha > 0.0);
+    ASSERT_EQUAL_TOL(cutoff, reportedCutoff, 1E-12);
+    ASSERT(isFastFFTSize(nx) && isFastFFTSize(ny) && isFastFFTSize(nz));
+    ASSERT_EQUAL(expectedOrder, order);
+
+    make_waterbox(numAtoms, boxEdgeLength, forceField3,  positions, system3, true, full, full, full, full);
+    forceField3->setNonbondedMethod(OpenMM::MPIDForce::Ewald);
+    forceField3->setEwaldErrorTolerance(1e-6);
+    forceField3->setDefaultTholeWidth(3.0);
+    forceField3->setCutoffDistance(cutoff);
+    forceField3->setPolarizationType(MPIDForce::Extrapolated);
+    system3.addForce(forceField3);
+    VerletIntegrator integrator3(0.01);
+    Context context3(system3, integrator3, Platform::getPlatformByName("Reference"));
+    context3.setPositions(positions);
+    State state3 = context3.getState(State::Forces);
+
+    double diff = 0.0, norm = 0.0;
+    for (int n = 0; n < numAtoms; ++n) {
+        Vec3 delta = state1.getForces()[n]-state3.getForces()[n];
+        diff += delta.dot(delta);
+        norm += state3.getForces()[n].dot(state3.getForces()[n]);
+    }
+    ASSERT(sqrt(diff/norm) < tolerance);
+
+    make_waterbox(numAtoms, boxEdgeLength, forceField2,  positions, system2, true, full, full, full, full);
+    forceField2->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField2->setPMEParameters(alpha, nx, ny, nz);
+    forceField2->setPmeBSplineOrder(order);
+    forceField2->setDefaultTholeWidth(3.0);
+    forceField2->setCutoffDistance(reportedCutoff);
+    forceField2->setPolarizationType(MPIDForce::Extrapolated);
+    system2.addForce(forceField2);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system2, integrator2, Platform::getPlatformByName("Reference"));
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1E-6);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(state2.getForces()[n], state1.getForces()[n], 1E-6);
+}
+
+void testBSplineOrderTooLowForOctopoles() {
+    // The force on an octopole takes the 4th derivative of the B-splines, which is zero for order 4
+    // and piecewise constant for order 5, so creating a Context with either must fail.
+    const double cutoff = 7.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const int numAtoms = 375;
+    for (int order = 4; order <= 6; ++order) {
+        MPIDForce* forceField = new MPIDForce();
+        vector<Vec3> positions;
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        forceField->setNonbondedMethod(OpenMM::MPIDForce::PME);
+        forceField->setPMEParameters(3.0, 24, 24, 24);
+        forceField->setPmeBSplineOrder(order);
+        forceField->setCutoffDistance(cutoff);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.01);
+        bool threwException = false;
+        try {
+            Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        }
+        catch (const OpenMMException& e) {
+            threwException = true;
+        }
+        ASSERT_EQUAL(order < 6, threwException);
+    }
+}
+
+void compareWithFreshContext(Context& context, const string& testname) {
+    // Build a new Context at the positions of the given one, so that its induced dipoles
+    // are solved from scratch, and compare the energies and forces.
+    State state1 = context.getState(State::Positions | State::Forces | State::Energy);
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    MPIDForce* forceField = new MPIDForce();
+    vector<Vec3> positions;
+    System system;
+    make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+    forceField->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField->setPMEParameters(3.0, 64, 64, 64);
+    forceField->setDefaultTholeWidth(3.0);
+    forceField->setCutoffDistance(cutoff);
+    forceField->setPolarizationType(MPIDForce::Mutual);
+    forceField->setMutualInducedTargetEpsilon(1e-8);
+    system.addForce(forceField);
+    VerletIntegrator integrator(0.001);
+    Context context2(system, integrator, Platform::getPlatformByName("Reference"));
+    context2.setPositions(state1.getPositions());
+    State state2 = context2.getState(State::Forces | State::Energy);
+
+    ASSERT_EQUAL_TOL_MOD(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1E-5, testname);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC_MOD(state2.getForces()[n], state1.getForces()[n], 1E-5, testname);
+}
+
+void testInducedDipolePredictor() {
+    // The mutual solver starts from dipoles extrapolated from previous steps; the converged
+    // result must not depend on that, both along a trajectory and after a jump.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    MPIDForce* forceField = new MPIDForce();
+    vector<Vec3> positions;
+    System system;
+    make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+    forceField->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField->setPMEParameters(3.0, 64, 64, 64);
+    forceField->setDefaultTholeWidth(3.0);
+    forceField->setCutoffDistance(cutoff);
+    forceField->setPolarizationType(MPIDForce::Mutual);
+    forceField->setMutualInducedTargetEpsilon(1e-8);
+    system.addForce(forceField);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    context.setVelocitiesToTemperature(300.0);
+    integrator.step(10);
+    compareWithFreshContext(context, "after 10 steps");
+
+    for (int n = 3; n < numAtoms; ++n)
+        positions[n] += Vec3(0.1, 0.05, -0.1);
+    context.setPositions(positions);
+    compareWithFreshContext(context, "after setPositions");
+    integrator.step(5);
+    compareWithFreshContext(context, "after 5 more steps");
+}
+
+void testGettersFollowChanges() {
+    // The dipole getters reuse the lab frame moments and induced dipoles of the last evaluation,
+    // so make sure they still pick up new positions and parameters.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    MPIDForce* forceField = new MPIDForce();
+    vector<Vec3> positions;
+    System system;
+    make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+    forceField->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField->setPMEParameters(3.0, 64, 64, 64);
+    forceField->setDefaultTholeWidth(3.0);
+    forceField->setCutoffDistance(cutoff);
+    forceField->setPolarizationType(MPIDForce::Mutual);
+    forceField->setMutualInducedTargetEpsilon(1e-8);
+    system.addForce(forceField);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    context.getState(State::Energy);
+
+    vector<Vec3> induced, permanent, total;
+    forceField->getInducedDipoles(context, induced);
+    forceField->getLabFramePermanentDipoles(context, permanent);
+    forceField->getTotalDipoles(context, total);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(permanent[n]+induced[n], total[n], 1E-10);
+
+    for (int step = 0; step < 2; step++) {
+        if (step == 0) {
+            for (int n = 3; n < numAtoms; ++n)
+                positions[n] += Vec3(0.1, 0.05, -0.1);
+            context.setPositions(positions);
+        }
+        else {
+            double charge, thole;
+            int axisType, atomZ, atomX, atomY;
+            vector<double> dipole, quadrupole, octopole, alphas;
+            forceField->getMultipoleParameters(0, charge, dipole, quadrupole, octopole, axisType, atomZ, atomX, atomY, thole, alphas);
+            for (auto& a : alphas)
+                a *= 1.5;
+            forceField->setMultipoleParameters(0, charge, dipole, quadrupole, octopole, axisType, atomZ, atomX, atomY, thole, alphas);
+            forceField->updateParametersInContext(context);
+        }
+        vector<Vec3> expected, actual;
+        VerletIntegrator integrator2(0.001);
+        Context context2(system, integrator2, Platform::getPlatformByName("Reference"));
+        context2.setPositions(positions);
+        forceField->getInducedDipoles(context2, expected);
+        forceField->getInducedDipoles(context, actual);
+        double change = 0.0;
+        for (int n = 0; n < numAtoms; ++n) {
+            ASSERT_EQUAL_VEC(expected[n], actual[n], 1E-6);
+            change += (actual[n]-induced[n]).dot(actual[n]-induced[n]);
+        }
+        ASSERT(change > 1E-12);
+        induced = actual;
+    }
+}
+
+void testLabFramePermanentMultipoles() {
+    // The lab frame moments must match the dipoles from a full evaluation, and rotating
+    // the whole system by 90 degrees about z must rotate the moments with it.
+    const int numAtoms = 6;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    MPIDForce* forceField = new MPIDForce();
+    vector<Vec3> positions;
+    System system;
+    make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+    forceField->setNonbondedMethod(OpenMM::MPIDForce::NoCutoff);
+    forceField->setPolarizationType(MPIDForce::Mutual);
+    system.addForce(forceField);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+
+    vector<Vec3> dipoles, dipoles2, expected;
+    vector<double> quadrupoles, quadrupoles2, octopoles, octopoles2;
+    forceField->getLabFramePermanentMultipoles(context, dipoles, quadrupoles, octopoles);
+    context.getState(State::Energy);
+    forceField->getLabFramePermanentDipoles(context, expected);
+    ASSERT_EQUAL(6*numAtoms, (int) quadrupoles.size());
+    ASSERT_EQUAL(10*numAtoms, (int) octopoles.size());
+    for (int n = 0; n < numAtoms; ++n) {
+        ASSERT_EQUAL_VEC(expected[n], dipoles[n], 1E-10);
+        ASSERT_EQUAL_TOL(0.0, quadrupoles[6*n]+quadrupoles[6*n+2]+quadrupoles[6*n+5], 1E-10);
+    }
+
+    for (auto& p : positions)
+        p = Vec3(-p[1], p[0], p[2]);
+    context.setPositions(positions);
+    forceField->getLabFramePermanentMultipoles(context, dipoles2, quadrupoles2, octopoles2);
+    for (int n = 0; n < numAtoms; ++n) {
+        ASSERT_EQUAL_VEC(Vec3(-dipoles[n][1], dipoles[n][0], dipoles[n][2]), dipoles2[n], 1E-10);
+        const double* q = &quadrupoles[6*n];
+        const double* q2 = &quadrupoles2[6*n];
+        ASSERT_EQUAL_TOL(q[2], q2[0], 1E-10);
+        ASSERT_EQUAL_TOL(-q[1], q2[1], 1E-10);
+        ASSERT_EQUAL_TOL(q[0], q2[2], 1E-10);
+        ASSERT_EQUAL_TOL(-q[4], q2[3], 1E-10);
+        ASSERT_EQUAL_TOL(q[3], q2[4], 1E-10);
+        ASSERT_EQUAL_TOL(q[5], q2[5], 1E-10);
+        const double* o = &octopoles[10*n];
+        const double* o2 = &octopoles2[10*n];
+        ASSERT_EQUAL_TOL(-o[3], o2[0], 1E-10);
+        ASSERT_EQUAL_TOL(o[0], o2[3], 1E-10);
+        ASSERT_EQUAL_TOL(-o[5], o2[5], 1E-10);
+        ASSERT_EQUAL_TOL(o[9], o2[9], 1E-10);
+    }
+}
+
+void testElectrostaticPotentialMatchesTestCharge(MPIDForce::NonbondedMethod method) {
+    // The potential at a point is the derivative of the energy with respect to the charge of a
+    // test particle placed there.  The central difference cancels the response of the induced
+    // dipoles to the test charge, and the energy is variational in the dipoles, so this checks
+    // every multipole order as well as the induced dipoles and, with PME, the interpolation.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double testCharge = 1E-3;
+    vector<Vec3> points;
+    points.push_back(Vec3(0.1, 0.2, 0.3));
+    points.push_back(Vec3(-0.35, 0.05, 0.6));
+    points.push_back(Vec3(0.9, -0.2, 0.15));
+    vector<double> energies[2];
+    vector<double> potential;
+    for (int withCharge = 0; withCharge < 3; withCharge++) {
+        for (int n = 0; n < (withCharge == 0 ? 1 : (int) points.size()); n++) {
+            MPIDForce* forceField = new MPIDForce();
+            vector<Vec3> positions;
+            System system;
+            make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+            forceField->setNonbondedMethod(method);
+            if (method == MPIDForce::PME)
+                forceField->setPMEParameters(3.0, 64, 64, 64);
+            else if (method == MPIDForce::Ewald)
+                forceField->setPMEParameters(3.0, 12, 12, 12);
+            forceField->setDefaultTholeWidth(3.0);
+            forceField->setCutoffDistance(cutoff);
+            forceField->setPolarizationType(MPIDForce::Direct);
+            if (withCharge > 0) {
+                system.addParticle(1.0);
+                forceField->addMultipole(withCharge == 1 ? testCharge : -testCharge, vector<double>(3, 0.0), vector<double>(6, 0.0),
+                                         vector<double>(10, 0.0), MPIDForce::NoAxisType, -1, -1, -1, 0.39, vector<double>(3, 0.0));
+                positions.push_back(points[n]);
+            }
+            system.addForce(forceField);
+            VerletIntegrator integrator(0.001);
+            Context context(system, integrator, Platform::getPlatformByName("Reference"));
+            context.setPositions(positions);
+            if (withCharge == 0)
+                forceField->getElectrostaticPotential(points, context, potential);
+            else
+                energies[withCharge-1].push_back(context.getState(State::Energy).getPotentialEnergy());
+        }
+    }
+    ASSERT_EQUAL(points.size(), potential.size());
+    for (int n = 0; n < (int) points.size(); n++)
+        ASSERT_EQUAL_TOL((energies[0][n]-energies[1][n])/(2*testCharge), potential[n], 1E-5);
+}
+
+void testElectrostaticPotentialVolume() {
+    // The lattice must give the same potential as the point getter, its field must be minus the
+    // gradient of that potential, and a raw file must hold the same values.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    MPIDForce* forceField = new MPIDForce();
+    vector<Vec3> positions;
+    System system;
+    make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+    forceField->setNonbondedMethod(OpenMM::MPIDForce::PME);
+    forceField->setPMEParameters(3.0, 64, 64, 64);
+    forceField->setDefaultTholeWidth(3.0);
+    forceField->setCutoffDistance(cutoff);
+    forceField->setPolarizationType(MPIDForce::Mutual);
+    forceField->setMutualInducedTargetEpsilon(1e-8);
+    system.addForce(forceField);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+
+    Vec3 origin(-0.3, -0.25, -0.2);
+    vector<Vec3> axes;
+    axes.push_back(Vec3(0.1, 0.0, 0.0));
+    axes.push_back(Vec3(0.02, 0.11, 0.0));
+    axes.push_back(Vec3(0.0, 0.01, 0.09));
+    vector<int> numPoints;
+    numPoints.push_back(4);
+    numPoints.push_back(5);
+    numPoints.push_back(6);
+    vector<double> potential;
+    vector<Vec3> field;
+    forceField->getElectrostaticPotentialVolume(context, origin, axes, numPoints, potential, field, true);
+    ASSERT_EQUAL(4*5*6, (int) potential.size());
+    ASSERT_EQUAL(4*5*6, (int) field.size());
+
+    vector<Vec3> points;
+    for (int i = 0; i < numPoints[0]; i++)
+        for (int j = 0; j < numPoints[1]; j++)
+            for (int k = 0; k < numPoints[2]; k++)
+                points.push_back(origin + axes[0]*i + axes[1]*j + axes[2]*k);
+    vector<double> expected;
+    forceField->getElectrostaticPotential(points, context, expected);
+    for (int n = 0; n < (int) points.size(); n++)
+        ASSERT_EQUAL_TOL(expected[n], potential[n], 1E-10);
+
+    const double delta = 1E-5;
+    for (int n = 0; n < (int) points.size(); n += 17) {
+        vector<Vec3> displaced;
+        for (int axis = 0; axis < 3; axis++) {
+            Vec3 offset;
+            offset[axis] = delta;
+            displaced.push_back(points[n]+offset);
+            displaced.push_back(points[n]-offset);
+        }
+        vector<double> displacedPotential;
+        forceField->getElectrostaticPotential(displaced, context, displacedPotential);
+        Vec3 finiteDifference;
+        for (int axis = 0; axis < 3; axis++)
+            finiteDifference[axis] = -(displacedPotential[2*axis]-displacedPotential[2*axis+1])/(2*delta);
+        ASSERT_EQUAL_VEC(finiteDifference, field[n], 1E-5);
+    }
+
+    const char* filename = "TestReferenceMPIDForceVolume.raw";
+    forceField->writeElectrostaticPotentialVolume(context, filename, MPIDForce::RawBinary, origin, axes, numPoints, true);
+    vector<double> values(4*points.size());
+    FILE* file = fopen(filename, "rb");
+    ASSERT(file != NULL);
+    ASSERT_EQUAL(values.size(), fread(&values[0], sizeof(double), values.size(), file));
+    fclose(file);
+    remove(filename);
+    for (int n = 0; n < (int) points.size(); n++) {
+        ASSERT_EQUAL_TOL(potential[n], values[4*n], 1E-10);
+        ASSERT_EQUAL_VEC(field[n], Vec3(values[4*n+1], values[4*n+2], values[4*n+3]), 1E-10);
+    }
+}
+
+void testElectricFields(MPIDForce::NonbondedMethod method) {
+    // At points, the field must be minus the gradient of the potential and its gradient the
+    // derivative of the field.  At the particles, the converged induced dipoles must be the
+    // polarizabilities times the field, and a probe particle without moments, polarizability or
+    // covalent partners must see the same field and gradient as a point at its position.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    const double coulomb = 138.935455846;
+    Vec3 probe(0.1, 0.2, 0.3);
+    vector<Vec3> pointFields, particleFields;
+    vector<double> pointGradients, particleGradients;
+    for (int withProbe = 0; withProbe < 2; withProbe++) {
+        MPIDForce* forceField = new MPIDForce();
+        vector<Vec3> positions;
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        forceField->setNonbondedMethod(method);
+        if (method == MPIDForce::PME)
+            forceField->setPMEParameters(3.0, 64, 64, 64);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedTargetEpsilon(1e-8);
+        if (withProbe) {
+            system.addParticle(1.0);
+            forceField->addMultipole(0.0, vector<double>(3, 0.0), vector<double>(6, 0.0), vector<double>(10, 0.0),
+                                     MPIDForce::NoAxisType, -1, -1, -1, 0.39, vector<double>(3, 0.0));
+            positions.push_back(probe);
+        }
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+
+        if (withProbe) {
+            forceField->getElectricFields(context, particleFields);
+            forceField->getElectricFieldGradients(context, particleGradients);
+            ASSERT_EQUAL(numAtoms+1, (int) particleFields.size());
+            ASSERT_EQUAL(6*(numAtoms+1), (int) particleGradients.size());
+            vector<Vec3> induced;
+            forceField->getInducedDipoles(context, induced);
+            for (int n = 0; n < numAtoms; n++) {
+                double charge, thole;
+                int axisType, atomZ, atomX, atomY;
+                vector<double> dipole, quadrupole, octopole, alphas;
+                forceField->getMultipoleParameters(n, charge, dipole, quadrupole, octopole, axisType, atomZ, atomX, atomY, thole, alphas);
+                ASSERT_EQUAL_VEC(particleFields[n], induced[n]*(coulomb/alphas[0]), 1E-5);
+            }
+            continue;
+        }
+
+        vector<Vec3> points;
+        points.push_back(probe);
+        points.push_back(Vec3(-0.35, 0.05, 0.6));
+        points.push_back(Vec3(0.9, -0.2, 0.15));
+        forceField->getElectricFieldsAtPoints(context, points, pointFields);
+        forceField->getElectricFieldGradientsAtPoints(context, points, pointGradients);
+        ASSERT_EQUAL(points.size(), pointFields.size());
+        ASSERT_EQUAL(6*points.size(), pointGradients.size());
+
+        const double delta = 1E-5;
+        const int index[3][3] = {{0, 1, 3}, {1, 2, 4}, {3, 4, 5}};
+        for (int n = 0; n < (int) points.size(); n++) {
+            const double* gradient = &pointGradients[6*n];
+
+            // away from the particles the field is divergence free, apart from the direct space cutoff of PME
+
+            if (method == MPIDForce::NoCutoff)
+                ASSERT_EQUAL_TOL(0.0, (gradient[0]+gradient[2]+gradient[5])/coulomb, 1E-8);
+            for (int axis = 0; axis < 3; axis++) {
+                vector<Vec3> displaced;
+                Vec3 offset;
+                offset[axis] = delta;
+                displaced.push_back(points[n]+offset);
+                displaced.push_back(points[n]-offset);
+                vector<double> displacedPotential;
+                vector<Vec3> displacedField;
+                forceField->getElectrostaticPotential(displaced, context, displacedPotential);
+                forceField->getElectricFieldsAtPoints(context, displaced, displacedField);
+                ASSERT_EQUAL_TOL(-(displacedPotential[0]-displacedPotential[1])/(2*delta), pointFields[n][axis], 1E-5);
+                for (int component = 0; component < 3; component++)
+                    ASSERT_EQUAL_TOL((displacedField[0][component]-displacedField[1][component])/(2*delta), gradient[index[component][axis]], 1E-5);
+            }
+        }
+    }
+    ASSERT_EQUAL_VEC(pointFields[0], particleFields[numAtoms], 1E-4);
+    for (int kk = 0; kk < 6; kk++)
+        ASSERT_EQUAL_TOL(pointGradients[kk], particleGradients[6*numAtoms+kk], 1E-4);
+}
+
+void testConjugateGradientSolver(MPIDForce::NonbondedMethod method) {
+    // The conjugate gradient solver converges to the same mutual dipoles as DIIS.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    vector<State> states;
+    for (int solver = MPIDForce::DIIS; solver <= MPIDForce::ConjugateGradient; ++solver) {
+        MPIDForce* forceField = new MPIDForce();
+        vector<Vec3> positions;
+        System system;
+        make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+        forceField->setNonbondedMethod(method);
+        forceField->setPMEParameters(3.0, 64, 64, 64);
+        forceField->setDefaultTholeWidth(3.0);
+        forceField->setCutoffDistance(cutoff);
+        forceField->setPolarizationType(MPIDForce::Mutual);
+        forceField->setMutualInducedSolver(static_cast<MPIDForce::MutualInducedSolver>(solver));
+        forceField->setMutualInducedTargetEpsilon(1e-8);
+        system.addForce(forceField);
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, Platform::getPlatformByName("Reference"));
+        context.setPositions(positions);
+        states.push_back(context.getState(State::Forces | State::Energy));
+    }
+
+    ASSERT_EQUAL_TOL(states[0].getPotentialEnergy(), states[1].getPotentialEnergy(), 1E-5);
+    for (int n = 0; n < numAtoms; ++n)
+        ASSERT_EQUAL_VEC(states[0].getForces()[n], states[1].getForces()[n], 1E-5);
+}
+
+void testTCGEnergyAndForces(MPIDForce::NonbondedMethod method, MPIDForce::PolarizationType polarization) {
+    // TCG dipoles are not converged, so the forces are only right if the solver's
+    // dependence on the positions is differentiated too.
+    const int numAtoms = 6;
+    const double cutoff = 6.0*OpenMM::NmPerAngstrom;
+    double boxEdgeLength = 20*OpenMM::NmPerAngstrom;
+    MPIDForce* forceField = new MPIDForce();
+    vector<Vec3> positions;
+    System system;
+    make_waterbox(numAtoms, boxEdgeLength, forceField,  positions, system);
+    forceField->setNonbondedMethod(method);
+    forceField->setPMEParameters(3.0, 64, 64, 64);
+    forceField->setDefaultTholeWidth(3.0);
+    forceField->setCutoffDistance(cutoff);
+    forceField->setPolarizationType(polarization);
+    system.addForce(forceField);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    check_finite_differences(state.getForces(), context, positions);
+}
 
 int main(int numberOfArguments, char* argv[]) {
 
@@ -1719,6 +2709,32 @@ int main(int numberOfArguments, char* argv[]) {
         testMethanolDimerEnergyAndForcesNoCutDirect();
         testMethanolDimerEnergyAndForcesPMEMutual();
         testMethanolDimerEnergyAndForcesNoCutMutual();
+        testChangingBoxPME();
+        testNeighborListReusePME();
+        testEwaldMatchesPME();
+        testMSMMatchesPME();
+        testInterlacedPMEMatchesEwald();
+        testAutomaticInterlacedPMEParameters();
+        testSlabCorrectionPME();
+        testFMMMatchesNoCutoff();
+        testAutomaticPMEParameters(true, 6);
+        testAutomaticPMEParameters(false, 4);
+        testBSplineOrderTooLowForOctopoles();
+        testInducedDipolePredictor();
+        testGettersFollowChanges();
+        testLabFramePermanentMultipoles();
+        testElectrostaticPotentialMatchesTestCharge(MPIDForce::NoCutoff);
+        testElectrostaticPotentialMatchesTestCharge(MPIDForce::PME);
+        testElectrostaticPotentialMatchesTestCharge(MPIDForce::Ewald);
+        testElectrostaticPotentialVolume();
+        testElectricFields(MPIDForce::NoCutoff);
+        testElectricFields(MPIDForce::PME);
+        testConjugateGradientSolver(MPIDForce::NoCutoff);
+        testConjugateGradientSolver(MPIDForce::PME);
+        testTCGEnergyAndForces(MPIDForce::NoCutoff, MPIDForce::TCG1);
+        testTCGEnergyAndForces(MPIDForce::NoCutoff, MPIDForce::TCG2);
+        testTCGEnergyAndForces(MPIDForce::PME, MPIDForce::TCG1);
+        testTCGEnergyAndForces(MPIDForce::PME, MPIDForce::TCG2);
     }
     catch(const std::exception& e) {
         std::cout << "exception: " << e.what() << std::endl;
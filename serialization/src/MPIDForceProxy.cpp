@@ -68,13 +68,22 @@ void loadCovalentMap(const SerializationNode& map, std::vector< int >& covalentM
 }
 
 void MPIDForceProxy::serialize(const void* object, SerializationNode& node) const {
-    node.setIntProperty("version", 0);
+    node.setIntProperty("version", 1);
     const MPIDForce& force = *reinterpret_cast<const MPIDForce*>(object);
 
     node.setIntProperty("forceGroup", force.getForceGroup());
     node.setIntProperty("nonbondedMethod",                  force.getNonbondedMethod());
     node.setIntProperty("polarizationType",                 force.getPolarizationType());
+    node.setIntProperty("mutualInducedSolver",              force.getMutualInducedSolver());
     node.setIntProperty("mutualInducedMaxIterations",       force.getMutualInducedMaxIterations());
+    node.setIntProperty("pmeBSplineOrder",                  force.getPmeBSplineOrder());
+    node.setBoolProperty("pmeOptimalInfluenceFunction",     force.getPmeOptimalInfluenceFunction());
+    node.setBoolProperty("pmeInterlacedGrids",              force.getPmeInterlacedGrids());
+    node.setBoolProperty("pmeSlabCorrection",               force.getPmeSlabCorrection());
+    int fmmExpansionOrder, fmmTreeDepth;
+    force.getFMMParameters(fmmExpansionOrder, fmmTreeDepth);
+    node.setIntProperty("fmmExpansionOrder",                fmmExpansionOrder);
+    node.setIntProperty("fmmTreeDepth",                     fmmTreeDepth);
 
     node.setDoubleProperty("cutoffDistance",                force.getCutoffDistance());
     double alpha;
@@ -151,7 +160,7 @@ void MPIDForceProxy::serialize(const void* object, SerializationNode& node) cons
 
 void* MPIDForceProxy::deserialize(const SerializationNode& node) const {
     int version = node.getIntProperty("version");
-    if (version < 0 || version > 0)
+    if (version < 0 || version > 1)
         throw OpenMMException("Unsupported version number");
     MPIDForce* force = new MPIDForce();
 
@@ -159,7 +168,13 @@ void* MPIDForceProxy::deserialize(const SerializationNode& node) const {
         force->setForceGroup(node.getIntProperty("forceGroup", 0));
         force->setNonbondedMethod(static_cast<MPIDForce::NonbondedMethod>(node.getIntProperty("nonbondedMethod")));
         force->setPolarizationType(static_cast<MPIDForce::PolarizationType>(node.getIntProperty("polarizationType")));
+        force->setMutualInducedSolver(static_cast<MPIDForce::MutualInducedSolver>(node.getIntProperty("mutualInducedSolver", MPIDForce::DIIS)));
         force->setMutualInducedMaxIterations(node.getIntProperty("mutualInducedMaxIterations"));
+        force->setPmeBSplineOrder(node.getIntProperty("pmeBSplineOrder", 0));
+        force->setPmeOptimalInfluenceFunction(node.getBoolProperty("pmeOptimalInfluenceFunction", false));
+        force->setPmeInterlacedGrids(node.getBoolProperty("pmeInterlacedGrids", false));
+        force->setPmeSlabCorrection(node.getBoolProperty("pmeSlabCorrection", false));
+        force->setFMMParameters(node.getIntProperty("fmmExpansionOrder", 12), node.getIntProperty("fmmTreeDepth", 0));
 
         force->setCutoffDistance(node.getDoubleProperty("cutoffDistance"));
         force->setMutualInducedTargetEpsilon(node.getDoubleProperty("mutualInducedTargetEpsilon"));
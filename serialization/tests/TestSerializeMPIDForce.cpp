@@ -64,7 +64,12 @@ void testSerialization() {
     force1.setNonbondedMethod(MPIDForce::NoCutoff);
     force1.setCutoffDistance(0.9);
     force1.setAEwald(0.544);
-    //force1.setPmeBSplineOrder(4);
+    force1.setMutualInducedSolver(MPIDForce::ConjugateGradient);
+    force1.setPmeBSplineOrder(4);
+    force1.setPmeOptimalInfluenceFunction(true);
+    force1.setPmeInterlacedGrids(true);
+    force1.setPmeSlabCorrection(true);
+    force1.setFMMParameters(14, 3);
 
     std::vector<int> gridDimension;
     gridDimension.push_back(64);
@@ -127,10 +132,21 @@ void testSerialization() {
     ASSERT_EQUAL(force1.getNonbondedMethod(),               force2.getNonbondedMethod());
     ASSERT_EQUAL(force1.getAEwald(),                        force2.getAEwald());
     ASSERT_EQUAL(force1.getMutualInducedMaxIterations(),    force2.getMutualInducedMaxIterations());
+    ASSERT_EQUAL(force1.getMutualInducedSolver(),           force2.getMutualInducedSolver());
+    ASSERT_EQUAL(force1.getPmeBSplineOrder(),               force2.getPmeBSplineOrder());
+    ASSERT_EQUAL(force1.getPmeOptimalInfluenceFunction(),   force2.getPmeOptimalInfluenceFunction());
+    ASSERT_EQUAL(force1.getPmeInterlacedGrids(),            force2.getPmeInterlacedGrids());
+    ASSERT_EQUAL(force1.getPmeSlabCorrection(),             force2.getPmeSlabCorrection());
     ASSERT_EQUAL(force1.getMutualInducedTargetEpsilon(),    force2.getMutualInducedTargetEpsilon());
     ASSERT_EQUAL(force1.getEwaldErrorTolerance(),           force2.getEwaldErrorTolerance());
     ASSERT_EQUAL(force1.get14ScaleFactor(),                 force2.get14ScaleFactor());
 
+    int fmmOrder1, fmmDepth1, fmmOrder2, fmmDepth2;
+    force1.getFMMParameters(fmmOrder1, fmmDepth1);
+    force2.getFMMParameters(fmmOrder2, fmmDepth2);
+    ASSERT_EQUAL(fmmOrder1, fmmOrder2);
+    ASSERT_EQUAL(fmmDepth1, fmmDepth2);
+
 
     std::vector<int> gridDimension1;
     std::vector<int> gridDimension2;